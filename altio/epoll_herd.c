@@ -0,0 +1,476 @@
+/* epoll_herd.c
+
+   Measure the "thundering herd" when several threads wait for the same
+   events with epoll, and compare the ways of avoiding it. This is a
+   measuring version of multithread_epoll_wait.c.
+
+   Usage as shown in usageError().
+
+   The events are incoming TCP connections on 'num-fds' listening
+   sockets (on the loopback interface). The main thread makes
+   'num-events' connections, spread across the sockets, sending on each
+   the time at which it began to connect. Each of 'num-threads' worker
+   threads loops calling epoll_wait() and then accepting connections
+   (until accept() fails with EAGAIN) on the sockets it was told about.
+   The modes are:
+
+        lt         One epoll instance, shared by all threads; the
+                   sockets are level-triggered
+        et         One shared epoll instance, with EPOLLET
+        oneshot    One shared epoll instance, with EPOLLONESHOT; a
+                   thread re-arms a socket with EPOLL_CTL_MOD after
+                   draining it
+        excl       One epoll instance per thread, each monitoring every
+                   socket with EPOLLEXCLUSIVE
+        reuseport  One epoll instance per thread, each monitoring its own
+                   set of sockets, bound to the same ports with
+                   SO_REUSEPORT; the kernel distributes connections
+                   among the sockets
+
+   For each mode and number of threads, the program reports the number
+   of times threads returned from epoll_wait(), how many of those
+   wakeups were spurious (the thread found no connection to accept),
+   the number of context switches the worker threads made (from
+   getrusage(RUSAGE_THREAD)), and the distribution of the dispatch
+   latency: the time from the start of connect() to the return of
+   accept().
+
+   The effects are clearest when the events are sparse, so that threads
+   are waiting when each arrives; use -i to set the interval between
+   connections.
+
+   This program is Linux-specific. EPOLLEXCLUSIVE requires Linux 4.5.
+*/
+#define _GNU_SOURCE /* For RUSAGE_THREAD */
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define MAX_THREADS 64
+#define MAX_FDS 64
+#define MAX_EVENTS 64 /* Events fetched by each epoll_wait() */
+
+enum mode
+{
+    MODE_LT,
+    MODE_ET,
+    MODE_ONESHOT,
+    MODE_EXCL,
+    MODE_REUSEPORT
+};
+
+static const char *modeNames[] = {"lt", "et", "oneshot", "excl", "reuseport"};
+
+#define NUM_MODES (sizeof(modeNames) / sizeof(modeNames[0]))
+
+static struct worker           /* Each on its own cache line */
+{
+    pthread_t tid;
+    int epfd;
+    int lfd[MAX_FDS];          /* Listening sockets this thread owns */
+    long wakeups;              /* Returns from epoll_wait() */
+    long spurious;             /* ... that found nothing to accept */
+    long csw;                  /* Voluntary + involuntary switches */
+} __attribute__((aligned(64))) workers[MAX_THREADS];
+
+static enum mode mode;
+static int numFds;
+static int stopFd;             /* eventfd: tells workers to finish */
+
+static long *samples;          /* Dispatch latencies */
+static long numAccepted;
+
+/* Create a nonblocking listening socket on the loopback interface, bound
+   to 'port' (0 means any) */
+
+static int
+listenSocket(int port, int reusePort)
+{
+    struct sockaddr_in addr;
+    int fd, optval;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd == -1)
+        errExit("socket");
+
+    optval = 1;
+    if (reusePort &&
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval,
+                       sizeof(optval)) == -1)
+        errExit("setsockopt-SO_REUSEPORT");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        errExit("bind");
+    if (listen(fd, SOMAXCONN) == -1)
+        errExit("listen");
+
+    return fd;
+}
+
+static int
+localPort(int fd)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if (getsockname(fd, (struct sockaddr *)&addr, &len) == -1)
+        errExit("getsockname");
+    return ntohs(addr.sin_port);
+}
+
+static void
+addFd(int epfd, int fd, uint32_t events)
+{
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        errExit("epoll_ctl");
+}
+
+/* Accept connections on 'lfd' until there are none left, recording the
+   latency of each. Returns the number accepted. */
+
+static int
+drain(int lfd)
+{
+    long long sent, now;
+    long idx;
+    int cfd, n;
+
+    for (n = 0;; n++)
+    {
+        cfd = accept(lfd, NULL, NULL);
+        if (cfd == -1)
+        {
+            if (errno == EAGAIN || errno == ECONNABORTED)
+                return n;
+            errExit("accept");
+        }
+        now = latNowNs();
+
+        /* The client sends its timestamp immediately after connecting;
+           the accepted socket is blocking, so we wait for it */
+
+        if (read(cfd, &sent, sizeof(sent)) == sizeof(sent))
+        {
+            idx = __atomic_fetch_add(&numAccepted, 1, __ATOMIC_RELAXED);
+            samples[idx] = now - sent;
+        }
+        close(cfd);
+    }
+}
+
+static void *
+workerFunc(void *arg)
+{
+    struct worker *w = arg;
+    struct epoll_event evlist[MAX_EVENTS], ev;
+    struct rusage ru;
+    int ready, fd, got, stop;
+
+    for (;;)
+    {
+        ready = epoll_wait(w->epfd, evlist, MAX_EVENTS, -1);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            errExit("epoll_wait");
+        }
+
+        got = 0;
+        stop = 0;
+        for (int j = 0; j < ready; j++)
+        {
+            fd = evlist[j].data.fd;
+            if (fd == stopFd)
+            {
+                stop = 1;
+                continue;
+            }
+
+            got += drain(fd);
+
+            if (mode == MODE_ONESHOT)
+            {
+                ev.events = EPOLLIN | EPOLLONESHOT;
+                ev.data.fd = fd;
+                if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, fd, &ev) == -1)
+                    errExit("epoll_ctl-EPOLL_CTL_MOD");
+            }
+        }
+
+        if (stop && got == 0)
+            break;
+        w->wakeups++;
+        if (got == 0)
+            w->spurious++;
+        if (stop)
+            break;
+    }
+
+    if (getrusage(RUSAGE_THREAD, &ru) == -1)
+        errExit("getrusage");
+    w->csw = ru.ru_nvcsw + ru.ru_nivcsw;
+    return NULL;
+}
+
+/* Make a connection to 'port' and send the time at which we started */
+
+static void
+connectOne(int port)
+{
+    struct sockaddr_in addr;
+    long long now;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        errExit("socket");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    now = latNowNs();
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        errExit("connect");
+    if (write(fd, &now, sizeof(now)) != sizeof(now))
+        fatal("partial/failed write");
+    close(fd);
+}
+
+static void
+runOne(int numThreads, int numEvents, int intervalUsecs, LatFormat fmt)
+{
+    int port[MAX_FDS], sharedFd[MAX_FDS];
+    struct timespec ts;
+    struct latSummary sum;
+    long wakeups, spurious, csw;
+    uint64_t one = 1;
+    char values[256];
+    int sharedEpfd, s;
+
+    numAccepted = 0;
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if (stopFd == -1)
+        errExit("eventfd");
+
+    /* Set up the listening sockets and epoll instances */
+
+    sharedEpfd = -1;
+    if (mode == MODE_REUSEPORT)
+    {
+        for (int f = 0; f < numFds; f++)
+        {
+            port[f] = 0;
+            for (int j = 0; j < numThreads; j++)
+            {
+                workers[j].lfd[f] = listenSocket(port[f], 1);
+                port[f] = localPort(workers[j].lfd[f]);
+            }
+        }
+    }
+    else
+    {
+        for (int f = 0; f < numFds; f++)
+        {
+            sharedFd[f] = listenSocket(0, 0);
+            port[f] = localPort(sharedFd[f]);
+        }
+    }
+
+    if (mode == MODE_LT || mode == MODE_ET || mode == MODE_ONESHOT)
+    {
+        sharedEpfd = epoll_create1(EPOLL_CLOEXEC);
+        if (sharedEpfd == -1)
+            errExit("epoll_create1");
+        for (int f = 0; f < numFds; f++)
+            addFd(sharedEpfd, sharedFd[f], EPOLLIN |
+                  ((mode == MODE_ET) ? EPOLLET : 0) |
+                  ((mode == MODE_ONESHOT) ? EPOLLONESHOT : 0));
+        addFd(sharedEpfd, stopFd, EPOLLIN);
+    }
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        struct worker *w = &workers[j];
+
+        w->wakeups = w->spurious = w->csw = 0;
+        if (sharedEpfd != -1)
+        {
+            w->epfd = sharedEpfd;
+        }
+        else
+        {
+            w->epfd = epoll_create1(EPOLL_CLOEXEC);
+            if (w->epfd == -1)
+                errExit("epoll_create1");
+            for (int f = 0; f < numFds; f++)
+                if (mode == MODE_EXCL)
+                    addFd(w->epfd, sharedFd[f], EPOLLIN | EPOLLEXCLUSIVE);
+                else
+                    addFd(w->epfd, w->lfd[f], EPOLLIN);
+            addFd(w->epfd, stopFd, EPOLLIN);
+        }
+
+        s = pthread_create(&w->tid, NULL, workerFunc, w);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+
+    /* Generate the connections, then wait until all have been accepted */
+
+    ts.tv_sec = intervalUsecs / 1000000;
+    ts.tv_nsec = (intervalUsecs % 1000000) * 1000;
+    for (int e = 0; e < numEvents; e++)
+    {
+        connectOne(port[e % numFds]);
+        if (intervalUsecs > 0)
+            nanosleep(&ts, NULL);
+    }
+
+    while (__atomic_load_n(&numAccepted, __ATOMIC_RELAXED) < numEvents)
+        usleep(1000);
+
+    if (write(stopFd, &one, sizeof(one)) != sizeof(one))
+        errExit("write-eventfd");
+
+    wakeups = spurious = csw = 0;
+    for (int j = 0; j < numThreads; j++)
+    {
+        s = pthread_join(workers[j].tid, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+        wakeups += workers[j].wakeups;
+        spurious += workers[j].spurious;
+        csw += workers[j].csw;
+
+        if (workers[j].epfd != sharedEpfd)
+            close(workers[j].epfd);
+        if (mode == MODE_REUSEPORT)
+            for (int f = 0; f < numFds; f++)
+                close(workers[j].lfd[f]);
+    }
+    if (sharedEpfd != -1)
+        close(sharedEpfd);
+    if (mode != MODE_REUSEPORT)
+        for (int f = 0; f < numFds; f++)
+            close(sharedFd[f]);
+    close(stopFd);
+
+    latSummarize(samples, numEvents, &sum);
+    snprintf(values, sizeof(values), "%s,%d,%d,%ld,%ld,%ld", modeNames[mode],
+             numThreads, numFds, wakeups, spurious, csw);
+    latPrintRow(fmt, "mode,threads,fds,wakeups,spurious,csw", values, &sum);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n list    Comma-separated thread counts "
+                    "(default: 1,2,4,8)\n");
+    fprintf(stderr, "    -f num     Number of listening sockets "
+                    "(default: 1)\n");
+    fprintf(stderr, "    -e num     Connections per run (default: 2000)\n");
+    fprintf(stderr, "    -i usecs   Interval between connections "
+                    "(default: 100)\n");
+    fprintf(stderr, "    -m list    Comma-separated modes (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_MODES; j++)
+        fprintf(stderr, " %s", modeNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *threadList, *modeList;
+    char *copy, *tok, *save;
+    int opt, numThreads, numEvents, intervalUsecs;
+    LatFormat fmt;
+
+    threadList = "1,2,4,8";
+    modeList = NULL;
+    numFds = 1;
+    numEvents = 2000;
+    intervalUsecs = 100;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "n:f:e:i:m:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            threadList = optarg;
+            break;
+        case 'f':
+            numFds = getInt(optarg, GN_GT_0, "num-fds");
+            if (numFds > MAX_FDS)
+                cmdLineErr("At most %d fds\n", MAX_FDS);
+            break;
+        case 'e':
+            numEvents = getInt(optarg, GN_GT_0, "num-events");
+            break;
+        case 'i':
+            intervalUsecs = getInt(optarg, GN_NONNEG, "interval");
+            break;
+        case 'm':
+            modeList = optarg;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    samples = calloc(numEvents, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    latPrintHeader(fmt, "mode,threads,fds,wakeups,spurious,csw");
+
+    for (mode = 0; mode < NUM_MODES; mode++)
+    {
+        if (modeList != NULL && !latInList(modeList, modeNames[mode]))
+            continue;
+
+        copy = strdup(threadList);
+        if (copy == NULL)
+            errExit("strdup");
+        for (tok = strtok_r(copy, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save))
+        {
+            numThreads = getInt(tok, GN_GT_0, "num-threads");
+            if (numThreads > MAX_THREADS)
+                cmdLineErr("At most %d threads\n", MAX_THREADS);
+            runOne(numThreads, numEvents, intervalUsecs, fmt);
+        }
+        free(copy);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -34,6 +34,9 @@
         Thread 4 completed epoll_wait(); ready = 1
         Thread 1 completed epoll_wait(); ready = 1
         main() about to terminate
+
+   See epoll_herd.c, which measures the cost of such wakeups, and
+   compares the ways of avoiding them.
 */
 #include <sys/epoll.h>
 #include <fcntl.h>
@@ -0,0 +1,609 @@
+/* mux_scale.c
+
+   Measure how the cost of I/O multiplexing grows with the number of
+   file descriptors monitored, for select(), poll(), epoll (level- and
+   edge-triggered), and io_uring poll requests.
+
+   Usage as shown in usageError().
+
+   For each number of file descriptors, N, the program creates N pipes
+   (or, with -s, UNIX domain socket pairs), and monitors the read ends.
+   In each of 'rounds' rounds, it writes a byte to each of K consecutive
+   pipes (starting at a random one), and then waits, with the mechanism
+   under test, until it has read all K bytes. Only K of the N descriptors
+   are ever active at once, which is the case in which select() and
+   poll(), whose cost grows with N, compare worst with epoll and
+   io_uring, whose cost grows with K.
+
+   The time taken for each round (from the start of waiting until all
+   K bytes have been read) is one sample. A round may take more than one
+   call of the mechanism, if not all K events are reported at once, so
+   the samples are the cost of collecting K events, not of a single
+   wakeup. The program reports their distribution, along with the
+   resulting rate of events (reads) per second. The mechanisms are:
+
+        select     The descriptor set is copied from a master copy
+                   before each call, and scanned after it. Skipped if
+                   any descriptor is too large for an fd_set.
+        poll       The pollfd array is built once; after each call it is
+                   scanned until all of the ready descriptors are found.
+        epoll-lt   All N descriptors are registered once.
+        epoll-et   As epoll-lt, but with EPOLLET.
+        uring      An io_uring instance, set up with raw system calls,
+                   with an IORING_OP_POLL_ADD request for each
+                   descriptor. Where the kernel supports it (Linux 5.13
+                   and later), these are multishot requests, which stay
+                   armed; otherwise each is resubmitted after it
+                   completes.
+
+   The program raises its soft limit on open files to the hard limit; N
+   pipes need 2 * N descriptors.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <fcntl.h>
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define URING_ENTRIES 4096
+
+enum mech
+{
+    MECH_SELECT,
+    MECH_POLL,
+    MECH_EPOLL_LT,
+    MECH_EPOLL_ET,
+    MECH_URING
+};
+
+static const char *mechNames[] = {"select", "poll", "epoll-lt", "epoll-et",
+                                  "uring"};
+
+#define NUM_MECHS (sizeof(mechNames) / sizeof(mechNames[0]))
+
+static int numFds;             /* N */
+static int numActive;          /* K */
+static int *rfd, *wfd;         /* Read and write ends */
+static int maxFd;
+
+/* State for each mechanism */
+
+static fd_set masterSet;
+static struct pollfd *pollFds;
+static int epfd;
+static struct epoll_event *evlist;
+
+/* A minimal io_uring: the submission and completion rings, mapped from
+   the kernel */
+
+static struct
+{
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned sqEntries;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize;
+    unsigned toSubmit;         /* SQEs queued since last io_uring_enter() */
+    int multishot;
+} ur;
+
+/* Read the byte written to 'fd'. Returns 1 if there was one, or 0 if
+   not (a spurious notification). */
+
+static int
+consume(int fd)
+{
+    char buf[64];
+    ssize_t numRead;
+
+    numRead = read(fd, buf, sizeof(buf));
+    if (numRead == -1 && errno != EAGAIN)
+        errExit("read");
+    return numRead > 0;
+}
+
+/* select() */
+
+static int
+waitSelect(void)
+{
+    fd_set readSet;
+    int ready, got;
+
+    memcpy(&readSet, &masterSet, sizeof(fd_set));
+    ready = select(maxFd + 1, &readSet, NULL, NULL, NULL);
+    if (ready == -1)
+        errExit("select");
+
+    got = 0;
+    for (int fd = 0; fd <= maxFd && ready > 0; fd++)
+    {
+        if (FD_ISSET(fd, &readSet))
+        {
+            got += consume(fd);
+            ready--;
+        }
+    }
+    return got;
+}
+
+/* poll() */
+
+static int
+waitPoll(void)
+{
+    int ready, got;
+
+    ready = poll(pollFds, numFds, -1);
+    if (ready == -1)
+        errExit("poll");
+
+    got = 0;
+    for (int j = 0; j < numFds && ready > 0; j++)
+    {
+        if (pollFds[j].revents & POLLIN)
+        {
+            got += consume(pollFds[j].fd);
+            ready--;
+        }
+    }
+    return got;
+}
+
+/* epoll */
+
+static int
+waitEpoll(void)
+{
+    int ready, got;
+
+    ready = epoll_wait(epfd, evlist, numActive, -1);
+    if (ready == -1)
+        errExit("epoll_wait");
+
+    got = 0;
+    for (int j = 0; j < ready; j++)
+        got += consume(evlist[j].data.fd);
+    return got;
+}
+
+/* io_uring */
+
+static int
+uringEnter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, ur.fd, toSubmit, minComplete, flags,
+                   NULL, 0);
+}
+
+/* Queue a poll request for 'fd', submitting what is already queued if
+   the submission ring is full */
+
+static void
+uringPollAdd(int fd)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail, idx;
+
+    tail = *ur.sqTail;
+    if (tail - __atomic_load_n(ur.sqHead, __ATOMIC_ACQUIRE) == ur.sqEntries)
+    {
+        if (uringEnter(ur.toSubmit, 0, 0) == -1)
+            errExit("io_uring_enter");
+        ur.toSubmit = 0;
+    }
+
+    idx = tail & *ur.sqMask;
+    sqe = &ur.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = ur.multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = fd;
+    ur.sqArray[idx] = idx;
+
+    __atomic_store_n(ur.sqTail, tail + 1, __ATOMIC_RELEASE);
+    ur.toSubmit++;
+}
+
+static int
+waitUring(void)
+{
+    struct io_uring_cqe *cqe;
+    unsigned head, tail;
+    int got, fd;
+
+    head = *ur.cqHead;
+    tail = __atomic_load_n(ur.cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) /* Nothing completed yet: submit and wait */
+    {
+        if (uringEnter(ur.toSubmit, 1, IORING_ENTER_GETEVENTS) == -1 &&
+                errno != EINTR)
+            errExit("io_uring_enter");
+        ur.toSubmit = 0;
+        tail = __atomic_load_n(ur.cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    got = 0;
+    for (; head != tail; head++)
+    {
+        cqe = &ur.cqes[head & *ur.cqMask];
+        fd = cqe->user_data;
+
+        if (cqe->res < 0)
+        {
+            if (cqe->res != -EINVAL || !ur.multishot)
+                fatal("poll request for fd %d failed: %s", fd,
+                      strerror(-cqe->res));
+            ur.multishot = 0; /* Kernel lacks multishot poll */
+        }
+        else
+        {
+            got += consume(fd);
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE)) /* Request has finished */
+            uringPollAdd(fd);
+    }
+    __atomic_store_n(ur.cqHead, head, __ATOMIC_RELEASE);
+
+    return got;
+}
+
+static void
+uringSetup(void)
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    ur.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ur.fd == -1)
+        errExit("io_uring_setup");
+
+    ur.sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ur.cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ur.cqRingSize > ur.sqRingSize)
+            ur.sqRingSize = ur.cqRingSize;
+        ur.cqRingSize = 0;
+    }
+
+    ur.sqRing = mmap(NULL, ur.sqRingSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING);
+    if (ur.sqRing == MAP_FAILED)
+        errExit("mmap-SQ ring");
+
+    ur.cqRing = ur.sqRing; /* Shared mapping unless mapped below */
+    if (ur.cqRingSize > 0)
+    {
+        ur.cqRing = mmap(NULL, ur.cqRingSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_CQ_RING);
+        if (ur.cqRing == MAP_FAILED)
+            errExit("mmap-CQ ring");
+    }
+
+    ur.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd,
+                   IORING_OFF_SQES);
+    if (ur.sqes == MAP_FAILED)
+        errExit("mmap-SQEs");
+
+    ur.sqHead = (unsigned *)((char *)ur.sqRing + p.sq_off.head);
+    ur.sqTail = (unsigned *)((char *)ur.sqRing + p.sq_off.tail);
+    ur.sqMask = (unsigned *)((char *)ur.sqRing + p.sq_off.ring_mask);
+    ur.sqArray = (unsigned *)((char *)ur.sqRing + p.sq_off.array);
+    ur.sqEntries = p.sq_entries;
+    ur.cqHead = (unsigned *)((char *)ur.cqRing + p.cq_off.head);
+    ur.cqTail = (unsigned *)((char *)ur.cqRing + p.cq_off.tail);
+    ur.cqMask = (unsigned *)((char *)ur.cqRing + p.cq_off.ring_mask);
+    ur.cqes = (struct io_uring_cqe *)((char *)ur.cqRing + p.cq_off.cqes);
+
+    ur.toSubmit = 0;
+    ur.multishot = 1;
+    for (int j = 0; j < numFds; j++)
+        uringPollAdd(rfd[j]);
+    if (uringEnter(ur.toSubmit, 0, 0) == -1)
+        errExit("io_uring_enter");
+    ur.toSubmit = 0;
+}
+
+static void
+uringTeardown(void)
+{
+    munmap(ur.sqes, ur.sqEntries * sizeof(struct io_uring_sqe));
+    if (ur.cqRingSize > 0)
+        munmap(ur.cqRing, ur.cqRingSize);
+    munmap(ur.sqRing, ur.sqRingSize);
+    close(ur.fd);
+}
+
+/* Prepare mechanism 'm' to monitor all of the read ends. Returns 0, or
+   -1 if the mechanism can't be used with these descriptors. */
+
+static int
+setup(enum mech m)
+{
+    struct epoll_event ev;
+
+    switch (m)
+    {
+    case MECH_SELECT:
+        if (maxFd >= FD_SETSIZE)
+            return -1;
+        FD_ZERO(&masterSet);
+        for (int j = 0; j < numFds; j++)
+            FD_SET(rfd[j], &masterSet);
+        break;
+
+    case MECH_POLL:
+        pollFds = calloc(numFds, sizeof(struct pollfd));
+        if (pollFds == NULL)
+            errExit("calloc");
+        for (int j = 0; j < numFds; j++)
+        {
+            pollFds[j].fd = rfd[j];
+            pollFds[j].events = POLLIN;
+        }
+        break;
+
+    case MECH_EPOLL_LT:
+    case MECH_EPOLL_ET:
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd == -1)
+            errExit("epoll_create1");
+        evlist = calloc(numActive, sizeof(struct epoll_event));
+        if (evlist == NULL)
+            errExit("calloc");
+        for (int j = 0; j < numFds; j++)
+        {
+            ev.events = EPOLLIN | ((m == MECH_EPOLL_ET) ? EPOLLET : 0);
+            ev.data.fd = rfd[j];
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, rfd[j], &ev) == -1)
+                errExit("epoll_ctl");
+        }
+        break;
+
+    case MECH_URING:
+        if (numActive > URING_ENTRIES) /* Completion ring could overflow */
+            return -1;
+        uringSetup();
+        break;
+    }
+    return 0;
+}
+
+static void
+teardown(enum mech m)
+{
+    switch (m)
+    {
+    case MECH_SELECT:
+        break;
+    case MECH_POLL:
+        free(pollFds);
+        break;
+    case MECH_EPOLL_LT:
+    case MECH_EPOLL_ET:
+        close(epfd);
+        free(evlist);
+        break;
+    case MECH_URING:
+        uringTeardown();
+        break;
+    }
+}
+
+static void
+runOne(enum mech m, int rounds, long *samples, LatFormat fmt)
+{
+    int (*waitFunc)(void);
+    struct latSummary sum;
+    long long start, total;
+    char values[128];
+    int first, got;
+
+    if (setup(m) == -1)
+    {
+        fprintf(stderr, "%s: skipped for %d fds, %d active\n",
+                mechNames[m], numFds, numActive);
+        return;
+    }
+
+    waitFunc = (m == MECH_SELECT) ? waitSelect :
+               (m == MECH_POLL) ? waitPoll :
+               (m == MECH_URING) ? waitUring : waitEpoll;
+
+    total = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        first = random() % numFds;
+        for (int j = 0; j < numActive; j++)
+            if (write(wfd[(first + j) % numFds], "x", 1) != 1)
+                errExit("write");
+
+        start = latNowNs();
+        for (got = 0; got < numActive; )
+            got += waitFunc();
+        samples[r] = latNowNs() - start;
+        total += samples[r];
+    }
+
+    teardown(m);
+
+    latSummarize(samples, rounds, &sum);
+    snprintf(values, sizeof(values), "%s,%d,%d,%.0f", mechNames[m], numFds,
+             numActive, (double)numActive * rounds / (total / 1e9) / 1e3);
+    latPrintRow(fmt, "mechanism,fds,active,Kev_per_s", values, &sum);
+}
+
+/* Create the pipes (or socket pairs). Returns 0 on success, or -1 if
+   there are not enough file descriptors. */
+
+static int
+createFds(int useSockets)
+{
+    int fds[2];
+
+    rfd = calloc(numFds, sizeof(int));
+    wfd = calloc(numFds, sizeof(int));
+    if (rfd == NULL || wfd == NULL)
+        errExit("calloc");
+
+    maxFd = 0;
+    for (int j = 0; j < numFds; j++)
+    {
+        if ((useSockets ? socketpair(AF_UNIX, SOCK_STREAM, 0, fds) :
+                          pipe(fds)) == -1)
+        {
+            if (errno != EMFILE)
+                errExit("pipe/socketpair");
+            while (--j >= 0)
+            {
+                close(rfd[j]);
+                close(wfd[j]);
+            }
+            free(rfd);
+            free(wfd);
+            return -1;
+        }
+        rfd[j] = fds[0];
+        wfd[j] = fds[1];
+        if (fcntl(rfd[j], F_SETFL, O_NONBLOCK) == -1)
+            errExit("fcntl");
+        if (rfd[j] > maxFd)
+            maxFd = rfd[j];
+    }
+    return 0;
+}
+
+static void
+closeFds(void)
+{
+    for (int j = 0; j < numFds; j++)
+    {
+        close(rfd[j]);
+        close(wfd[j]);
+    }
+    free(rfd);
+    free(wfd);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n list    Comma-separated numbers of fds "
+                    "(default: 10,100,1000,5000)\n");
+    fprintf(stderr, "    -k num     Number of fds active in each round "
+                    "(default: 1)\n");
+    fprintf(stderr, "    -r num     Rounds per measurement (default: "
+                    "2000)\n");
+    fprintf(stderr, "    -s         Use socket pairs rather than pipes\n");
+    fprintf(stderr, "    -m list    Comma-separated mechanisms (default: "
+                    "all):\n               ");
+    for (size_t j = 0; j < NUM_MECHS; j++)
+        fprintf(stderr, " %s", mechNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *fdList, *mechList;
+    char *copy, *tok, *save;
+    struct rlimit rl;
+    long *samples;
+    int opt, rounds, useSockets, active;
+    LatFormat fmt;
+
+    fdList = "10,100,1000,5000";
+    mechList = NULL;
+    active = 1;
+    rounds = 2000;
+    useSockets = 0;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "n:k:r:sm:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            fdList = optarg;
+            break;
+        case 'k':
+            active = getInt(optarg, GN_GT_0, "num-active");
+            break;
+        case 'r':
+            rounds = getInt(optarg, GN_GT_0, "rounds");
+            break;
+        case 's':
+            useSockets = 1;
+            break;
+        case 'm':
+            mechList = optarg;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1)
+        errExit("getrlimit");
+    rl.rlim_cur = rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) == -1)
+        errExit("setrlimit");
+
+    samples = calloc(rounds, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    latPrintHeader(fmt, "mechanism,fds,active,Kev_per_s");
+
+    copy = strdup(fdList);
+    if (copy == NULL)
+        errExit("strdup");
+    for (tok = strtok_r(copy, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save))
+    {
+        numFds = getInt(tok, GN_GT_0, "num-fds");
+        numActive = (active < numFds) ? active : numFds;
+        if (createFds(useSockets) == -1)
+        {
+            fprintf(stderr, "%d fds: not enough file descriptors (limit "
+                    "is %ld)\n", numFds, (long)rl.rlim_cur);
+            continue;
+        }
+
+        for (size_t m = 0; m < NUM_MECHS; m++)
+            if (mechList == NULL || latInList(mechList, mechNames[m]))
+                runOne(m, rounds, samples, fmt);
+
+        closeFds();
+    }
+    free(copy);
+
+    exit(EXIT_SUCCESS);
+}
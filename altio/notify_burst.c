@@ -0,0 +1,464 @@
+/* notify_burst.c
+
+   Compare ways in which a signal handler can wake a program that is
+   waiting in select(), poll(), or epoll_wait(), when the signals come in
+   bursts.
+
+   Usage as shown in usageError().
+
+   A sender thread queues bursts of 'burst-size' realtime signals
+   (SIGRTMIN) to the process with sigqueue(); realtime signals are
+   queued, rather than merged, so every one reaches the handler. The
+   main thread waits with the chosen multiplexing call, and each time it
+   is woken, consumes the notifications; once it has seen the whole
+   burst, it tells the sender, which then sends the next burst. The
+   modes are:
+
+        pipe           The handler writes a byte to a pipe, and the main
+                       thread reads the bytes one at a time, as in
+                       self_pipe.c
+        eventfd        The handler adds 1 to an eventfd, and the main
+                       thread reads the total with one read()
+        nt-eventfd     ntNotify() and ntConsume() from lib/notifier.c:
+                       as eventfd, but only the first notification
+                       since the last consume writes to the eventfd
+        nt-pipe        As nt-eventfd, with a pipe (NT_PIPE)
+        signalfd       The signal is blocked, and the main thread reads
+                       it from a signalfd; there is no handler
+
+   For each mode, the program reports the time from the start of each
+   burst until the main thread has consumed it, and, per burst, the
+   number of times the main thread was woken, the number of reads it
+   made (counting each ntConsume() as one), and the number of writes
+   made by the handler.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdint.h>
+#include "notifier.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+enum mode
+{
+    MODE_PIPE,
+    MODE_EVENTFD,
+    MODE_NOTIFIER,
+    MODE_NOTIFIER_PIPE,
+    MODE_SIGNALFD
+};
+
+static const char *modeNames[] = {"pipe", "eventfd", "nt-eventfd",
+                                  "nt-pipe", "signalfd"};
+
+#define NUM_MODES (sizeof(modeNames) / sizeof(modeNames[0]))
+
+enum waiter
+{
+    WAIT_SELECT,
+    WAIT_POLL,
+    WAIT_EPOLL
+};
+
+static const char *waiterNames[] = {"select", "poll", "epoll"};
+
+static enum mode mode;
+static enum waiter waiter;
+static int burstSize, numBursts;
+
+static int pfd[2];              /* MODE_PIPE */
+static int efd;                 /* MODE_EVENTFD */
+static Notifier nt;             /* MODE_NOTIFIER, MODE_NOTIFIER_PIPE */
+static int sfd;                 /* MODE_SIGNALFD */
+static int waitFd;              /* The descriptor the main thread waits on */
+static int epfd;
+
+static long handled;            /* Signals seen by the handler */
+static long writes;             /* Writes made by the handler */
+static sem_t burstDone;
+static long *samples;
+
+static void
+handler(int sig)
+{
+    int savedErrno;
+    uint64_t one = 1;
+
+    savedErrno = errno;
+    __atomic_fetch_add(&handled, 1, __ATOMIC_RELAXED);
+
+    switch (mode)
+    {
+    case MODE_PIPE:
+        if (write(pfd[1], "x", 1) == 1)
+            __atomic_fetch_add(&writes, 1, __ATOMIC_RELAXED);
+        break;
+    case MODE_EVENTFD:
+        if (write(efd, &one, sizeof(one)) == sizeof(one))
+            __atomic_fetch_add(&writes, 1, __ATOMIC_RELAXED);
+        break;
+    case MODE_NOTIFIER:
+    case MODE_NOTIFIER_PIPE:
+        if (ntNotify(&nt) == 1)
+            __atomic_fetch_add(&writes, 1, __ATOMIC_RELAXED);
+        break;
+    case MODE_SIGNALFD:
+        break;
+    }
+
+    errno = savedErrno;
+}
+
+/* Sender thread: send the bursts, timing each until the main thread
+   says it has consumed it */
+
+static void *
+senderFunc(void *arg)
+{
+    union sigval sv;
+    sigset_t set;
+    long long start;
+    int s;
+
+    /* Block the signal here, so that it's delivered to the main thread */
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGRTMIN);
+    s = pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (s != 0)
+        errExitEN(s, "pthread_sigmask");
+
+    sv.sival_int = 0;
+    for (int b = 0; b < numBursts; b++)
+    {
+        start = latNowNs();
+        for (int j = 0; j < burstSize; j++)
+        {
+            while (sigqueue(getpid(), SIGRTMIN, sv) == -1)
+            {
+                if (errno != EAGAIN) /* EAGAIN: queue full */
+                    errExit("sigqueue");
+                sched_yield();
+            }
+        }
+
+        while (sem_wait(&burstDone) == -1)
+            if (errno != EINTR)
+                errExit("sem_wait");
+        samples[b] = latNowNs() - start;
+    }
+    return NULL;
+}
+
+/* Wait until 'waitFd' is readable. Returns 0, or -1 if interrupted by a
+   signal handler. */
+
+static int
+waitReadable(void)
+{
+    fd_set readSet;
+    struct pollfd p;
+    struct epoll_event ev;
+    int ready;
+
+    switch (waiter)
+    {
+    case WAIT_SELECT:
+        FD_ZERO(&readSet);
+        FD_SET(waitFd, &readSet);
+        ready = select(waitFd + 1, &readSet, NULL, NULL, NULL);
+        break;
+    case WAIT_POLL:
+        p.fd = waitFd;
+        p.events = POLLIN;
+        ready = poll(&p, 1, -1);
+        break;
+    default: /* WAIT_EPOLL */
+        ready = epoll_wait(epfd, &ev, 1, -1);
+        break;
+    }
+
+    if (ready == -1 && errno != EINTR)
+        errExit("waiting for input");
+    return (ready == -1) ? -1 : 0;
+}
+
+/* Consume the notifications now available. Returns the number of
+   signals they account for (for the handler-based modes, the signals
+   handled so far, since the handler counts them). */
+
+static long
+consume(long *reads)
+{
+    struct signalfd_siginfo si[64];
+    uint64_t value;
+    ssize_t numRead;
+    long n;
+    char ch;
+
+    switch (mode)
+    {
+    case MODE_PIPE:
+        for (;;)
+        {
+            (*reads)++;
+            if (read(pfd[0], &ch, 1) == -1)
+            {
+                if (errno == EAGAIN)
+                    break;
+                errExit("read");
+            }
+        }
+        break;
+
+    case MODE_EVENTFD:
+        (*reads)++;
+        if (read(efd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+            errExit("read");
+        break;
+
+    case MODE_NOTIFIER:
+    case MODE_NOTIFIER_PIPE:
+        (*reads)++;
+        if (ntConsume(&nt) == -1)
+            errExit("ntConsume");
+        break;
+
+    case MODE_SIGNALFD:
+        n = 0;
+        for (;;)
+        {
+            (*reads)++;
+            numRead = read(sfd, si, sizeof(si));
+            if (numRead == -1)
+            {
+                if (errno == EAGAIN)
+                    break;
+                errExit("read");
+            }
+            n += numRead / sizeof(si[0]);
+        }
+        return n;
+    }
+
+    return __atomic_exchange_n(&handled, 0, __ATOMIC_RELAXED);
+}
+
+static void
+runOne(LatFormat fmt)
+{
+    struct sigaction sa;
+    struct epoll_event ev;
+    struct latSummary sum;
+    sigset_t set;
+    pthread_t sender;
+    long wakeups, reads, seen;
+    char values[256];
+    int s;
+
+    handled = writes = 0;
+    if (sem_init(&burstDone, 0, 0) == -1)
+        errExit("sem_init");
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGRTMIN);
+
+    switch (mode)
+    {
+    case MODE_PIPE:
+        if (pipe2(pfd, O_NONBLOCK) == -1)
+            errExit("pipe2");
+        waitFd = pfd[0];
+        break;
+    case MODE_EVENTFD:
+        efd = eventfd(0, EFD_NONBLOCK);
+        if (efd == -1)
+            errExit("eventfd");
+        waitFd = efd;
+        break;
+    case MODE_NOTIFIER:
+    case MODE_NOTIFIER_PIPE:
+        if (ntInit(&nt, (mode == MODE_NOTIFIER_PIPE) ? NT_PIPE : 0) == -1)
+            errExit("ntInit");
+        waitFd = nt.fd;
+        break;
+    case MODE_SIGNALFD:
+        s = pthread_sigmask(SIG_BLOCK, &set, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_sigmask");
+        sfd = signalfd(-1, &set, SFD_NONBLOCK);
+        if (sfd == -1)
+            errExit("signalfd");
+        waitFd = sfd;
+        break;
+    }
+
+    if (mode != MODE_SIGNALFD)
+    {
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sa.sa_handler = handler;
+        if (sigaction(SIGRTMIN, &sa, NULL) == -1)
+            errExit("sigaction");
+    }
+
+    if (waiter == WAIT_EPOLL)
+    {
+        epfd = epoll_create1(0);
+        if (epfd == -1)
+            errExit("epoll_create1");
+        ev.events = EPOLLIN;
+        ev.data.fd = waitFd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, waitFd, &ev) == -1)
+            errExit("epoll_ctl");
+    }
+
+    s = pthread_create(&sender, NULL, senderFunc, NULL);
+    if (s != 0)
+        errExitEN(s, "pthread_create");
+
+    /* Consume the bursts */
+
+    wakeups = reads = 0;
+    for (int b = 0; b < numBursts; b++)
+    {
+        for (seen = 0; seen < burstSize; )
+        {
+            if (waitReadable() == -1)
+                continue;
+            wakeups++;
+            seen += consume(&reads);
+        }
+        if (seen > burstSize)
+            fatal("%s: saw %ld signals in a burst of %d", modeNames[mode],
+                  seen, burstSize);
+        if (sem_post(&burstDone) == -1)
+            errExit("sem_post");
+    }
+
+    s = pthread_join(sender, NULL);
+    if (s != 0)
+        errExitEN(s, "pthread_join");
+
+    /* Tidy up, leaving the signal unblocked and at its default */
+
+    if (waiter == WAIT_EPOLL)
+        close(epfd);
+    switch (mode)
+    {
+    case MODE_PIPE:
+        close(pfd[0]);
+        close(pfd[1]);
+        break;
+    case MODE_EVENTFD:
+        close(efd);
+        break;
+    case MODE_NOTIFIER:
+    case MODE_NOTIFIER_PIPE:
+        ntClose(&nt);
+        break;
+    case MODE_SIGNALFD:
+        close(sfd);
+        s = pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_sigmask");
+        break;
+    }
+    if (signal(SIGRTMIN, SIG_DFL) == SIG_ERR)
+        errExit("signal");
+    sem_destroy(&burstDone);
+
+    latSummarize(samples, numBursts, &sum);
+    snprintf(values, sizeof(values), "%s,%s,%d,%.1f,%.1f,%.1f",
+             modeNames[mode], waiterNames[waiter], burstSize,
+             (double)wakeups / numBursts, (double)reads / numBursts,
+             (double)writes / numBursts);
+    latPrintRow(fmt, "mode,waiter,burst,wakeups,reads,writes", values, &sum);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -b num     Signals per burst (default: 1000)\n");
+    fprintf(stderr, "    -n num     Number of bursts (default: 200)\n");
+    fprintf(stderr, "    -w waiter  select, poll (default), or epoll\n");
+    fprintf(stderr, "    -m list    Comma-separated modes (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_MODES; j++)
+        fprintf(stderr, " %s", modeNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *modeList;
+    int opt;
+    LatFormat fmt;
+
+    burstSize = 1000;
+    numBursts = 200;
+    waiter = WAIT_POLL;
+    modeList = NULL;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "b:n:w:m:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            burstSize = getInt(optarg, GN_GT_0, "burst-size");
+            break;
+        case 'n':
+            numBursts = getInt(optarg, GN_GT_0, "num-bursts");
+            break;
+        case 'w':
+            if (strcmp(optarg, "select") == 0)
+                waiter = WAIT_SELECT;
+            else if (strcmp(optarg, "poll") == 0)
+                waiter = WAIT_POLL;
+            else if (strcmp(optarg, "epoll") == 0)
+                waiter = WAIT_EPOLL;
+            else
+                usageError(argv[0]);
+            break;
+        case 'm':
+            modeList = optarg;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    samples = calloc(numBursts, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    latPrintHeader(fmt, "mode,waiter,burst,wakeups,reads,writes");
+
+    for (mode = 0; mode < NUM_MODES; mode++)
+        if (modeList == NULL || latInList(modeList, modeNames[mode]))
+            runOne(fmt);
+
+    exit(EXIT_SUCCESS);
+}
@@ -6,6 +6,10 @@
    Usage as shown in synopsis below; for example:
 
         self_pipe - 0
+
+   See lib/notifier.c for a version of this technique that coalesces a
+   burst of signals into a single wakeup, and notify_burst.c, which
+   compares the two.
 */
 #include <sys/time.h>
 #if !defined(__hpux) /* HP-UX 11 doesn't have this header file */
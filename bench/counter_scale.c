@@ -0,0 +1,296 @@
+/* counter_scale.c
+
+   Show how the cost of incrementing a counter from many threads depends
+   on how the counter is laid out in memory.
+
+   Usage as shown in usageError().
+
+   Each thread increments the counter 'loops' times; the program reports
+   the total rate of increments and the average cost of one increment,
+   for each number of threads. The variants are:
+
+        mutex      One counter, protected by a mutex
+                   (cf. threads/thread_incr_mutex.c)
+        atomic     One counter, updated with an atomic fetch-and-add
+        packed     One counter per thread, in adjacent array elements;
+                   several counters share each cache line ("false
+                   sharing"), so the line bounces between CPUs even
+                   though no two threads touch the same counter
+        padded     One counter per thread, each on its own cache line,
+                   with scAddSlot() (cf. threads/thread_incr_sharded.c)
+        percpu     One counter per CPU, each on its own cache line, with
+                   scAdd()
+
+   On a machine with a single CPU, there is no cache-line traffic between
+   CPUs, and the variants differ only in the cost of the instructions
+   they execute.
+*/
+#include <pthread.h>
+#include "sharded_counter.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+static int loops;
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static volatile long glob;
+static volatile long packed[64];
+static ShardedCounter *sc;
+
+static void
+incMutex(int idx)
+{
+    int s;
+
+    for (int j = 0; j < loops; j++)
+    {
+        s = pthread_mutex_lock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        glob++;
+        s = pthread_mutex_unlock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+    }
+}
+
+static void
+incAtomic(int idx)
+{
+    for (int j = 0; j < loops; j++)
+        __atomic_fetch_add(&glob, 1, __ATOMIC_RELAXED);
+}
+
+static void
+incPacked(int idx)
+{
+    for (int j = 0; j < loops; j++)
+        packed[idx]++;
+}
+
+static void
+incPadded(int idx)
+{
+    for (int j = 0; j < loops; j++)
+        scAddSlot(sc, idx, 1);
+}
+
+static void
+incPercpu(int idx)
+{
+    for (int j = 0; j < loops; j++)
+        scAdd(sc, 1);
+}
+
+static long
+readGlob(int numThreads)
+{
+    return glob;
+}
+
+static long
+readPacked(int numThreads)
+{
+    long sum = 0;
+
+    for (int j = 0; j < numThreads; j++)
+        sum += packed[j];
+    return sum;
+}
+
+static long
+readSharded(int numThreads)
+{
+    return scRead(sc);
+}
+
+static const struct variant
+{
+    const char *name;
+    void (*inc)(int idx);
+    long (*read)(int numThreads);
+    int numSlots; /* For the sharded counter: -1 == none, 0 == per CPU,
+                     1 == per thread */
+} variants[] = {
+    {"mutex", incMutex, readGlob, -1},
+    {"atomic", incAtomic, readGlob, -1},
+    {"packed", incPacked, readPacked, -1},
+    {"padded", incPadded, readSharded, 1},
+    {"percpu", incPercpu, readSharded, 0},
+};
+
+#define NUM_VARIANTS (sizeof(variants) / sizeof(variants[0]))
+#define MAX_THREADS (sizeof(packed) / sizeof(packed[0]))
+
+static const struct variant *var; /* Variant in the current run */
+static pthread_barrier_t barrier;
+
+static void *
+threadFunc(void *arg)
+{
+    int s;
+
+    s = pthread_barrier_wait(&barrier);
+    if (s != 0 && s != PTHREAD_BARRIER_SERIAL_THREAD)
+        errExitEN(s, "pthread_barrier_wait");
+
+    var->inc(*(int *)arg);
+    return NULL;
+}
+
+static void
+runOne(int numThreads, LatFormat fmt)
+{
+    pthread_t thread[MAX_THREADS];
+    int idx[MAX_THREADS];
+    long long start, elapsed;
+    double total;
+    int s;
+
+    glob = 0;
+    memset((void *)packed, 0, sizeof(packed));
+    sc = NULL;
+    if (var->numSlots >= 0)
+    {
+        sc = scCreate(var->numSlots == 0 ? 0 : numThreads);
+        if (sc == NULL)
+            errExit("scCreate");
+    }
+
+    s = pthread_barrier_init(&barrier, NULL, numThreads + 1);
+    if (s != 0)
+        errExitEN(s, "pthread_barrier_init");
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        idx[j] = j;
+        s = pthread_create(&thread[j], NULL, threadFunc, &idx[j]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+
+    s = pthread_barrier_wait(&barrier);
+    if (s != 0 && s != PTHREAD_BARRIER_SERIAL_THREAD)
+        errExitEN(s, "pthread_barrier_wait");
+    start = latNowNs();
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        s = pthread_join(thread[j], NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+    elapsed = latNowNs() - start;
+    pthread_barrier_destroy(&barrier);
+
+    total = (double)numThreads * loops;
+    if (var->read(numThreads) != (long)total)
+        fatal("%s: count is %ld; expected %.0f", var->name,
+              var->read(numThreads), total);
+
+    switch (fmt)
+    {
+    case LAT_FMT_TEXT:
+        printf("%-8s %7d %12.1f %10.2f\n", var->name, numThreads,
+               total / (elapsed / 1e3), (double)elapsed * numThreads / total);
+        break;
+    case LAT_FMT_CSV:
+        printf("%s,%d,%d,%.1f,%.2f\n", var->name, numThreads, loops,
+               total / (elapsed / 1e3), (double)elapsed * numThreads / total);
+        break;
+    case LAT_FMT_JSON:
+        printf("{\"variant\": \"%s\", \"threads\": %d, \"loops\": %d, "
+               "\"Mincr_per_s\": %.1f, \"ns_per_incr\": %.2f}\n", var->name,
+               numThreads, loops, total / (elapsed / 1e3),
+               (double)elapsed * numThreads / total);
+        break;
+    }
+    fflush(stdout);
+
+    if (sc != NULL)
+        scFree(sc);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -l loops   Increments per thread (default: "
+                    "10000000)\n");
+    fprintf(stderr, "    -n list    Comma-separated thread counts "
+                    "(default: 1,2,4,8)\n");
+    fprintf(stderr, "    -v list    Comma-separated variants (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_VARIANTS; j++)
+        fprintf(stderr, " %s", variants[j].name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *threadList, *varList;
+    char *copy, *tok, *save;
+    int opt, numThreads;
+    LatFormat fmt;
+
+    loops = 10000000;
+    threadList = "1,2,4,8";
+    varList = NULL;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "l:n:v:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            loops = getInt(optarg, GN_GT_0, "loops");
+            break;
+        case 'n':
+            threadList = optarg;
+            break;
+        case 'v':
+            varList = optarg;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    if (fmt == LAT_FMT_TEXT)
+        printf("%-8s %7s %12s %10s\n", "variant", "threads", "Mincr/s",
+               "ns/incr");
+    else if (fmt == LAT_FMT_CSV)
+        printf("variant,threads,loops,Mincr_per_s,ns_per_incr\n");
+
+    for (size_t v = 0; v < NUM_VARIANTS; v++)
+    {
+        var = &variants[v];
+        if (varList != NULL && !latInList(varList, var->name))
+            continue;
+
+        copy = strdup(threadList);
+        if (copy == NULL)
+            errExit("strdup");
+        for (tok = strtok_r(copy, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save))
+        {
+            numThreads = getInt(tok, GN_GT_0, "num-threads");
+            if (numThreads > MAX_THREADS)
+                cmdLineErr("At most %ld threads\n", (long)MAX_THREADS);
+            runOne(numThreads, fmt);
+        }
+        free(copy);
+    }
+
+    exit(EXIT_SUCCESS);
+}
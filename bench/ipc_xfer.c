@@ -0,0 +1,767 @@
+/* ipc_xfer.c
+
+   Compare the bulk data-transfer throughput of the IPC mechanisms
+   demonstrated elsewhere in this tree.
+
+   Usage as shown in usageError().
+
+   For each mechanism and each message size, a sender process transfers
+   a fixed total number of bytes to a receiver process, which touches
+   every cache line of each message that it receives (so that mechanisms
+   that hand over data in place are charged for reading it). The program
+   reports MB/s, messages/s, and the CPU time (user + system, both
+   processes) consumed per byte transferred. The mechanisms are:
+
+        pipe       pipe(2), as in pipes/simple_pipe.c
+        fifo       A FIFO, as in pipes/fifo_seqnum_*.c
+        ustream    UNIX domain stream socket pair (cf. sockets/us_xfr_*.c)
+        udgram     UNIX domain datagram socket pair (cf. sockets/ud_ucase_*.c)
+        tcp        TCP connection over the loopback interface
+        pmsg       POSIX message queue (cf. pmsg/)
+        svmsg      System V message queue (cf. svmsg/)
+        svshm      System V shared memory ring of slots, with a pair of
+                   counting semaphores (cf. svshm/svshm_xfr_*.c)
+        vmsplice   pipe(2), with the sender mapping its buffer into the
+                   pipe using vmsplice(2) rather than copying it
+        memfd      A memfd_create(2) ring of slots whose descriptor is
+                   passed once with SCM_RIGHTS; after that only slot
+                   numbers travel over a UNIX domain socket
+
+   Message-based mechanisms have size limits; sizes beyond a mechanism's
+   limit are skipped. (For the message queues, the limits are those in
+   /proc/sys/fs/mqueue/msgsize_max and /proc/sys/kernel/msgmax.)
+
+   The 'vmsplice' sender never modifies its buffer, which is what makes
+   it safe to reuse the buffer while the kernel still refers to it; a
+   real producer would need the double-buffering scheme described in
+   vmsplice(2).
+*/
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/sem.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <mqueue.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include "semun.h"
+#include "scm_functions.h"
+#include "rdwrn.h"
+#include "inet_sockets.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define NUM_SLOTS 16 /* Slots in the shared memory rings */
+#define CACHE_LINE 64
+
+static int fd[2];          /* Receiving and sending ends, where relevant */
+static int listenFd;       /* 'tcp' */
+static char tcpPort[16];   /* 'tcp' */
+static char fifoPath[64];  /* 'fifo' */
+static mqd_t mqd;          /* 'pmsg' */
+static int msqId;          /* 'svmsg' */
+static int shmId, semId;   /* 'svshm' */
+
+static volatile unsigned long sink; /* Defeat optimization of consume() */
+
+/* Read one byte from each cache line of a received message */
+
+static void
+consume(const char *p, size_t len)
+{
+    unsigned long sum = 0;
+
+    for (size_t j = 0; j < len; j += CACHE_LINE)
+        sum += (unsigned char)p[j];
+    sink += sum;
+}
+
+static char *
+allocBuf(size_t size)
+{
+    void *buf;
+    int s;
+
+    s = posix_memalign(&buf, sysconf(_SC_PAGESIZE), size);
+    if (s != 0)
+        errExitEN(s, "posix_memalign");
+    memset(buf, 'x', size);
+    return buf;
+}
+
+/* Read a single number from a /proc file, or return 'dflt' */
+
+static size_t
+procLimit(const char *path, size_t dflt)
+{
+    FILE *fp;
+    long val;
+
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return dflt;
+    if (fscanf(fp, "%ld", &val) != 1)
+        val = dflt;
+    fclose(fp);
+    return val;
+}
+
+/* Stream mechanisms: transfer 'n' messages of 'size' bytes using
+   write(2) and read(2) on fd[1] and fd[0] */
+
+static void
+streamSend(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+
+    for (long j = 0; j < n; j++)
+        if (writen(fd[1], buf, size) != size)
+            errExit("write");
+}
+
+static void
+streamRecv(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+    long long remaining;
+    ssize_t numRead;
+
+    for (remaining = (long long)n * size; remaining > 0; remaining -= numRead)
+    {
+        numRead = read(fd[0], buf, min((long long)size, remaining));
+        if (numRead <= 0)
+            errExit("read");
+        consume(buf, numRead);
+    }
+}
+
+static void
+closeBoth(void)
+{
+    close(fd[0]);
+    close(fd[1]);
+}
+
+/* ---------- pipe, vmsplice ---------- */
+
+static void
+pipeSetup(size_t size)
+{
+    if (pipe(fd) == -1)
+        errExit("pipe");
+}
+
+static void
+vmspliceSend(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+    struct iovec iov;
+    ssize_t s;
+
+    for (long j = 0; j < n; j++)
+    {
+        iov.iov_base = buf;
+        iov.iov_len = size;
+        while (iov.iov_len > 0)
+        {
+            s = vmsplice(fd[1], &iov, 1, 0);
+            if (s == -1)
+                errExit("vmsplice");
+            iov.iov_base = (char *)iov.iov_base + s;
+            iov.iov_len -= s;
+        }
+    }
+}
+
+/* ---------- fifo ---------- */
+
+static void
+fifoSetup(size_t size)
+{
+    snprintf(fifoPath, sizeof(fifoPath), "/tmp/ipc_xfer.%ld", (long)getpid());
+    if (mkfifo(fifoPath, S_IRUSR | S_IWUSR) == -1)
+        errExit("mkfifo %s", fifoPath);
+}
+
+static void
+fifoSend(size_t size, long n)
+{
+    fd[1] = open(fifoPath, O_WRONLY);
+    if (fd[1] == -1)
+        errExit("open %s", fifoPath);
+    streamSend(size, n);
+}
+
+static void
+fifoRecv(size_t size, long n)
+{
+    fd[0] = open(fifoPath, O_RDONLY);
+    if (fd[0] == -1)
+        errExit("open %s", fifoPath);
+    streamRecv(size, n);
+}
+
+static void
+fifoCleanup(void)
+{
+    unlink(fifoPath);
+}
+
+/* ---------- UNIX domain sockets ---------- */
+
+static void
+ustreamSetup(size_t size)
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == -1)
+        errExit("socketpair");
+}
+
+static void
+udgramSetup(size_t size)
+{
+    int bufSize = 4 * size;
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fd) == -1)
+        errExit("socketpair");
+
+    /* Make room for more than one maximum-size datagram */
+
+    if (setsockopt(fd[1], SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(int)) == -1)
+        errExit("setsockopt");
+}
+
+static void
+dgramSend(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+
+    for (long j = 0; j < n; j++)
+        if (send(fd[1], buf, size, 0) != size)
+            errExit("send");
+}
+
+static void
+dgramRecv(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+    ssize_t numRead;
+
+    for (long j = 0; j < n; j++)
+    {
+        numRead = recv(fd[0], buf, size, 0);
+        if (numRead == -1)
+            errExit("recv");
+        consume(buf, numRead);
+    }
+}
+
+/* ---------- TCP loopback ---------- */
+
+static void
+tcpSetup(size_t size)
+{
+    struct sockaddr_storage addr;
+    socklen_t len;
+    in_port_t port;
+
+    listenFd = inetListen("0", 1, NULL); /* Ephemeral port */
+    if (listenFd == -1)
+        errExit("inetListen");
+
+    len = sizeof(addr);
+    if (getsockname(listenFd, (struct sockaddr *)&addr, &len) == -1)
+        errExit("getsockname");
+    port = (addr.ss_family == AF_INET6) ?
+               ((struct sockaddr_in6 *)&addr)->sin6_port :
+               ((struct sockaddr_in *)&addr)->sin_port;
+    snprintf(tcpPort, sizeof(tcpPort), "%d", ntohs(port));
+}
+
+static void
+tcpSend(size_t size, long n)
+{
+    fd[1] = inetConnect("localhost", tcpPort, SOCK_STREAM);
+    if (fd[1] == -1)
+        errExit("inetConnect");
+    streamSend(size, n);
+}
+
+static void
+tcpRecv(size_t size, long n)
+{
+    fd[0] = accept(listenFd, NULL, NULL);
+    if (fd[0] == -1)
+        errExit("accept");
+    streamRecv(size, n);
+}
+
+static void
+tcpCleanup(void)
+{
+    close(listenFd);
+}
+
+/* ---------- POSIX message queues ---------- */
+
+static void
+pmsgSetup(size_t size)
+{
+    struct mq_attr attr;
+    char name[64];
+
+    attr.mq_maxmsg = 10; /* The default limit in /proc/sys/fs/mqueue/msg_max */
+    attr.mq_msgsize = size;
+
+    snprintf(name, sizeof(name), "/ipc_xfer.%ld", (long)getpid());
+    mqd = mq_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR, &attr);
+    if (mqd == (mqd_t)-1)
+        errExit("mq_open");
+    if (mq_unlink(name) == -1)
+        errExit("mq_unlink");
+}
+
+static void
+pmsgSend(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+
+    for (long j = 0; j < n; j++)
+        if (mq_send(mqd, buf, size, 0) == -1)
+            errExit("mq_send");
+}
+
+static void
+pmsgRecv(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+    ssize_t numRead;
+
+    for (long j = 0; j < n; j++)
+    {
+        numRead = mq_receive(mqd, buf, size, NULL);
+        if (numRead == -1)
+            errExit("mq_receive");
+        consume(buf, numRead);
+    }
+}
+
+static void
+pmsgCleanup(void)
+{
+    mq_close(mqd);
+}
+
+/* ---------- System V message queues ---------- */
+
+struct svmsgBuf
+{
+    long mtype;
+    char mtext[];
+};
+
+static void
+svmsgSetup(size_t size)
+{
+    msqId = msgget(IPC_PRIVATE, S_IRUSR | S_IWUSR);
+    if (msqId == -1)
+        errExit("msgget");
+}
+
+static void
+svmsgSend(size_t size, long n)
+{
+    struct svmsgBuf *msg;
+
+    msg = (struct svmsgBuf *)allocBuf(sizeof(long) + size);
+    msg->mtype = 1;
+    for (long j = 0; j < n; j++)
+        if (msgsnd(msqId, msg, size, 0) == -1)
+            errExit("msgsnd");
+}
+
+static void
+svmsgRecv(size_t size, long n)
+{
+    struct svmsgBuf *msg;
+    ssize_t numRead;
+
+    msg = (struct svmsgBuf *)allocBuf(sizeof(long) + size);
+    for (long j = 0; j < n; j++)
+    {
+        numRead = msgrcv(msqId, msg, size, 0, 0);
+        if (numRead == -1)
+            errExit("msgrcv");
+        consume(msg->mtext, numRead);
+    }
+}
+
+static void
+svmsgCleanup(void)
+{
+    if (msgctl(msqId, IPC_RMID, NULL) == -1)
+        errExit("msgctl");
+}
+
+/* ---------- System V shared memory ---------- */
+
+/* Semaphore 0 counts empty slots; semaphore 1 counts full slots */
+
+#define SEM_EMPTY 0
+#define SEM_FULL 1
+
+static void
+semAdd(int semNum, int delta)
+{
+    struct sembuf sop;
+
+    sop.sem_num = semNum;
+    sop.sem_op = delta;
+    sop.sem_flg = 0;
+    while (semop(semId, &sop, 1) == -1)
+        if (errno != EINTR)
+            errExit("semop");
+}
+
+static void
+svshmSetup(size_t size)
+{
+    union semun arg;
+
+    shmId = shmget(IPC_PRIVATE, NUM_SLOTS * size, S_IRUSR | S_IWUSR);
+    if (shmId == -1)
+        errExit("shmget");
+
+    semId = semget(IPC_PRIVATE, 2, S_IRUSR | S_IWUSR);
+    if (semId == -1)
+        errExit("semget");
+    arg.val = NUM_SLOTS;
+    if (semctl(semId, SEM_EMPTY, SETVAL, arg) == -1)
+        errExit("semctl");
+    arg.val = 0;
+    if (semctl(semId, SEM_FULL, SETVAL, arg) == -1)
+        errExit("semctl");
+}
+
+static void
+svshmSend(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+    char *ring;
+
+    ring = shmat(shmId, NULL, 0);
+    if (ring == (void *)-1)
+        errExit("shmat");
+
+    for (long j = 0; j < n; j++)
+    {
+        semAdd(SEM_EMPTY, -1);
+        memcpy(ring + (j % NUM_SLOTS) * size, buf, size);
+        semAdd(SEM_FULL, 1);
+    }
+}
+
+static void
+svshmRecv(size_t size, long n)
+{
+    char *ring;
+
+    ring = shmat(shmId, NULL, SHM_RDONLY);
+    if (ring == (void *)-1)
+        errExit("shmat");
+
+    for (long j = 0; j < n; j++)
+    {
+        semAdd(SEM_FULL, -1);
+        consume(ring + (j % NUM_SLOTS) * size, size);
+        semAdd(SEM_EMPTY, 1);
+    }
+}
+
+static void
+svshmCleanup(void)
+{
+    union semun dummy;
+
+    if (shmctl(shmId, IPC_RMID, NULL) == -1)
+        errExit("shmctl");
+    if (semctl(semId, 0, IPC_RMID, dummy) == -1)
+        errExit("semctl");
+}
+
+/* ---------- memfd ring, slot numbers passed over a socket ---------- */
+
+static void
+memfdSend(size_t size, long n)
+{
+    char *buf = allocBuf(size);
+    uint32_t slot;
+    char *ring;
+    int mfd;
+
+    mfd = memfd_create("ipc_xfer", MFD_CLOEXEC);
+    if (mfd == -1)
+        errExit("memfd_create");
+    if (ftruncate(mfd, NUM_SLOTS * size) == -1)
+        errExit("ftruncate");
+    ring = mmap(NULL, NUM_SLOTS * size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                mfd, 0);
+    if (ring == MAP_FAILED)
+        errExit("mmap");
+    if (sendfd(fd[1], mfd) == -1)
+        errExit("sendfd");
+
+    for (long j = 0; j < n; j++)
+    {
+        if (j >= NUM_SLOTS) /* Wait for the receiver to free a slot */
+            if (readn(fd[1], &slot, sizeof(slot)) != sizeof(slot))
+                errExit("read credit");
+
+        slot = j % NUM_SLOTS;
+        memcpy(ring + slot * size, buf, size);
+        if (write(fd[1], &slot, sizeof(slot)) != sizeof(slot))
+            errExit("write slot");
+    }
+}
+
+static void
+memfdRecv(size_t size, long n)
+{
+    uint32_t slot;
+    char *ring;
+    int mfd;
+
+    mfd = recvfd(fd[0]);
+    if (mfd == -1)
+        errExit("recvfd");
+    ring = mmap(NULL, NUM_SLOTS * size, PROT_READ, MAP_SHARED, mfd, 0);
+    if (ring == MAP_FAILED)
+        errExit("mmap");
+
+    for (long j = 0; j < n; j++)
+    {
+        if (readn(fd[0], &slot, sizeof(slot)) != sizeof(slot))
+            errExit("read slot");
+        consume(ring + slot * size, size);
+        if (j + NUM_SLOTS < n) /* Return the slot to the sender */
+            if (write(fd[0], &slot, sizeof(slot)) != sizeof(slot))
+                errExit("write credit");
+    }
+}
+
+/* ---------- Driver ---------- */
+
+struct mechanism
+{
+    const char *name;
+    size_t (*maxSize)(void); /* NULL == unlimited */
+    void (*setup)(size_t size);
+    void (*sender)(size_t size, long n);
+    void (*receiver)(size_t size, long n);
+    void (*cleanup)(void);
+};
+
+static size_t
+udgramMax(void)
+{
+    return 65536;
+}
+
+static size_t
+pmsgMax(void)
+{
+    return procLimit("/proc/sys/fs/mqueue/msgsize_max", 8192);
+}
+
+static size_t
+svmsgMax(void)
+{
+    return procLimit("/proc/sys/kernel/msgmax", 8192);
+}
+
+static const struct mechanism mechs[] = {
+    {"pipe", NULL, pipeSetup, streamSend, streamRecv, closeBoth},
+    {"fifo", NULL, fifoSetup, fifoSend, fifoRecv, fifoCleanup},
+    {"ustream", NULL, ustreamSetup, streamSend, streamRecv, closeBoth},
+    {"udgram", udgramMax, udgramSetup, dgramSend, dgramRecv, closeBoth},
+    {"tcp", NULL, tcpSetup, tcpSend, tcpRecv, tcpCleanup},
+    {"pmsg", pmsgMax, pmsgSetup, pmsgSend, pmsgRecv, pmsgCleanup},
+    {"svmsg", svmsgMax, svmsgSetup, svmsgSend, svmsgRecv, svmsgCleanup},
+    {"svshm", NULL, svshmSetup, svshmSend, svshmRecv, svshmCleanup},
+    {"vmsplice", NULL, pipeSetup, vmspliceSend, streamRecv, closeBoth},
+    {"memfd", NULL, ustreamSetup, memfdSend, memfdRecv, closeBoth},
+};
+
+#define NUM_MECHS (sizeof(mechs) / sizeof(mechs[0]))
+
+static double
+cpuSecs(const struct rusage *ru)
+{
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6 +
+           ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+}
+
+static void
+runOne(const struct mechanism *m, size_t size, long long totalBytes,
+       LatFormat fmt)
+{
+    struct rusage before, after;
+    long long start, elapsed;
+    double secs, bytes, cpu;
+    long n;
+
+    n = totalBytes / size;
+    if (n == 0)
+        n = 1;
+
+    m->setup(size);
+    fflush(stdout); /* Don't duplicate buffered output in children */
+
+    if (getrusage(RUSAGE_CHILDREN, &before) == -1)
+        errExit("getrusage");
+    start = latNowNs();
+
+    switch (fork())
+    {
+    case -1:
+        errExit("fork");
+    case 0:
+        m->sender(size, n);
+        _exit(EXIT_SUCCESS);
+    default:
+        break;
+    }
+
+    switch (fork())
+    {
+    case -1:
+        errExit("fork");
+    case 0:
+        m->receiver(size, n);
+        _exit(EXIT_SUCCESS);
+    default:
+        break;
+    }
+
+    for (int j = 0; j < 2; j++)
+        if (wait(NULL) == -1)
+            errExit("wait");
+
+    elapsed = latNowNs() - start;
+    if (getrusage(RUSAGE_CHILDREN, &after) == -1)
+        errExit("getrusage");
+
+    m->cleanup();
+
+    secs = elapsed / 1e9;
+    bytes = (double)n * size;
+    cpu = cpuSecs(&after) - cpuSecs(&before);
+
+    switch (fmt)
+    {
+    case LAT_FMT_TEXT:
+        printf("%-9s %8zu %9ld %10.1f %12.0f %10.3f\n", m->name, size, n,
+               bytes / secs / 1e6, n / secs, cpu * 1e9 / bytes);
+        break;
+    case LAT_FMT_CSV:
+        printf("%s,%zu,%ld,%.1f,%.0f,%.3f\n", m->name, size, n,
+               bytes / secs / 1e6, n / secs, cpu * 1e9 / bytes);
+        break;
+    case LAT_FMT_JSON:
+        printf("{\"mechanism\": \"%s\", \"msg_size\": %zu, \"messages\": %ld, "
+               "\"MB_per_s\": %.1f, \"msgs_per_s\": %.0f, "
+               "\"cpu_ns_per_byte\": %.3f}\n", m->name, size, n,
+               bytes / secs / 1e6, n / secs, cpu * 1e9 / bytes);
+        break;
+    }
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -b bytes   Total bytes per test (default: 67108864)\n");
+    fprintf(stderr, "    -s list    Comma-separated message sizes "
+                    "(default: 64,512,4096,32768,262144)\n");
+    fprintf(stderr, "    -p list    Comma-separated mechanisms (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_MECHS; j++)
+        fprintf(stderr, " %s", mechs[j].name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sizeList, *mechList;
+    long long totalBytes;
+    char *copy, *tok, *save;
+    LatFormat fmt;
+    size_t size;
+    int opt;
+
+    totalBytes = 64 * 1024 * 1024;
+    sizeList = "64,512,4096,32768,262144";
+    mechList = NULL;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "b:s:p:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            totalBytes = getLong(optarg, GN_GT_0 | GN_ANY_BASE, "bytes");
+            break;
+        case 's':
+            sizeList = optarg;
+            break;
+        case 'p':
+            mechList = optarg;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    if (fmt == LAT_FMT_TEXT)
+        printf("%-9s %8s %9s %10s %12s %10s\n", "mechanism", "size",
+               "messages", "MB/s", "msgs/s", "cpu-ns/B");
+    else if (fmt == LAT_FMT_CSV)
+        printf("mechanism,msg_size,messages,MB_per_s,msgs_per_s,"
+               "cpu_ns_per_byte\n");
+
+    for (size_t j = 0; j < NUM_MECHS; j++)
+    {
+        if (mechList != NULL && !latInList(mechList, mechs[j].name))
+            continue;
+
+        copy = strdup(sizeList);
+        if (copy == NULL)
+            errExit("strdup");
+        for (tok = strtok_r(copy, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save))
+        {
+            size = getLong(tok, GN_GT_0 | GN_ANY_BASE, "size");
+            if (mechs[j].maxSize != NULL && size > mechs[j].maxSize())
+                continue;
+            runOne(&mechs[j], size, totalBytes, fmt);
+        }
+        free(copy);
+    }
+
+    exit(EXIT_SUCCESS);
+}
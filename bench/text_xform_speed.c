@@ -0,0 +1,193 @@
+/* text_xform_speed.c
+
+   Measure the speed of each implementation of the text transformations
+   in lib/text_xform.c (as used by pipes/change_case.c and the
+   sockets/ud_ucase_sv.c and i6d_ucase_sv.c servers) across a range of
+   buffer sizes.
+
+   Usage as shown in usageError().
+
+   For each implementation that the CPU supports, each operation, and
+   each buffer size, the program repeatedly transforms the same buffer
+   until 'total' bytes have been processed, and reports the throughput
+   in bytes per cycle and in MB/s. Small buffers show the fixed cost of
+   a call (and of handling the tail that doesn't fill a whole vector);
+   large ones show the cost of streaming through the caches.
+
+   On x86, cycles are counted with RDTSC, which ticks at a constant
+   reference rate that may differ from the core's actual clock rate;
+   pin the program to one CPU (-c) and fix its frequency for the most
+   stable results. Elsewhere, only MB/s is reported.
+
+   Before timing, each implementation's output is checked against the
+   scalar implementation's.
+*/
+#include "text_xform.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+static const char *implNames[] = {"avx2", "sse2", "scalar"};
+static const char *opNames[] = {"upper", "lower", "ascii-byte"};
+static const size_t bufSizes[] = {
+    16, 64, 100, 256, 1024, 4096, 16384, 65536, 262144, 1048576
+};
+
+#define NUM_ELEMS(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Fill 'buf' with a mixture of lowercase, uppercase, punctuation, and
+   non-ASCII bytes */
+
+static void
+fillBuf(char *buf, size_t len)
+{
+    static const char sample[] = "The Quick Brown Fox, 42 jumps \xc3\xa9t\xc3\xa9!\n";
+
+    for (size_t j = 0; j < len; j++)
+        buf[j] = sample[j % (sizeof(sample) - 1)];
+}
+
+/* Check that implementation 'name' agrees with the scalar one */
+
+static void
+checkImpl(const char *name, char *buf, char *ref, size_t len)
+{
+    for (TxOp op = TX_UPPER; op <= TX_ASCII_BYTES; op++)
+    {
+        for (size_t n = 0; n <= len; n += (n < 100) ? 1 : 997)
+        {
+            fillBuf(buf, n);
+            fillBuf(ref, n);
+
+            if (txSetImpl("scalar") == -1)
+                errExit("txSetImpl scalar");
+            txTransform(op, ref, n);
+            if (txSetImpl(name) == -1)
+                errExit("txSetImpl %s", name);
+            txTransform(op, buf, n);
+
+            if (memcmp(buf, ref, n) != 0)
+                fatal("%s: %s gives wrong result for length %ld",
+                      name, opNames[op], (long)n);
+        }
+    }
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n bytes   Bytes to process per measurement "
+                    "(default: 268435456)\n");
+    fprintf(stderr, "    -i impl    Only test 'impl' (avx2, sse2, or "
+                    "scalar)\n");
+    fprintf(stderr, "    -c cpu     Pin to CPU 'cpu'\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    long long total, reps, t0, ns;
+    const char *only;
+    char *buf, *ref;
+    int opt, cpu;
+    size_t maxSize;
+#ifdef HAVE_RDTSC
+    unsigned long long c0, cycles;
+#endif
+
+    total = 1LL << 28;
+    only = NULL;
+    cpu = -1;
+    while ((opt = getopt(argc, argv, "n:i:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            total = getLong(optarg, GN_GT_0 | GN_ANY_BASE, "bytes");
+            break;
+        case 'i':
+            only = optarg;
+            break;
+        case 'c':
+            cpu = getInt(optarg, GN_NONNEG, "cpu");
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    if (latPinCpu(cpu) == -1)
+        errExit("latPinCpu");
+
+    maxSize = bufSizes[NUM_ELEMS(bufSizes) - 1];
+    buf = malloc(maxSize);
+    ref = malloc(maxSize);
+    if (buf == NULL || ref == NULL)
+        errExit("malloc");
+
+    printf("Default implementation: %s\n\n", txImplName());
+    printf("%-7s %-6s %9s %12s %10s\n", "impl", "op", "size",
+#ifdef HAVE_RDTSC
+           "bytes/cycle",
+#else
+           "",
+#endif
+           "MB/s");
+
+    for (size_t i = 0; i < NUM_ELEMS(implNames); i++)
+    {
+        if (only != NULL && strcmp(only, implNames[i]) != 0)
+            continue;
+        if (txSetImpl(implNames[i]) == -1)
+        {
+            if (errno != ENOTSUP)
+                errExit("txSetImpl %s", implNames[i]);
+            printf("%-7s (not supported on this CPU)\n", implNames[i]);
+            continue;
+        }
+
+        checkImpl(implNames[i], buf, ref, 4096);
+
+        for (TxOp op = TX_UPPER; op <= TX_ASCII_BYTES; op++)
+        {
+            for (size_t s = 0; s < NUM_ELEMS(bufSizes); s++)
+            {
+                fillBuf(buf, bufSizes[s]);
+                reps = total / bufSizes[s];
+
+                t0 = latNowNs();
+#ifdef HAVE_RDTSC
+                c0 = __rdtsc();
+#endif
+                for (long long r = 0; r < reps; r++)
+                {
+                    txTransform(op, buf, bufSizes[s]);
+                    __asm__ __volatile__("" : : "r"(buf) : "memory");
+                }
+#ifdef HAVE_RDTSC
+                cycles = __rdtsc() - c0;
+#endif
+                ns = latNowNs() - t0;
+
+                printf("%-7s %-6s %9ld ", implNames[i], opNames[op],
+                       (long)bufSizes[s]);
+#ifdef HAVE_RDTSC
+                printf("%12.2f ", (double)reps * bufSizes[s] / cycles);
+#else
+                printf("%12s ", "-");
+#endif
+                printf("%10.1f\n", (double)reps * bufSizes[s] * 1e3 / ns);
+            }
+        }
+    }
+
+    exit(EXIT_SUCCESS);
+}
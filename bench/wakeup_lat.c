@@ -0,0 +1,676 @@
+/* wakeup_lat.c
+
+   Measure the round-trip wakeup latency of each of the synchronization
+   mechanisms demonstrated elsewhere in this tree, using the same
+   ping-pong protocol for all of them.
+
+   Usage as shown in usageError().
+
+   Two parties (two threads, or a parent and child process) pass a token
+   back and forth over a pair of one-way channels built from the
+   mechanism under test. Party 0 timestamps each round trip with
+   CLOCK_MONOTONIC; the distribution of these times is then reported.
+   The mechanisms are:
+
+        svsem     System V semaphores (cf. svsem/)
+        psem      POSIX unnamed semaphores (cf. psem/)
+        condvar   Mutex plus condition variable (cf. threads/prod_condvar.c)
+        signal    SIGUSR1 plus sigsuspend() (cf. signals/sig_speed_sigsuspend.c)
+        pipe      One-byte writes to a pipe (cf. pipes/)
+        mqueue    POSIX message queues (cf. pmsg/)
+        futex     Raw futex(2) wait/wake on a flag word
+        eventfd   eventfd(2) counters
+
+   Every channel remembers a post that arrives before the corresponding
+   wait (a semaphore count, a pending signal, unread data, a set flag),
+   so the two parties never need any further handshaking.
+
+   For example, to compare all mechanisms across processes, with the
+   parties pinned to different CPUs, producing CSV:
+
+        $ ./wakeup_lat -m process -c 0,1 -o csv
+*/
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/sem.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <semaphore.h>
+#include <mqueue.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include "semun.h" /* Definition of semun union */
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+/* Channel 0 carries the "ping" from party 0 to party 1; channel 1
+   carries the "pong" back. The party that waits on channel 'ch' is
+   therefore party (1 - ch). */
+
+struct shared
+{ /* Lives in MAP_SHARED memory, so it is usable across fork() */
+    sem_t psem[2];
+    pthread_mutex_t mtx[2];
+    pthread_cond_t cond[2];
+    int flag[2];          /* Protected by 'mtx' */
+    int futexWord[2];     /* 1 == posted */
+    pid_t pid[2];         /* PID of each party (process mode) */
+    pthread_t thread[2];  /* Thread ID of each party (thread mode) */
+};
+
+static struct shared *sh;
+static int semId;
+static int pfd[2][2];
+static int efd[2];
+static mqd_t mqd[2];
+static sigset_t suspendMask;
+static int useThreads;
+
+static long numIters, numWarmup;
+static int cpu[2] = {-1, -1};
+
+/* ---------- System V semaphores ---------- */
+
+static void
+svsemSetup(void)
+{
+    union semun arg;
+
+    semId = semget(IPC_PRIVATE, 2, S_IRUSR | S_IWUSR);
+    if (semId == -1)
+        errExit("semget");
+    arg.val = 0;
+    for (int j = 0; j < 2; j++)
+        if (semctl(semId, j, SETVAL, arg) == -1)
+            errExit("semctl-SETVAL");
+}
+
+static void
+svsemOp(int ch, int op)
+{
+    struct sembuf sop;
+
+    sop.sem_num = ch;
+    sop.sem_op = op;
+    sop.sem_flg = 0;
+    while (semop(semId, &sop, 1) == -1)
+        if (errno != EINTR)
+            errExit("semop");
+}
+
+static void svsemPost(int ch) { svsemOp(ch, 1); }
+static void svsemWait(int ch) { svsemOp(ch, -1); }
+
+static void
+svsemCleanup(void)
+{
+    union semun dummy;
+
+    if (semctl(semId, 0, IPC_RMID, dummy) == -1)
+        errExit("semctl-IPC_RMID");
+}
+
+/* ---------- POSIX unnamed semaphores ---------- */
+
+static void
+psemSetup(void)
+{
+    for (int j = 0; j < 2; j++)
+        if (sem_init(&sh->psem[j], 1, 0) == -1)
+            errExit("sem_init");
+}
+
+static void
+psemPost(int ch)
+{
+    if (sem_post(&sh->psem[ch]) == -1)
+        errExit("sem_post");
+}
+
+static void
+psemWait(int ch)
+{
+    while (sem_wait(&sh->psem[ch]) == -1)
+        if (errno != EINTR)
+            errExit("sem_wait");
+}
+
+static void
+psemCleanup(void)
+{
+    for (int j = 0; j < 2; j++)
+        if (sem_destroy(&sh->psem[j]) == -1)
+            errExit("sem_destroy");
+}
+
+/* ---------- Mutex plus condition variable ---------- */
+
+static void
+condvarSetup(void)
+{
+    pthread_mutexattr_t mattr;
+    pthread_condattr_t cattr;
+    int s;
+
+    s = pthread_mutexattr_init(&mattr);
+    if (s != 0)
+        errExitEN(s, "pthread_mutexattr_init");
+    s = pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    if (s != 0)
+        errExitEN(s, "pthread_mutexattr_setpshared");
+    s = pthread_condattr_init(&cattr);
+    if (s != 0)
+        errExitEN(s, "pthread_condattr_init");
+    s = pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    if (s != 0)
+        errExitEN(s, "pthread_condattr_setpshared");
+
+    for (int j = 0; j < 2; j++)
+    {
+        s = pthread_mutex_init(&sh->mtx[j], &mattr);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_init");
+        s = pthread_cond_init(&sh->cond[j], &cattr);
+        if (s != 0)
+            errExitEN(s, "pthread_cond_init");
+        sh->flag[j] = 0;
+    }
+
+    pthread_mutexattr_destroy(&mattr);
+    pthread_condattr_destroy(&cattr);
+}
+
+static void
+condvarPost(int ch)
+{
+    int s;
+
+    s = pthread_mutex_lock(&sh->mtx[ch]);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+    sh->flag[ch] = 1;
+    s = pthread_mutex_unlock(&sh->mtx[ch]);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+    s = pthread_cond_signal(&sh->cond[ch]);
+    if (s != 0)
+        errExitEN(s, "pthread_cond_signal");
+}
+
+static void
+condvarWait(int ch)
+{
+    int s;
+
+    s = pthread_mutex_lock(&sh->mtx[ch]);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+    while (sh->flag[ch] == 0)
+    {
+        s = pthread_cond_wait(&sh->cond[ch], &sh->mtx[ch]);
+        if (s != 0)
+            errExitEN(s, "pthread_cond_wait");
+    }
+    sh->flag[ch] = 0;
+    s = pthread_mutex_unlock(&sh->mtx[ch]);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+}
+
+static void
+condvarCleanup(void)
+{
+    for (int j = 0; j < 2; j++)
+    {
+        pthread_mutex_destroy(&sh->mtx[j]);
+        pthread_cond_destroy(&sh->cond[j]);
+    }
+}
+
+/* ---------- Signals ---------- */
+
+static void
+handler(int sig)
+{
+    /* Nothing: we just need sigsuspend() to return */
+}
+
+static void
+signalSetup(void)
+{
+    struct sigaction sa;
+    sigset_t blockMask;
+
+    /* SIGUSR1 stays blocked except inside sigsuspend(), so that a
+       signal sent before the peer is waiting simply stays pending.
+       The mask is inherited by the thread or child created later. */
+
+    sigemptyset(&blockMask);
+    sigaddset(&blockMask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &blockMask, &suspendMask) == -1)
+        errExit("sigprocmask");
+    sigdelset(&suspendMask, SIGUSR1);
+
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sa.sa_handler = handler;
+    if (sigaction(SIGUSR1, &sa, NULL) == -1)
+        errExit("sigaction");
+}
+
+static void
+signalPost(int ch)
+{
+    int s;
+
+    if (useThreads)
+    {
+        s = pthread_kill(sh->thread[1 - ch], SIGUSR1);
+        if (s != 0)
+            errExitEN(s, "pthread_kill");
+    }
+    else
+    {
+        if (kill(sh->pid[1 - ch], SIGUSR1) == -1)
+            errExit("kill");
+    }
+}
+
+static void
+signalWait(int ch)
+{
+    if (sigsuspend(&suspendMask) == -1 && errno != EINTR)
+        errExit("sigsuspend");
+}
+
+static void
+signalCleanup(void)
+{
+    sigset_t blockMask;
+
+    sigemptyset(&blockMask);
+    sigaddset(&blockMask, SIGUSR1);
+    if (sigprocmask(SIG_UNBLOCK, &blockMask, NULL) == -1)
+        errExit("sigprocmask");
+}
+
+/* ---------- Pipes ---------- */
+
+static void
+pipeSetup(void)
+{
+    for (int j = 0; j < 2; j++)
+        if (pipe(pfd[j]) == -1)
+            errExit("pipe");
+}
+
+static void
+pipePost(int ch)
+{
+    if (write(pfd[ch][1], "x", 1) != 1)
+        errExit("write");
+}
+
+static void
+pipeWait(int ch)
+{
+    char c;
+
+    if (read(pfd[ch][0], &c, 1) != 1)
+        errExit("read");
+}
+
+static void
+pipeCleanup(void)
+{
+    for (int j = 0; j < 2; j++)
+    {
+        close(pfd[j][0]);
+        close(pfd[j][1]);
+    }
+}
+
+/* ---------- POSIX message queues ---------- */
+
+#define MQ_MSG_SIZE 8
+
+static void
+mqueueSetup(void)
+{
+    struct mq_attr attr;
+    char name[64];
+
+    attr.mq_maxmsg = 1;
+    attr.mq_msgsize = MQ_MSG_SIZE;
+
+    /* The queues are unlinked at once; the open descriptors survive,
+       and are inherited across fork() */
+
+    for (int j = 0; j < 2; j++)
+    {
+        snprintf(name, sizeof(name), "/wakeup_lat.%ld.%d", (long)getpid(), j);
+        mqd[j] = mq_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR,
+                         &attr);
+        if (mqd[j] == (mqd_t)-1)
+            errExit("mq_open");
+        if (mq_unlink(name) == -1)
+            errExit("mq_unlink");
+    }
+}
+
+static void
+mqueuePost(int ch)
+{
+    if (mq_send(mqd[ch], "x", 1, 0) == -1)
+        errExit("mq_send");
+}
+
+static void
+mqueueWait(int ch)
+{
+    char buf[MQ_MSG_SIZE];
+
+    if (mq_receive(mqd[ch], buf, MQ_MSG_SIZE, NULL) == -1)
+        errExit("mq_receive");
+}
+
+static void
+mqueueCleanup(void)
+{
+    for (int j = 0; j < 2; j++)
+        mq_close(mqd[j]);
+}
+
+/* ---------- Futexes ---------- */
+
+/* We use the non-private futex operations, since the flag words may be
+   shared between processes */
+
+static void
+futexSetup(void)
+{
+    sh->futexWord[0] = sh->futexWord[1] = 0;
+}
+
+static void
+futexPost(int ch)
+{
+    __atomic_store_n(&sh->futexWord[ch], 1, __ATOMIC_RELEASE);
+    if (syscall(SYS_futex, &sh->futexWord[ch], FUTEX_WAKE, 1,
+                NULL, NULL, 0) == -1)
+        errExit("futex-FUTEX_WAKE");
+}
+
+static void
+futexWait(int ch)
+{
+    /* Consume the post if there is one; otherwise sleep while the
+       word is still 0 (the kernel rechecks this atomically) */
+
+    while (__atomic_exchange_n(&sh->futexWord[ch], 0, __ATOMIC_ACQUIRE) == 0)
+        if (syscall(SYS_futex, &sh->futexWord[ch], FUTEX_WAIT, 0,
+                    NULL, NULL, 0) == -1 &&
+            errno != EAGAIN && errno != EINTR)
+            errExit("futex-FUTEX_WAIT");
+}
+
+static void
+futexCleanup(void)
+{
+}
+
+/* ---------- eventfd ---------- */
+
+static void
+eventfdSetup(void)
+{
+    for (int j = 0; j < 2; j++)
+    {
+        efd[j] = eventfd(0, 0);
+        if (efd[j] == -1)
+            errExit("eventfd");
+    }
+}
+
+static void
+eventfdPost(int ch)
+{
+    uint64_t one = 1;
+
+    if (write(efd[ch], &one, sizeof(one)) != sizeof(one))
+        errExit("write");
+}
+
+static void
+eventfdWait(int ch)
+{
+    uint64_t val;
+
+    if (read(efd[ch], &val, sizeof(val)) != sizeof(val))
+        errExit("read");
+}
+
+static void
+eventfdCleanup(void)
+{
+    close(efd[0]);
+    close(efd[1]);
+}
+
+/* ---------- Driver ---------- */
+
+struct primitive
+{
+    const char *name;
+    void (*setup)(void);
+    void (*post)(int ch);
+    void (*wait)(int ch);
+    void (*cleanup)(void);
+};
+
+static const struct primitive prims[] = {
+    {"svsem", svsemSetup, svsemPost, svsemWait, svsemCleanup},
+    {"psem", psemSetup, psemPost, psemWait, psemCleanup},
+    {"condvar", condvarSetup, condvarPost, condvarWait, condvarCleanup},
+    {"signal", signalSetup, signalPost, signalWait, signalCleanup},
+    {"pipe", pipeSetup, pipePost, pipeWait, pipeCleanup},
+    {"mqueue", mqueueSetup, mqueuePost, mqueueWait, mqueueCleanup},
+    {"futex", futexSetup, futexPost, futexWait, futexCleanup},
+    {"eventfd", eventfdSetup, eventfdPost, eventfdWait, eventfdCleanup},
+};
+
+#define NUM_PRIMS (sizeof(prims) / sizeof(prims[0]))
+
+static const struct primitive *curr;
+
+/* Party 1: echo every ping back as a pong */
+
+static void *
+responder(void *arg)
+{
+    if (latPinCpu(cpu[1]) == -1)
+        errExit("latPinCpu");
+
+    for (long j = 0; j < numWarmup + numIters; j++)
+    {
+        curr->wait(0);
+        curr->post(1);
+    }
+    return NULL;
+}
+
+/* Party 0: time each round trip, recording it in 'samples' */
+
+static void
+initiator(long *samples)
+{
+    long long t0;
+
+    if (latPinCpu(cpu[0]) == -1)
+        errExit("latPinCpu");
+
+    for (long j = 0; j < numWarmup + numIters; j++)
+    {
+        t0 = latNowNs();
+        curr->post(0);
+        curr->wait(1);
+        if (j >= numWarmup)
+            samples[j - numWarmup] = latNowNs() - t0;
+    }
+}
+
+static void
+runOne(const struct primitive *p, int threads, long *samples,
+       LatFormat fmt)
+{
+    struct latSummary sum;
+    char values[64];
+    pthread_t t;
+    pid_t child;
+    int s;
+
+    curr = p;
+    useThreads = threads;
+    p->setup();
+
+    if (threads)
+    {
+        sh->thread[0] = pthread_self();
+        s = pthread_create(&sh->thread[1], NULL, responder, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+        t = sh->thread[1];
+
+        initiator(samples);
+
+        s = pthread_join(t, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+    else
+    {
+        sh->pid[0] = getpid();
+        child = fork();
+        switch (child)
+        {
+        case -1:
+            errExit("fork");
+        case 0:
+            responder(NULL);
+            _exit(EXIT_SUCCESS);
+        default:
+            break;
+        }
+        sh->pid[1] = child;
+
+        initiator(samples);
+
+        if (waitpid(child, NULL, 0) == -1)
+            errExit("waitpid");
+    }
+
+    p->cleanup();
+
+    latSummarize(samples, numIters, &sum);
+    snprintf(values, sizeof(values), "%s,%s", p->name,
+             threads ? "thread" : "process");
+    latPrintRow(fmt, "primitive,mode", values, &sum);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n num     Round trips measured (default: 100000)\n");
+    fprintf(stderr, "    -w num     Untimed warm-up round trips "
+                    "(default: 1000)\n");
+    fprintf(stderr, "    -p list    Comma-separated mechanisms (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_PRIMS; j++)
+        fprintf(stderr, " %s", prims[j].name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -m mode    'thread', 'process', or 'both' "
+                    "(default)\n");
+    fprintf(stderr, "    -c c0,c1   Pin party 0 to CPU c0 and party 1 to "
+                    "CPU c1\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, doThreads, doProcs;
+    const char *primList;
+    LatFormat fmt;
+    long *samples;
+
+    numIters = 100000;
+    numWarmup = 1000;
+    primList = NULL;
+    doThreads = doProcs = 1;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "n:w:p:m:c:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            numIters = getLong(optarg, GN_GT_0, "num");
+            break;
+        case 'w':
+            numWarmup = getLong(optarg, GN_NONNEG, "num");
+            break;
+        case 'p':
+            primList = optarg;
+            break;
+        case 'm':
+            doThreads = strcmp(optarg, "process") != 0;
+            doProcs = strcmp(optarg, "thread") != 0;
+            if (!doThreads && !doProcs)
+                usageError(argv[0]);
+            break;
+        case 'c':
+            if (sscanf(optarg, "%d,%d", &cpu[0], &cpu[1]) != 2)
+                usageError(argv[0]);
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    sh = mmap(NULL, sizeof(struct shared), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED)
+        errExit("mmap");
+
+    samples = calloc(numIters, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    latPrintHeader(fmt, "primitive,mode");
+
+    for (size_t j = 0; j < NUM_PRIMS; j++)
+    {
+        if (primList != NULL && !latInList(primList, prims[j].name))
+            continue;               /* This mechanism wasn't requested */
+
+        if (doThreads)
+            runOne(&prims[j], 1, samples, fmt);
+        if (doProcs)
+            runOne(&prims[j], 0, samples, fmt);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,288 @@
+/* epoch_reclaim.c
+
+   Implement the epoch-based reclamation declared in epoch_reclaim.h.
+
+   The domain has a global epoch counter, which each grace period
+   advances. Each reader slot, on its own cache line, holds the epoch
+   that its thread saw on entering its current critical section, or 0
+   if the thread is not in one. A grace period advances the epoch and
+   then waits until no slot holds an epoch older than the new one.
+
+   For this to work, a reader's store to its slot must become visible
+   before it loads the protected pointer; that ordering (store followed
+   by load) needs a full memory barrier. Where the kernel supports it,
+   we instead have the thread that waits for a grace period call
+   membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED), which makes every
+   running thread in the process execute a full barrier. The reader then
+   needs only a compiler barrier, and the expensive part is moved to the
+   (rare) writer. With the EBR_FENCE flag, or on older kernels, readers
+   execute a fence instead.
+*/
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "epoch_reclaim.h" /* Declares functions defined here */
+
+#define CACHE_LINE 64
+#define RECLAIM_BATCH 64 /* ebrRetire() reclaims when this many pending */
+
+struct ebrSlot
+{
+    unsigned long epoch; /* Epoch at ebrEnter(), or 0 if not reading */
+    int inUse;           /* Slot allocated by ebrRegister()? */
+} __attribute__((aligned(CACHE_LINE)));
+
+struct ebrRetired /* A retired object awaiting a grace period */
+{
+    struct ebrRetired *next;
+    void *ptr;
+    EbrFreeFunc freeFunc;
+};
+
+struct ebrDomain
+{
+    int maxThreads;
+    int useMembarrier;
+    struct ebrSlot *slots;
+
+    unsigned long epoch __attribute__((aligned(CACHE_LINE)));
+
+    pthread_mutex_t mtx __attribute__((aligned(CACHE_LINE)));
+                                 /* Protects the following */
+    struct ebrRetired *retired;
+    int numRetired;
+};
+
+/* Create a domain for up to 'maxThreads' reader threads. Returns NULL
+   on error. */
+
+EbrDomain *
+ebrCreate(int maxThreads, int flags)
+{
+    EbrDomain *d;
+    int s;
+
+    if (maxThreads < 1)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    d = aligned_alloc(CACHE_LINE, sizeof(EbrDomain));
+    if (d == NULL)
+        return NULL;
+    memset(d, 0, sizeof(EbrDomain));
+
+    d->slots = aligned_alloc(CACHE_LINE, maxThreads * sizeof(struct ebrSlot));
+    if (d->slots == NULL)
+    {
+        free(d);
+        return NULL;
+    }
+    memset(d->slots, 0, maxThreads * sizeof(struct ebrSlot));
+
+    s = pthread_mutex_init(&d->mtx, NULL);
+    if (s != 0)
+    {
+        free(d->slots);
+        free(d);
+        errno = s;
+        return NULL;
+    }
+
+    d->maxThreads = maxThreads;
+    d->epoch = 1;
+
+    /* Registration is per process, and harmless to repeat */
+
+    d->useMembarrier = 0;
+#ifdef SYS_membarrier
+    if (!(flags & EBR_FENCE))
+        d->useMembarrier = syscall(SYS_membarrier,
+                    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#endif
+
+    return d;
+}
+
+/* Allocate a reader slot for the calling thread. Returns the slot
+   number, or -1 (with errno set to EAGAIN) if all are in use. */
+
+int
+ebrRegister(EbrDomain *d)
+{
+    int expected;
+
+    for (int j = 0; j < d->maxThreads; j++)
+    {
+        expected = 0;
+        if (__atomic_compare_exchange_n(&d->slots[j].inUse, &expected, 1,
+                                        0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED))
+            return j;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+void
+ebrUnregister(EbrDomain *d, int slot)
+{
+    __atomic_store_n(&d->slots[slot].epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&d->slots[slot].inUse, 0, __ATOMIC_RELEASE);
+}
+
+/* Enter a read-side critical section */
+
+void
+ebrEnter(EbrDomain *d, int slot)
+{
+    /* The epoch must be loaded with acquire semantics. If the reader
+       sees an epoch advanced by ebrSynchronize(), which then accepts
+       this slot as being past the grace period, the reader must also see
+       every pointer update made before that advance; otherwise, on a
+       weakly ordered CPU, it could load a pointer to an object that is
+       about to be freed. (The membarrier() in ebrSynchronize() comes
+       after the advance, so it doesn't provide this ordering.) */
+
+    __atomic_store_n(&d->slots[slot].epoch,
+                     __atomic_load_n(&d->epoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELAXED);
+
+    /* Order the store above before the caller's loads of protected
+       data (see the comment at the top of this file) */
+
+    if (d->useMembarrier)
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    else
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* Leave a read-side critical section. The release store orders the
+   caller's reads of protected data before the slot is seen to be
+   clear. */
+
+void
+ebrLeave(EbrDomain *d, int slot)
+{
+    __atomic_store_n(&d->slots[slot].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Wait for a grace period: on return, every reader that was in a
+   critical section at the time of the call has left it */
+
+void
+ebrSynchronize(EbrDomain *d)
+{
+    unsigned long target, e;
+    int spins;
+
+    target = __atomic_add_fetch(&d->epoch, 1, __ATOMIC_SEQ_CST);
+
+    if (d->useMembarrier)
+        syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+    else
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for (int j = 0; j < d->maxThreads; j++)
+    {
+        spins = 0;
+        for (;;)
+        {
+            e = __atomic_load_n(&d->slots[j].epoch, __ATOMIC_ACQUIRE);
+            if (e == 0 || e >= target)
+                break;
+            if (++spins % 100 == 0)
+                sched_yield();
+        }
+    }
+}
+
+/* Free all objects retired before this call, after waiting for a grace
+   period. Returns the number of objects freed. */
+
+int
+ebrReclaim(EbrDomain *d)
+{
+    struct ebrRetired *list, *next;
+    int n;
+
+    pthread_mutex_lock(&d->mtx);
+    list = d->retired;
+    d->retired = NULL;
+    d->numRetired = 0;
+    pthread_mutex_unlock(&d->mtx);
+
+    if (list == NULL)
+        return 0;
+
+    ebrSynchronize(d);
+
+    for (n = 0; list != NULL; list = next, n++)
+    {
+        next = list->next;
+        list->freeFunc(list->ptr);
+        free(list);
+    }
+    return n;
+}
+
+/* Arrange for 'freeFunc(ptr)' to be called once no reader can still be
+   using 'ptr'. Once enough objects are pending, the caller waits for a
+   grace period and frees them. Returns 0 on success, or -1 on error. */
+
+int
+ebrRetire(EbrDomain *d, void *ptr, EbrFreeFunc freeFunc)
+{
+    struct ebrRetired *r;
+    int n;
+
+    r = malloc(sizeof(struct ebrRetired));
+    if (r == NULL)
+        return -1;
+    r->ptr = ptr;
+    r->freeFunc = freeFunc;
+
+    pthread_mutex_lock(&d->mtx);
+    r->next = d->retired;
+    d->retired = r;
+    n = ++d->numRetired;
+    pthread_mutex_unlock(&d->mtx);
+
+    if (n >= RECLAIM_BATCH)
+        ebrReclaim(d);
+    return 0;
+}
+
+int
+ebrUsesMembarrier(EbrDomain *d)
+{
+    return d->useMembarrier;
+}
+
+/* Free the domain, and any objects still awaiting reclamation. The
+   caller must ensure that no thread is still reading. */
+
+void
+ebrFree(EbrDomain *d)
+{
+    struct ebrRetired *next;
+
+    for (; d->retired != NULL; d->retired = next)
+    {
+        next = d->retired->next;
+        d->retired->freeFunc(d->retired->ptr);
+        free(d->retired);
+    }
+
+    pthread_mutex_destroy(&d->mtx);
+    free(d->slots);
+    free(d);
+}
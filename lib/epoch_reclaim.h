@@ -0,0 +1,50 @@
+/* epoch_reclaim.h
+
+   Header file for epoch_reclaim.c.
+
+   Epoch-based reclamation, a userspace form of RCU (read-copy-update)
+   for read-mostly data reached through a pointer. Readers bracket their
+   use of the data with ebrEnter() and ebrLeave(); neither writes to
+   memory shared with other threads, so readers on different CPUs don't
+   contend. A writer copies the data, modifies the copy, publishes it by
+   atomically swapping the pointer, and hands the old version to
+   ebrRetire(). The old version is freed only once a grace period has
+   passed: that is, once every reader that might have fetched the old
+   pointer has left its critical section.
+
+   Each thread that reads must first register with the domain, obtaining
+   a slot number that it passes to ebrEnter() and ebrLeave(). Critical
+   sections may not be nested, and a thread must not wait for a grace
+   period (ebrRetire(), ebrReclaim(), or ebrSynchronize()) while inside
+   one.
+*/
+#ifndef EPOCH_RECLAIM_H
+#define EPOCH_RECLAIM_H /* Prevent accidental double inclusion */
+
+#define EBR_FENCE 01 /* ebrCreate() flag: don't use membarrier(2) */
+
+typedef void (*EbrFreeFunc)(void *ptr);
+
+typedef struct ebrDomain EbrDomain; /* Opaque */
+
+EbrDomain *ebrCreate(int maxThreads, int flags);
+
+int ebrRegister(EbrDomain *d);
+
+void ebrUnregister(EbrDomain *d, int slot);
+
+void ebrEnter(EbrDomain *d, int slot);
+
+void ebrLeave(EbrDomain *d, int slot);
+
+void ebrSynchronize(EbrDomain *d);
+
+int ebrRetire(EbrDomain *d, void *ptr, EbrFreeFunc freeFunc);
+
+int ebrReclaim(EbrDomain *d);
+
+int ebrUsesMembarrier(EbrDomain *d);
+
+void ebrFree(EbrDomain *d);
+
+#endif
@@ -0,0 +1,286 @@
+/* io_deadline.c
+
+   Implement the deadline-aware I/O functions declared in io_deadline.h.
+
+   Each function tries its operation, and if that fails with EAGAIN (or,
+   for a blocking descriptor, before each attempt), waits in ppoll() for
+   the descriptor to become ready, with a timeout computed afresh from
+   the deadline each time. So an EINTR from ppoll() just causes another
+   wait, for the time remaining, and a deadline that has passed is
+   noticed before the next wait.
+*/
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include "io_deadline.h" /* Declares functions defined here */
+
+static long long
+nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Return the deadline 'timeoutNs' nanoseconds from now */
+
+long long
+ioDeadline(long long timeoutNs)
+{
+    return nowNs() + timeoutNs;
+}
+
+/* Wait until 'fd' is ready for 'events' (or has an error condition,
+   which the caller's next operation will report). Returns 0 when it is,
+   or -1 with errno set to ETIMEDOUT if 'deadline' passes first. Even if
+   the deadline has already passed, the descriptor is checked once, so
+   that an operation that need not wait still succeeds. */
+
+static int
+waitFd(int fd, short events, long long deadline)
+{
+    struct pollfd pfd;
+    struct timespec ts;
+    long long remaining;
+    int ready;
+
+    pfd.fd = fd;
+    pfd.events = events;
+
+    for (;;)
+    {
+        if (deadline != IO_NO_DEADLINE)
+        {
+            remaining = deadline - nowNs();
+            if (remaining < 0)
+                remaining = 0;
+            ts.tv_sec = remaining / 1000000000;
+            ts.tv_nsec = remaining % 1000000000;
+        }
+
+        ready = ppoll(&pfd, 1, (deadline != IO_NO_DEADLINE) ? &ts : NULL,
+                      NULL);
+        if (ready > 0)
+            return 0;
+        if (ready == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+/* Return 1 if 'fd' is nonblocking, 0 if it is blocking, or -1 on error */
+
+static int
+isNonblocking(int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+    if (flags == -1)
+        return -1;
+    return (flags & O_NONBLOCK) != 0;
+}
+
+/* Like read(), but fail with ETIMEDOUT if no input arrives by
+   'deadline' */
+
+ssize_t
+readDeadline(int fd, void *buf, size_t len, long long deadline)
+{
+    ssize_t numRead;
+    int nonblock;
+
+    nonblock = isNonblocking(fd);
+    if (nonblock == -1)
+        return -1;
+
+    for (;;)
+    {
+        if (!nonblock && waitFd(fd, POLLIN, deadline) == -1)
+            return -1;
+
+        numRead = read(fd, buf, len);
+        if (numRead != -1)
+            return numRead;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            if (waitFd(fd, POLLIN, deadline) == -1)
+                return -1;
+        }
+        else if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+/* Return value of readnDeadline() and writenDeadline() after an error,
+   when 'done' bytes have been transferred: the count, if the error was
+   a timeout and the count is nonzero, otherwise -1 */
+
+static ssize_t
+partialCount(size_t done)
+{
+    return (errno == ETIMEDOUT && done > 0) ? (ssize_t)done : -1;
+}
+
+/* Like readn(), but stop if 'len' bytes (or end-of-file) have not been
+   read by 'deadline'. If no bytes had been read, returns -1 with errno
+   set to ETIMEDOUT; otherwise, returns the (short) count of bytes read,
+   with errno set to ETIMEDOUT. A short count because of end-of-file
+   leaves errno set to 0. */
+
+ssize_t
+readnDeadline(int fd, void *buffer, size_t len, long long deadline)
+{
+    ssize_t numRead;
+    size_t totRead;
+    char *buf;
+
+    buf = buffer;
+    for (totRead = 0; totRead < len;)
+    {
+        numRead = readDeadline(fd, buf, len - totRead, deadline);
+        if (numRead == 0)   /* EOF */
+        {
+            errno = 0;
+            return totRead;
+        }
+        if (numRead == -1)
+            return partialCount(totRead);
+        totRead += numRead;
+        buf += numRead;
+    }
+    return totRead;
+}
+
+/* Like writen(), but stop if 'len' bytes have not been written by
+   'deadline'. If no bytes had been written, returns -1 with errno set to
+   ETIMEDOUT; otherwise, returns the (short) count of bytes written, with
+   errno set to ETIMEDOUT, so that the caller knows where the stream
+   stands. */
+
+ssize_t
+writenDeadline(int fd, const void *buffer, size_t len, long long deadline)
+{
+    ssize_t numWritten;
+    size_t totWritten;
+    const char *buf;
+    int nonblock;
+
+    nonblock = isNonblocking(fd);
+    if (nonblock == -1)
+        return -1;
+
+    buf = buffer;
+    for (totWritten = 0; totWritten < len;)
+    {
+        if (!nonblock && waitFd(fd, POLLOUT, deadline) == -1)
+            return partialCount(totWritten);
+
+        numWritten = write(fd, buf, len - totWritten);
+        if (numWritten <= 0)
+        {
+            if (numWritten == -1 && errno == EINTR)
+                continue;
+            if (numWritten == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                if (waitFd(fd, POLLOUT, deadline) == -1)
+                    return partialCount(totWritten);
+                continue;
+            }
+            return -1;
+        }
+        totWritten += numWritten;
+        buf += numWritten;
+    }
+    return totWritten;
+}
+
+/* Like connect(), but fail with ETIMEDOUT if the connection has not
+   been established by 'deadline'. After a failure, the state of the
+   socket is unspecified, and it should be closed. */
+
+int
+connectDeadline(int sfd, const struct sockaddr *addr, socklen_t addrlen,
+                long long deadline)
+{
+    socklen_t optlen;
+    int flags, s, err, savedErrno;
+
+    flags = fcntl(sfd, F_GETFL);
+    if (flags == -1)
+        return -1;
+    if (!(flags & O_NONBLOCK) && fcntl(sfd, F_SETFL, flags | O_NONBLOCK) == -1)
+        return -1;
+
+    s = connect(sfd, addr, addrlen);
+    if (s == -1 && (errno == EINPROGRESS || errno == EINTR))
+    {
+        /* The connection completes in the background; when the socket
+           becomes writable, SO_ERROR says how it went */
+
+        s = waitFd(sfd, POLLOUT, deadline);
+        if (s == 0)
+        {
+            optlen = sizeof(err);
+            s = getsockopt(sfd, SOL_SOCKET, SO_ERROR, &err, &optlen);
+            if (s == 0 && err != 0)
+            {
+                errno = err;
+                s = -1;
+            }
+        }
+    }
+
+    savedErrno = errno;
+    if (!(flags & O_NONBLOCK) && fcntl(sfd, F_SETFL, flags) == -1 && s == 0)
+        return -1;
+    errno = savedErrno;
+    return s;
+}
+
+/* Like accept(), but fail with ETIMEDOUT if no connection arrives by
+   'deadline' */
+
+int
+acceptDeadline(int lfd, struct sockaddr *addr, socklen_t *addrlen,
+               long long deadline)
+{
+    int cfd, nonblock;
+
+    nonblock = isNonblocking(lfd);
+    if (nonblock == -1)
+        return -1;
+
+    for (;;)
+    {
+        if (!nonblock && waitFd(lfd, POLLIN, deadline) == -1)
+            return -1;
+
+        cfd = accept(lfd, addr, addrlen);
+        if (cfd != -1)
+            return cfd;
+
+        /* ECONNABORTED means a connection went away before we accepted
+           it; there may be others */
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)
+        {
+            if (nonblock && waitFd(lfd, POLLIN, deadline) == -1)
+                return -1;
+        }
+        else if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
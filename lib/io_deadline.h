@@ -0,0 +1,58 @@
+/* io_deadline.h
+
+   Header file for io_deadline.c.
+
+   I/O functions that give up when an absolute deadline on the
+   CLOCK_MONOTONIC clock passes, failing with the error ETIMEDOUT:
+
+        readDeadline()      like read()
+        readnDeadline()     like readn() (see rdwrn.c)
+        writenDeadline()    like writen()
+        connectDeadline()   like connect()
+        acceptDeadline()    like accept()
+
+   Each takes the same arguments as the function it is like, plus the
+   deadline, in nanoseconds (as returned by ioDeadline(), which converts
+   a timeout to a deadline), or IO_NO_DEADLINE to wait indefinitely.
+   Because the deadline is absolute, a caller that performs several
+   operations within one overall time limit can pass the same deadline
+   to each of them. If the deadline passes after readnDeadline() or
+   writenDeadline() has transferred some bytes, it returns the short
+   count (with errno set to ETIMEDOUT) rather than -1, so that the caller
+   knows where the stream stands.
+
+   The functions wait with ppoll(), rather than interrupting a blocking
+   call with a signal, as timers/timed_read.c does with alarm(). They
+   keep no state beyond their arguments, and use no signals, so any
+   number of threads may use them at once. They work best with
+   nonblocking file descriptors; with a blocking one, they wait for the
+   descriptor to become ready before each call, so the call normally
+   doesn't block, but may do so if the readiness was spurious (or was
+   consumed by another thread). A deadline that has already passed still
+   allows an operation that can complete without waiting.
+   connectDeadline() makes the socket nonblocking while it connects.
+*/
+#ifndef IO_DEADLINE_H
+#define IO_DEADLINE_H /* Prevent accidental double inclusion */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define IO_NO_DEADLINE 0LL
+
+long long ioDeadline(long long timeoutNs);
+
+ssize_t readDeadline(int fd, void *buf, size_t len, long long deadline);
+
+ssize_t readnDeadline(int fd, void *buf, size_t len, long long deadline);
+
+ssize_t writenDeadline(int fd, const void *buf, size_t len,
+                       long long deadline);
+
+int connectDeadline(int sfd, const struct sockaddr *addr, socklen_t addrlen,
+                    long long deadline);
+
+int acceptDeadline(int lfd, struct sockaddr *addr, socklen_t *addrlen,
+                   long long deadline);
+
+#endif
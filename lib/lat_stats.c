@@ -0,0 +1,210 @@
+/* lat_stats.c
+
+   Implement the benchmark helpers declared in lat_stats.h.
+*/
+#define _GNU_SOURCE /* For sched_setaffinity() and CPU_SET() */
+#include <sched.h>
+#include <time.h>
+#include <ctype.h>
+#include "lat_stats.h" /* Declares functions defined here */
+#include "tlpi_hdr.h"
+
+/* Return the value of CLOCK_MONOTONIC in nanoseconds */
+
+long long
+latNowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Restrict the calling thread to 'cpu'. A negative 'cpu' means "don't
+   pin", and is not an error. Returns 0 on success, or -1 on error. */
+
+int latPinCpu(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+/* Convert "text", "csv", or "json" to a LatFormat. Returns 0 on
+   success, or -1 if 'str' is not recognized. */
+
+int latParseFormat(const char *str, LatFormat *fmt)
+{
+    if (strcmp(str, "text") == 0)
+        *fmt = LAT_FMT_TEXT;
+    else if (strcmp(str, "csv") == 0)
+        *fmt = LAT_FMT_CSV;
+    else if (strcmp(str, "json") == 0)
+        *fmt = LAT_FMT_JSON;
+    else
+        return -1;
+    return 0;
+}
+
+/* Return 1 if 'name' is one of the items in the comma-separated 'list'
+   (such as the argument of a benchmark's option that selects which
+   cases to run), otherwise 0 */
+
+int latInList(const char *list, const char *name)
+{
+    char *copy, *tok, *save;
+    int found;
+
+    copy = strdup(list);
+    if (copy == NULL)
+        errExit("strdup");
+    found = 0;
+    for (tok = strtok_r(copy, ",", &save); tok != NULL && !found;
+         tok = strtok_r(NULL, ",", &save))
+        found = strcmp(tok, name) == 0;
+    free(copy);
+    return found;
+}
+
+static int
+cmpLong(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Return the sample at percentile 'pct' of the sorted array 'v' */
+
+static long
+percentile(const long *v, size_t n, double pct)
+{
+    size_t idx;
+
+    idx = (size_t)(pct / 100.0 * n);
+    return v[(idx >= n) ? n - 1 : idx];
+}
+
+/* Sort 'samples' in place and summarize them in 'sum' */
+
+void latSummarize(long *samples, size_t n, struct latSummary *sum)
+{
+    double total;
+
+    memset(sum, 0, sizeof(*sum));
+    if (n == 0)
+        return;
+
+    qsort(samples, n, sizeof(long), cmpLong);
+
+    total = 0;
+    for (size_t j = 0; j < n; j++)
+        total += samples[j];
+
+    sum->count = n;
+    sum->min = samples[0];
+    sum->max = samples[n - 1];
+    sum->mean = total / n;
+    sum->p50 = percentile(samples, n, 50);
+    sum->p90 = percentile(samples, n, 90);
+    sum->p99 = percentile(samples, n, 99);
+    sum->p999 = percentile(samples, n, 99.9);
+}
+
+/* 'labels' is a comma-separated list of names for the leading columns
+   of each row; the corresponding values are given to latPrintRow() as
+   a comma-separated list in the same order. */
+
+void latPrintHeader(LatFormat fmt, const char *labels)
+{
+    char buf[256];
+    char *tok, *save;
+
+    switch (fmt)
+    {
+    case LAT_FMT_CSV:
+        printf("%s,count,min_ns,mean_ns,p50_ns,p90_ns,p99_ns,p99.9_ns,"
+               "max_ns\n", labels);
+        break;
+
+    case LAT_FMT_TEXT:
+        snprintf(buf, sizeof(buf), "%s", labels);
+        for (tok = strtok_r(buf, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save))
+            printf("%-10s ", tok);
+        printf("%9s %9s %10s %9s %9s %9s %9s %10s\n", "count", "min",
+               "mean", "p50", "p90", "p99", "p99.9", "max");
+        break;
+
+    case LAT_FMT_JSON: /* Each row is self-describing */
+        break;
+    }
+    fflush(stdout);
+}
+
+/* Return 1 if the label value 'tok' can be written in a JSON row as a
+   number: strtod() must consume all of it, and it must use only the
+   characters of a JSON number (which rules out "inf", "nan", and hex) */
+
+static int
+isJsonNumber(const char *tok)
+{
+    char *end;
+
+    if (*tok != '-' && !isdigit((unsigned char)*tok))
+        return 0;
+    if (tok[strspn(tok, "0123456789+-.eE")] != '\0')
+        return 0;
+    strtod(tok, &end);
+    return *end == '\0';
+}
+
+void latPrintRow(LatFormat fmt, const char *labels, const char *values,
+                 const struct latSummary *sum)
+{
+    char lbuf[256], vbuf[256];
+    char *ltok, *vtok, *lsave, *vsave;
+
+    switch (fmt)
+    {
+    case LAT_FMT_CSV:
+        printf("%s,%zu,%ld,%.1f,%ld,%ld,%ld,%ld,%ld\n", values, sum->count,
+               sum->min, sum->mean, sum->p50, sum->p90, sum->p99,
+               sum->p999, sum->max);
+        break;
+
+    case LAT_FMT_TEXT:
+        snprintf(vbuf, sizeof(vbuf), "%s", values);
+        for (vtok = strtok_r(vbuf, ",", &vsave); vtok != NULL;
+             vtok = strtok_r(NULL, ",", &vsave))
+            printf("%-10s ", vtok);
+        printf("%9zu %9ld %10.1f %9ld %9ld %9ld %9ld %10ld\n", sum->count,
+               sum->min, sum->mean, sum->p50, sum->p90, sum->p99,
+               sum->p999, sum->max);
+        break;
+
+    case LAT_FMT_JSON:
+        snprintf(lbuf, sizeof(lbuf), "%s", labels);
+        snprintf(vbuf, sizeof(vbuf), "%s", values);
+        printf("{");
+        for (ltok = strtok_r(lbuf, ",", &lsave),
+            vtok = strtok_r(vbuf, ",", &vsave);
+             ltok != NULL && vtok != NULL;
+             ltok = strtok_r(NULL, ",", &lsave),
+            vtok = strtok_r(NULL, ",", &vsave))
+            printf(isJsonNumber(vtok) ? "\"%s\": %s, " : "\"%s\": \"%s\", ",
+                   ltok, vtok);
+        printf("\"count\": %zu, \"min_ns\": %ld, \"mean_ns\": %.1f, "
+               "\"p50_ns\": %ld, \"p90_ns\": %ld, \"p99_ns\": %ld, "
+               "\"p99.9_ns\": %ld, \"max_ns\": %ld}\n",
+               sum->count, sum->min, sum->mean, sum->p50, sum->p90,
+               sum->p99, sum->p999, sum->max);
+        break;
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,50 @@
+/* lat_stats.h
+
+   Header file for lat_stats.c.
+
+   Helpers shared by the benchmark programs: a monotonic nanosecond
+   clock, optional CPU pinning, reduction of an array of latency samples
+   to percentiles, matching of comma-separated option lists, and
+   printing of results as plain text, CSV, or JSON (one object per
+   line).
+*/
+#ifndef LAT_STATS_H
+#define LAT_STATS_H /* Prevent accidental double inclusion */
+
+#include <stddef.h>
+
+typedef enum
+{
+    LAT_FMT_TEXT,
+    LAT_FMT_CSV,
+    LAT_FMT_JSON
+} LatFormat;
+
+struct latSummary
+{                  /* All values in nanoseconds */
+    size_t count;  /* Number of samples */
+    long min;
+    long max;
+    double mean;
+    long p50;
+    long p90;
+    long p99;
+    long p999;     /* 99.9th percentile */
+};
+
+long long latNowNs(void);
+
+int latPinCpu(int cpu);
+
+int latParseFormat(const char *str, LatFormat *fmt);
+
+int latInList(const char *list, const char *name);
+
+void latSummarize(long *samples, size_t n, struct latSummary *sum);
+
+void latPrintHeader(LatFormat fmt, const char *labels);
+
+void latPrintRow(LatFormat fmt, const char *labels, const char *values,
+                 const struct latSummary *sum);
+
+#endif
@@ -0,0 +1,296 @@
+/* mpmc_ring.c
+
+   Implement the bounded multi-producer, multi-consumer ring declared in
+   mpmc_ring.h.
+
+   This is Dmitry Vyukov's bounded MPMC queue, extended to move batches.
+   Each cell carries a sequence number saying what the cell is waiting
+   for. Cell (pos & mask) is free for the producer that claims position
+   'pos' when its sequence number is 'pos', and holds an item for the
+   consumer that claims 'pos' when its sequence number is 'pos + 1'.
+   Having claimed a position by advancing 'enqPos' (or 'deqPos') with a
+   compare-and-swap, a thread owns the cell until it publishes the new
+   sequence number, so cells never need locking. To claim a batch, a
+   thread counts how many consecutive cells from 'pos' are ready, and
+   then advances the position by that many.
+
+   Sleeping uses an "event count": before sleeping, a consumer reads
+   'wakeSeq', registers itself in 'waiters', and checks the ring once
+   more; it then sleeps with FUTEX_WAIT, which returns at once if
+   'wakeSeq' has changed in the meantime. A producer, after publishing
+   items, checks 'waiters', and if there is a sleeper that no other
+   producer is already waking, it claims that sleeper (in the same
+   compare-and-swap that checks), increments 'wakeSeq', and calls
+   FUTEX_WAKE. A consumer returning from FUTEX_WAIT gives up one claim
+   along with its registration. Keeping both counts in one word means
+   that a producer never sees a claim without the sleeper it belongs to,
+   so it can't skip a sleeper that nobody is waking. The sequentially
+   consistent operations on 'waiters' (in the consumer) and the fence
+   (in the producer) ensure that either the producer sees the sleeper,
+   or the sleeper sees the items.
+*/
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "mpmc_ring.h" /* Declares functions defined here */
+
+#define SPINS_BEFORE_SLEEP 100 /* Empty checks before a consumer sleeps */
+
+#define SLEEPER (1ULL << 32)    /* One consumer in 'waiters' */
+#define SLEEPERS(w) ((w) >> 32)
+#define WAKES(w) ((w) & 0xffffffffULL)
+
+static long
+futex(unsigned int *uaddr, int op, unsigned int val)
+{
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+/* Create a ring that holds up to 'capacity' items, which must be a power
+   of 2. Returns NULL on error. */
+
+MpmcRing *
+mrCreate(size_t capacity)
+{
+    MpmcRing *r;
+
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    r = aligned_alloc(MR_CACHE_LINE, sizeof(MpmcRing));
+    if (r == NULL)
+        return NULL;
+    memset(r, 0, sizeof(MpmcRing));
+
+    r->cells = malloc(capacity * sizeof(struct mrCell));
+    if (r->cells == NULL)
+    {
+        free(r);
+        return NULL;
+    }
+
+    for (size_t j = 0; j < capacity; j++)
+        r->cells[j].seq = j;
+    r->mask = capacity - 1;
+    return r;
+}
+
+/* Advance '*posVar' (enqPos or deqPos) over up to 'n' consecutive cells
+   whose sequence numbers are 'target' more than their positions (0 for
+   free cells, 1 for full ones). Returns the number of cells claimed,
+   with the first one's position in '*posp'; or 0 if the ring is full (or
+   empty). */
+
+static size_t
+claim(MpmcRing *r, size_t *posVar, size_t n, size_t target, size_t *posp)
+{
+    size_t pos, k, seq;
+
+    pos = __atomic_load_n(posVar, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        for (k = 0; k < n; k++)
+        {
+            seq = __atomic_load_n(&r->cells[(pos + k) & r->mask].seq,
+                                  __ATOMIC_ACQUIRE);
+            if (seq != pos + k + target)
+                break;
+        }
+
+        if (k == 0)
+        {
+            /* If the first cell is behind, the ring is full (for
+               producers) or empty (for consumers); if it is ahead,
+               another thread claimed 'pos' first, so reload */
+
+            seq = __atomic_load_n(&r->cells[pos & r->mask].seq,
+                                  __ATOMIC_ACQUIRE);
+            if ((long)(seq - (pos + target)) < 0)
+                return 0;
+            pos = __atomic_load_n(posVar, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* On failure, 'pos' is updated to the current value */
+
+        if (__atomic_compare_exchange_n(posVar, &pos, pos + k, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            *posp = pos;
+            return k;
+        }
+    }
+}
+
+/* Wake sleeping consumers that aren't already being woken, if there
+   are any. 'all' says whether to wake all of them, or just one. */
+
+static void
+wakeConsumers(MpmcRing *r, int all)
+{
+    unsigned long long w, nw;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    w = __atomic_load_n(&r->waiters, __ATOMIC_RELAXED);
+    do
+    {
+        if (SLEEPERS(w) <= WAKES(w))
+            return;                     /* None, or all being woken */
+        nw = all ? SLEEPERS(w) * SLEEPER + SLEEPERS(w) : w + 1;
+    } while (!__atomic_compare_exchange_n(&r->waiters, &w, nw, 1,
+                                          __ATOMIC_SEQ_CST,
+                                          __ATOMIC_RELAXED));
+
+    __atomic_fetch_add(&r->wakeSeq, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&r->numWakes, 1, __ATOMIC_RELAXED);
+    futex(&r->wakeSeq, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1);
+}
+
+/* Remove a consumer from 'waiters'. If it slept, it also takes away one
+   of the wakes on their way (if any; it may have seen 'wakeSeq' change
+   before a producer's wake arrived). The number of wakes on their way
+   never exceeds the number of sleepers. */
+
+static void
+leaveWaiters(MpmcRing *r, int slept)
+{
+    unsigned long long w, nw, s, k;
+
+    w = __atomic_load_n(&r->waiters, __ATOMIC_RELAXED);
+    do
+    {
+        s = SLEEPERS(w) - 1;
+        k = WAKES(w);
+        if (slept && k > 0)
+            k--;
+        if (k > s)
+            k = s;
+        nw = s * SLEEPER + k;
+    } while (!__atomic_compare_exchange_n(&r->waiters, &w, nw, 1,
+                                          __ATOMIC_SEQ_CST,
+                                          __ATOMIC_RELAXED));
+}
+
+/* Add the 'n' items in 'items' to the ring, waiting (by yielding the
+   CPU) while the ring is full. Returns 'n'. */
+
+size_t
+mrEnqueue(MpmcRing *r, void *const *items, size_t n)
+{
+    size_t done, k, pos;
+
+    for (done = 0; done < n; done += k)
+    {
+        k = claim(r, &r->enqPos, n - done, 0, &pos);
+        if (k == 0)
+        {
+            sched_yield(); /* Full */
+            continue;
+        }
+
+        for (size_t j = 0; j < k; j++)
+        {
+            r->cells[(pos + j) & r->mask].item = items[done + j];
+            __atomic_store_n(&r->cells[(pos + j) & r->mask].seq,
+                             pos + j + 1, __ATOMIC_RELEASE);
+        }
+
+        /* A batch may satisfy several consumers */
+
+        wakeConsumers(r, k > 1);
+    }
+
+    return n;
+}
+
+/* Take up to 'max' items from the ring, placing them in 'items'. Returns
+   the number of items taken, which is 0 if the ring is empty. */
+
+size_t
+mrTryDequeue(MpmcRing *r, void **items, size_t max)
+{
+    size_t k, pos;
+
+    k = claim(r, &r->deqPos, max, 1, &pos);
+
+    for (size_t j = 0; j < k; j++)
+    {
+        items[j] = r->cells[(pos + j) & r->mask].item;
+        __atomic_store_n(&r->cells[(pos + j) & r->mask].seq,
+                         pos + j + r->mask + 1, __ATOMIC_RELEASE);
+    }
+
+    return k;
+}
+
+/* As mrTryDequeue(), but if the ring is empty, wait until it isn't.
+   Returns 0 only if the ring is empty and mrClose() has been called. */
+
+size_t
+mrDequeue(MpmcRing *r, void **items, size_t max)
+{
+    unsigned int seq;
+    size_t k;
+    int slept;
+
+    for (int spins = 0;; spins++)
+    {
+        k = mrTryDequeue(r, items, max);
+        if (k > 0)
+            return k;
+        if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE))
+            return mrTryDequeue(r, items, max); /* Catch late arrivals */
+        if (spins < SPINS_BEFORE_SLEEP)
+            continue;
+
+        seq = __atomic_load_n(&r->wakeSeq, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&r->waiters, SLEEPER, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); /* Pairs with the fence in
+                                                    wakeConsumers() */
+        k = mrTryDequeue(r, items, max);
+        slept = k == 0 && !__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+        if (slept)
+        {
+            __atomic_fetch_add(&r->numSleeps, 1, __ATOMIC_RELAXED);
+            futex(&r->wakeSeq, FUTEX_WAIT_PRIVATE, seq);
+        }
+
+        leaveWaiters(r, slept);
+        if (k > 0)
+            return k;
+        spins = 0;
+    }
+}
+
+/* Mark the ring as closed: consumers drain whatever remains, and then
+   mrDequeue() returns 0 rather than waiting. Call this only once all
+   producers have finished. */
+
+void
+mrClose(MpmcRing *r)
+{
+    __atomic_store_n(&r->closed, 1, __ATOMIC_RELEASE);
+
+    /* Wake everyone, even those already being woken: each wake on its
+       way may be taken by a different consumer */
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&r->wakeSeq, 1, __ATOMIC_SEQ_CST);
+    futex(&r->wakeSeq, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
+
+void
+mrFree(MpmcRing *r)
+{
+    free(r->cells);
+    free(r);
+}
@@ -0,0 +1,73 @@
+/* mpmc_ring.h
+
+   Header file for mpmc_ring.c.
+
+   A bounded, lock-free queue of pointers that any number of threads may
+   add to (produce) and take from (consume) concurrently. The operations
+   are:
+
+        create a ring:              mrCreate(capacity)
+        add items:                  mrEnqueue(r, items, n)
+        take items, if any:         mrTryDequeue(r, items, max)
+        take items, waiting:        mrDequeue(r, items, max)
+        end of input:               mrClose(r)
+        free it:                    mrFree(r)
+
+   Each of these moves up to 'n' (or 'max') items in one go, claiming a
+   run of consecutive slots with a single atomic operation, so moving
+   items in batches costs little more than moving one.
+
+   A consumer that finds the ring empty sleeps on a futex; a producer
+   makes a futex() system call only if some consumer is asleep and not
+   already being woken, so each sleep costs at most one wakeup. A
+   producer that finds the ring full just yields the CPU and tries again.
+*/
+#ifndef MPMC_RING_H
+#define MPMC_RING_H /* Prevent accidental double inclusion */
+
+#include <stddef.h>
+
+#define MR_CACHE_LINE 64
+
+struct mrCell
+{
+    size_t seq; /* Which lap of the ring this cell is ready for */
+    void *item;
+};
+
+typedef struct
+{
+    size_t mask;          /* Capacity - 1; the capacity is a power of 2 */
+    struct mrCell *cells;
+
+    size_t enqPos __attribute__((aligned(MR_CACHE_LINE)));
+    size_t deqPos __attribute__((aligned(MR_CACHE_LINE)));
+
+    /* Used to put consumers to sleep when the ring is empty */
+
+    unsigned int wakeSeq __attribute__((aligned(MR_CACHE_LINE)));
+    unsigned long long waiters; /* Consumers in, or about to be in,
+                                   FUTEX_WAIT (high 32 bits), and wakes
+                                   on their way to them (low 32 bits) */
+    int closed;
+
+    /* Statistics (updated atomically, so approximate only if read while
+       the ring is in use) */
+
+    long numSleeps;       /* Times a consumer went to sleep */
+    long numWakes;        /* FUTEX_WAKE calls made by producers */
+} MpmcRing;
+
+MpmcRing *mrCreate(size_t capacity);
+
+size_t mrEnqueue(MpmcRing *r, void *const *items, size_t n);
+
+size_t mrTryDequeue(MpmcRing *r, void **items, size_t max);
+
+size_t mrDequeue(MpmcRing *r, void **items, size_t max);
+
+void mrClose(MpmcRing *r);
+
+void mrFree(MpmcRing *r);
+
+#endif
@@ -0,0 +1,111 @@
+/* notifier.c
+
+   Implement the notifier declared in notifier.h.
+
+   'count' records the notifications not yet consumed. ntNotify()
+   increments it, and writes to the descriptor only if it was zero;
+   ntConsume() first empties the descriptor, and then takes (and zeroes)
+   the count. In that order, a notification that arrives between the two
+   steps is counted now, and also leaves the descriptor readable, which
+   later gives a wakeup for which ntConsume() returns 0; the other order
+   could leave a notification counted but the descriptor not readable,
+   so that the program is never woken for it.
+
+   The atomic operations on 'count' are lock-free, and so may be used
+   in a signal handler.
+*/
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include "notifier.h" /* Declares functions defined here */
+
+/* Initialize 'nt'. Returns 0 on success, or -1 on error. */
+
+int
+ntInit(Notifier *nt, int flags)
+{
+    int pfd[2];
+
+    nt->count = 0;
+
+    if (flags & NT_PIPE)
+    {
+        if (pipe2(pfd, O_NONBLOCK | O_CLOEXEC) == -1)
+            return -1;
+        nt->fd = pfd[0];
+        nt->wfd = pfd[1];
+    }
+    else
+    {
+        nt->fd = nt->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (nt->fd == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/* Make the notifier's descriptor readable. Returns 1 if this call wrote
+   to the descriptor, 0 if an earlier notification that has not yet been
+   consumed already did, or -1 on error (in which case errno is,
+   unusually, not meaningful: it is restored to the caller's value). */
+
+int
+ntNotify(Notifier *nt)
+{
+    uint64_t one = 1;
+    int savedErrno, s;
+
+    if (__atomic_fetch_add(&nt->count, 1, __ATOMIC_SEQ_CST) != 0)
+        return 0; /* Already readable, or about to be */
+
+    savedErrno = errno;
+    s = (nt->fd == nt->wfd) ? write(nt->wfd, &one, sizeof(one)) :
+                              write(nt->wfd, "x", 1);
+
+    /* EAGAIN means a full pipe (or counter), which is still readable */
+
+    s = (s == -1 && errno != EAGAIN) ? -1 : 1;
+    errno = savedErrno;
+    return s;
+}
+
+/* Consume the pending notifications. Returns the number of calls to
+   ntNotify() since the last call (which may be 0, if the caller was
+   woken by a notification that an earlier call already counted), or
+   -1 on error. */
+
+long
+ntConsume(Notifier *nt)
+{
+    uint64_t value;
+    char buf[64];
+
+    if (nt->fd == nt->wfd)
+    {
+        if (read(nt->fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+            return -1;
+    }
+    else
+    {
+        /* Normally there is just one byte, but reading in bulk copes
+           with a burst that overlaps a consume */
+
+        while (read(nt->fd, buf, sizeof(buf)) > 0)
+            continue;
+        if (errno != EAGAIN)
+            return -1;
+    }
+
+    return __atomic_exchange_n(&nt->count, 0, __ATOMIC_SEQ_CST);
+}
+
+void
+ntClose(Notifier *nt)
+{
+    close(nt->fd);
+    if (nt->wfd != nt->fd)
+        close(nt->wfd);
+}
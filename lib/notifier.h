@@ -0,0 +1,41 @@
+/* notifier.h
+
+   Header file for notifier.c.
+
+   A notifier is a file descriptor that becomes readable when
+   ntNotify() is called, so that a program blocked in select(), poll(),
+   or epoll_wait() can be woken by a signal handler or another thread
+   (cf. the self-pipe trick in altio/self_pipe.c). Any number of calls
+   to ntNotify() before the program calls ntConsume() are coalesced into
+   one wakeup: only the first of them makes a system call, and
+   ntConsume() reads the descriptor once, rather than draining a byte per
+   notification.
+
+   ntNotify() is async-signal-safe, and preserves errno.
+
+   The descriptor is an eventfd or, with the NT_PIPE flag, the read end
+   of a pipe. Where the notifications come from signals, and the signals
+   can be blocked, a signalfd (see signalfd(2)) avoids the need for a
+   handler at all.
+*/
+#ifndef NOTIFIER_H
+#define NOTIFIER_H /* Prevent accidental double inclusion */
+
+#define NT_PIPE 01 /* ntInit() flag: use a pipe rather than an eventfd */
+
+typedef struct
+{
+    int fd;      /* Monitor this for input; readable when notified */
+    int wfd;     /* Written by ntNotify(); same as 'fd' for an eventfd */
+    long count;  /* Notifications not yet consumed */
+} Notifier;
+
+int ntInit(Notifier *nt, int flags);
+
+int ntNotify(Notifier *nt);
+
+long ntConsume(Notifier *nt);
+
+void ntClose(Notifier *nt);
+
+#endif
@@ -0,0 +1,376 @@
+/* pipeline.c
+
+   Implement the process pipeline functions declared in pipeline.h.
+
+   All pipes are created with pipe2(O_CLOEXEC), so that they vanish from
+   a program stage when it execs. Program stages additionally close every
+   descriptor above 2 with close_range(2) (where available) just before
+   the exec, so that they don't inherit whatever else the caller had
+   open. In-process stages can't use O_CLOEXEC to shed the other stages'
+   pipe ends, so they close them explicitly; otherwise a stage could
+   hold open the write end of its own input pipe and never see EOF.
+*/
+#define _GNU_SOURCE /* For pipe2(), splice(), tee(), F_SETPIPE_SZ */
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include "pipeline.h" /* Declares functions defined here */
+#include "tlpi_hdr.h"
+
+#define SPLICE_CHUNK 65536 /* Bytes requested per splice() or tee() */
+
+/* Create an empty pipeline. If 'pipeSize' is nonzero, each pipe's
+   capacity is set to that value with F_SETPIPE_SZ. Returns NULL on
+   error. */
+
+Pipeline *
+plCreate(int pipeSize)
+{
+    Pipeline *pl;
+
+    pl = calloc(1, sizeof(Pipeline));
+    if (pl == NULL)
+        return NULL;
+
+    pl->inFd = STDIN_FILENO;
+    pl->outFd = STDOUT_FILENO;
+    pl->pipeSize = pipeSize;
+    return pl;
+}
+
+static struct plStage *
+addStage(Pipeline *pl)
+{
+    struct plStage *stages;
+
+    stages = realloc(pl->stages, (pl->numStages + 1) * sizeof(struct plStage));
+    if (stages == NULL)
+        return NULL;
+    pl->stages = stages;
+
+    memset(&stages[pl->numStages], 0, sizeof(struct plStage));
+    return &stages[pl->numStages++];
+}
+
+/* Append a stage that execs the program named in argv[0]. 'argv' is
+   not copied, and must remain valid until plRun() returns. Returns 0
+   on success, or -1 on error. */
+
+int plAddExec(Pipeline *pl, char *const argv[])
+{
+    struct plStage *st;
+
+    st = addStage(pl);
+    if (st == NULL)
+        return -1;
+    st->argv = argv;
+    return 0;
+}
+
+/* Append a stage that calls func(inFd, outFd, arg) in a child process.
+   Returns 0 on success, or -1 on error. */
+
+int plAddFunc(Pipeline *pl, PlFunc func, void *arg)
+{
+    struct plStage *st;
+
+    st = addStage(pl);
+    if (st == NULL)
+        return -1;
+    st->func = func;
+    st->arg = arg;
+    return 0;
+}
+
+/* Close all file descriptors numbered 'lowFd' and above */
+
+static void
+closeFrom(int lowFd)
+{
+    long maxFd;
+
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, lowFd, ~0U, 0) == 0)
+        return;
+#endif
+
+    maxFd = sysconf(_SC_OPEN_MAX);
+    if (maxFd == -1)
+        maxFd = 1024; /* A guess */
+    for (long fd = lowFd; fd < maxFd; fd++)
+        close(fd);
+}
+
+/* Code run in the child for stage 'j'. Does not return. */
+
+static void
+runStage(Pipeline *pl, int j, int (*pfd)[2], int inFd, int outFd)
+{
+    struct plStage *st = &pl->stages[j];
+
+    if (st->argv != NULL)
+    {
+        if (inFd != STDIN_FILENO)
+            if (dup2(inFd, STDIN_FILENO) == -1)
+                errExit("dup2");
+        if (outFd != STDOUT_FILENO)
+            if (dup2(outFd, STDOUT_FILENO) == -1)
+                errExit("dup2");
+
+        closeFrom(STDERR_FILENO + 1);
+
+        execvp(st->argv[0], st->argv);
+        errMsg("execvp %s", st->argv[0]);
+        _exit(127); /* As the shell does for "command not found" */
+    }
+
+    for (int k = 0; k < pl->numStages - 1; k++)
+    {
+        if (pfd[k][0] != inFd)
+            close(pfd[k][0]);
+        if (pfd[k][1] != outFd)
+            close(pfd[k][1]);
+    }
+
+    /* Not exit(): that would flush stdio buffers and run exit handlers
+       that were inherited from the parent, duplicating their effects */
+
+    _exit(st->func(inFd, outFd, st->arg));
+}
+
+/* Run all stages of 'pl' concurrently, and wait for them to finish.
+   Returns 0 if all stages were started and waited for (whatever their
+   exit statuses), or -1 on error. */
+
+int plRun(Pipeline *pl)
+{
+    int (*pfd)[2];
+    int inFd, outFd, s, savedErrno;
+    int numPipes;
+
+    numPipes = pl->numStages - 1;
+    if (numPipes < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pfd = calloc(numPipes + 1, sizeof(pfd[0])); /* +1: avoid calloc(0) */
+    if (pfd == NULL)
+        return -1;
+
+    for (int j = 0; j < numPipes; j++)
+    {
+        if (pipe2(pfd[j], O_CLOEXEC) == -1)
+            goto fail;
+        if (pl->pipeSize > 0 &&
+            fcntl(pfd[j][1], F_SETPIPE_SZ, pl->pipeSize) == -1)
+            goto fail;
+    }
+
+    fflush(NULL); /* Don't let children inherit unflushed stdio output */
+
+    for (int j = 0; j < pl->numStages; j++)
+    {
+        inFd = (j == 0) ? pl->inFd : pfd[j - 1][0];
+        outFd = (j == numPipes) ? pl->outFd : pfd[j][1];
+
+        pl->stages[j].pid = fork();
+        if (pl->stages[j].pid == -1)
+            goto fail; /* Earlier stages will see EOF or EPIPE */
+        if (pl->stages[j].pid == 0)
+            runStage(pl, j, pfd, inFd, outFd);
+    }
+
+    for (int j = 0; j < numPipes; j++)
+    {
+        close(pfd[j][0]);
+        close(pfd[j][1]);
+    }
+    free(pfd);
+
+    for (int j = 0; j < pl->numStages; j++)
+    {
+        while ((s = wait4(pl->stages[j].pid, &pl->stages[j].status, 0,
+                          &pl->stages[j].ru)) == -1 &&
+               errno == EINTR)
+            continue;
+        if (s == -1)
+            return -1;
+    }
+    return 0;
+
+fail:
+    savedErrno = errno;
+    for (int j = 0; j < numPipes; j++)
+    {
+        if (pfd[j][0] > 0)
+            close(pfd[j][0]);
+        if (pfd[j][1] > 0)
+            close(pfd[j][1]);
+    }
+    free(pfd);
+    for (int j = 0; j < pl->numStages; j++)
+        if (pl->stages[j].pid > 0)
+            waitpid(pl->stages[j].pid, &pl->stages[j].status, 0);
+    errno = savedErrno;
+    return -1;
+}
+
+void plFree(Pipeline *pl)
+{
+    free(pl->stages);
+    free(pl);
+}
+
+/* Copy 'inFd' to 'outFd' (and, if 'copyFd' is not -1, to 'copyFd' as
+   well) with read() and write(). Used where splice() or tee() can't be,
+   because the descriptors are not of a suitable type. */
+
+static int
+copyFallback(int inFd, int outFd, int copyFd)
+{
+    char buf[SPLICE_CHUNK];
+    ssize_t numRead;
+
+    while ((numRead = read(inFd, buf, sizeof(buf))) > 0)
+    {
+        if (write(outFd, buf, numRead) != numRead)
+        {
+            errMsg("write");
+            return EXIT_FAILURE;
+        }
+        if (copyFd != -1 && write(copyFd, buf, numRead) != numRead)
+        {
+            errMsg("write");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (numRead == -1)
+    {
+        errMsg("read");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Stage function: pass all input through to the output with splice().
+   At least one of 'inFd' and 'outFd' must be a pipe for splice() to
+   work; otherwise, we fall back to read() and write(). */
+
+int plSpliceCopy(int inFd, int outFd, void *arg)
+{
+    ssize_t n;
+
+    for (;;)
+    {
+        n = splice(inFd, NULL, outFd, NULL, SPLICE_CHUNK, SPLICE_F_MOVE);
+        if (n == 0)
+            return EXIT_SUCCESS;
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EINVAL)
+                return copyFallback(inFd, outFd, -1);
+            errMsg("splice");
+            return EXIT_FAILURE;
+        }
+    }
+}
+
+/* Move the next 'len' bytes of 'inFd', which tee() has already sent to
+   the output, to 'copyFd' with read() and write(). Used when 'copyFd'
+   can't be spliced to (it is, for example, a file opened with
+   O_APPEND). Returns 0 on success, or -1 on error. */
+
+static int
+copyChunk(int inFd, int copyFd, size_t len)
+{
+    char buf[SPLICE_CHUNK];
+    ssize_t numRead, numWritten;
+
+    while (len > 0)
+    {
+        numRead = read(inFd, buf, (len < sizeof(buf)) ? len : sizeof(buf));
+        if (numRead == -1 && errno == EINTR)
+            continue;
+        if (numRead <= 0)
+        {
+            errMsg("plTeeFd: read from input pipe");
+            return -1;
+        }
+        len -= numRead;
+
+        for (char *p = buf; numRead > 0; p += numWritten, numRead -= numWritten)
+        {
+            numWritten = write(copyFd, p, numRead);
+            if (numWritten == -1 && errno == EINTR)
+                numWritten = 0;
+            else if (numWritten <= 0)
+            {
+                errMsg("plTeeFd: write to copy descriptor");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Stage function: pass all input through to the output, like tee(1),
+   while also writing a copy to the file descriptor pointed to by 'arg'.
+   tee() duplicates the data from the input pipe into the output pipe
+   without consuming it; splice() then moves the same data from the input
+   pipe to the copy descriptor (or, if the copy descriptor doesn't
+   support that, read() and write() do). This requires that 'inFd' and
+   'outFd' are both pipes; otherwise, we fall back to read() and write()
+   throughout. */
+
+int plTeeFd(int inFd, int outFd, void *arg)
+{
+    int copyFd = *(int *)arg;
+    int spliceToCopy = 1;
+    ssize_t n, s;
+
+    for (;;)
+    {
+        n = tee(inFd, outFd, SPLICE_CHUNK, 0);
+        if (n == 0)
+            return EXIT_SUCCESS;
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EINVAL)
+                return copyFallback(inFd, outFd, copyFd);
+            errMsg("plTeeFd: tee to output pipe");
+            return EXIT_FAILURE;
+        }
+
+        while (n > 0)
+        { /* Now consume the same bytes from the input pipe */
+            if (!spliceToCopy)
+            {
+                if (copyChunk(inFd, copyFd, n) == -1)
+                    return EXIT_FAILURE;
+                break;
+            }
+
+            s = splice(inFd, NULL, copyFd, NULL, n, SPLICE_F_MOVE);
+            if (s == -1 && errno == EINTR)
+                continue;
+            if (s == -1 && errno == EINVAL)
+            {
+                spliceToCopy = 0;       /* Use copyChunk() from now on */
+                continue;
+            }
+            if (s <= 0)
+            {
+                errMsg("plTeeFd: splice to copy descriptor");
+                return EXIT_FAILURE;
+            }
+            n -= s;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/* pipeline.h
+
+   Header file for pipeline.c.
+
+   Build and run an N-stage process pipeline, in the manner of a shell
+   command such as "ls -l | grep foo | wc -l". The operations are:
+
+        create a pipeline:          plCreate(pipeSize)
+        append a program:           plAddExec(pl, argv)
+        append an in-process stage: plAddFunc(pl, func, arg)
+        run it to completion:       plRun(pl)
+        free it:                    plFree(pl)
+
+   Each stage runs in its own child process. A program stage execs
+   'argv' (searching PATH) with its standard input and output connected
+   to the neighbouring pipes. An in-process stage instead calls
+   func(inFd, outFd, arg) in the child, and uses the function's return
+   value as its exit status (the child ends with _exit(), so a function
+   that writes with stdio must flush its output itself); plSpliceCopy() and plTeeFd() are ready-made
+   stage functions that move data with splice(2) and tee(2), without
+   copying it through user space.
+
+   After plRun(), each stage's 'status' (as returned by waitpid()) and
+   'ru' (its resource usage) are filled in.
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H /* Prevent accidental double inclusion */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+typedef int (*PlFunc)(int inFd, int outFd, void *arg);
+
+struct plStage
+{
+    char *const *argv; /* Program stage: argument vector (NULL otherwise) */
+    PlFunc func;       /* In-process stage: function to call */
+    void *arg;         /* Argument for 'func' */
+    pid_t pid;         /* Filled in by plRun() */
+    int status;        /* Wait status, filled in by plRun() */
+    struct rusage ru;  /* Resource usage, filled in by plRun() */
+};
+
+typedef struct
+{
+    int numStages;
+    struct plStage *stages;
+    int inFd;     /* Input of first stage (default: STDIN_FILENO) */
+    int outFd;    /* Output of last stage (default: STDOUT_FILENO) */
+    int pipeSize; /* Capacity set with F_SETPIPE_SZ; 0 == don't set */
+} Pipeline;
+
+Pipeline *plCreate(int pipeSize);
+
+int plAddExec(Pipeline *pl, char *const argv[]);
+
+int plAddFunc(Pipeline *pl, PlFunc func, void *arg);
+
+int plRun(Pipeline *pl);
+
+void plFree(Pipeline *pl);
+
+int plSpliceCopy(int inFd, int outFd, void *arg);
+
+int plTeeFd(int inFd, int outFd, void *arg);
+
+#endif
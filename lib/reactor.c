@@ -0,0 +1,656 @@
+/* reactor.c
+
+   Implement the event loop declared in reactor.h.
+
+   Callbacks are kept in an array indexed by file descriptor. Each entry
+   also holds a generation number, incremented each time the entry is
+   registered, and a descriptor is given to epoll with its number and
+   generation as the event data. An event left in the current batch for
+   a descriptor that a callback has since removed is skipped, since the
+   entry has been cleared; and so is one for a descriptor that has been
+   closed and its number reused (say, by accept()) and registered again,
+   since the generation no longer matches. The timerfd, signalfd, and
+   eventfd are registered in the same way, with internal callbacks.
+
+   Timers are kept in a binary heap ordered by expiry time (on the
+   CLOCK_MONOTONIC clock), and the timerfd is set, as an absolute time,
+   to the expiry of the timer at the top of the heap. It is reset only
+   when that changes, so adding a timer that doesn't expire first costs
+   no system call.
+*/
+#define _GNU_SOURCE
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "reactor.h" /* Declares functions defined here */
+
+#define MAX_EVENTS 64   /* Events fetched by each epoll_wait() */
+#define MAX_SIGINFO 16  /* Signals fetched by each read() of signalfd */
+
+struct rxHandler
+{
+    RxFdFunc func;      /* NULL if fd not registered */
+    void *arg;
+    unsigned int gen;   /* Incremented by each rxAddFd() */
+};
+
+/* Event data for descriptor 'fd', with generation 'gen' */
+
+#define EV_DATA(fd, gen) (((uint64_t)(gen) << 32) | (unsigned int)(fd))
+#define EV_FD(data) ((int)((data) & 0xffffffff))
+#define EV_GEN(data) ((unsigned int)((data) >> 32))
+
+struct rxTimer
+{
+    long long expiry;     /* CLOCK_MONOTONIC, in nanoseconds */
+    long long interval;   /* 0 for a one-shot timer */
+    RxTimerFunc func;
+    void *arg;
+    int heapIdx;          /* Position in heap, or -1 if timer is free */
+    int nextFree;         /* Next in list of free timers */
+};
+
+struct rxPosted
+{
+    struct rxPosted *next;
+    RxPostFunc func;
+    void *arg;
+};
+
+struct reactor
+{
+    int epfd;
+    int timerFd;
+    int sigFd;            /* -1 until a signal is added */
+    int eventFd;
+    int stop;
+
+    struct rxHandler *handlers; /* Indexed by file descriptor */
+    int numHandlers;
+
+    struct rxTimer *timers;     /* Indexed by timer ID */
+    int numTimers;
+    int freeTimer;              /* Head of free list, or -1 */
+    int *heap;                  /* Timer IDs, earliest expiry first */
+    int heapLen;
+    long long armedNs;          /* Expiry timerfd is set for, or 0 */
+
+    sigset_t sigMask;
+    struct
+    {
+        RxSignalFunc func;
+        void *arg;
+    } sigHandlers[NSIG];
+
+    pthread_mutex_t postMtx;    /* Protects the following */
+    struct rxPosted *postHead, *postTail;
+};
+
+long long
+rxNowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Make sure that the handler array has an entry for 'fd' */
+
+static int
+growHandlers(Reactor *rx, int fd)
+{
+    struct rxHandler *h;
+    int n;
+
+    if (fd < rx->numHandlers)
+        return 0;
+
+    n = (rx->numHandlers == 0) ? 64 : rx->numHandlers;
+    while (n <= fd)
+        n *= 2;
+
+    h = realloc(rx->handlers, n * sizeof(struct rxHandler));
+    if (h == NULL)
+        return -1;
+    memset(h + rx->numHandlers, 0,
+           (n - rx->numHandlers) * sizeof(struct rxHandler));
+
+    rx->handlers = h;
+    rx->numHandlers = n;
+    return 0;
+}
+
+static uint32_t
+epollEvents(uint32_t events, int flags)
+{
+    if (flags & RX_EDGE)
+        events |= EPOLLET;
+    if (flags & RX_EXCLUSIVE)
+        events |= EPOLLEXCLUSIVE;
+    return events;
+}
+
+/* Register 'func' to be called when 'fd' is ready for any of 'events'
+   (EPOLLIN, EPOLLOUT, etc.). Returns 0 on success, or -1 on error. */
+
+int
+rxAddFd(Reactor *rx, int fd, uint32_t events, int flags, RxFdFunc func,
+        void *arg)
+{
+    struct epoll_event ev;
+
+    if (growHandlers(rx, fd) == -1)
+        return -1;
+
+    ev.events = epollEvents(events, flags);
+    ev.data.u64 = EV_DATA(fd, rx->handlers[fd].gen + 1);
+    if (epoll_ctl(rx->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        return -1;
+
+    rx->handlers[fd].gen++;
+    rx->handlers[fd].func = func;
+    rx->handlers[fd].arg = arg;
+    return 0;
+}
+
+/* Change the events for which the callback of 'fd' is called */
+
+int
+rxModFd(Reactor *rx, int fd, uint32_t events, int flags)
+{
+    struct epoll_event ev;
+
+    if (fd >= rx->numHandlers || rx->handlers[fd].func == NULL)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    ev.events = epollEvents(events, flags);
+    ev.data.u64 = EV_DATA(fd, rx->handlers[fd].gen);
+    return epoll_ctl(rx->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/* Stop monitoring 'fd'. This must be done before 'fd' is closed. */
+
+int
+rxRemoveFd(Reactor *rx, int fd)
+{
+    if (fd >= rx->numHandlers || rx->handlers[fd].func == NULL)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    rx->handlers[fd].func = NULL;
+    return epoll_ctl(rx->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/* Timer heap */
+
+static void
+heapSet(Reactor *rx, int idx, int id)
+{
+    rx->heap[idx] = id;
+    rx->timers[id].heapIdx = idx;
+}
+
+static void
+heapUp(Reactor *rx, int idx)
+{
+    int id = rx->heap[idx];
+    int parent;
+
+    while (idx > 0)
+    {
+        parent = (idx - 1) / 2;
+        if (rx->timers[rx->heap[parent]].expiry <= rx->timers[id].expiry)
+            break;
+        heapSet(rx, idx, rx->heap[parent]);
+        idx = parent;
+    }
+    heapSet(rx, idx, id);
+}
+
+static void
+heapDown(Reactor *rx, int idx)
+{
+    int id = rx->heap[idx];
+    int child;
+
+    for (;;)
+    {
+        child = 2 * idx + 1;
+        if (child >= rx->heapLen)
+            break;
+        if (child + 1 < rx->heapLen &&
+                rx->timers[rx->heap[child + 1]].expiry <
+                rx->timers[rx->heap[child]].expiry)
+            child++;
+        if (rx->timers[id].expiry <= rx->timers[rx->heap[child]].expiry)
+            break;
+        heapSet(rx, idx, rx->heap[child]);
+        idx = child;
+    }
+    heapSet(rx, idx, id);
+}
+
+static void
+heapInsert(Reactor *rx, int id)
+{
+    heapSet(rx, rx->heapLen++, id);
+    heapUp(rx, rx->heapLen - 1);
+}
+
+static void
+heapRemove(Reactor *rx, int id)
+{
+    int idx = rx->timers[id].heapIdx;
+    int last = rx->heap[--rx->heapLen];
+
+    if (last != id)
+    {
+        heapSet(rx, idx, last);
+        heapUp(rx, idx);
+        heapDown(rx, rx->timers[last].heapIdx);
+    }
+}
+
+/* Set the timerfd to expire when the earliest timer does (or disarm it,
+   if there are no timers), unless it already is */
+
+static int
+rearm(Reactor *rx)
+{
+    struct itimerspec its;
+    long long next;
+
+    next = (rx->heapLen > 0) ? rx->timers[rx->heap[0]].expiry : 0;
+    if (next == rx->armedNs)
+        return 0;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000000000;
+    its.it_value.tv_nsec = next % 1000000000;
+    if (timerfd_settime(rx->timerFd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+        return -1;
+
+    rx->armedNs = next;
+    return 0;
+}
+
+static void
+freeTimer(Reactor *rx, int id)
+{
+    rx->timers[id].heapIdx = -1;
+    rx->timers[id].nextFree = rx->freeTimer;
+    rx->freeTimer = id;
+}
+
+/* Call 'func' after 'delayNs' nanoseconds and then, if 'intervalNs' is
+   nonzero, every 'intervalNs' nanoseconds. Returns a timer ID, or -1 on
+   error. The ID of a one-shot timer may be reused once the timer has
+   expired or been cancelled. */
+
+int
+rxAddTimer(Reactor *rx, long long delayNs, long long intervalNs,
+           RxTimerFunc func, void *arg)
+{
+    struct rxTimer *t;
+    int *h, n, id;
+
+    if (delayNs < 0 || intervalNs < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (rx->freeTimer == -1) /* Double the size of the timer table */
+    {
+        n = (rx->numTimers == 0) ? 16 : 2 * rx->numTimers;
+        t = realloc(rx->timers, n * sizeof(struct rxTimer));
+        if (t == NULL)
+            return -1;
+        rx->timers = t;
+        h = realloc(rx->heap, n * sizeof(int));
+        if (h == NULL)
+            return -1;
+        rx->heap = h;
+
+        for (id = n - 1; id >= rx->numTimers; id--)
+            freeTimer(rx, id);
+        rx->numTimers = n;
+    }
+
+    id = rx->freeTimer;
+    t = &rx->timers[id];
+    rx->freeTimer = t->nextFree;
+
+    t->expiry = rxNowNs() + delayNs;
+    t->interval = intervalNs;
+    t->func = func;
+    t->arg = arg;
+    heapInsert(rx, id);
+
+    if (rearm(rx) == -1)
+    {
+        heapRemove(rx, id);
+        freeTimer(rx, id);
+        return -1;
+    }
+    return id;
+}
+
+int
+rxCancelTimer(Reactor *rx, int timerId)
+{
+    if (timerId < 0 || timerId >= rx->numTimers ||
+            rx->timers[timerId].heapIdx == -1)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    heapRemove(rx, timerId);
+    freeTimer(rx, timerId);
+    return rearm(rx);
+}
+
+/* Called when the timerfd expires: run the callbacks of all timers that
+   have expired */
+
+static void
+onTimerFd(Reactor *rx, int fd, uint32_t events, void *arg)
+{
+    uint64_t numExp;
+    struct rxTimer *t;
+    long long now;
+    int id;
+
+    if (read(fd, &numExp, sizeof(numExp)) == -1 && errno != EAGAIN)
+        return;
+    rx->armedNs = 0; /* The timerfd has no interval, so it's now disarmed */
+
+    now = rxNowNs();
+    while (rx->heapLen > 0 && rx->timers[rx->heap[0]].expiry <= now)
+    {
+        id = rx->heap[0];
+        t = &rx->timers[id];
+        heapRemove(rx, id);
+
+        /* Reschedule or free the timer before calling back, so that the
+           callback may cancel it or add timers. A periodic timer that
+           has fallen behind skips the intervals it missed. */
+
+        if (t->interval > 0)
+        {
+            t->expiry += t->interval;
+            if (t->expiry <= now)
+                t->expiry = now + t->interval;
+            heapInsert(rx, id);
+        }
+        else
+        {
+            freeTimer(rx, id);
+        }
+
+        t->func(rx, id, t->arg); /* May reallocate 'rx->timers' */
+    }
+
+    rearm(rx);
+}
+
+static void
+onSignalFd(Reactor *rx, int fd, uint32_t events, void *arg)
+{
+    struct signalfd_siginfo si[MAX_SIGINFO];
+    ssize_t numRead;
+    int sig;
+
+    /* Drain all pending signals */
+
+    while ((numRead = read(fd, si, sizeof(si))) > 0)
+    {
+        for (size_t j = 0; j < numRead / sizeof(si[0]); j++)
+        {
+            sig = si[j].ssi_signo;
+            if (sig < NSIG && rx->sigHandlers[sig].func != NULL)
+                rx->sigHandlers[sig].func(rx, &si[j],
+                                          rx->sigHandlers[sig].arg);
+        }
+    }
+}
+
+/* Call 'func' whenever signal 'sig' is delivered to the process. 'sig'
+   is blocked in the calling thread. Returns 0 on success, or -1 on
+   error. */
+
+int
+rxAddSignal(Reactor *rx, int sig, RxSignalFunc func, void *arg)
+{
+    sigset_t set;
+    int fd, s;
+
+    if (sig <= 0 || sig >= NSIG)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    s = pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (s != 0)
+    {
+        errno = s;
+        return -1;
+    }
+
+    sigaddset(&rx->sigMask, sig);
+    fd = signalfd(rx->sigFd, &rx->sigMask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    if (rx->sigFd == -1)
+    {
+        if (rxAddFd(rx, fd, EPOLLIN, 0, onSignalFd, NULL) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+        rx->sigFd = fd;
+    }
+
+    rx->sigHandlers[sig].func = func;
+    rx->sigHandlers[sig].arg = arg;
+    return 0;
+}
+
+static int
+wake(Reactor *rx)
+{
+    uint64_t one = 1;
+
+    return (write(rx->eventFd, &one, sizeof(one)) == -1) ? -1 : 0;
+}
+
+/* Called when the eventfd is signaled: run the posted functions */
+
+static void
+onEventFd(Reactor *rx, int fd, uint32_t events, void *arg)
+{
+    uint64_t count;
+    struct rxPosted *p, *next;
+
+    if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        return;
+
+    pthread_mutex_lock(&rx->postMtx);
+    p = rx->postHead;
+    rx->postHead = rx->postTail = NULL;
+    pthread_mutex_unlock(&rx->postMtx);
+
+    for (; p != NULL; p = next)
+    {
+        next = p->next;
+        p->func(rx, p->arg);
+        free(p);
+    }
+}
+
+/* Arrange for 'func(rx, arg)' to be called by the thread running 'rx'.
+   May be called from any thread. Returns 0 on success, or -1 on
+   error. */
+
+int
+rxPost(Reactor *rx, RxPostFunc func, void *arg)
+{
+    struct rxPosted *p;
+    int wasEmpty;
+
+    p = malloc(sizeof(struct rxPosted));
+    if (p == NULL)
+        return -1;
+    p->func = func;
+    p->arg = arg;
+    p->next = NULL;
+
+    pthread_mutex_lock(&rx->postMtx);
+    wasEmpty = rx->postHead == NULL;
+    if (wasEmpty)
+        rx->postHead = p;
+    else
+        rx->postTail->next = p;
+    rx->postTail = p;
+    pthread_mutex_unlock(&rx->postMtx);
+
+    /* If the queue wasn't empty, an earlier rxPost() has already woken
+       the loop, and it hasn't yet taken the queue */
+
+    return wasEmpty ? wake(rx) : 0;
+}
+
+/* Make rxRun() return, after it finishes dispatching the current batch
+   of events. May be called from any thread. */
+
+void
+rxStop(Reactor *rx)
+{
+    __atomic_store_n(&rx->stop, 1, __ATOMIC_RELEASE);
+    wake(rx);
+}
+
+/* Run the loop until rxStop() is called. Returns 0, or -1 if
+   epoll_wait() fails. */
+
+int
+rxRun(Reactor *rx)
+{
+    struct epoll_event evlist[MAX_EVENTS];
+    struct rxHandler *h;
+    int ready, fd;
+
+    while (!__atomic_load_n(&rx->stop, __ATOMIC_ACQUIRE))
+    {
+        ready = epoll_wait(rx->epfd, evlist, MAX_EVENTS, -1);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        for (int j = 0; j < ready; j++)
+        {
+            fd = EV_FD(evlist[j].data.u64);
+            if (fd >= rx->numHandlers)
+                continue;
+            h = &rx->handlers[fd];
+            if (h->func != NULL && h->gen == EV_GEN(evlist[j].data.u64))
+                h->func(rx, fd, evlist[j].events, h->arg);
+        }
+    }
+
+    /* So that rxRun() can be called again */
+
+    __atomic_store_n(&rx->stop, 0, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Create a reactor. Returns NULL on error. */
+
+Reactor *
+rxCreate(void)
+{
+    Reactor *rx;
+    int savedErrno;
+
+    rx = calloc(1, sizeof(Reactor));
+    if (rx == NULL)
+        return NULL;
+
+    rx->timerFd = rx->eventFd = rx->sigFd = -1;
+    rx->freeTimer = -1;
+    sigemptyset(&rx->sigMask);
+    pthread_mutex_init(&rx->postMtx, NULL);
+
+    rx->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (rx->epfd == -1)
+        goto fail;
+
+    rx->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (rx->timerFd == -1 ||
+            rxAddFd(rx, rx->timerFd, EPOLLIN, 0, onTimerFd, NULL) == -1)
+        goto fail;
+
+    rx->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (rx->eventFd == -1 ||
+            rxAddFd(rx, rx->eventFd, EPOLLIN, 0, onEventFd, NULL) == -1)
+        goto fail;
+
+    return rx;
+
+fail:
+    savedErrno = errno;
+    rxFree(rx);
+    errno = savedErrno;
+    return NULL;
+}
+
+/* Free the reactor. Functions still waiting to be posted are discarded;
+   file descriptors added with rxAddFd() are not closed. */
+
+void
+rxFree(Reactor *rx)
+{
+    struct rxPosted *next;
+
+    if (rx->epfd != -1)
+        close(rx->epfd);
+    if (rx->timerFd != -1)
+        close(rx->timerFd);
+    if (rx->eventFd != -1)
+        close(rx->eventFd);
+    if (rx->sigFd != -1)
+        close(rx->sigFd);
+
+    for (; rx->postHead != NULL; rx->postHead = next)
+    {
+        next = rx->postHead->next;
+        free(rx->postHead);
+    }
+    pthread_mutex_destroy(&rx->postMtx);
+
+    free(rx->handlers);
+    free(rx->timers);
+    free(rx->heap);
+    free(rx);
+}
@@ -0,0 +1,73 @@
+/* reactor.h
+
+   Header file for reactor.c.
+
+   An event loop built on epoll. A reactor calls back the functions
+   registered with it when:
+
+        a file descriptor becomes ready:    rxAddFd(), rxModFd(), rxRemoveFd()
+        a timer expires:                    rxAddTimer(), rxCancelTimer()
+        a signal arrives:                   rxAddSignal()
+        another thread posts a function:    rxPost()
+
+   rxRun() runs the loop in the calling thread until rxStop() is called.
+   A reactor belongs to the thread that runs it: apart from rxPost() and
+   rxStop(), which may be called from any thread, its functions should be
+   called only from that thread (usually from within callbacks). A
+   program may have several reactors, each run by its own thread.
+
+   All of a reactor's timers share one timerfd, which is set to expire at
+   the earliest of them. Signals are received through a signalfd, so
+   they are handled synchronously, as part of the loop, and there are no
+   restrictions on what a callback may do. Because a signal that is not
+   blocked in some thread may be delivered to that thread instead,
+   signals should be added before other threads are created (the new
+   threads inherit the signal mask), and only one reactor should handle
+   any given signal. rxPost() and rxStop() wake the loop with an eventfd.
+*/
+#ifndef REACTOR_H
+#define REACTOR_H /* Prevent accidental double inclusion */
+
+#include <sys/signalfd.h>
+#include <stdint.h>
+
+#define RX_EDGE 01      /* rxAddFd()/rxModFd() flag: edge-triggered */
+#define RX_EXCLUSIVE 02 /* rxAddFd() flag: EPOLLEXCLUSIVE, for an fd that
+                           several reactors monitor (see
+                           altio/epoll_herd.c) */
+
+typedef struct reactor Reactor; /* Opaque */
+
+typedef void (*RxFdFunc)(Reactor *rx, int fd, uint32_t events, void *arg);
+typedef void (*RxTimerFunc)(Reactor *rx, int timerId, void *arg);
+typedef void (*RxSignalFunc)(Reactor *rx,
+                             const struct signalfd_siginfo *si, void *arg);
+typedef void (*RxPostFunc)(Reactor *rx, void *arg);
+
+Reactor *rxCreate(void);
+
+int rxAddFd(Reactor *rx, int fd, uint32_t events, int flags,
+            RxFdFunc func, void *arg);
+
+int rxModFd(Reactor *rx, int fd, uint32_t events, int flags);
+
+int rxRemoveFd(Reactor *rx, int fd);
+
+int rxAddTimer(Reactor *rx, long long delayNs, long long intervalNs,
+               RxTimerFunc func, void *arg);
+
+int rxCancelTimer(Reactor *rx, int timerId);
+
+int rxAddSignal(Reactor *rx, int sig, RxSignalFunc func, void *arg);
+
+int rxPost(Reactor *rx, RxPostFunc func, void *arg);
+
+int rxRun(Reactor *rx);
+
+void rxStop(Reactor *rx);
+
+long long rxNowNs(void);
+
+void rxFree(Reactor *rx);
+
+#endif
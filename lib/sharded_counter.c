@@ -0,0 +1,92 @@
+/* sharded_counter.c
+
+   Implement the sharded counter declared in sharded_counter.h.
+
+   scAdd() finds the caller's CPU with sched_getcpu(). Since version
+   2.35, glibc registers a restartable sequences (rseq(2)) area for each
+   thread, into which the kernel writes the number of the CPU the thread
+   is running on; sched_getcpu() then just reads that field, rather than
+   making a (vDSO) call.
+*/
+#define _GNU_SOURCE /* For sched_getcpu() */
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sharded_counter.h" /* Declares functions defined here */
+
+/* Create a counter with 'numSlots' slots, or, if 'numSlots' is 0, one
+   slot per configured CPU. Returns NULL on error. */
+
+ShardedCounter *
+scCreate(int numSlots)
+{
+    ShardedCounter *sc;
+
+    if (numSlots <= 0)
+    {
+        numSlots = sysconf(_SC_NPROCESSORS_CONF);
+        if (numSlots <= 0)
+            numSlots = 1;
+    }
+
+    sc = malloc(sizeof(ShardedCounter));
+    if (sc == NULL)
+        return NULL;
+
+    sc->numSlots = numSlots;
+    sc->slots = aligned_alloc(SC_CACHE_LINE, numSlots * sizeof(struct scSlot));
+    if (sc->slots == NULL)
+    {
+        free(sc);
+        return NULL;
+    }
+    memset(sc->slots, 0, numSlots * sizeof(struct scSlot));
+
+    return sc;
+}
+
+/* Add 'n' to the slot of the CPU we are running on */
+
+void scAdd(ShardedCounter *sc, long n)
+{
+    int cpu;
+
+    cpu = sched_getcpu();
+    if (cpu < 0) /* Not supported; everyone shares slot 0 */
+        cpu = 0;
+
+    __atomic_fetch_add(&sc->slots[cpu % sc->numSlots].value, n,
+                       __ATOMIC_RELAXED);
+}
+
+/* Add 'n' to slot 'slot' (modulo the number of slots). The caller must
+   ensure that no other thread updates the same slot concurrently. */
+
+void scAddSlot(ShardedCounter *sc, int slot, long n)
+{
+    long *v = &sc->slots[slot % sc->numSlots].value;
+
+    /* A plain load and store: only we write this slot. The atomic store
+       just guarantees that a concurrent scRead() sees a whole value. */
+
+    __atomic_store_n(v, __atomic_load_n(v, __ATOMIC_RELAXED) + n,
+                     __ATOMIC_RELAXED);
+}
+
+/* Return the sum of all slots */
+
+long scRead(ShardedCounter *sc)
+{
+    long sum = 0;
+
+    for (int j = 0; j < sc->numSlots; j++)
+        sum += __atomic_load_n(&sc->slots[j].value, __ATOMIC_RELAXED);
+    return sum;
+}
+
+void scFree(ShardedCounter *sc)
+{
+    free(sc->slots);
+    free(sc);
+}
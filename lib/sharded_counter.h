@@ -0,0 +1,52 @@
+/* sharded_counter.h
+
+   Header file for sharded_counter.c.
+
+   A counter that many threads can increment without all of them
+   contending for a single memory location. The count is split across a
+   number of slots, each on its own cache line; an update touches just
+   one slot, and a read sums all of them. This suits counters that are
+   updated much more often than they are read (statistics, for example).
+
+   There are two ways of choosing a slot:
+
+   * scAdd() uses the slot belonging to the CPU that the caller is
+     running on. Two threads could be on the same CPU (or the caller
+     could migrate in the middle of an update), so the update is atomic,
+     but in the common case the slot's cache line stays in that CPU's
+     cache.
+
+   * scAddSlot() uses a slot chosen by the caller, typically one per
+     thread. If each slot is only ever updated by a single thread, the
+     update needs no atomic read-modify-write at all.
+
+   scRead() returns the sum of the slots. It is not a snapshot: updates
+   made while it runs may or may not be included.
+*/
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H /* Prevent accidental double inclusion */
+
+#define SC_CACHE_LINE 64
+
+struct scSlot
+{
+    long value;
+} __attribute__((aligned(SC_CACHE_LINE))); /* One slot per cache line */
+
+typedef struct
+{
+    int numSlots;
+    struct scSlot *slots;
+} ShardedCounter;
+
+ShardedCounter *scCreate(int numSlots);
+
+void scAdd(ShardedCounter *sc, long n);
+
+void scAddSlot(ShardedCounter *sc, int slot, long n);
+
+long scRead(ShardedCounter *sc);
+
+void scFree(ShardedCounter *sc);
+
+#endif
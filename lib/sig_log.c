@@ -0,0 +1,134 @@
+/* sig_log.c
+
+   Implement the signal log declared in sig_log.h.
+
+   The producer claims position 'head' (the cell at 'head & mask'), fills
+   in the record, and then publishes it by setting the cell's sequence
+   number to 'head + 1'. The consumer takes records from 'tail' onward
+   while their cells are published, and then advances 'tail', which
+   frees the cells for reuse.
+
+   Because a handler can be interrupted by another handler in the same
+   thread, the producer claims its position with a compare-and-swap:
+   if a nested handler claims a position between our reading 'head' and
+   advancing it, the compare-and-swap fails and we try again with the
+   next position. The nested handler runs to completion before we
+   resume, so we retry at most once per nested handler. A nested handler
+   may publish its record before the handler it interrupted; the
+   consumer then stops at the unpublished cell, and takes both records
+   in order once it has been published.
+*/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "sig_log.h" /* Declares functions defined here */
+
+/* Create a log that holds up to 'capacity' records not yet drained,
+   which must be a power of 2. Returns NULL on error. */
+
+SigLog *
+slCreate(size_t capacity)
+{
+    SigLog *log;
+
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    log = aligned_alloc(SL_CACHE_LINE, sizeof(SigLog));
+    if (log == NULL)
+        return NULL;
+    memset(log, 0, sizeof(SigLog));
+
+    log->cells = calloc(capacity, sizeof(struct slCell));
+    if (log->cells == NULL)
+    {
+        free(log);
+        return NULL;
+    }
+
+    log->mask = capacity - 1;
+    return log;
+}
+
+/* Add a record to the log. Returns 0 on success, or -1 if the log was
+   full, in which case the record is counted as dropped. Async-signal-safe,
+   and preserves errno. */
+
+int
+slLog(SigLog *log, int event, long a0, long a1, long a2)
+{
+    struct timespec ts;
+    struct slCell *cell;
+    size_t pos;
+    int savedErrno;
+
+    pos = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+    do
+    {
+        if (pos - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) > log->mask)
+        {
+            __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&log->head, &pos, pos + 1, 0,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    savedErrno = errno;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    errno = savedErrno;
+
+    cell = &log->cells[pos & log->mask];
+    cell->rec.timeNs = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    cell->rec.event = event;
+    cell->rec.arg[0] = a0;
+    cell->rec.arg[1] = a1;
+    cell->rec.arg[2] = a2;
+
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Call 'func' for each published record, oldest first, and then free
+   their cells. Returns the number of records taken. */
+
+size_t
+slDrain(SigLog *log, void (*func)(const struct slRecord *rec, void *arg),
+        void *arg)
+{
+    struct slCell *cell;
+    size_t tail, start;
+
+    start = tail = __atomic_load_n(&log->tail, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        cell = &log->cells[tail & log->mask];
+        if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != tail + 1)
+            break;
+        func(&cell->rec, arg);
+        tail++;
+    }
+
+    __atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+    return tail - start;
+}
+
+/* Return the number of records dropped since the last call */
+
+long
+slDropped(SigLog *log)
+{
+    return __atomic_exchange_n(&log->dropped, 0, __ATOMIC_RELAXED);
+}
+
+void
+slFree(SigLog *log)
+{
+    free(log->cells);
+    free(log);
+}
@@ -0,0 +1,69 @@
+/* sig_log.h
+
+   Header file for sig_log.c.
+
+   A signal log is a ring of fixed-size binary records into which a
+   signal handler can log events, and from which a normal thread later
+   takes the records and formats them. A handler can't safely call
+   printf() or syslog() (see signals/nonreentrant.c), but slLog() uses
+   only atomic operations and clock_gettime(), and so is
+   async-signal-safe. The operations are:
+
+        create a log:               slCreate(capacity)
+        log an event:               slLog(log, event, a0, a1, a2)
+        take and format records:    slDrain(log, func, arg)
+        count records lost:         slDropped(log)
+        free it:                    slFree(log)
+
+   There is a single producer and a single consumer: the producer is the
+   signal handlers run by one thread (a handler that interrupts another
+   handler in the same thread is fine), and the consumer is one thread
+   that calls slDrain(). A program in which handlers run in several
+   threads should give each thread its own log. Neither side ever waits
+   for the other; if the ring is full, slLog() drops the record and
+   counts it, so that the consumer can report the loss.
+*/
+#ifndef SIG_LOG_H
+#define SIG_LOG_H /* Prevent accidental double inclusion */
+
+#include <stddef.h>
+
+#define SL_CACHE_LINE 64
+
+struct slRecord
+{
+    long long timeNs;     /* CLOCK_MONOTONIC time of slLog() call */
+    int event;            /* Caller-defined event code */
+    long arg[3];          /* Caller-defined data */
+};
+
+struct slCell
+{
+    size_t seq;           /* 'pos + 1' once the record for 'pos' is ready */
+    struct slRecord rec;
+};
+
+typedef struct
+{
+    size_t mask;          /* Capacity - 1; the capacity is a power of 2 */
+    struct slCell *cells;
+
+    size_t head __attribute__((aligned(SL_CACHE_LINE)));  /* Producer */
+    long dropped;         /* Records lost because the ring was full */
+
+    size_t tail __attribute__((aligned(SL_CACHE_LINE)));  /* Consumer */
+} SigLog;
+
+SigLog *slCreate(size_t capacity);
+
+int slLog(SigLog *log, int event, long a0, long a1, long a2);
+
+size_t slDrain(SigLog *log,
+               void (*func)(const struct slRecord *rec, void *arg),
+               void *arg);
+
+long slDropped(SigLog *log);
+
+void slFree(SigLog *log);
+
+#endif
@@ -0,0 +1,215 @@
+/* spin_barrier.c
+
+   Implement the barriers declared in spin_barrier.h.
+
+   All of the kinds number the episodes (uses) of the barrier. Each
+   thread keeps a count of the episodes it has taken part in; the
+   barrier opens when the episode counter ('episode') reaches that
+   count. (A central barrier is usually described in terms of a flag
+   whose "sense" flips at each episode; the low bit of 'episode' is that
+   flag.) Because the counter only ever increases, nothing needs to be
+   reset between episodes.
+
+   Spinning threads call sched_yield() every so often, so that the
+   barrier still works, if slowly, when there are more threads than
+   CPUs.
+*/
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "spin_barrier.h" /* Declares functions defined here */
+
+#define CACHE_LINE 64
+#define SPINS_BEFORE_YIELD 1000
+#define SPINS_BEFORE_SLEEP 2000 /* SB_HYBRID */
+
+struct sbThread /* Per-thread state, each on its own cache line */
+{
+    unsigned int episode; /* Episodes this thread has completed */
+    unsigned int arrived; /* SB_TREE: last episode this thread arrived at */
+} __attribute__((aligned(CACHE_LINE)));
+
+struct spinBarrier
+{
+    SbKind kind;
+    int numThreads;
+    struct sbThread *threads;
+
+    unsigned int episode __attribute__((aligned(CACHE_LINE)));
+                                 /* Episodes completed; also futex word */
+    int count __attribute__((aligned(CACHE_LINE)));
+                                 /* Threads yet to arrive (not SB_TREE) */
+    int sleepers;                /* SB_HYBRID: threads in FUTEX_WAIT */
+};
+
+static void
+spinPause(int *spins)
+{
+    if (++*spins % SPINS_BEFORE_YIELD == 0)
+    {
+        sched_yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* Create a barrier of the given kind for 'numThreads' threads. Returns
+   NULL on error. */
+
+SpinBarrier *
+sbCreate(SbKind kind, int numThreads)
+{
+    SpinBarrier *b;
+
+    if (numThreads < 1 || kind < SB_CENTRAL || kind > SB_HYBRID)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    b = aligned_alloc(CACHE_LINE, sizeof(SpinBarrier));
+    if (b == NULL)
+        return NULL;
+    memset(b, 0, sizeof(SpinBarrier));
+
+    b->threads = aligned_alloc(CACHE_LINE,
+                               numThreads * sizeof(struct sbThread));
+    if (b->threads == NULL)
+    {
+        free(b);
+        return NULL;
+    }
+    memset(b->threads, 0, numThreads * sizeof(struct sbThread));
+
+    b->kind = kind;
+    b->numThreads = numThreads;
+    b->count = numThreads;
+    return b;
+}
+
+/* Spin (and, if 'maySleep', eventually sleep) until b->episode is no
+   longer 'old' */
+
+static void
+awaitEpisode(SpinBarrier *b, unsigned int old, int maySleep)
+{
+    int spins = 0;
+
+    while (__atomic_load_n(&b->episode, __ATOMIC_ACQUIRE) == old)
+    {
+        if (!maySleep || spins < SPINS_BEFORE_SLEEP)
+        {
+            spinPause(&spins);
+            continue;
+        }
+
+        /* Register as a sleeper and check again before sleeping; the
+           releasing thread checks 'sleepers' after bumping 'episode', so
+           either it sees us, or we see the new episode */
+
+        __atomic_fetch_add(&b->sleepers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&b->episode, __ATOMIC_ACQUIRE) == old)
+            syscall(SYS_futex, &b->episode, FUTEX_WAIT_PRIVATE, old,
+                    NULL, NULL, 0);
+        __atomic_fetch_sub(&b->sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/* Open the barrier for the episode that follows 'old' */
+
+static void
+release(SpinBarrier *b, unsigned int old)
+{
+    __atomic_store_n(&b->episode, old + 1, __ATOMIC_RELEASE);
+
+    if (b->kind == SB_HYBRID)
+    {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&b->sleepers, __ATOMIC_RELAXED) > 0)
+            syscall(SYS_futex, &b->episode, FUTEX_WAKE_PRIVATE, INT_MAX,
+                    NULL, NULL, 0);
+    }
+}
+
+static int
+centralWait(SpinBarrier *b, unsigned int old)
+{
+    if (__atomic_sub_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        /* Last to arrive: reset the count (no one touches it until the
+           barrier opens), and open the barrier */
+
+        __atomic_store_n(&b->count, b->numThreads, __ATOMIC_RELAXED);
+        release(b, old);
+        return 1;
+    }
+
+    awaitEpisode(b, old, b->kind == SB_HYBRID);
+    return 0;
+}
+
+static int
+treeWait(SpinBarrier *b, int idx, unsigned int old)
+{
+    int step, partner, spins;
+
+    /* In successive rounds, wait for the partner whose index is
+       'step' above ours; drop out when our own index isn't a multiple
+       of 2 * step, after telling the partner below that we've arrived */
+
+    for (step = 1; step < b->numThreads; step *= 2)
+    {
+        if (idx % (2 * step) != 0)
+        {
+            __atomic_store_n(&b->threads[idx].arrived, old + 1,
+                             __ATOMIC_RELEASE);
+            awaitEpisode(b, old, 0);
+            return 0;
+        }
+
+        partner = idx + step;
+        if (partner < b->numThreads)
+        {
+            spins = 0;
+            while (__atomic_load_n(&b->threads[partner].arrived,
+                                   __ATOMIC_ACQUIRE) != old + 1)
+                spinPause(&spins);
+        }
+    }
+
+    /* Only thread 0 gets here, after everyone has arrived */
+
+    release(b, old);
+    return 1;
+}
+
+/* Wait at the barrier. 'threadIdx' identifies the calling thread. Returns
+   1 in exactly one of the threads (like PTHREAD_BARRIER_SERIAL_THREAD)
+   and 0 in the others. */
+
+int
+sbWait(SpinBarrier *b, int threadIdx)
+{
+    unsigned int old;
+
+    old = b->threads[threadIdx].episode++;
+
+    return (b->kind == SB_TREE) ? treeWait(b, threadIdx, old) :
+                                  centralWait(b, old);
+}
+
+void
+sbFree(SpinBarrier *b)
+{
+    free(b->threads);
+    free(b);
+}
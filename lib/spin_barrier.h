@@ -0,0 +1,44 @@
+/* spin_barrier.h
+
+   Header file for spin_barrier.c.
+
+   Barriers in which waiting threads spin, rather than (as with
+   pthread_barrier_wait()) sleeping in the kernel. When every thread has
+   its own CPU and the threads arrive at much the same time, this avoids
+   the cost of going to sleep and being woken. The kinds are:
+
+        SB_CENTRAL   A single counter and a "sense" flag that flips at
+                     each episode. Simple, but every arrival updates the
+                     same cache line.
+        SB_TREE      A tournament: in round k, thread i (where i is a
+                     multiple of 2^(k+1)) waits for thread i + 2^k to
+                     arrive. Each arrival flag is written by one thread
+                     and read by one other, so arrivals don't contend.
+                     Thread 0, the champion, then releases everyone.
+        SB_HYBRID    As SB_CENTRAL, but a thread that has spun for a
+                     while without the barrier opening sleeps on a futex.
+                     This suits threads that arrive at different times,
+                     or more threads than CPUs.
+
+   Each thread that uses the barrier has an index, from 0 to one less
+   than the number of threads, which it must pass to sbWait().
+*/
+#ifndef SPIN_BARRIER_H
+#define SPIN_BARRIER_H /* Prevent accidental double inclusion */
+
+typedef enum
+{
+    SB_CENTRAL,
+    SB_TREE,
+    SB_HYBRID
+} SbKind;
+
+typedef struct spinBarrier SpinBarrier; /* Opaque */
+
+SpinBarrier *sbCreate(SbKind kind, int numThreads);
+
+int sbWait(SpinBarrier *b, int threadIdx);
+
+void sbFree(SpinBarrier *b);
+
+#endif
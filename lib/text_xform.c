@@ -0,0 +1,215 @@
+/* text_xform.c
+
+   Implement the text transformations declared in text_xform.h.
+
+   The vector versions all use the same trick to find the bytes in a
+   range [lo, lo + n) without an unsigned byte comparison (which SSE2 and
+   AVX2 lack): adding (0x80 - lo) to each byte maps the range onto
+   [-128, -128 + n), which a signed "less than" comparison can pick out.
+   The resulting mask selects the bytes to change; for case conversion,
+   the change is to flip bit 0x20. Any tail shorter than a vector is left
+   to the scalar code.
+
+   The AVX2 code is compiled with a target attribute, so that the rest of
+   the library need not be built with -mavx2; it is only ever called if
+   CPUID says that the CPU (and the kernel) support AVX2.
+*/
+#include <string.h>
+#include <errno.h>
+#include "text_xform.h" /* Declares functions defined here */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TX_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*TxFunc)(TxOp op, char *buf, size_t len);
+
+/* Return the first byte of the range to be changed by 'op', and set
+   '*n' to the size of that range */
+
+static unsigned char
+rangeOf(TxOp op, unsigned char *n)
+{
+    switch (op)
+    {
+    case TX_UPPER:
+        *n = 26;
+        return 'a';
+    case TX_LOWER:
+        *n = 26;
+        return 'A';
+    default: /* TX_ASCII_BYTES */
+        *n = 128;
+        return 0x80;
+    }
+}
+
+static void
+txScalar(TxOp op, char *buf, size_t len)
+{
+    unsigned char lo, n, c;
+
+    lo = rangeOf(op, &n);
+    for (size_t j = 0; j < len; j++)
+    {
+        c = buf[j];
+        if ((unsigned char)(c - lo) < n)
+            buf[j] = (op == TX_ASCII_BYTES) ? '?' : c ^ 0x20;
+    }
+}
+
+#ifdef TX_X86
+
+__attribute__((target("sse2"))) static void
+txSse2(TxOp op, char *buf, size_t len)
+{
+    __m128i bias, limit, repl, v, mask;
+    unsigned char lo, n;
+    size_t j;
+
+    lo = rangeOf(op, &n);
+    bias = _mm_set1_epi8((char)(0x80 - lo));
+    limit = _mm_set1_epi8((char)(-128 + n));
+    repl = _mm_set1_epi8((op == TX_ASCII_BYTES) ? '?' : 0x20);
+
+    for (j = 0; j + 16 <= len; j += 16)
+    {
+        v = _mm_loadu_si128((__m128i *)(buf + j));
+        mask = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+        if (op == TX_ASCII_BYTES)
+            v = _mm_or_si128(_mm_andnot_si128(mask, v),
+                             _mm_and_si128(mask, repl));
+        else
+            v = _mm_xor_si128(v, _mm_and_si128(mask, repl));
+        _mm_storeu_si128((__m128i *)(buf + j), v);
+    }
+
+    txScalar(op, buf + j, len - j);
+}
+
+__attribute__((target("avx2"))) static void
+txAvx2(TxOp op, char *buf, size_t len)
+{
+    __m256i bias, limit, repl, v, mask;
+    unsigned char lo, n;
+    size_t j;
+
+    lo = rangeOf(op, &n);
+    bias = _mm256_set1_epi8((char)(0x80 - lo));
+    limit = _mm256_set1_epi8((char)(-128 + n));
+    repl = _mm256_set1_epi8((op == TX_ASCII_BYTES) ? '?' : 0x20);
+
+    for (j = 0; j + 32 <= len; j += 32)
+    {
+        v = _mm256_loadu_si256((__m256i *)(buf + j));
+        mask = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, bias));
+        if (op == TX_ASCII_BYTES)
+            v = _mm256_blendv_epi8(v, repl, mask);
+        else
+            v = _mm256_xor_si256(v, _mm256_and_si256(mask, repl));
+        _mm256_storeu_si256((__m256i *)(buf + j), v);
+    }
+
+    /* txSse2() uses the legacy (non-VEX) SSE encodings, which stall if
+       the upper halves of the YMM registers are still in use. The
+       compiler doesn't reliably clear them before a tail call, so we do. */
+
+    _mm256_zeroupper();
+    txSse2(op, buf + j, len - j); /* At most 31 bytes remain */
+}
+
+#endif
+
+static const struct
+{
+    const char *name;
+    TxFunc func;
+} impls[] = {
+#ifdef TX_X86
+    {"avx2", txAvx2},
+    {"sse2", txSse2},
+#endif
+    {"scalar", txScalar},
+};
+
+#define NUM_IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+static int implIdx = -1; /* Index into impls[]; -1 == not yet chosen */
+
+/* Return true if the CPU can run impls[idx] */
+
+static int
+supported(size_t idx)
+{
+#ifdef TX_X86
+    /* __builtin_cpu_supports() consults CPUID; for AVX2, it also checks
+       (via XGETBV) that the kernel saves the YMM registers */
+
+    __builtin_cpu_init();
+    if (impls[idx].func == txAvx2)
+        return __builtin_cpu_supports("avx2");
+    if (impls[idx].func == txSse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return 1;
+}
+
+/* Choose the first (i.e., fastest) implementation that the CPU supports.
+   Several threads may race to do this, but they all reach the same
+   answer. */
+
+static void
+chooseImpl(void)
+{
+    size_t j;
+
+    for (j = 0; j < NUM_IMPLS - 1; j++)
+        if (supported(j))
+            break;
+    implIdx = j;
+}
+
+/* Apply 'op' to the 'len' bytes in 'buf', in place */
+
+void
+txTransform(TxOp op, char *buf, size_t len)
+{
+    if (implIdx == -1)
+        chooseImpl();
+    impls[implIdx].func(op, buf, len);
+}
+
+/* Return the name of the implementation in use */
+
+const char *
+txImplName(void)
+{
+    if (implIdx == -1)
+        chooseImpl();
+    return impls[implIdx].name;
+}
+
+/* Use the implementation named 'name' ("avx2", "sse2", or "scalar").
+   Returns 0 on success, or -1 (with errno set to ENOENT) if there is no
+   such implementation, or to ENOTSUP if the CPU can't run it. */
+
+int
+txSetImpl(const char *name)
+{
+    for (size_t j = 0; j < NUM_IMPLS; j++)
+    {
+        if (strcmp(name, impls[j].name) != 0)
+            continue;
+        if (!supported(j))
+        {
+            errno = ENOTSUP;
+            return -1;
+        }
+        implIdx = j;
+        return 0;
+    }
+
+    errno = ENOENT;
+    return -1;
+}
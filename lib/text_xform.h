@@ -0,0 +1,44 @@
+/* text_xform.h
+
+   Header file for text_xform.c.
+
+   Byte-at-a-time text transformations, done a vector at a time:
+
+        TX_UPPER        convert ASCII letters to uppercase
+        TX_LOWER        convert ASCII letters to lowercase
+        TX_ASCII_BYTES  replace each non-ASCII byte (0x80-0xff) with '?'
+
+   TX_ASCII_BYTES works on bytes, not characters: it doesn't decode
+   UTF-8 (or any other multibyte encoding), so a character encoded in
+   several bytes becomes several '?'s. ("\xc3\xa9", an e with an acute
+   accent, becomes "??".) This keeps the output the same length as the
+   input, so the transformation can be done in place.
+
+   TX_UPPER and TX_LOWER give the same results as toupper() and tolower()
+   in the "C" locale, which is what a program gets if it never calls
+   setlocale().
+
+   On x86, the implementation is chosen at run time according to what the
+   CPU supports (AVX2, then SSE2); elsewhere, a portable scalar version
+   is used. txSetImpl() forces a particular implementation, which is
+   useful for comparing them.
+*/
+#ifndef TEXT_XFORM_H
+#define TEXT_XFORM_H /* Prevent accidental double inclusion */
+
+#include <stddef.h>
+
+typedef enum
+{
+    TX_UPPER,
+    TX_LOWER,
+    TX_ASCII_BYTES
+} TxOp;
+
+void txTransform(TxOp op, char *buf, size_t len);
+
+const char *txImplName(void);
+
+int txSetImpl(const char *name);
+
+#endif
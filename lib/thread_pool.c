@@ -0,0 +1,622 @@
+/* thread_pool.c
+
+   Implement the work-stealing thread pool declared in thread_pool.h.
+
+   Each worker's deque is a Chase-Lev deque, using the memory orderings
+   given by Le, Pop, Cohen, and Zappa Nardelli, "Correct and Efficient
+   Work-Stealing for Weak Memory Models" (PPoPP 2013). The owner pushes
+   and takes at the bottom without any atomic read-modify-write, except
+   when taking the last element, where it races with thieves, who take
+   from the top with a compare-and-swap. When the deque's array fills,
+   the owner replaces it with one twice the size; a thief may still be
+   reading the old array, so old arrays are only freed when the pool is
+   destroyed.
+
+   Sleeping and waking: 'queued' counts tasks that have been spawned but
+   not yet picked up, and 'numIdle' counts workers that are going to
+   sleep. A worker increments 'numIdle' and then checks 'queued' (with
+   the mutex held); a spawner increments 'queued' and then checks
+   'numIdle', and takes the mutex to signal if it is nonzero. With
+   sequentially consistent operations on both counters, at least one
+   side sees the other, so no wakeup is lost.
+*/
+#define _GNU_SOURCE /* For pthread_setaffinity_np() and CPU_SET() */
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "thread_pool.h" /* Declares functions defined here */
+#include "tlpi_hdr.h"
+
+#define CACHE_LINE 64
+#define INITIAL_DEQUE_SIZE 256 /* Must be a power of 2 */
+
+struct tpTask
+{
+    TpFunc func;
+    void *arg;
+    TpGroup *group;
+    struct tpTask *next; /* For the shared queue */
+};
+
+struct tpArray
+{
+    long size;
+    struct tpArray *prev; /* Array that this one replaced */
+    struct tpTask *buf[];
+};
+
+struct tpDeque
+{
+    long top __attribute__((aligned(CACHE_LINE)));    /* Thieves' end */
+    long bottom __attribute__((aligned(CACHE_LINE))); /* Owner's end */
+    struct tpArray *array;
+};
+
+struct tpWorker
+{
+    ThreadPool *tp;
+    int idx;
+    pthread_t tid;
+    unsigned int seed; /* For choosing victims */
+    struct tpDeque dq;
+    struct tpStats stats;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct threadPool
+{
+    int numWorkers;                /* Workers (and deques) */
+    int numStarted;                /* Worker threads actually started */
+    int flags;
+    struct tpWorker *workers;
+
+    pthread_mutex_t mtx;           /* Protects the following */
+    pthread_cond_t cond;
+    int shutdown;
+    struct tpTask *injHead;        /* Queue of tasks spawned by threads */
+    struct tpTask *injTail;        /*   outside the pool */
+
+    long queued;                   /* Tasks spawned but not picked up */
+    int numIdle;                   /* Workers going to sleep */
+    long numInjected;              /* Tasks in the shared queue */
+};
+
+static __thread struct tpWorker *self; /* Worker that this thread is */
+
+static long long
+nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Chase-Lev deque operations */
+
+static int
+dqInit(struct tpDeque *dq)
+{
+    dq->top = dq->bottom = 0;
+    dq->array = malloc(sizeof(struct tpArray) +
+                       INITIAL_DEQUE_SIZE * sizeof(struct tpTask *));
+    if (dq->array == NULL)
+        return -1;
+    dq->array->size = INITIAL_DEQUE_SIZE;
+    dq->array->prev = NULL;
+    return 0;
+}
+
+static void
+dqFree(struct tpDeque *dq)
+{
+    struct tpArray *a, *prev;
+
+    for (a = dq->array; a != NULL; a = prev)
+    {
+        prev = a->prev;
+        free(a);
+    }
+}
+
+/* Called by the owner only. Returns -1 if the deque needed to grow,
+   but couldn't. */
+
+static int
+dqPush(struct tpDeque *dq, struct tpTask *task)
+{
+    struct tpArray *a, *na;
+    long b, t;
+
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    a = __atomic_load_n(&dq->array, __ATOMIC_RELAXED);
+
+    if (b - t > a->size - 1) /* Full: grow */
+    {
+        na = malloc(sizeof(struct tpArray) +
+                    2 * a->size * sizeof(struct tpTask *));
+        if (na == NULL)
+            return -1;
+        na->size = 2 * a->size;
+        na->prev = a;
+        for (long j = t; j < b; j++)
+            na->buf[j & (na->size - 1)] =
+                __atomic_load_n(&a->buf[j & (a->size - 1)], __ATOMIC_RELAXED);
+        __atomic_store_n(&dq->array, na, __ATOMIC_RELEASE);
+        a = na;
+    }
+
+    __atomic_store_n(&a->buf[b & (a->size - 1)], task, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Called by the owner only. Returns NULL if the deque is empty. */
+
+static struct tpTask *
+dqTake(struct tpDeque *dq)
+{
+    struct tpArray *a;
+    struct tpTask *task;
+    long b, t;
+
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    a = __atomic_load_n(&dq->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+    if (t > b) /* Empty */
+    {
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    task = __atomic_load_n(&a->buf[b & (a->size - 1)], __ATOMIC_RELAXED);
+    if (t == b) /* Last element: race any thieves for it */
+    {
+        if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            task = NULL;
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+/* Called by any thread. Returns NULL if the deque is empty, or if
+   another thread took the element first. */
+
+static struct tpTask *
+dqSteal(struct tpDeque *dq)
+{
+    struct tpArray *a;
+    struct tpTask *task;
+    long b, t;
+
+    t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return NULL;
+
+    a = __atomic_load_n(&dq->array, __ATOMIC_ACQUIRE);
+    task = __atomic_load_n(&a->buf[t & (a->size - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return task;
+}
+
+/* Find a task for the calling thread to run: from its own deque (if it
+   is one of the pool's workers), then from the shared queue, and then
+   by stealing. Returns NULL if no task was found. */
+
+static struct tpTask *
+findTask(ThreadPool *tp, struct tpWorker *w, unsigned int *seed)
+{
+    struct tpTask *task;
+    int victim, s;
+
+    if (w != NULL)
+    {
+        task = dqTake(&w->dq);
+        if (task != NULL)
+            goto found;
+    }
+
+    if (__atomic_load_n(&tp->numInjected, __ATOMIC_RELAXED) > 0)
+    {
+        s = pthread_mutex_lock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        task = tp->injHead;
+        if (task != NULL)
+        {
+            tp->injHead = task->next;
+            if (tp->injHead == NULL)
+                tp->injTail = NULL;
+            __atomic_fetch_sub(&tp->numInjected, 1, __ATOMIC_RELAXED);
+        }
+        s = pthread_mutex_unlock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+        if (task != NULL)
+            goto found;
+    }
+
+    for (int j = 0; j < 2 * tp->numWorkers; j++)
+    {
+        victim = rand_r(seed) % tp->numWorkers;
+        if (w != NULL && victim == w->idx)
+            continue;
+        task = dqSteal(&tp->workers[victim].dq);
+        if (task != NULL)
+        {
+            if (w != NULL)
+                w->stats.steals++;
+            goto found;
+        }
+        if (w != NULL)
+            w->stats.failedSteals++;
+    }
+    return NULL;
+
+found:
+    __atomic_fetch_sub(&tp->queued, 1, __ATOMIC_SEQ_CST);
+    return task;
+}
+
+static void
+runTask(struct tpWorker *w, struct tpTask *task)
+{
+    long long start;
+    TpGroup *g = task->group;
+
+    start = (w != NULL) ? nowNs() : 0;
+    task->func(task->arg);
+    free(task);
+
+    if (w != NULL)
+    {
+        /* Measure the time outside nested waits as well as inside; a
+           task that waits helps by running other tasks, so 'busyNs'
+           can count some time twice. 'tasks' is exact. */
+
+        w->stats.busyNs += nowNs() - start;
+        w->stats.tasks++;
+    }
+
+    __atomic_fetch_sub(&g->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void *
+workerFunc(void *arg)
+{
+    struct tpWorker *w = arg;
+    ThreadPool *tp = w->tp;
+    struct tpTask *task;
+    cpu_set_t set;
+    long long start;
+    long numCpus;
+    int s;
+
+    self = w;
+
+    if (tp->flags & TP_PIN)
+    {
+        numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        CPU_ZERO(&set);
+        CPU_SET(w->idx % (numCpus > 0 ? numCpus : 1), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    for (;;)
+    {
+        task = findTask(tp, w, &w->seed);
+        if (task != NULL)
+        {
+            runTask(w, task);
+            continue;
+        }
+
+        s = pthread_mutex_lock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+
+        if (tp->shutdown)
+        {
+            s = pthread_mutex_unlock(&tp->mtx);
+            if (s != 0)
+                errExitEN(s, "pthread_mutex_unlock");
+            break;
+        }
+
+        __atomic_fetch_add(&tp->numIdle, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&tp->queued, __ATOMIC_SEQ_CST) <= 0)
+        {
+            start = nowNs();
+            s = pthread_cond_wait(&tp->cond, &tp->mtx);
+            if (s != 0)
+                errExitEN(s, "pthread_cond_wait");
+            w->stats.idleNs += nowNs() - start;
+        }
+        __atomic_fetch_sub(&tp->numIdle, 1, __ATOMIC_SEQ_CST);
+
+        s = pthread_mutex_unlock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+    }
+
+    return NULL;
+}
+
+/* Create a pool of 'numWorkers' threads, or, if 'numWorkers' is 0, one
+   per online CPU. 'flags' is 0 or TP_PIN. Returns NULL on error. */
+
+ThreadPool *
+tpCreate(int numWorkers, int flags)
+{
+    ThreadPool *tp;
+    int s, savedErrno;
+
+    if (numWorkers <= 0)
+    {
+        numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+        if (numWorkers <= 0)
+            numWorkers = 1;
+    }
+
+    tp = calloc(1, sizeof(ThreadPool));
+    if (tp == NULL)
+        return NULL;
+    tp->numWorkers = numWorkers;
+    tp->flags = flags;
+    pthread_mutex_init(&tp->mtx, NULL);
+    pthread_cond_init(&tp->cond, NULL);
+
+    tp->workers = aligned_alloc(CACHE_LINE,
+                                numWorkers * sizeof(struct tpWorker));
+    if (tp->workers == NULL)
+    {
+        free(tp);
+        return NULL;
+    }
+    memset(tp->workers, 0, numWorkers * sizeof(struct tpWorker));
+
+    for (int j = 0; j < numWorkers; j++)
+    {
+        tp->workers[j].tp = tp;
+        tp->workers[j].idx = j;
+        tp->workers[j].seed = j + 1;
+        if (dqInit(&tp->workers[j].dq) == -1)
+            goto fail;
+    }
+
+    /* Workers may steal from any deque as soon as they start, so all
+       the deques must exist first */
+
+    for (int j = 0; j < numWorkers; j++)
+    {
+        s = pthread_create(&tp->workers[j].tid, NULL, workerFunc,
+                           &tp->workers[j]);
+        if (s != 0)
+        {
+            errno = s;
+            goto fail;
+        }
+        tp->numStarted++;
+    }
+
+    return tp;
+
+fail:
+    savedErrno = errno;
+    tpDestroy(tp); /* Stops whichever workers were started */
+    errno = savedErrno;
+    return NULL;
+}
+
+void
+tpGroupInit(TpGroup *g)
+{
+    g->pending = 0;
+}
+
+/* Spawn a task, in group 'g', that calls func(arg). Returns 0 on
+   success, or -1 on error. */
+
+int
+tpSpawn(ThreadPool *tp, TpGroup *g, TpFunc func, void *arg)
+{
+    struct tpTask *task;
+    int s;
+
+    task = malloc(sizeof(struct tpTask));
+    if (task == NULL)
+        return -1;
+    task->func = func;
+    task->arg = arg;
+    task->group = g;
+    task->next = NULL;
+
+    __atomic_fetch_add(&g->pending, 1, __ATOMIC_RELAXED);
+
+    if (self == NULL || self->tp != tp || dqPush(&self->dq, task) == -1)
+    {
+        s = pthread_mutex_lock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        if (tp->injTail == NULL)
+            tp->injHead = task;
+        else
+            tp->injTail->next = task;
+        tp->injTail = task;
+        __atomic_fetch_add(&tp->numInjected, 1, __ATOMIC_RELAXED);
+        s = pthread_mutex_unlock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+    }
+
+    __atomic_fetch_add(&tp->queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&tp->numIdle, __ATOMIC_SEQ_CST) > 0)
+    {
+        s = pthread_mutex_lock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        s = pthread_cond_signal(&tp->cond);
+        if (s != 0)
+            errExitEN(s, "pthread_cond_signal");
+        s = pthread_mutex_unlock(&tp->mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+    }
+
+    return 0;
+}
+
+/* Wait until all tasks in group 'g' have finished, running tasks (from
+   any group) in the meantime */
+
+void
+tpWait(ThreadPool *tp, TpGroup *g)
+{
+    struct tpWorker *w = (self != NULL && self->tp == tp) ? self : NULL;
+    unsigned int seed = (unsigned int)(long)&seed; /* For non-workers */
+    struct tpTask *task;
+
+    while (__atomic_load_n(&g->pending, __ATOMIC_ACQUIRE) > 0)
+    {
+        task = findTask(tp, w, (w != NULL) ? &w->seed : &seed);
+        if (task != NULL)
+            runTask(w, task);
+        else
+            sched_yield();
+    }
+}
+
+/* Parallel loops: a range task repeatedly splits off the upper half of
+   its range as a new task, until the range is no bigger than 'grain',
+   and then processes what remains. Thieves thus steal large ranges. */
+
+struct rangeTask
+{
+    ThreadPool *tp;
+    TpGroup *group;
+    long lo, hi, grain;
+    TpRangeFunc func;
+    void *arg;
+};
+
+static void
+rangeRun(void *arg)
+{
+    struct rangeTask *r = arg, *half;
+    long mid;
+
+    while (r->hi - r->lo > r->grain)
+    {
+        mid = r->lo + (r->hi - r->lo) / 2;
+
+        half = malloc(sizeof(struct rangeTask));
+        if (half == NULL)
+            break; /* Do the rest ourselves */
+        *half = *r;
+        half->lo = mid;
+        if (tpSpawn(r->tp, r->group, rangeRun, half) == -1)
+        {
+            free(half);
+            break;
+        }
+        r->hi = mid;
+    }
+
+    r->func(r->lo, r->hi, r->arg);
+    free(r);
+}
+
+/* Call func(l, h, arg) for subranges [l, h) that together cover [lo, hi),
+   each no bigger than 'grain' (or 1, if 'grain' is less than 1), in
+   parallel, and wait for them all to finish. Returns 0 on success, or
+   -1 on error. */
+
+int
+tpParallelFor(ThreadPool *tp, long lo, long hi, long grain,
+              TpRangeFunc func, void *arg)
+{
+    struct rangeTask *r;
+    TpGroup g;
+
+    if (lo >= hi)
+        return 0;
+
+    r = malloc(sizeof(struct rangeTask));
+    if (r == NULL)
+        return -1;
+    r->tp = tp;
+    r->group = &g;
+    r->lo = lo;
+    r->hi = hi;
+    r->grain = (grain < 1) ? 1 : grain;
+    r->func = func;
+    r->arg = arg;
+
+    tpGroupInit(&g);
+    if (tpSpawn(tp, &g, rangeRun, r) == -1)
+    {
+        free(r);
+        return -1;
+    }
+    tpWait(tp, &g);
+    return 0;
+}
+
+int
+tpNumWorkers(ThreadPool *tp)
+{
+    return tp->numWorkers;
+}
+
+/* Return the statistics of worker 'workerIdx'. They are updated without
+   synchronization, so are only exact once the pool is quiescent. */
+
+void
+tpGetStats(ThreadPool *tp, int workerIdx, struct tpStats *stats)
+{
+    *stats = tp->workers[workerIdx].stats;
+}
+
+/* Stop the workers and free the pool. The caller should first wait for
+   all tasks to finish. */
+
+void
+tpDestroy(ThreadPool *tp)
+{
+    int s;
+
+    s = pthread_mutex_lock(&tp->mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+    tp->shutdown = 1;
+    s = pthread_cond_broadcast(&tp->cond);
+    if (s != 0)
+        errExitEN(s, "pthread_cond_broadcast");
+    s = pthread_mutex_unlock(&tp->mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+
+    for (int j = 0; j < tp->numStarted; j++)
+    {
+        s = pthread_join(tp->workers[j].tid, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+
+    for (int j = 0; j < tp->numWorkers; j++)
+        dqFree(&tp->workers[j].dq);
+
+    pthread_mutex_destroy(&tp->mtx);
+    pthread_cond_destroy(&tp->cond);
+    free(tp->workers);
+    free(tp);
+}
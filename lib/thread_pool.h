@@ -0,0 +1,68 @@
+/* thread_pool.h
+
+   Header file for thread_pool.c.
+
+   A work-stealing thread pool. Tasks are spawned into a group, and a
+   thread waits for all of the tasks in a group to finish; tasks may
+   themselves spawn and wait (fork-join parallelism). The operations are:
+
+        create a pool:              tpCreate(numWorkers, flags)
+        start a group of tasks:     tpGroupInit(&group)
+        spawn a task in a group:    tpSpawn(tp, &group, func, arg)
+        wait for a group:           tpWait(tp, &group)
+        run a loop in parallel:     tpParallelFor(tp, lo, hi, grain, func, arg)
+        get a worker's statistics:  tpGetStats(tp, workerIdx, &stats)
+        destroy the pool:           tpDestroy(tp)
+
+   Each worker thread has its own deque of tasks: it pushes tasks it
+   spawns onto one end and takes tasks from the same end, so it works
+   depth-first, on data that is likely still in its cache. A worker
+   whose deque is empty steals from the other end of a randomly chosen
+   worker's deque, which tends to yield the largest remaining pieces of
+   work. Tasks spawned by threads outside the pool go to a shared queue.
+   A thread that waits for a group runs other tasks while it waits.
+
+   Workers with nothing to do sleep on a condition variable.
+*/
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H /* Prevent accidental double inclusion */
+
+#define TP_PIN 01 /* tpCreate() flag: pin worker j to CPU (j % num-CPUs) */
+
+typedef void (*TpFunc)(void *arg);
+typedef void (*TpRangeFunc)(long lo, long hi, void *arg);
+
+typedef struct
+{
+    long pending; /* Spawned tasks that have not yet finished */
+} TpGroup;
+
+struct tpStats
+{
+    long tasks;          /* Tasks run */
+    long steals;         /* Tasks taken from other workers' deques */
+    long failedSteals;   /* Steal attempts that found nothing */
+    long long busyNs;    /* Time spent running tasks */
+    long long idleNs;    /* Time spent asleep, waiting for work */
+};
+
+typedef struct threadPool ThreadPool; /* Opaque */
+
+ThreadPool *tpCreate(int numWorkers, int flags);
+
+void tpGroupInit(TpGroup *g);
+
+int tpSpawn(ThreadPool *tp, TpGroup *g, TpFunc func, void *arg);
+
+void tpWait(ThreadPool *tp, TpGroup *g);
+
+int tpParallelFor(ThreadPool *tp, long lo, long hi, long grain,
+                  TpRangeFunc func, void *arg);
+
+int tpNumWorkers(ThreadPool *tp);
+
+void tpGetStats(ThreadPool *tp, int workerIdx, struct tpStats *stats);
+
+void tpDestroy(ThreadPool *tp);
+
+#endif
@@ -0,0 +1,394 @@
+/* timer_wheel.c
+
+   Implement the timing wheel declared in timer_wheel.h.
+
+   Time is counted in ticks since the wheel was created. The wheel has
+   TW_LEVELS levels of TW_SLOTS (64) slots; each slot is a list of timers.
+   A timer that expires less than 64 ticks after 'curTick' (the next tick
+   not yet processed) is put in level 0, in the slot given by the low 6
+   bits of its expiry tick. A timer that expires less than 64^2 ticks
+   ahead goes in level 1, in the slot given by the next 6 bits, and so
+   on. Processing a tick runs the timers in its level-0 slot. When the
+   tick is the first of a block of 64^n ticks, the level-n slot for that
+   block is first "cascaded": its timers are put back in the wheel,
+   where, being closer to expiry, they land in a lower level. Adding and
+   cancelling a timer is then just adding it to, or removing it from, a
+   doubly linked list.
+
+   Each level has a 64-bit map of its nonempty slots. Processing skips
+   ahead over empty level-0 slots, and the next tick at which anything
+   can happen (a level-0 slot to process or a slot to cascade) is found
+   with a few bit operations. The timerfd is set, as an absolute time, to
+   that tick. It is reset only when that changes: adding a timer that
+   expires after the one the timerfd is set for makes no system call, and
+   cancelling a timer never does (the timerfd may then expire with
+   nothing to do).
+*/
+#define _GNU_SOURCE
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "timer_wheel.h" /* Declares functions defined here */
+
+#define TW_BITS 6
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 6             /* Spanning 64^6 ticks */
+#define TW_EXPIRED TW_LEVELS    /* 'level' of a timer in the expired list */
+#define TW_NONE UINT64_MAX      /* 'armedTick' when timerfd is disarmed */
+
+struct timerWheel
+{
+    int tfd;
+    long long tickNs;
+    long long baseNs;           /* CLOCK_MONOTONIC time of tick 0 */
+    uint64_t curTick;           /* Next tick not yet processed */
+    uint64_t armedTick;         /* Tick timerfd is set for, or TW_NONE */
+    uint64_t map[TW_LEVELS];    /* Bit n set if slot n is nonempty */
+    TwTimer slots[TW_LEVELS][TW_SLOTS]; /* Heads of circular lists */
+    TwTimer expired;            /* Timers being run by twProcess() */
+};
+
+static long long
+nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+listInit(TwTimer *head)
+{
+    head->next = head->prev = head;
+}
+
+static void
+listAppend(TwTimer *head, TwTimer *t)
+{
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+/* Put 't' in the slot for its expiry time, relative to 'curTick' */
+
+static void
+place(TimerWheel *tw, TwTimer *t)
+{
+    uint64_t exp, delta;
+    int level;
+
+    exp = (t->expires < tw->curTick) ? tw->curTick : t->expires;
+    delta = exp - tw->curTick;
+
+    for (level = 0; level < TW_LEVELS - 1; level++)
+        if (delta < (1ULL << (TW_BITS * (level + 1))))
+            break;
+
+    /* A timer beyond the wheel's span goes in the last slot it reaches;
+       it is cascaded back into the top level until it comes into range */
+
+    if (delta >= (1ULL << (TW_BITS * TW_LEVELS)))
+        exp = tw->curTick + (1ULL << (TW_BITS * TW_LEVELS)) - 1;
+
+    t->level = level;
+    t->slot = (exp >> (TW_BITS * level)) & TW_MASK;
+    listAppend(&tw->slots[level][t->slot], t);
+    tw->map[level] |= 1ULL << t->slot;
+}
+
+/* Take 't' out of whatever list it is in */
+
+static void
+detach(TimerWheel *tw, TwTimer *t)
+{
+    TwTimer *head;
+
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+
+    if (t->level < TW_LEVELS)
+    {
+        head = &tw->slots[t->level][t->slot];
+        if (head->next == head)
+            tw->map[t->level] &= ~(1ULL << t->slot);
+    }
+    t->level = -1;
+}
+
+/* Move the timers in 'tw->slots[level][slot]' to the end of the list
+   'dest' */
+
+static void
+moveSlot(TimerWheel *tw, int level, int slot, TwTimer *dest)
+{
+    TwTimer *head = &tw->slots[level][slot];
+
+    if (head->next == head)
+        return;
+
+    head->next->prev = dest->prev;
+    dest->prev->next = head->next;
+    head->prev->next = dest;
+    dest->prev = head->prev;
+    listInit(head);
+    tw->map[level] &= ~(1ULL << slot);
+}
+
+/* Put the timers in the level-'level' slot for the block that starts at
+   'curTick' back into the wheel */
+
+static void
+cascade(TimerWheel *tw, int level)
+{
+    TwTimer list, *t;
+
+    listInit(&list);
+    moveSlot(tw, level, (tw->curTick >> (TW_BITS * level)) & TW_MASK, &list);
+    while (list.next != &list)
+    {
+        t = list.next;
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+        place(tw, t);
+    }
+}
+
+/* Process the ticks up to and including 'target', moving the timers that
+   expire to 'tw->expired' */
+
+static void
+advance(TimerWheel *tw, uint64_t target)
+{
+    uint64_t above, next;
+    int idx;
+
+    while (tw->curTick <= target)
+    {
+        idx = tw->curTick & TW_MASK;
+        if (idx == 0)
+        {
+            for (int level = 1; level < TW_LEVELS; level++)
+            {
+                cascade(tw, level);
+                if (((tw->curTick >> (TW_BITS * level)) & TW_MASK) != 0)
+                    break;
+            }
+        }
+
+        for (TwTimer *t = tw->slots[0][idx].next; t != &tw->slots[0][idx];
+             t = t->next)
+            t->level = TW_EXPIRED;
+        moveSlot(tw, 0, idx, &tw->expired);
+
+        /* Skip to the next nonempty level-0 slot in this block, or else
+           to the start of the next block */
+
+        above = (idx == TW_MASK) ? 0 : tw->map[0] & (~0ULL << (idx + 1));
+        next = tw->curTick - idx +
+               (above ? (uint64_t)__builtin_ctzll(above) : TW_SLOTS);
+        tw->curTick = (next <= target) ? next : target + 1;
+    }
+}
+
+/* Return the next tick at which a level-0 slot must be processed or a
+   higher-level slot cascaded, or TW_NONE if there are no timers */
+
+static uint64_t
+nextEvent(const TimerWheel *tw)
+{
+    uint64_t best, block, rot, tick;
+    int shift, r;
+
+    best = TW_NONE;
+    for (int level = 0; level < TW_LEVELS; level++)
+    {
+        if (tw->map[level] == 0)
+            continue;
+
+        /* The first block of this level that starts at or after
+           'curTick', and the first nonempty slot from there on */
+
+        shift = TW_BITS * level;
+        block = (tw->curTick + (1ULL << shift) - 1) >> shift;
+        r = block & TW_MASK;
+        rot = (tw->map[level] >> r) | (tw->map[level] << ((TW_SLOTS - r) &
+                                                          TW_MASK));
+        tick = (block + __builtin_ctzll(rot)) << shift;
+        if (tick < best)
+            best = tick;
+    }
+    return best;
+}
+
+/* Set the timerfd to expire at 'tick' (or disarm it, for TW_NONE),
+   unless it already is */
+
+static int
+arm(TimerWheel *tw, uint64_t tick)
+{
+    struct itimerspec its;
+    long long ns;
+
+    if (tick == tw->armedTick)
+        return 0;
+
+    memset(&its, 0, sizeof(its));
+    if (tick != TW_NONE)
+    {
+        ns = tw->baseNs + (long long)tick * tw->tickNs;
+        its.it_value.tv_sec = ns / 1000000000;
+        its.it_value.tv_nsec = ns % 1000000000;
+    }
+    if (timerfd_settime(tw->tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+        return -1;
+
+    tw->armedTick = tick;
+    return 0;
+}
+
+/* Create a wheel whose resolution is 'tickNs' nanoseconds. Returns NULL
+   on error. */
+
+TimerWheel *
+twCreate(long long tickNs)
+{
+    TimerWheel *tw;
+
+    if (tickNs <= 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    tw = malloc(sizeof(TimerWheel));
+    if (tw == NULL)
+        return NULL;
+    memset(tw, 0, sizeof(TimerWheel));
+
+    tw->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tw->tfd == -1)
+    {
+        free(tw);
+        return NULL;
+    }
+
+    for (int level = 0; level < TW_LEVELS; level++)
+        for (int slot = 0; slot < TW_SLOTS; slot++)
+            listInit(&tw->slots[level][slot]);
+    listInit(&tw->expired);
+
+    tw->tickNs = tickNs;
+    tw->baseNs = nowNs();
+    tw->armedTick = TW_NONE;
+    return tw;
+}
+
+int
+twFd(const TimerWheel *tw)
+{
+    return tw->tfd;
+}
+
+void
+twInitTimer(TwTimer *t, void (*func)(TimerWheel *, TwTimer *, void *),
+            void *arg)
+{
+    t->next = t->prev = NULL;
+    t->level = -1;
+    t->func = func;
+    t->arg = arg;
+}
+
+/* Start 't', so that its callback is called after 'delayNs' nanoseconds.
+   If 't' is already pending, it is first cancelled. Returns 0 on success,
+   or -1 on error. */
+
+int
+twAdd(TimerWheel *tw, TwTimer *t, long long delayNs)
+{
+    long long ns;
+
+    if (t->level != -1)
+        detach(tw, t);
+
+    /* Round up, so that the timer can't expire early */
+
+    ns = nowNs() + (delayNs > 0 ? delayNs : 0) - tw->baseNs;
+    t->expires = (ns + tw->tickNs - 1) / tw->tickNs;
+    place(tw, t);
+
+    if (tw->armedTick == TW_NONE || t->expires < tw->armedTick)
+        return arm(tw, nextEvent(tw));
+    return 0;
+}
+
+/* Stop 't'. Returns 1 if it was pending, or 0 if it was not (because it
+   had expired, or was already cancelled). */
+
+int
+twCancel(TimerWheel *tw, TwTimer *t)
+{
+    if (t->level == -1)
+        return 0;
+    detach(tw, t);
+    return 1;
+}
+
+int
+twPending(const TwTimer *t)
+{
+    return t->level != -1;
+}
+
+/* Run the callbacks of the timers that have expired, and reset the
+   timerfd. Call this when the timerfd is readable. Returns the number of
+   callbacks run, or -1 on error. */
+
+long
+twProcess(TimerWheel *tw)
+{
+    uint64_t numExp;
+    TwTimer *t;
+    long long ns;
+    long n;
+
+    if (read(tw->tfd, &numExp, sizeof(numExp)) == -1)
+    {
+        if (errno != EAGAIN)
+            return -1;
+    }
+    else
+    {
+        tw->armedTick = TW_NONE; /* No interval, so it's now disarmed */
+    }
+
+    ns = nowNs() - tw->baseNs;
+    if (ns >= 0)
+        advance(tw, ns / tw->tickNs);
+
+    /* Take each timer off the expired list before calling back, so that
+       the callback may restart it, or cancel others on the list */
+
+    for (n = 0; tw->expired.next != &tw->expired; n++)
+    {
+        t = tw->expired.next;
+        detach(tw, t);
+        t->func(tw, t, t->arg);
+    }
+
+    return (arm(tw, nextEvent(tw)) == -1) ? -1 : n;
+}
+
+void
+twFree(TimerWheel *tw)
+{
+    close(tw->tfd);
+    free(tw);
+}
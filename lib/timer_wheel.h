@@ -0,0 +1,65 @@
+/* timer_wheel.h
+
+   Header file for timer_wheel.c.
+
+   A hierarchical timing wheel: a set of one-shot timers, possibly
+   hundreds of thousands of them (for example, one idle timeout per
+   connection), that shares a single timerfd. Adding and cancelling a
+   timer take constant time, and usually make no system call. The
+   operations are:
+
+        create a wheel:             twCreate(tickNs)
+        descriptor to monitor:      twFd(tw)
+        prepare a timer:            twInitTimer(t, func, arg)
+        start (or restart) it:      twAdd(tw, t, delayNs)
+        stop it:                    twCancel(tw, t)
+        run expired timers:         twProcess(tw)
+        free the wheel:             twFree(tw)
+
+   The caller allocates the TwTimer structures (typically inside the
+   structure for a connection), and must not free or reinitialize one
+   while it is pending. Times are rounded up to a whole number of ticks,
+   so a timer never expires early, and may expire up to a tick late.
+
+   The wheel's file descriptor (a timerfd) becomes readable when a timer
+   may have expired; the caller monitors it with epoll (or select() or
+   poll()), and calls twProcess(), which runs the callbacks of all the
+   expired timers as one batch. A callback may add or cancel timers. A
+   wheel belongs to one thread.
+*/
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H /* Prevent accidental double inclusion */
+
+#include <stdint.h>
+
+typedef struct timerWheel TimerWheel; /* Opaque */
+
+typedef struct twTimer TwTimer;
+
+struct twTimer
+{
+    TwTimer *next, *prev;       /* In a slot's list, when pending */
+    uint64_t expires;           /* Tick at which the timer expires */
+    int level, slot;            /* Where it is; level is -1 if not pending */
+    void (*func)(TimerWheel *tw, TwTimer *t, void *arg);
+    void *arg;
+};
+
+TimerWheel *twCreate(long long tickNs);
+
+int twFd(const TimerWheel *tw);
+
+void twInitTimer(TwTimer *t, void (*func)(TimerWheel *, TwTimer *, void *),
+                 void *arg);
+
+int twAdd(TimerWheel *tw, TwTimer *t, long long delayNs);
+
+int twCancel(TimerWheel *tw, TwTimer *t);
+
+int twPending(const TwTimer *t);
+
+long twProcess(TimerWheel *tw);
+
+void twFree(TimerWheel *tw);
+
+#endif
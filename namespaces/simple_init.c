@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/mount.h>
+#include "sig_log.h"
 
 #define errExit(msg)        \
     do                      \
@@ -26,6 +27,18 @@
 
 static int verbose = 0;
 
+/* printf() and perror() are not async-signal-safe, so the SIGCHLD
+   handler logs what it does to 'sigLog', and the main program prints
+   the records (see drain_log()) */
+
+static SigLog *sigLog;
+
+enum
+{
+    EV_REAPED,       /* arg[0] = PID */
+    EV_WAIT_ERROR    /* arg[0] = errno from waitpid() */
+};
+
 /* Display wait status (from waitpid() or similar) given in 'wstatus' */
 
 /* SIGCHLD handler: reap child processes as they change state */
@@ -35,6 +48,7 @@ child_handler(int sig)
 {
     pid_t pid;
     int wstatus;
+    int saved_errno = errno;
 
     /* WUNTRACED and WCONTINUED allow waitpid() to catch stopped and
        continued children (in addition to terminated children) */
@@ -46,14 +60,33 @@ child_handler(int sig)
         {
             if (errno == ECHILD) /* No more children */
                 break;
-            else
-                perror("waitpid"); /* Unexpected error */
+            slLog(sigLog, EV_WAIT_ERROR, errno, 0, 0); /* Unexpected */
+            break;
         }
 
-        if (verbose)
-            printf("\tinit: SIGCHLD handler: PID %ld terminated\n",
-                   (long)pid);
+        slLog(sigLog, EV_REAPED, pid, 0, 0);
     }
+    errno = saved_errno;
+}
+
+/* Print a record logged by child_handler() */
+
+static void
+print_record(const struct slRecord *rec, void *arg)
+{
+    if (rec->event == EV_WAIT_ERROR)
+        fprintf(stderr, "waitpid: %s\n", strerror((int)rec->arg[0]));
+    else if (verbose)
+        printf("\tinit: SIGCHLD handler: PID %ld terminated\n",
+               rec->arg[0]);
+}
+
+static void
+drain_log(void)
+{
+    slDrain(sigLog, print_record, NULL);
+    if (slDropped(sigLog) > 0)
+        fprintf(stderr, "init: some SIGCHLD log records were lost\n");
 }
 
 /* Perform word expansion on string in 'cmd', allocating and
@@ -115,6 +148,10 @@ int main(int argc, char *argv[])
         }
     }
 
+    sigLog = slCreate(256);
+    if (sigLog == NULL)
+        errExit("slCreate");
+
     struct sigaction sa;
     sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
     sigemptyset(&sa.sa_mask);
@@ -245,6 +282,7 @@ int main(int argc, char *argv[])
             printf("\tinit: created child %ld\n", (long)pid);
 
         pause(); /* Will be interrupted by signal handler */
+        drain_log();
 
         /* After child changes state, ensure that the 'init' program
            is the foreground process group for the terminal */
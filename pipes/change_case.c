@@ -7,7 +7,7 @@
    sends it back to the parent using the other pipe. The parent reads
    the text returned by the child and echoes it on standard output.
 */
-#include <ctype.h>
+#include "text_xform.h"
 #include "tlpi_hdr.h"
 
 #define BUF_SIZE 100 /* Should be <= PIPE_BUF bytes */
@@ -43,8 +43,7 @@ int main(int argc, char *argv[])
 
         while ((cnt = read(outbound[0], buf, BUF_SIZE)) > 0)
         {
-            for (int j = 0; j < cnt; j++)
-                buf[j] = toupper((unsigned char)buf[j]);
+            txTransform(TX_UPPER, buf, cnt);
             if (write(inbound[1], buf, cnt) != cnt)
                 fatal("failed/partial write(): inbound pipe");
         }
@@ -7,10 +7,17 @@
    its PID and the length of the sequence it wishes to be allocated. The client
    then reads the server's response and displays it on stdout.
 
+   With "-n num-requests", the client sends that many requests, keeping
+   both FIFOs open throughout, and reports the rate at which requests
+   were served. So that a server that closes our FIFO after each response
+   doesn't cause us to see end-of-file, we hold a write descriptor for
+   our own FIFO, in the same way that the server does for its FIFO.
+
    See fifo_seqnum.h for the format of request and response messages.
 
    The server is in fifo_seqnum_server.c.
 */
+#include <time.h>
 #include "fifo_seqnum.h"
 
 static char clientFifo[CLIENT_FIFO_NAME_LEN];
@@ -21,14 +28,61 @@ removeFifo(void)
     unlink(clientFifo);
 }
 
+/* Send 'numReqs' requests over already open FIFOs, and report the
+   request rate */
+
+static void
+requestLoop(int serverFd, int clientFd, const struct request *req,
+            long numReqs)
+{
+    struct timespec start, end;
+    struct response resp;
+    double secs;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+        errExit("clock_gettime");
+
+    for (long j = 0; j < numReqs; j++)
+    {
+        if (write(serverFd, req, sizeof(struct request)) !=
+            sizeof(struct request))
+            fatal("Can't write to server");
+
+        if (read(clientFd, &resp, sizeof(struct response)) !=
+            sizeof(struct response))
+            fatal("Can't read response from server");
+    }
+
+    if (clock_gettime(CLOCK_MONOTONIC, &end) == -1)
+        errExit("clock_gettime");
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%ld requests in %.3f secs (%.0f requests/sec); last: %d\n",
+           numReqs, secs, numReqs / secs, resp.seqNum);
+}
+
 int main(int argc, char *argv[])
 {
-    int serverFd, clientFd;
+    int serverFd, clientFd, dummyFd, opt, flags;
     struct request req;
     struct response resp;
-
-    if (argc > 1 && strcmp(argv[1], "--help") == 0)
-        usageErr("%s [seq-len]\n", argv[0]);
+    long numReqs;
+
+    numReqs = 1;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            numReqs = getLong(optarg, GN_GT_0, "num-requests");
+            break;
+        default:
+            usageErr("%s [-n num-requests] [seq-len]\n", argv[0]);
+        }
+    }
+
+    if (optind < argc && strcmp(argv[optind], "--help") == 0)
+        usageErr("%s [-n num-requests] [seq-len]\n", argv[0]);
 
     /* Create our FIFO (before sending request, to avoid a race) */
 
@@ -44,12 +98,31 @@ int main(int argc, char *argv[])
     /* Construct request message, open server FIFO, and send message */
 
     req.pid = getpid();
-    req.seqLen = (argc > 1) ? getInt(argv[1], GN_GT_0, "seq-len") : 1;
+    req.seqLen = (optind < argc) ? getInt(argv[optind], GN_GT_0, "seq-len") : 1;
 
     serverFd = open(SERVER_FIFO, O_WRONLY);
     if (serverFd == -1)
         errExit("open %s", SERVER_FIFO);
 
+    if (numReqs > 1)
+    {
+        /* Open our FIFO for reading without waiting for the server,
+           then add our own writer, and make reads blocking again */
+
+        clientFd = open(clientFifo, O_RDONLY | O_NONBLOCK);
+        if (clientFd == -1)
+            errExit("open %s", clientFifo);
+        dummyFd = open(clientFifo, O_WRONLY);
+        if (dummyFd == -1)
+            errExit("open %s", clientFifo);
+        flags = fcntl(clientFd, F_GETFL);
+        if (flags == -1 || fcntl(clientFd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+            errExit("fcntl");
+
+        requestLoop(serverFd, clientFd, &req, numReqs);
+        exit(EXIT_SUCCESS);
+    }
+
     if (write(serverFd, &req, sizeof(struct request)) !=
         sizeof(struct request))
         fatal("Can't write to server");
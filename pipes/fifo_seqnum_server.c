@@ -14,19 +14,219 @@
 
    See fifo_seqnum.h for the format of request and response messages.
 
+   By default, the server reads one request per read(), and opens and
+   closes the client's FIFO for each response. With the -p option, the
+   server instead:
+
+   * reads as many requests as are available (up to PIPE_BUF bytes) with
+     each read(); since each request is written with a single write() of
+     fewer than PIPE_BUF bytes, requests are never split or interleaved;
+
+   * keeps client FIFOs open between responses, in a cache of 'cache-size'
+     descriptors (default 64) from which the least recently used entry is
+     evicted when the cache is full. A write that fails with EPIPE means
+     that the cached FIFO no longer has a reader (the client has exited,
+     and its PID may since have been reused); the entry is discarded, and
+     the FIFO is opened afresh by name.
+
+   When the server is terminated with SIGINT, it displays the number of
+   requests handled, the request rate (measured from the first request
+   to the last), and the number of FIFO opens.
+   Running the clients against the server with and without -p shows what
+   the open()/close() pair per response costs.
+
    The client is in fifo_seqnum_client.c.
 */
 #include <signal.h>
+#include <limits.h>
+#include <time.h>
 #include "fifo_seqnum.h"
 
-int main(int argc, char *argv[])
+#define MAX_BATCH (PIPE_BUF / sizeof(struct request))
+
+struct clientCache
+{                  /* One cached client FIFO descriptor */
+    pid_t pid;     /* 0 == slot unused */
+    int fd;
+    long lastUse;  /* Value of 'useCounter' when last used */
+};
+
+static struct clientCache *cache;
+static int cacheSize;
+static long useCounter;
+
+static long numReqs, numOpens, numEvictions, numStale;
+static volatile sig_atomic_t gotSigint = 0;
+
+static void
+sigintHandler(int sig)
+{
+    gotSigint = 1;
+}
+
+/* Open the FIFO of the client with the given PID */
+
+static int
+openClientFifo(pid_t pid)
 {
-    int serverFd, dummyFd, clientFd;
     char clientFifo[CLIENT_FIFO_NAME_LEN];
-    struct request req;
+    int fd;
+
+    snprintf(clientFifo, CLIENT_FIFO_NAME_LEN, CLIENT_FIFO_TEMPLATE,
+             (long)pid);
+    fd = open(clientFifo, O_WRONLY);
+    if (fd == -1)
+        errMsg("open %s", clientFifo);
+    else
+        numOpens++;
+    return fd;
+}
+
+/* Return the cache slot for 'pid', opening the client FIFO (and evicting
+   the least recently used slot) if the client is not in the cache.
+   Returns NULL if the FIFO can't be opened. */
+
+static struct clientCache *
+lookupClient(pid_t pid)
+{
+    struct clientCache *victim;
+    int fd;
+
+    victim = &cache[0];
+    for (int j = 0; j < cacheSize; j++)
+    {
+        if (cache[j].pid == pid)
+        {
+            cache[j].lastUse = ++useCounter;
+            return &cache[j];
+        }
+        if (cache[j].lastUse < victim->lastUse)
+            victim = &cache[j]; /* Unused slots have 'lastUse' == 0 */
+    }
+
+    fd = openClientFifo(pid);
+    if (fd == -1)
+        return NULL;
+
+    if (victim->pid != 0)
+    {
+        close(victim->fd);
+        numEvictions++;
+    }
+    victim->pid = pid;
+    victim->fd = fd;
+    victim->lastUse = ++useCounter;
+    return victim;
+}
+
+static void
+dropClient(struct clientCache *c)
+{
+    close(c->fd);
+    c->pid = 0;
+    c->lastUse = 0;
+}
+
+/* Send 'resp' to client 'pid' via a cached descriptor */
+
+static void
+respondCached(pid_t pid, const struct response *resp)
+{
+    struct clientCache *c;
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        c = lookupClient(pid);
+        if (c == NULL)
+            return;
+
+        if (write(c->fd, resp, sizeof(struct response)) ==
+            sizeof(struct response))
+            return;
+
+        /* On EPIPE, the cached FIFO has no reader; try once more with
+           a freshly opened FIFO */
+
+        if (errno != EPIPE)
+        {
+            errMsg("write to client %ld", (long)pid);
+            dropClient(c);
+            return;
+        }
+        dropClient(c);
+        numStale++;
+    }
+}
+
+/* Send 'resp' to client 'pid', opening and closing its FIFO */
+
+static void
+respondOnce(pid_t pid, const struct response *resp)
+{
+    int clientFd;
+
+    /* Open client FIFO (previously created by client) */
+
+    clientFd = openClientFifo(pid);
+    if (clientFd == -1) /* Open failed, give up on client */
+        return;
+
+    /* Send response and close FIFO */
+
+    if (write(clientFd, resp, sizeof(struct response)) != sizeof(struct response))
+        fprintf(stderr, "Error writing to FIFO of client %ld\n", (long)pid);
+    if (close(clientFd) == -1)
+        errMsg("close");
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [-p] [-c cache-size]\n", progName);
+    fprintf(stderr, "    -p   Batch request reads and keep client FIFOs "
+                    "open\n");
+    fprintf(stderr, "    -c   Number of client FIFOs kept open with -p "
+                    "(default: 64)\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    int serverFd, dummyFd, opt, persistent;
+    struct request req[MAX_BATCH], *r;
     struct response resp;
+    struct sigaction sa;
+    struct timespec start, end;
+    ssize_t numRead;
+    size_t numBytes, readSize;
+    double secs;
     int seqNum = 0; /* This is our "service" */
 
+    persistent = 0;
+    cacheSize = 64;
+    while ((opt = getopt(argc, argv, "pc:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            persistent = 1;
+            break;
+        case 'c':
+            cacheSize = getInt(optarg, GN_GT_0, "cache-size");
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (persistent)
+    {
+        cache = calloc(cacheSize, sizeof(struct clientCache));
+        if (cache == NULL)
+            errExit("calloc");
+    }
+    readSize = persistent ? sizeof(req) : sizeof(struct request);
+
     /* Create well-known FIFO, and open it for reading */
 
     umask(0); /* So we get the permissions we want */
@@ -47,33 +247,60 @@ int main(int argc, char *argv[])
     if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
         errExit("signal");
 
-    for (;;)
+    /* SIGINT interrupts read() (no SA_RESTART), so that we can report
+       our statistics */
+
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sa.sa_handler = sigintHandler;
+    if (sigaction(SIGINT, &sa, NULL) == -1)
+        errExit("sigaction");
+
+    start.tv_sec = 0;
+    while (!gotSigint)
     { /* Read requests and send responses */
-        if (read(serverFd, &req, sizeof(struct request)) != sizeof(struct request))
+        numRead = read(serverFd, req, readSize);
+        if (numRead == -1 && errno == EINTR)
+            continue;
+        if (numRead <= 0 || numRead % sizeof(struct request) != 0)
         {
             fprintf(stderr, "Error reading request; discarding\n");
             continue; /* Either partial read or error */
         }
 
-        /* Open client FIFO (previously created by client) */
+        if (start.tv_sec == 0) /* Time from the first request */
+            if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+                errExit("clock_gettime");
 
-        snprintf(clientFifo, CLIENT_FIFO_NAME_LEN, CLIENT_FIFO_TEMPLATE,
-                 (long)req.pid);
-        clientFd = open(clientFifo, O_WRONLY);
-        if (clientFd == -1)
-        { /* Open failed, give up on client */
-            errMsg("open %s", clientFifo);
-            continue;
-        }
+        for (numBytes = 0; numBytes < numRead;
+             numBytes += sizeof(struct request))
+        {
+            r = &req[numBytes / sizeof(struct request)];
 
-        /* Send response and close FIFO */
+            resp.seqNum = seqNum;
+            if (persistent)
+                respondCached(r->pid, &resp);
+            else
+                respondOnce(r->pid, &resp);
 
-        resp.seqNum = seqNum;
-        if (write(clientFd, &resp, sizeof(struct response)) != sizeof(struct response))
-            fprintf(stderr, "Error writing to FIFO %s\n", clientFifo);
-        if (close(clientFd) == -1)
-            errMsg("close");
+            seqNum += r->seqLen; /* Update our sequence number */
+            numReqs++;
+        }
 
-        seqNum += req.seqLen; /* Update our sequence number */
+        if (clock_gettime(CLOCK_MONOTONIC, &end) == -1) /* Time to the */
+            errExit("clock_gettime");                   /* last request */
     }
+
+    secs = (start.tv_sec == 0) ? 0 :
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("\n%s mode: %ld requests in %.3f secs (%.0f requests/sec)\n",
+           persistent ? "Persistent" : "Open-per-response", numReqs, secs,
+           (secs > 0) ? numReqs / secs : 0.0);
+    printf("FIFO opens: %ld", numOpens);
+    if (persistent)
+        printf("; evictions: %ld; stale (EPIPE): %ld", numEvictions, numStale);
+    printf("\n");
+
+    exit(EXIT_SUCCESS);
 }
\ No newline at end of file
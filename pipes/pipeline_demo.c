@@ -0,0 +1,151 @@
+/* pipeline_demo.c
+
+   Usage: pipeline_demo [-s pipe-size] [-t tee-file] [-x] 'cmd args...'...
+
+   Run the given commands as a pipeline, using the functions in
+   lib/pipeline.c, and report each stage's exit status and resource
+   usage. Each command-line argument is one stage; it is split into
+   words at white space (there is no quoting).
+
+   Options:
+
+        -s pipe-size   Set the capacity of each pipe with F_SETPIPE_SZ
+        -t tee-file    After the first stage, insert an in-process stage
+                       that writes a copy of the data to 'tee-file'
+                       using tee(2) and splice(2)
+        -x             Insert an in-process splice(2) pass-through stage
+                       between every pair of commands (this shows the
+                       cost of an extra stage that never copies data into
+                       user space)
+
+   For example, the equivalent of pipe_ls_wc.c, with a copy of the
+   listing saved in a file:
+
+        $ ./pipeline_demo -t /tmp/ls.out 'ls' 'wc -l'
+
+   Compare pipe_ls_wc.c, which wires up exactly two children by hand.
+*/
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "pipeline.h"
+#include "print_wait_status.h"
+#include "tlpi_hdr.h"
+
+#define MAX_WORDS 64
+
+/* Split 'str' (in place) into a NULL-terminated vector of words */
+
+static char **
+splitWords(char *str)
+{
+    char **argv;
+    char *save;
+    int n;
+
+    argv = calloc(MAX_WORDS + 1, sizeof(char *));
+    if (argv == NULL)
+        errExit("calloc");
+
+    n = 0;
+    for (char *tok = strtok_r(str, " \t", &save); tok != NULL;
+         tok = strtok_r(NULL, " \t", &save))
+    {
+        if (n == MAX_WORDS)
+            fatal("Too many words in command");
+        argv[n++] = tok;
+    }
+    if (n == 0)
+        fatal("Empty command");
+    return argv;
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [-s pipe-size] [-t tee-file] [-x] "
+                    "'cmd args...'...\n", progName);
+    fprintf(stderr, "    -s   Set pipe capacities with F_SETPIPE_SZ\n");
+    fprintf(stderr, "    -t   Save a copy of the first stage's output "
+                    "in a file\n");
+    fprintf(stderr, "    -x   Add a splice() stage between commands\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, pipeSize, spliceStages, teeFd;
+    const char *teeFile;
+    struct plStage *st;
+    char label[64];
+    Pipeline *pl;
+
+    pipeSize = 0;
+    teeFile = NULL;
+    spliceStages = 0;
+    while ((opt = getopt(argc, argv, "s:t:x")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            pipeSize = getInt(optarg, GN_GT_0 | GN_ANY_BASE, "pipe-size");
+            break;
+        case 't':
+            teeFile = optarg;
+            break;
+        case 'x':
+            spliceStages = 1;
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind >= argc)
+        usageError(argv[0]);
+
+    pl = plCreate(pipeSize);
+    if (pl == NULL)
+        errExit("plCreate");
+
+    teeFd = -1;
+    if (teeFile != NULL)
+    {
+        teeFd = open(teeFile, O_WRONLY | O_CREAT | O_TRUNC,
+                     S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (teeFd == -1)
+            errExit("open %s", teeFile);
+    }
+
+    for (int j = optind; j < argc; j++)
+    {
+        if (plAddExec(pl, splitWords(argv[j])) == -1)
+            errExit("plAddExec");
+
+        if (j == optind && teeFd != -1)
+            if (plAddFunc(pl, plTeeFd, &teeFd) == -1)
+                errExit("plAddFunc");
+
+        if (spliceStages && j < argc - 1)
+            if (plAddFunc(pl, plSpliceCopy, NULL) == -1)
+                errExit("plAddFunc");
+    }
+
+    if (plRun(pl) == -1)
+        errExit("plRun");
+
+    for (int j = 0; j < pl->numStages; j++)
+    {
+        st = &pl->stages[j];
+        snprintf(label, sizeof(label), "stage %d (%s): ", j,
+                 (st->argv != NULL) ? st->argv[0] :
+                 (st->func == plTeeFd) ? "tee" : "splice");
+        printWaitStatus(label, st->status);
+        printf("        user %.3f s, sys %.3f s, max RSS %ld kB\n",
+               st->ru.ru_utime.tv_sec + st->ru.ru_utime.tv_usec / 1e6,
+               st->ru.ru_stime.tv_sec + st->ru.ru_stime.tv_usec / 1e6,
+               st->ru.ru_maxrss);
+    }
+
+    plFree(pl);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,338 @@
+/* vmsplice_xfer.c
+
+   Compare moving data through a pipe with write(2) and read(2) against
+   moving it with vmsplice(2) and splice(2), which avoid copying the data
+   into and out of the pipe.
+
+   Usage as shown in usageError().
+
+   A producer (the parent) generates data in chunks and feeds it into a
+   pipe; a consumer (the child) passes everything that arrives onward to
+   an output, which is /dev/null, a file, or (with "-o socket") a UNIX
+   domain socket drained by a third process.
+
+   The producer either write()s each chunk, or hands the chunk's pages to
+   the pipe with vmsplice(SPLICE_F_GIFT). After a vmsplice(), the pipe
+   refers to our pages rather than to a copy of them, so we must not
+   modify a chunk until the consumer has taken it out of the pipe. We
+   achieve this by double buffering: the chunks come from a page-aligned
+   pool made up of two halves, each at least as large as the pipe. By the
+   time we come back to the start of one half, we have vmspliced a whole
+   half's worth of data since it was last used, and that data alone is
+   enough to fill the pipe, so the earlier half must have been consumed.
+
+   The consumer either read()s and write()s, or splice()s directly from
+   the pipe to the output.
+
+   That argument fails when vmsplice() is combined with splice() to a
+   socket: splicing into a socket queues references to the pages rather
+   than copies of them, so a page may still be waiting in the socket
+   buffer after it has left the pipe, and overwriting it would change
+   data already "sent". (A file or /dev/null takes a copy, or nothing.)
+   The program therefore refuses that combination, and leaves it out of
+   a sweep.
+
+   With -s, the program sweeps a range of pipe capacities (set with
+   F_SETPIPE_SZ) and chunk sizes, and reports MB/s for each combination
+   of methods, showing where zero-copy transfer beats copying.
+
+   See also simple_pipe.c and ../bench/ipc_xfer.c.
+*/
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include "tlpi_hdr.h"
+
+static const char *outPath = "/dev/null";
+
+/* Can the producer's pages be reused once the consumer has taken them
+   from the pipe? (See the comment at the top of this file.) */
+
+static int
+giftSafe(int useVmsplice, int useSplice)
+{
+    return !(useVmsplice && useSplice && strcmp(outPath, "socket") == 0);
+}
+
+/* Produce 'total' bytes into 'fd', 'chunk' bytes at a time */
+
+static void
+produce(int fd, int useVmsplice, size_t chunk, size_t pipeSize,
+        long long total)
+{
+    struct iovec iov;
+    size_t half, off, poolSize;
+    long long done;
+    ssize_t s;
+    char *pool;
+    int err;
+
+    /* Each half of the pool is the pipe capacity, rounded up to a
+       multiple of the chunk size */
+
+    half = (pipeSize + chunk - 1) / chunk * chunk;
+    poolSize = useVmsplice ? 2 * half : chunk;
+
+    err = posix_memalign((void **)&pool, sysconf(_SC_PAGESIZE), poolSize);
+    if (err != 0)
+        errExitEN(err, "posix_memalign");
+
+    off = 0;
+    for (done = 0; done < total; done += chunk)
+    {
+        memset(pool + off, 'a' + (done / chunk) % 26, chunk); /* "Produce" */
+
+        if (!useVmsplice)
+        {
+            if (write(fd, pool, chunk) != chunk)
+                errExit("write");
+            continue;
+        }
+
+        iov.iov_base = pool + off;
+        iov.iov_len = chunk;
+        while (iov.iov_len > 0)
+        {
+            s = vmsplice(fd, &iov, 1, SPLICE_F_GIFT);
+            if (s == -1)
+                errExit("vmsplice");
+            iov.iov_base = (char *)iov.iov_base + s;
+            iov.iov_len -= s;
+        }
+        off = (off + chunk) % poolSize;
+    }
+}
+
+/* Pass everything read from 'fd' onward to 'outFd' */
+
+static void
+consume(int fd, int outFd, int useSplice, size_t chunk)
+{
+    ssize_t numRead;
+    char *buf;
+
+    if (useSplice)
+    {
+        while ((numRead = splice(fd, NULL, outFd, NULL, chunk,
+                                 SPLICE_F_MOVE | SPLICE_F_MORE)) > 0)
+            continue;
+        if (numRead == -1)
+            errExit("splice");
+        return;
+    }
+
+    buf = malloc(chunk);
+    if (buf == NULL)
+        errExit("malloc");
+
+    while ((numRead = read(fd, buf, chunk)) > 0)
+        if (write(outFd, buf, numRead) != numRead)
+            errExit("write");
+    if (numRead == -1)
+        errExit("read");
+}
+
+/* Open the output. For "socket", create a socket pair and a process that
+   discards whatever is written to it. */
+
+static int
+openOutput(pid_t *drainer)
+{
+    char buf[65536];
+    int sv[2], fd;
+
+    *drainer = 0;
+    if (strcmp(outPath, "socket") != 0)
+    {
+        fd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (fd == -1)
+            errExit("open %s", outPath);
+        return fd;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+        errExit("socketpair");
+
+    *drainer = fork();
+    switch (*drainer)
+    {
+    case -1:
+        errExit("fork");
+    case 0:
+        close(sv[0]);
+        while (read(sv[1], buf, sizeof(buf)) > 0)
+            continue;
+        _exit(EXIT_SUCCESS);
+    default:
+        close(sv[1]);
+        return sv[0];
+    }
+}
+
+/* Do one transfer and return the throughput in MB/s */
+
+static double
+runOne(int useVmsplice, int useSplice, size_t pipeSize, size_t chunk,
+       long long total)
+{
+    struct timespec start, end;
+    int pfd[2], outFd, actual;
+    pid_t consumer, drainer;
+    double secs;
+
+    outFd = openOutput(&drainer); /* Before pipe(), so that the drainer
+                                     doesn't hold the pipe open */
+    if (pipe(pfd) == -1)
+        errExit("pipe");
+
+    actual = fcntl(pfd[1], F_SETPIPE_SZ, (int)pipeSize);
+    if (actual == -1)
+        errExit("fcntl-F_SETPIPE_SZ %ld", (long)pipeSize);
+
+    if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+        errExit("clock_gettime");
+
+    consumer = fork();
+    switch (consumer)
+    {
+    case -1:
+        errExit("fork");
+    case 0:
+        close(pfd[1]);
+        consume(pfd[0], outFd, useSplice, chunk);
+        _exit(EXIT_SUCCESS);
+    default:
+        break;
+    }
+
+    close(pfd[0]);
+    close(outFd);
+
+    produce(pfd[1], useVmsplice, chunk, actual, total);
+    close(pfd[1]); /* Consumer sees EOF */
+
+    if (waitpid(consumer, NULL, 0) == -1)
+        errExit("waitpid");
+    if (clock_gettime(CLOCK_MONOTONIC, &end) == -1)
+        errExit("clock_gettime");
+
+    if (drainer != 0 && waitpid(drainer, NULL, 0) == -1)
+        errExit("waitpid");
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return total / secs / 1e6;
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -p method  Producer: 'write' or 'vmsplice' "
+                    "(default)\n");
+    fprintf(stderr, "    -c method  Consumer: 'read' or 'splice' "
+                    "(default)\n");
+    fprintf(stderr, "    -P size    Pipe capacity (default: 65536)\n");
+    fprintf(stderr, "    -C size    Chunk size; a multiple of the page "
+                    "size (default: 65536)\n");
+    fprintf(stderr, "    -n bytes   Total bytes (default: 1073741824)\n");
+    fprintf(stderr, "    -o output  File, or 'socket' (default: "
+                    "/dev/null); 'socket' can't\n");
+    fprintf(stderr, "               be used with vmsplice/splice\n");
+    fprintf(stderr, "    -s         Sweep pipe capacities and chunk sizes\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t pipeSizes[] = {65536, 262144, 1048576};
+    static const size_t chunkSizes[] = {4096, 16384, 65536, 262144};
+    static const struct
+    {
+        int vmsplice, splice;
+        const char *label;
+    } methods[] = {
+        {0, 0, "write/read"},
+        {0, 1, "write/splice"},
+        {1, 1, "vmsplice/splice"},
+    };
+    int opt, useVmsplice, useSplice, sweep;
+    size_t pipeSize, chunk;
+    long long total;
+    long pageSize;
+
+    useVmsplice = useSplice = 1;
+    pipeSize = 65536;
+    chunk = 65536;
+    total = 1LL << 30;
+    sweep = 0;
+
+    while ((opt = getopt(argc, argv, "p:c:P:C:n:o:s")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            if (strcmp(optarg, "write") != 0 &&
+                strcmp(optarg, "vmsplice") != 0)
+                usageError(argv[0]);
+            useVmsplice = strcmp(optarg, "vmsplice") == 0;
+            break;
+        case 'c':
+            if (strcmp(optarg, "read") != 0 && strcmp(optarg, "splice") != 0)
+                usageError(argv[0]);
+            useSplice = strcmp(optarg, "splice") == 0;
+            break;
+        case 'P':
+            pipeSize = getLong(optarg, GN_GT_0 | GN_ANY_BASE, "pipe-size");
+            break;
+        case 'C':
+            chunk = getLong(optarg, GN_GT_0 | GN_ANY_BASE, "chunk");
+            break;
+        case 'n':
+            total = getLong(optarg, GN_GT_0 | GN_ANY_BASE, "bytes");
+            break;
+        case 'o':
+            outPath = optarg;
+            break;
+        case 's':
+            sweep = 1;
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    pageSize = sysconf(_SC_PAGESIZE);
+    if (chunk % pageSize != 0)
+        cmdLineErr("chunk size must be a multiple of %ld\n", pageSize);
+
+    if (!sweep)
+    {
+        if (!giftSafe(useVmsplice, useSplice))
+            cmdLineErr("vmsplice/splice can't be used with '-o socket': "
+                       "the socket would still refer to pages that are "
+                       "reused\n");
+        printf("%s/%s: %.1f MB/s\n", useVmsplice ? "vmsplice" : "write",
+               useSplice ? "splice" : "read",
+               runOne(useVmsplice, useSplice, pipeSize, chunk, total));
+        exit(EXIT_SUCCESS);
+    }
+
+    printf("%-16s %10s %10s %10s\n", "method", "pipe-size", "chunk", "MB/s");
+    for (size_t p = 0; p < sizeof(pipeSizes) / sizeof(pipeSizes[0]); p++)
+        for (size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+            for (size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); m++)
+                if (giftSafe(methods[m].vmsplice, methods[m].splice))
+                        printf("%-16s %10ld %10ld %10.1f\n", methods[m].label,
+                           (long)pipeSizes[p], (long)chunkSizes[c],
+                           runOne(methods[m].vmsplice, methods[m].splice,
+                                  pipeSizes[p], chunkSizes[c], total));
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,347 @@
+/* mq_dispatch.c
+
+   Implement the POSIX message queue dispatcher declared in mq_dispatch.h.
+
+   Each pool thread loops in epoll_wait(), retrieving one event at a
+   time. An event for a queue hands that queue to the thread (because of
+   EPOLLONESHOT, no other thread will see the queue until it is rearmed).
+   An event on the eventfd means that mqDispatcherStop() was called; the
+   eventfd is never read, so it stays readable and wakes every thread.
+
+   A removed queue's mqReg structure is not freed until the dispatcher is
+   destroyed, because a thread may already have retrieved an event that
+   refers to it. A thread marks a queue 'busy' while it drains it, and
+   checks the 'removed' flag before each message, so that
+   mqDispatcherRemove() need only wait for the current handler (if any)
+   to return.
+*/
+#define _GNU_SOURCE
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include "mq_dispatch.h" /* Declares functions defined here */
+#include "tlpi_hdr.h"
+
+/* Drain all messages currently in the queue described by 'reg', unless
+   the queue is removed meanwhile */
+
+static void
+drainQueue(struct mqReg *reg)
+{
+    unsigned int prio;
+    ssize_t numRead;
+
+    while (!__atomic_load_n(&reg->removed, __ATOMIC_ACQUIRE))
+    {
+        numRead = mq_receive(reg->mqd, reg->buf, reg->msgsize, &prio);
+        if (numRead == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                errMsg("mq_receive");
+            return;
+        }
+        reg->numMsgs++;
+        reg->func(reg->mqd, reg->buf, numRead, prio, reg->arg);
+    }
+}
+
+static void *
+threadFunc(void *arg)
+{
+    MqDispatcher *d = arg;
+    struct epoll_event ev;
+    struct mqReg *reg;
+    int ready;
+
+    while (!d->stop)
+    {
+        ready = epoll_wait(d->epfd, &ev, 1, -1);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            errExit("epoll_wait");
+        }
+
+        if (ev.data.ptr == NULL) /* eventfd: we are being stopped */
+            break;
+
+        __atomic_add_fetch(&d->numWakeups, 1, __ATOMIC_RELAXED);
+
+        reg = ev.data.ptr;
+        pthread_mutex_lock(&d->mtx);
+        if (reg->removed)
+        {
+            pthread_mutex_unlock(&d->mtx);
+            continue;
+        }
+        reg->busy = 1;
+        reg->owner = pthread_self();
+        pthread_mutex_unlock(&d->mtx);
+
+        drainQueue(reg);
+
+        /* Give the queue back to epoll (or, if it was removed while we
+           drained it, tell mqDispatcherRemove() that we've finished). If
+           a message arrived after our final mq_receive(), the rearmed
+           descriptor is already ready. */
+
+        pthread_mutex_lock(&d->mtx);
+        reg->busy = 0;
+        if (reg->removed)
+        {
+            pthread_cond_broadcast(&d->drained);
+        }
+        else
+        {
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.ptr = reg;
+            if (epoll_ctl(d->epfd, EPOLL_CTL_MOD, reg->mqd, &ev) == -1)
+                errMsg("epoll_ctl-EPOLL_CTL_MOD");
+        }
+        pthread_mutex_unlock(&d->mtx);
+    }
+
+    return NULL;
+}
+
+/* Create a dispatcher that will run handlers on 'numThreads' threads.
+   Returns NULL (with errno set) on error. */
+
+MqDispatcher *
+mqDispatcherCreate(int numThreads)
+{
+    struct epoll_event ev;
+    MqDispatcher *d;
+    int s;
+
+    if (numThreads <= 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    d = calloc(1, sizeof(MqDispatcher));
+    if (d == NULL)
+        return NULL;
+
+    d->epfd = d->wakeFd = -1;
+    d->numThreads = numThreads;
+    d->threads = calloc(numThreads, sizeof(pthread_t));
+    if (d->threads == NULL)
+        goto fail;
+
+    s = pthread_mutex_init(&d->mtx, NULL);
+    if (s != 0)
+    {
+        errno = s;
+        goto fail;
+    }
+    s = pthread_cond_init(&d->drained, NULL);
+    if (s != 0)
+    {
+        pthread_mutex_destroy(&d->mtx);
+        errno = s;
+        goto fail;
+    }
+
+    d->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (d->epfd == -1)
+        goto fail;
+
+    d->wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (d->wakeFd == -1)
+        goto fail;
+
+    ev.events = EPOLLIN; /* Level-triggered: wakes every thread */
+    ev.data.ptr = NULL;
+    if (epoll_ctl(d->epfd, EPOLL_CTL_ADD, d->wakeFd, &ev) == -1)
+        goto fail;
+
+    return d;
+
+fail:
+    s = errno;
+    if (d->epfd != -1)
+        close(d->epfd);
+    if (d->wakeFd != -1)
+        close(d->wakeFd);
+    free(d->threads);
+    free(d);
+    errno = s;
+    return NULL;
+}
+
+/* Register 'mqd', so that 'func' is called (with 'arg' as its last
+   argument) for each message that arrives on the queue. The descriptor
+   is placed in nonblocking mode. May be called before or after
+   mqDispatcherStart(). Returns 0 on success, or -1 on error. */
+
+int mqDispatcherAdd(MqDispatcher *d, mqd_t mqd, MqHandler func, void *arg)
+{
+    struct epoll_event ev;
+    struct mq_attr attr, newAttr;
+    struct mqReg *reg;
+    int savedErrno;
+
+    if (mq_getattr(mqd, &attr) == -1)
+        return -1;
+
+    if (!(attr.mq_flags & O_NONBLOCK))
+    {
+        newAttr = attr;
+        newAttr.mq_flags |= O_NONBLOCK;
+        if (mq_setattr(mqd, &newAttr, NULL) == -1)
+            return -1;
+    }
+
+    reg = calloc(1, sizeof(struct mqReg));
+    if (reg == NULL)
+        return -1;
+    reg->buf = malloc(attr.mq_msgsize);
+    if (reg->buf == NULL)
+    {
+        free(reg);
+        return -1;
+    }
+    reg->mqd = mqd;
+    reg->func = func;
+    reg->arg = arg;
+    reg->msgsize = attr.mq_msgsize;
+
+    pthread_mutex_lock(&d->mtx);
+
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = reg;
+    if (epoll_ctl(d->epfd, EPOLL_CTL_ADD, mqd, &ev) == -1)
+    {
+        savedErrno = errno;
+        pthread_mutex_unlock(&d->mtx);
+        free(reg->buf);
+        free(reg);
+        errno = savedErrno;
+        return -1;
+    }
+
+    reg->next = d->regs;
+    d->regs = reg;
+
+    pthread_mutex_unlock(&d->mtx);
+    return 0;
+}
+
+/* Stop dispatching messages from 'mqd'. If a handler is running for
+   this queue, wait for it to return (unless we are that handler); no
+   further messages are delivered once this function returns. Returns 0
+   on success, or -1 (with errno set to ENOENT) if 'mqd' is not
+   registered. */
+
+int mqDispatcherRemove(MqDispatcher *d, mqd_t mqd)
+{
+    struct mqReg *reg;
+    int s;
+
+    s = -1;
+    pthread_mutex_lock(&d->mtx);
+    for (reg = d->regs; reg != NULL; reg = reg->next)
+    {
+        if (reg->mqd == mqd && !reg->removed)
+        {
+            __atomic_store_n(&reg->removed, 1, __ATOMIC_RELEASE);
+            s = epoll_ctl(d->epfd, EPOLL_CTL_DEL, mqd, NULL);
+            while (reg->busy && !pthread_equal(reg->owner, pthread_self()))
+                pthread_cond_wait(&d->drained, &d->mtx);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&d->mtx);
+
+    if (reg == NULL)
+        errno = ENOENT;
+    return s;
+}
+
+/* Create the pool threads. Returns 0 on success, or -1 on error, in
+   which case any threads already created have been stopped. */
+
+int mqDispatcherStart(MqDispatcher *d)
+{
+    uint64_t one = 1, count;
+    int s;
+
+    d->stop = 0;
+    for (int j = 0; j < d->numThreads; j++)
+    {
+        s = pthread_create(&d->threads[j], NULL, threadFunc, d);
+        if (s != 0)
+        {
+            /* Stop the threads we created as mqDispatcherStop() does,
+               rather than with pthread_cancel(), which could catch one
+               inside a handler, or holding 'mtx' */
+
+            d->stop = 1;
+            if (write(d->wakeFd, &one, sizeof(one)) == sizeof(one))
+            {
+                for (int k = 0; k < j; k++)
+                    pthread_join(d->threads[k], NULL);
+
+                /* Make the eventfd unreadable again, for a later call */
+
+                read(d->wakeFd, &count, sizeof(count));
+            }
+            errno = s;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Ask the pool threads to terminate, and wait for them to do so.
+   Returns 0 on success, or -1 on error. */
+
+int mqDispatcherStop(MqDispatcher *d)
+{
+    uint64_t one = 1;
+    int s;
+
+    d->stop = 1;
+    if (write(d->wakeFd, &one, sizeof(one)) != sizeof(one))
+        return -1;
+
+    for (int j = 0; j < d->numThreads; j++)
+    {
+        s = pthread_join(d->threads[j], NULL);
+        if (s != 0)
+        {
+            errno = s;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Free all resources used by 'd'. The pool threads must already have
+   been stopped. The registered message queue descriptors are not
+   closed. */
+
+void mqDispatcherDestroy(MqDispatcher *d)
+{
+    struct mqReg *reg, *next;
+
+    for (reg = d->regs; reg != NULL; reg = next)
+    {
+        next = reg->next;
+        free(reg->buf);
+        free(reg);
+    }
+
+    close(d->epfd);
+    close(d->wakeFd);
+    pthread_cond_destroy(&d->drained);
+    pthread_mutex_destroy(&d->mtx);
+    free(d->threads);
+    free(d);
+}
@@ -0,0 +1,78 @@
+/* mq_dispatch.h
+
+   Header file for mq_dispatch.c.
+
+   A dispatcher that waits for messages on many POSIX message queues at
+   once, using a single epoll instance (on Linux, a message queue
+   descriptor can be monitored with epoll), and runs a handler for each
+   message on a fixed pool of threads. The operations are:
+
+        create a dispatcher:   mqDispatcherCreate(numThreads)
+        add a queue:           mqDispatcherAdd(d, mqd, func, arg)
+        remove a queue:        mqDispatcherRemove(d, mqd)
+        start the threads:     mqDispatcherStart(d)
+        stop the threads:      mqDispatcherStop(d)
+        free the dispatcher:   mqDispatcherDestroy(d)
+
+   Queues are registered with EPOLLONESHOT, so that at most one thread at
+   a time works on a given queue; that thread drains the queue with
+   nonblocking mq_receive() calls until EAGAIN, and then rearms it.
+   Messages from one queue are therefore handled one at a time, in the
+   order in which mq_receive() returns them, while different queues are
+   handled in parallel.
+
+   Compare with mq_notify_thread.c, where every notification creates a
+   new thread, and mq_notify() must be called again after each one.
+*/
+#ifndef MQ_DISPATCH_H
+#define MQ_DISPATCH_H /* Prevent accidental double inclusion */
+
+#include <mqueue.h>
+#include <pthread.h>
+
+typedef void (*MqHandler)(mqd_t mqd, const char *msg, size_t len,
+                          unsigned int prio, void *arg);
+
+struct mqReg
+{                       /* One registered queue */
+    mqd_t mqd;
+    MqHandler func;
+    void *arg;          /* Passed to 'func' */
+    char *buf;          /* mq_msgsize bytes; used only by the thread
+                           that currently owns the queue */
+    long msgsize;
+    int removed;        /* Set by mqDispatcherRemove() */
+    int busy;           /* A thread is draining the queue... */
+    pthread_t owner;    /* ...and this is the thread */
+    long numMsgs;       /* Messages handled */
+    struct mqReg *next;
+};
+
+typedef struct
+{
+    int epfd;                /* epoll instance */
+    int wakeFd;              /* eventfd used by mqDispatcherStop() */
+    int numThreads;
+    pthread_t *threads;
+    pthread_mutex_t mtx;     /* Protects 'regs' and the 'removed' and
+                                'busy' flags */
+    pthread_cond_t drained;  /* Signaled when a removed queue's drain
+                                finishes */
+    struct mqReg *regs;      /* All registrations (freed at destroy) */
+    volatile int stop;
+    long numWakeups;         /* Events returned by epoll_wait() */
+} MqDispatcher;
+
+MqDispatcher *mqDispatcherCreate(int numThreads);
+
+int mqDispatcherAdd(MqDispatcher *d, mqd_t mqd, MqHandler func, void *arg);
+
+int mqDispatcherRemove(MqDispatcher *d, mqd_t mqd);
+
+int mqDispatcherStart(MqDispatcher *d);
+
+int mqDispatcherStop(MqDispatcher *d);
+
+void mqDispatcherDestroy(MqDispatcher *d);
+
+#endif
@@ -0,0 +1,531 @@
+/* pshm_hash.c
+
+   Implementation of an open-addressing hash table held in a POSIX
+   shared memory object.
+
+   See pshm_hash.h for a summary of the interface and of the locking
+   scheme.
+
+   The layout of the shared memory object is:
+
+        struct pshmHashHdr              (padded to PSHM_ALIGN bytes)
+        struct pshmStripe[numStripes]   (padded to PSHM_ALIGN bytes)
+        struct pshmBucket[numBuckets]
+
+   Keys are placed by linear probing. A deleted key leaves a tombstone
+   (PSHM_BKT_DEAD) so that probe sequences running through it are not
+   cut short; tombstones are reused by later insertions.
+
+   Writers of the same key always hash to the same stripe, so they are
+   serialized by that stripe's mutex. Writers of different keys may
+   still race to claim the same free bucket; that race is settled by
+   making the bucket's sequence number odd with a compare-and-swap, which
+   doubles as the "write in progress" marker seen by readers.
+
+   While it has a bucket's sequence number odd, a writer records the
+   bucket, and the odd number, in its stripe. If the writer dies, the
+   next locker of the stripe gets EOWNERDEAD, and uses that record to make
+   the number even again. It changes the number only if it is still the
+   one recorded, so that it can't disturb a writer of another stripe that
+   has since claimed the bucket.
+*/
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include "pshm_hash.h"
+#include "tlpi_hdr.h"
+
+#define PSHM_ALIGN 64 /* Keep each region on its own cache lines */
+
+#define ROUND_UP(n, a) (((n) + (a) - 1) / (a) * (a))
+
+/* Offsets of the stripe and bucket arrays within the mapping */
+
+static size_t
+stripeOffset(void)
+{
+    return ROUND_UP(sizeof(struct pshmHashHdr), PSHM_ALIGN);
+}
+
+static size_t
+bucketOffset(int numStripes)
+{
+    return stripeOffset() +
+           ROUND_UP(numStripes * sizeof(struct pshmStripe), PSHM_ALIGN);
+}
+
+/* 64-bit FNV-1a hash of a null-terminated string */
+
+static uint64_t
+hashKey(const char *key)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (const unsigned char *p = (const unsigned char *)key; *p != '\0'; p++)
+    {
+        h ^= *p;
+        h *= 0x100000001b3ULL;
+    }
+    return h ^ (h >> 32); /* Fold high bits into the bits we mask with */
+}
+
+/* Take a consistent snapshot of bucket 'b' without writing to it */
+
+static void
+readBucket(const struct pshmBucket *b, struct pshmBucket *copy)
+{
+    uint32_t s1, s2;
+
+    for (;;)
+    {
+        s1 = __atomic_load_n(&b->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1)
+        { /* Writer active; try again */
+            sched_yield();
+            continue;
+        }
+
+        memcpy(copy, (const void *)b, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        s2 = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+        if (s1 == s2)
+            return;
+    }
+}
+
+/* Mark bucket 'b' as being modified. Readers will retry until
+   unlockBucket() is called. Returns the (odd) new sequence number. */
+
+static uint32_t
+lockBucket(struct pshmBucket *b)
+{
+    uint32_t s;
+
+    for (;;)
+    {
+        s = __atomic_load_n(&b->seq, __ATOMIC_RELAXED);
+        if (!(s & 1) &&
+            __atomic_compare_exchange_n(&b->seq, &s, s + 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+        sched_yield();
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE); /* 'seq' visible before data */
+    return s + 1;
+}
+
+static void
+unlockBucket(struct pshmBucket *b)
+{
+    __atomic_store_n(&b->seq, b->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Lock bucket 'idx' on behalf of the holder of stripe 'st', recording
+   it in the stripe in case we die before endWrite() */
+
+static struct pshmBucket *
+beginWrite(PshmHash *h, struct pshmStripe *st, uint64_t idx)
+{
+    st->busySeq = lockBucket(&h->bucket[idx]);
+    st->busyIdx = idx + 1;
+    return &h->bucket[idx];
+}
+
+static void
+endWrite(struct pshmStripe *st, struct pshmBucket *b)
+{
+    unlockBucket(b);
+    st->busyIdx = 0;
+}
+
+/* Lock the stripe that covers home bucket 'home', placing a pointer to
+   it in '*stp'. If the previous holder died, first undo its bucket lock.
+   Returns 0 on success, or an error number. */
+
+static int
+lockStripe(PshmHash *h, uint64_t home, struct pshmStripe **stp)
+{
+    struct pshmStripe *st;
+    uint32_t odd;
+    int s;
+
+    st = &h->stripe[home % h->hdr->numStripes];
+    *stp = st;
+
+    s = pthread_mutex_lock(&st->mtx);
+    if (s != EOWNERDEAD)
+        return s;
+
+    if (st->busyIdx != 0)
+    {
+        odd = st->busySeq;
+        __atomic_compare_exchange_n(&h->bucket[st->busyIdx - 1].seq, &odd,
+                                    odd + 1, 0, __ATOMIC_RELEASE,
+                                    __ATOMIC_RELAXED);
+        st->busyIdx = 0;
+    }
+    return pthread_mutex_consistent(&st->mtx);
+}
+
+/* Fill in the pointers in 'h' from a mapping of 'size' bytes at 'addr' */
+
+static PshmHash *
+newHandle(void *addr, size_t size)
+{
+    PshmHash *h;
+
+    h = malloc(sizeof(PshmHash));
+    if (h == NULL)
+        return NULL;
+
+    h->hdr = addr;
+    h->stripe = (struct pshmStripe *)((char *)addr + stripeOffset());
+    h->bucket = (struct pshmBucket *)((char *)addr +
+                                      bucketOffset(h->hdr->numStripes));
+    h->mapSize = size;
+    return h;
+}
+
+/* Create a new table called 'name'. 'numBuckets' is rounded up to a
+   power of two. Returns a handle opened for reading and writing, or
+   NULL (with errno set) on error. */
+
+PshmHash *
+pshmHashCreate(const char *name, size_t numBuckets, int numStripes,
+               mode_t perms)
+{
+    pthread_mutexattr_t mattr;
+    struct pshmHashHdr *hdr;
+    struct pshmStripe *stripe;
+    size_t nb, size;
+    PshmHash *h;
+    void *addr;
+    int fd, s, savedErrno;
+
+    if (numBuckets == 0 || numStripes <= 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (nb = 1; nb < numBuckets; nb <<= 1)
+        continue;
+
+    size = bucketOffset(numStripes) + nb * sizeof(struct pshmBucket);
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, perms);
+    if (fd == -1)
+        return NULL;
+
+    addr = MAP_FAILED;
+
+    /* ftruncate() zero-fills, so every bucket starts out EMPTY with
+       an even sequence number */
+
+    if (ftruncate(fd, size) == -1)
+        goto fail;
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        goto fail;
+
+    hdr = addr;
+    hdr->numStripes = numStripes;
+    hdr->numBuckets = nb;
+    hdr->numEntries = 0;
+
+    stripe = (struct pshmStripe *)((char *)addr + stripeOffset());
+
+    s = pthread_mutexattr_init(&mattr);
+    if (s == 0)
+        s = pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    if (s == 0)
+        s = pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    for (int j = 0; s == 0 && j < numStripes; j++)
+        s = pthread_mutex_init(&stripe[j].mtx, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+    if (s != 0)
+    {
+        errno = s;
+        goto fail;
+    }
+
+    h = newHandle(addr, size);
+    if (h == NULL)
+        goto fail;
+
+    close(fd); /* 'fd' is no longer needed */
+
+    /* Publish the table only once it is completely initialized */
+
+    __atomic_store_n(&hdr->magic, PSHM_HASH_MAGIC, __ATOMIC_RELEASE);
+    return h;
+
+fail:
+    savedErrno = errno;
+    if (addr != MAP_FAILED)
+        munmap(addr, size);
+    close(fd);
+    shm_unlink(name);
+    errno = savedErrno;
+    return NULL;
+}
+
+/* Open an existing table. If 'readOnly' is true, the table is mapped
+   PROT_READ, and only pshmHashGet() may be used on the handle. */
+
+PshmHash *
+pshmHashOpen(const char *name, int readOnly)
+{
+    struct pshmHashHdr *hdr;
+    struct stat sb;
+    PshmHash *h;
+    void *addr;
+    int fd, savedErrno;
+
+    fd = shm_open(name, readOnly ? O_RDONLY : O_RDWR, 0);
+    if (fd == -1)
+        return NULL;
+
+    if (fstat(fd, &sb) == -1)
+        goto fail;
+
+    if (sb.st_size < (off_t)sizeof(struct pshmHashHdr))
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    addr = mmap(NULL, sb.st_size,
+                readOnly ? PROT_READ : PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+        goto fail;
+
+    close(fd);
+
+    hdr = addr;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != PSHM_HASH_MAGIC ||
+        (size_t)sb.st_size < bucketOffset(hdr->numStripes) +
+                                 hdr->numBuckets * sizeof(struct pshmBucket))
+    {
+        munmap(addr, sb.st_size);
+        errno = EINVAL; /* Not (yet) a table */
+        return NULL;
+    }
+
+    h = newHandle(addr, sb.st_size);
+    if (h == NULL)
+        munmap(addr, sb.st_size);
+    return h;
+
+fail:
+    savedErrno = errno;
+    close(fd);
+    errno = savedErrno;
+    return NULL;
+}
+
+int pshmHashClose(PshmHash *h)
+{
+    int s;
+
+    s = munmap(h->hdr, h->mapSize);
+    free(h);
+    return s;
+}
+
+/* Look up 'key'. On success, copy up to 'bufSize' bytes of the value
+   into 'buf' and return the full length of the value. Returns -1 with
+   errno set to ENOENT if 'key' is not present. */
+
+ssize_t
+pshmHashGet(PshmHash *h, const char *key, void *buf, size_t bufSize)
+{
+    struct pshmBucket copy;
+    uint64_t mask, idx;
+
+    mask = h->hdr->numBuckets - 1;
+    idx = hashKey(key) & mask;
+
+    for (uint64_t j = 0; j <= mask; j++, idx = (idx + 1) & mask)
+    {
+        readBucket(&h->bucket[idx], &copy);
+
+        if (copy.state == PSHM_BKT_EMPTY)
+            break;
+
+        if (copy.state == PSHM_BKT_FULL &&
+            strncmp(copy.key, key, PSHM_HASH_KEY_MAX) == 0)
+        {
+            memcpy(buf, copy.val, min(bufSize, (size_t)copy.valLen));
+            return copy.valLen;
+        }
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+/* Insert 'key', or update its value if it is already present.
+   Returns 0 on success, or -1 with errno set to ENAMETOOLONG (key too
+   long), E2BIG (value too long), or ENOSPC (table full). */
+
+int pshmHashPut(PshmHash *h, const char *key, const void *val, size_t len)
+{
+    struct pshmBucket copy, *b;
+    uint64_t mask, home, idx, j, freeIdx;
+    struct pshmStripe *st;
+    int s, found;
+
+    if (strlen(key) >= PSHM_HASH_KEY_MAX)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (len > PSHM_HASH_VAL_MAX)
+    {
+        errno = E2BIG;
+        return -1;
+    }
+
+    mask = h->hdr->numBuckets - 1;
+    home = hashKey(key) & mask;
+
+    s = lockStripe(h, home, &st);
+    if (s != 0)
+    {
+        errno = s;
+        return -1;
+    }
+
+    /* Search for an existing instance of 'key', remembering the first
+       bucket that we could reuse if the key is absent */
+
+    found = 0;
+    freeIdx = mask + 1; /* "None yet" */
+    for (j = 0, idx = home; j <= mask; j++, idx = (idx + 1) & mask)
+    {
+        readBucket(&h->bucket[idx], &copy);
+
+        if (copy.state == PSHM_BKT_FULL)
+        {
+            if (strncmp(copy.key, key, PSHM_HASH_KEY_MAX) == 0)
+            {
+                found = 1;
+                break;
+            }
+        }
+        else
+        {
+            if (freeIdx > mask)
+                freeIdx = idx;
+            if (copy.state == PSHM_BKT_EMPTY)
+                break;
+        }
+    }
+
+    if (found)
+    { /* Only writers holding 'st' can change this bucket's key */
+        b = beginWrite(h, st, idx);
+        memcpy(b->val, val, len);
+        b->valLen = len;
+        endWrite(st, b);
+    }
+    else
+    {
+        /* Claim the first non-FULL bucket at or after 'freeIdx'. A writer
+           of some other key may beat us to it, in which case we move on. */
+
+        found = 0;
+        if (freeIdx <= mask)
+        {
+            for (j = 0, idx = freeIdx; j <= mask; j++, idx = (idx + 1) & mask)
+            {
+                b = beginWrite(h, st, idx);
+                if (b->state != PSHM_BKT_FULL)
+                {
+                    strcpy(b->key, key);
+                    memcpy(b->val, val, len);
+                    b->valLen = len;
+                    b->state = PSHM_BKT_FULL;
+                    found = 1;
+                }
+                endWrite(st, b);
+                if (found)
+                    break;
+            }
+        }
+
+        if (!found)
+        {
+            pthread_mutex_unlock(&st->mtx);
+            errno = ENOSPC;
+            return -1;
+        }
+        __atomic_add_fetch(&h->hdr->numEntries, 1, __ATOMIC_RELAXED);
+    }
+
+    s = pthread_mutex_unlock(&st->mtx);
+    if (s != 0)
+    {
+        errno = s;
+        return -1;
+    }
+    return 0;
+}
+
+/* Remove 'key'. Returns 0 on success, or -1 with errno set to ENOENT if
+   'key' is not present. */
+
+int pshmHashDelete(PshmHash *h, const char *key)
+{
+    struct pshmBucket copy, *b;
+    uint64_t mask, home, idx;
+    struct pshmStripe *st;
+    int s, found;
+
+    mask = h->hdr->numBuckets - 1;
+    home = hashKey(key) & mask;
+
+    s = lockStripe(h, home, &st);
+    if (s != 0)
+    {
+        errno = s;
+        return -1;
+    }
+
+    found = 0;
+    idx = home;
+    for (uint64_t j = 0; j <= mask; j++, idx = (idx + 1) & mask)
+    {
+        readBucket(&h->bucket[idx], &copy);
+        if (copy.state == PSHM_BKT_EMPTY)
+            break;
+        if (copy.state == PSHM_BKT_FULL &&
+            strncmp(copy.key, key, PSHM_HASH_KEY_MAX) == 0)
+        {
+            b = beginWrite(h, st, idx);
+            b->state = PSHM_BKT_DEAD;
+            endWrite(st, b);
+            __atomic_sub_fetch(&h->hdr->numEntries, 1, __ATOMIC_RELAXED);
+            found = 1;
+            break;
+        }
+    }
+
+    s = pthread_mutex_unlock(&st->mtx);
+    if (s != 0)
+    {
+        errno = s;
+        return -1;
+    }
+    if (!found)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+/* pshm_hash.h
+
+   Header file for pshm_hash.c.
+
+   An open-addressing hash table that lives inside a POSIX shared memory
+   object, so that many processes can share one lookup table. The
+   operations are:
+
+        create a table:     pshmHashCreate(name, numBuckets, numStripes, perms)
+        open a table:       pshmHashOpen(name, readOnly)
+        detach from table:  pshmHashClose(h)
+        insert or update:   pshmHashPut(h, key, val, len)
+        look up a key:      pshmHashGet(h, key, buf, bufSize)
+        remove a key:       pshmHashDelete(h, key)
+
+   Lookups never take a lock and never write to the shared object (a
+   table opened with 'readOnly' is mapped PROT_READ). Each bucket carries
+   a sequence number that writers make odd while they modify the bucket;
+   a reader that sees an odd number, or a number that changed while it
+   was copying the bucket, simply retries. Writers serialize on one of
+   'numStripes' process-shared mutexes, chosen by the key's home bucket.
+   The mutexes are robust: if a writer dies holding one, the next writer
+   to take it makes the bucket that was being modified (if any) readable
+   again, leaving in it whatever the dead writer had written.
+*/
+#ifndef PSHM_HASH_H
+#define PSHM_HASH_H /* Prevent accidental double inclusion */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define PSHM_HASH_KEY_MAX 40 /* Including terminating null byte */
+#define PSHM_HASH_VAL_MAX 80
+
+#define PSHM_HASH_MAGIC 0x70736868UL /* "pshh" */
+
+/* States of a bucket */
+
+#define PSHM_BKT_EMPTY 0 /* Never used; terminates a probe sequence */
+#define PSHM_BKT_FULL 1  /* Holds a key/value pair */
+#define PSHM_BKT_DEAD 2  /* Tombstone left by pshmHashDelete() */
+
+struct pshmBucket
+{                                /* 128 bytes: two whole cache lines */
+    uint32_t seq;                /* Odd while a writer is modifying bucket */
+    uint16_t state;              /* PSHM_BKT_* */
+    uint16_t valLen;             /* Number of bytes used in 'val' */
+    char key[PSHM_HASH_KEY_MAX]; /* Null-terminated key */
+    char val[PSHM_HASH_VAL_MAX]; /* Value (not necessarily a string) */
+};
+
+struct pshmHashHdr
+{                         /* Start of the shared memory object */
+    uint32_t magic;       /* PSHM_HASH_MAGIC once initialized */
+    uint32_t numStripes;  /* Number of entries in 'stripe' */
+    uint64_t numBuckets;  /* Always a power of two */
+    uint64_t numEntries;  /* FULL buckets (updated under stripe lock) */
+    /* Followed by 'numStripes' struct pshmStripe, then the buckets */
+};
+
+struct pshmStripe
+{                         /* A writer lock */
+    pthread_mutex_t mtx;  /* Robust and process-shared */
+    uint64_t busyIdx;     /* 1 + bucket its holder is modifying, or 0 */
+    uint32_t busySeq;     /* That bucket's (odd) sequence number */
+};
+
+typedef struct
+{                               /* Per-process handle on a table */
+    struct pshmHashHdr *hdr;    /* Start of mapping */
+    struct pshmStripe *stripe;  /* Array of writer locks */
+    struct pshmBucket *bucket;  /* Array of buckets */
+    size_t mapSize;             /* Size of mapping */
+} PshmHash;
+
+PshmHash *pshmHashCreate(const char *name, size_t numBuckets,
+                         int numStripes, mode_t perms);
+
+PshmHash *pshmHashOpen(const char *name, int readOnly);
+
+int pshmHashClose(PshmHash *h);
+
+int pshmHashPut(PshmHash *h, const char *key, const void *val, size_t len);
+
+ssize_t pshmHashGet(PshmHash *h, const char *key, void *buf, size_t bufSize);
+
+int pshmHashDelete(PshmHash *h, const char *key);
+
+#endif
@@ -0,0 +1,237 @@
+/* pshm_hash_bench.c
+
+   Measure the lookup rate of the shared memory hash table implemented in
+   pshm_hash.c as the number of reader processes grows.
+
+   Usage as shown in usageError().
+
+   The table should first be populated with "pshm_hash_ctl fill", which
+   inserts keys of the form "key<n>". For each reader count in the
+   sequence 1, 2, 4, ..., max-readers, the program forks that many
+   children, each of which opens the table read-only and looks up
+   randomly chosen keys until told to stop. The parent then reports the
+   aggregate and per-process lookup rates.
+
+   With -w, one additional child repeatedly rewrites the values of
+   randomly chosen keys while the readers run, so that the cost of
+   readers retrying around in-progress writes is included.
+
+   See also pshm_hash_ctl.c.
+*/
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "pshm_hash.h"
+#include "tlpi_hdr.h"
+
+#define CACHE_LINE 64
+
+struct readerStats
+{                   /* One per child, each on its own cache line */
+    long lookups;
+    long misses;
+    char pad[CACHE_LINE - 2 * sizeof(long)];
+};
+
+struct shared
+{                     /* Shared between parent and children */
+    volatile int stop; /* Set by parent to end the run */
+    char pad[CACHE_LINE - sizeof(int)];
+    struct readerStats stats[]; /* One per child */
+};
+
+/* Cheap per-process pseudorandom generator (xorshift64) */
+
+static uint64_t
+nextRand(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void NORETURN
+readerLoop(const char *name, long numKeys, struct shared *sh, int id)
+{
+    char key[PSHM_HASH_KEY_MAX];
+    char val[PSHM_HASH_VAL_MAX];
+    uint64_t rnd;
+    long lookups, misses;
+    PshmHash *h;
+
+    h = pshmHashOpen(name, 1);
+    if (h == NULL)
+        errExit("pshmHashOpen");
+
+    rnd = 0x9e3779b97f4a7c15ULL * (getpid() + 1);
+    lookups = misses = 0;
+
+    while (!sh->stop)
+    {
+        for (int j = 0; j < 256; j++)
+        { /* Check 'stop' only occasionally */
+            snprintf(key, sizeof(key), "key%ld",
+                     (long)(nextRand(&rnd) % numKeys));
+            if (pshmHashGet(h, key, val, sizeof(val)) == -1)
+                misses++;
+        }
+        lookups += 256;
+    }
+
+    sh->stats[id].lookups = lookups;
+    sh->stats[id].misses = misses;
+    _exit(EXIT_SUCCESS);
+}
+
+static void NORETURN
+writerLoop(const char *name, long numKeys, struct shared *sh)
+{
+    char key[PSHM_HASH_KEY_MAX];
+    char val[PSHM_HASH_VAL_MAX];
+    uint64_t rnd;
+    long n;
+    PshmHash *h;
+
+    h = pshmHashOpen(name, 0);
+    if (h == NULL)
+        errExit("pshmHashOpen");
+
+    rnd = 0x2545f4914f6cdd1dULL;
+    while (!sh->stop)
+    {
+        n = nextRand(&rnd) % numKeys;
+        snprintf(key, sizeof(key), "key%ld", n);
+        snprintf(val, sizeof(val), "value%ld", n);
+        if (pshmHashPut(h, key, val, strlen(val)) == -1)
+            errExit("pshmHashPut");
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/* Run one measurement with 'numReaders' children for 'secs' seconds */
+
+static void
+runTest(const char *name, long numKeys, int numReaders, int withWriter,
+        int secs, struct shared *sh)
+{
+    struct timespec start, end;
+    long total, misses;
+    double elapsed;
+    int numChildren;
+
+    sh->stop = 0;
+    memset(sh->stats, 0, numReaders * sizeof(struct readerStats));
+
+    for (int j = 0; j < numReaders; j++)
+    {
+        switch (fork())
+        {
+        case -1:
+            errExit("fork");
+        case 0:
+            readerLoop(name, numKeys, sh, j);
+        default:
+            break;
+        }
+    }
+
+    numChildren = numReaders;
+    if (withWriter)
+    {
+        switch (fork())
+        {
+        case -1:
+            errExit("fork");
+        case 0:
+            writerLoop(name, numKeys, sh);
+        default:
+            break;
+        }
+        numChildren++;
+    }
+
+    if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+        errExit("clock_gettime");
+    sleep(secs);
+    sh->stop = 1;
+
+    for (int j = 0; j < numChildren; j++)
+        if (wait(NULL) == -1)
+            errExit("wait");
+    if (clock_gettime(CLOCK_MONOTONIC, &end) == -1)
+        errExit("clock_gettime");
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+              (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    total = misses = 0;
+    for (int j = 0; j < numReaders; j++)
+    {
+        total += sh->stats[j].lookups;
+        misses += sh->stats[j].misses;
+    }
+
+    printf("%7d %14.0f %14.0f %10ld\n", numReaders, total / elapsed,
+           total / elapsed / numReaders, misses);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [-w] [-t secs] shm-name num-keys "
+                    "max-readers\n", progName);
+    fprintf(stderr, "    -t secs  Duration of each run (default: 2)\n");
+    fprintf(stderr, "    -w       Run a concurrent writer process\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, secs, withWriter, maxReaders;
+    long numKeys;
+    struct shared *sh;
+    const char *name;
+
+    secs = 2;
+    withWriter = 0;
+    while ((opt = getopt(argc, argv, "t:w")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            secs = getInt(optarg, GN_GT_0, "secs");
+            break;
+        case 'w':
+            withWriter = 1;
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind + 2 >= argc)
+        usageError(argv[0]);
+
+    name = argv[optind];
+    numKeys = getLong(argv[optind + 1], GN_GT_0, "num-keys");
+    maxReaders = getInt(argv[optind + 2], GN_GT_0, "max-readers");
+
+    sh = mmap(NULL, sizeof(struct shared) +
+                        maxReaders * sizeof(struct readerStats),
+              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED)
+        errExit("mmap");
+
+    printf("%7s %14s %14s %10s\n", "readers", "lookups/sec",
+           "per-reader", "misses");
+
+    for (int n = 1; n <= maxReaders; n *= 2)
+    {
+        runTest(name, numKeys, n, withWriter, secs, sh);
+        if (n < maxReaders && n * 2 > maxReaders)
+            runTest(name, numKeys, maxReaders, withWriter, secs, sh);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,148 @@
+/* pshm_hash_ctl.c
+
+   Command-line interface to the shared memory hash table implemented
+   in pshm_hash.c.
+
+   Usage as shown in usageError().
+
+   For example:
+
+        $ ./pshm_hash_ctl create /demo_hash 65536 64
+        $ ./pshm_hash_ctl put /demo_hash colour blue
+        $ ./pshm_hash_ctl get /demo_hash colour
+        blue
+        $ ./pshm_hash_ctl fill /demo_hash 10000
+        $ ./pshm_hash_ctl stat /demo_hash
+
+   The table is removed with pshm_unlink(1).
+
+   See also pshm_hash_bench.c.
+*/
+#include <sys/stat.h>
+#include "pshm_hash.h"
+#include "tlpi_hdr.h"
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s command shm-name [args...]\n", progName);
+    fprintf(stderr, "Commands:\n");
+    fprintf(stderr, "    create shm-name num-buckets [num-stripes "
+                    "[octal-perms]]\n");
+    fprintf(stderr, "    put shm-name key value\n");
+    fprintf(stderr, "    get shm-name key\n");
+    fprintf(stderr, "    del shm-name key\n");
+    fprintf(stderr, "    fill shm-name count      "
+                    "Insert keys \"key0\" .. \"key<count-1>\"\n");
+    fprintf(stderr, "    stat shm-name\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    char val[PSHM_HASH_VAL_MAX + 1];
+    char key[PSHM_HASH_KEY_MAX];
+    const char *cmd;
+    PshmHash *h;
+    ssize_t len;
+    long count;
+    uint64_t used, dead;
+
+    if (argc < 3 || strcmp(argv[1], "--help") == 0)
+        usageError(argv[0]);
+
+    cmd = argv[1];
+
+    if (strcmp(cmd, "create") == 0)
+    {
+        if (argc < 4)
+            usageError(argv[0]);
+        h = pshmHashCreate(argv[2],
+                           getLong(argv[3], GN_GT_0 | GN_ANY_BASE, "num-buckets"),
+                           (argc > 4) ? getInt(argv[4], GN_GT_0, "num-stripes") : 64,
+                           (argc > 5) ? getLong(argv[5], GN_BASE_8, "octal-perms")
+                                      : (S_IRUSR | S_IWUSR));
+        if (h == NULL)
+            errExit("pshmHashCreate");
+        printf("Created table with %llu buckets, %u stripes (%ld bytes)\n",
+               (unsigned long long)h->hdr->numBuckets, h->hdr->numStripes,
+               (long)h->mapSize);
+    }
+    else if (strcmp(cmd, "put") == 0)
+    {
+        if (argc != 5)
+            usageError(argv[0]);
+        h = pshmHashOpen(argv[2], 0);
+        if (h == NULL)
+            errExit("pshmHashOpen");
+        if (pshmHashPut(h, argv[3], argv[4], strlen(argv[4])) == -1)
+            errExit("pshmHashPut");
+    }
+    else if (strcmp(cmd, "get") == 0)
+    {
+        if (argc != 4)
+            usageError(argv[0]);
+        h = pshmHashOpen(argv[2], 1);
+        if (h == NULL)
+            errExit("pshmHashOpen");
+        len = pshmHashGet(h, argv[3], val, PSHM_HASH_VAL_MAX);
+        if (len == -1)
+            errExit("pshmHashGet");
+        printf("%.*s\n", (int)len, val);
+    }
+    else if (strcmp(cmd, "del") == 0)
+    {
+        if (argc != 4)
+            usageError(argv[0]);
+        h = pshmHashOpen(argv[2], 0);
+        if (h == NULL)
+            errExit("pshmHashOpen");
+        if (pshmHashDelete(h, argv[3]) == -1)
+            errExit("pshmHashDelete");
+    }
+    else if (strcmp(cmd, "fill") == 0)
+    {
+        if (argc != 4)
+            usageError(argv[0]);
+        h = pshmHashOpen(argv[2], 0);
+        if (h == NULL)
+            errExit("pshmHashOpen");
+        count = getLong(argv[3], GN_NONNEG, "count");
+        for (long j = 0; j < count; j++)
+        {
+            snprintf(key, sizeof(key), "key%ld", j);
+            snprintf(val, sizeof(val), "value%ld", j);
+            if (pshmHashPut(h, key, val, strlen(val)) == -1)
+                errExit("pshmHashPut %s", key);
+        }
+    }
+    else if (strcmp(cmd, "stat") == 0)
+    {
+        h = pshmHashOpen(argv[2], 1);
+        if (h == NULL)
+            errExit("pshmHashOpen");
+
+        used = dead = 0;
+        for (uint64_t j = 0; j < h->hdr->numBuckets; j++)
+        {
+            if (h->bucket[j].state == PSHM_BKT_FULL)
+                used++;
+            else if (h->bucket[j].state == PSHM_BKT_DEAD)
+                dead++;
+        }
+        printf("buckets: %llu; stripes: %u; entries: %llu\n",
+               (unsigned long long)h->hdr->numBuckets, h->hdr->numStripes,
+               (unsigned long long)h->hdr->numEntries);
+        printf("full: %llu; tombstones: %llu; load factor: %.3f\n",
+               (unsigned long long)used, (unsigned long long)dead,
+               (double)used / h->hdr->numBuckets);
+    }
+    else
+    {
+        usageError(argv[0]);
+    }
+
+    if (pshmHashClose(h) == -1)
+        errExit("pshmHashClose");
+    exit(EXIT_SUCCESS);
+}
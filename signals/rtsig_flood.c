@@ -0,0 +1,341 @@
+/* rtsig_flood.c
+
+   Measure how many realtime signals per second can be pushed from a set
+   of sending processes to a receiver that reads them from a signalfd,
+   many at a time. Compare t_sigqueue.c and catch_rtsigs.c, which send
+   and receive one signal at a time.
+
+   Usage as shown in usageError().
+
+   Each of the sender children calls sigqueue() in a tight loop,
+   cycling through 'prios' realtime signals, starting with SIGRTMIN.
+   The signal's data is the time at which it was sent, which the
+   receiver uses to compute each signal's latency, and to check that the
+   instances of each signal from each sender arrive in order.
+
+   When the receiver falls behind, the queue fills up to the
+   RLIMIT_SIGPENDING limit, and sigqueue() fails with EAGAIN. By default
+   the signal is then dropped (and counted); with -r, the sender yields
+   the CPU and retries. The -l option lowers the limit, to show the
+   effect of saturation with fewer signals.
+
+   The receiver reads up to 'batch' signalfd_siginfo structures in each
+   read(); each batch size given with -b is a separate run. Besides the
+   latency percentiles, a run reports the number of signals sent, the
+   number of EAGAIN failures, the average number of signals per read(),
+   the peak number of queued signals (sampled from the SigQ field of
+   /proc/self/status) out of the limit, the throughput in thousands of
+   signals per second, and the number of priority inversions: the times
+   that one read() returned a signal with a lower number (that is, a
+   higher priority) after one with a higher number, because the former
+   was queued while the read() was in progress.
+
+   The payload carries a 64-bit timestamp only where pointers are 64 bits
+   wide; elsewhere the latencies are meaningless.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sched.h>
+#include <poll.h>
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define LABELS "batch,senders,prios,sent,eagain,per_read,peak_q,limit," \
+               "Ksig_per_s,inversions"
+
+struct senderStats
+{                  /* Written by a sender, read by the receiver */
+    long sent;
+    long eagain;
+};
+
+static int numSenders, numPrios, numSigs, retry;
+
+static void
+sender(struct senderStats *st, pid_t receiver)
+{
+    union sigval sv;
+    int s;
+
+    for (int j = 0; j < numSigs; j++)
+    {
+        sv.sival_ptr = (void *)(intptr_t)latNowNs();
+        while ((s = sigqueue(receiver, SIGRTMIN + j % numPrios, sv)) == -1)
+        {
+            if (errno != EAGAIN)
+                errExit("sigqueue");
+            st->eagain++;
+            if (!retry)
+                break;          /* Drop this signal */
+            sched_yield();
+        }
+        if (s == 0)
+            st->sent++;
+    }
+}
+
+/* Return the number of signals queued for our real user ID, as shown in
+   the SigQ field of /proc/self/status, or -1 if it can't be read */
+
+static long
+queuedSigs(void)
+{
+    char line[256];
+    long queued;
+    FILE *fp;
+
+    fp = fopen("/proc/self/status", "r");
+    if (fp == NULL)
+        return -1;
+    queued = -1;
+    while (fgets(line, sizeof(line), fp) != NULL)
+        if (sscanf(line, "SigQ: %ld/", &queued) == 1)
+            break;
+    fclose(fp);
+    return queued;
+}
+
+static void
+runOne(int batch, struct senderStats *stats, long *samples, LatFormat fmt)
+{
+    struct signalfd_siginfo *buf;
+    struct latSummary sum;
+    struct rlimit rl;
+    struct pollfd pfd;
+    long long start, now, *lastSent;
+    long recv, reads, inversions, peak, q, sent, eagain;
+    pid_t *pids;
+    sigset_t mask;
+    ssize_t numRead;
+    char values[256];
+    int sfd, live, s, p;
+
+    buf = calloc(batch, sizeof(struct signalfd_siginfo));
+    pids = calloc(numSenders, sizeof(pid_t));
+    lastSent = calloc(numSenders * numPrios, sizeof(long long));
+    if (buf == NULL || pids == NULL || lastSent == NULL)
+        errExit("calloc");
+
+    sigemptyset(&mask);
+    for (p = 0; p < numPrios; p++)
+        sigaddset(&mask, SIGRTMIN + p);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+        errExit("sigprocmask");
+    sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd == -1)
+        errExit("signalfd");
+
+    memset(stats, 0, numSenders * sizeof(struct senderStats));
+
+    start = latNowNs();
+    for (s = 0; s < numSenders; s++)
+    {
+        switch (pids[s] = fork())
+        {
+        case -1:
+            errExit("fork");
+        case 0:
+            sender(&stats[s], getppid());
+            _exit(EXIT_SUCCESS);
+        default:
+            break;
+        }
+    }
+
+    /* Read until all senders have exited and no signals remain queued.
+       The check for an empty queue must follow the last exit, so after
+       reaping the last sender, we read once more. */
+
+    recv = reads = inversions = peak = 0;
+    now = start;
+    pfd.fd = sfd;
+    pfd.events = POLLIN;
+    live = numSenders;
+
+    for (;;)
+    {
+        numRead = read(sfd, buf, batch * sizeof(struct signalfd_siginfo));
+        if (numRead == -1)
+        {
+            if (errno != EAGAIN)
+                errExit("read");
+            if (live == 0)
+                break;
+            while (live > 0 && waitpid(-1, NULL, WNOHANG) > 0)
+                live--;
+            if (live > 0 && poll(&pfd, 1, 10) == -1 && errno != EINTR)
+                errExit("poll");
+            continue;
+        }
+
+        now = latNowNs();
+        reads++;
+        if (reads % 16 == 0)
+        {
+            q = queuedSigs();
+            if (q > peak)
+                peak = q;
+        }
+
+        for (size_t j = 0; j < numRead / sizeof(struct signalfd_siginfo); j++)
+        {
+            struct signalfd_siginfo *si = &buf[j];
+            long long sentAt = (long long)si->ssi_ptr;
+
+            if (j > 0 && si->ssi_signo < buf[j - 1].ssi_signo)
+                inversions++;
+
+            for (s = 0; s < numSenders; s++)
+                if (pids[s] == (pid_t)si->ssi_pid)
+                    break;
+            if (s == numSenders)
+                fatal("signal from unexpected PID %ld", (long)si->ssi_pid);
+
+            p = si->ssi_signo - SIGRTMIN;
+            if (sentAt < lastSent[s * numPrios + p])
+                fatal("sender %d: signal %d arrived out of order", s,
+                      (int)si->ssi_signo);
+            lastSent[s * numPrios + p] = sentAt;
+
+            if (recv < (long)numSenders * numSigs)
+                samples[recv] = now - sentAt;
+            recv++;
+        }
+    }
+
+    sent = eagain = 0;
+    for (s = 0; s < numSenders; s++)
+    {
+        sent += stats[s].sent;
+        eagain += stats[s].eagain;
+    }
+    if (recv != sent)
+        fatal("%ld signals sent, but %ld received", sent, recv);
+
+    if (getrlimit(RLIMIT_SIGPENDING, &rl) == -1)
+        errExit("getrlimit");
+
+    latSummarize(samples, recv, &sum);
+    snprintf(values, sizeof(values), "%d,%d,%d,%ld,%ld,%.1f,%ld,%ld,%.1f,%ld",
+             batch, numSenders, numPrios, sent, eagain,
+             reads > 0 ? (double)recv / reads : 0.0, peak,
+             (long)rl.rlim_cur, recv * 1e6 / (now - start + 1), inversions);
+    latPrintRow(fmt, LABELS, values, &sum);
+
+    close(sfd);
+    free(buf);
+    free(pids);
+    free(lastSent);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -s num     Sender processes (default: 2)\n");
+    fprintf(stderr, "    -n num     Signals per sender (default: 100000)\n");
+    fprintf(stderr, "    -p num     Realtime signals (priorities) to cycle "
+                    "through (default: 4)\n");
+    fprintf(stderr, "    -b list    Comma-separated batch sizes for read() "
+                    "(default: 1,16,64)\n");
+    fprintf(stderr, "    -r         On EAGAIN, retry rather than drop\n");
+    fprintf(stderr, "    -l num     Lower RLIMIT_SIGPENDING to 'num'\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    struct senderStats *stats;
+    char *batchList, *tok, *save;
+    struct rlimit rl;
+    long *samples;
+    int opt;
+    LatFormat fmt;
+
+    numSenders = 2;
+    numSigs = 100000;
+    numPrios = 4;
+    retry = 0;
+    batchList = "1,16,64";
+    fmt = LAT_FMT_TEXT;
+    rl.rlim_cur = RLIM_INFINITY;
+
+    while ((opt = getopt(argc, argv, "s:n:p:b:rl:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            numSenders = getInt(optarg, GN_GT_0, "senders");
+            break;
+        case 'n':
+            numSigs = getInt(optarg, GN_GT_0, "signals");
+            break;
+        case 'p':
+            numPrios = getInt(optarg, GN_GT_0, "prios");
+            break;
+        case 'b':
+            batchList = optarg;
+            break;
+        case 'r':
+            retry = 1;
+            break;
+        case 'l':
+            rl.rlim_cur = getLong(optarg, GN_GT_0, "limit");
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+    if (numPrios > SIGRTMAX - SIGRTMIN + 1)
+        cmdLineErr("at most %d priorities\n", SIGRTMAX - SIGRTMIN + 1);
+
+    if (rl.rlim_cur != RLIM_INFINITY)
+    {
+        rlim_t cur = rl.rlim_cur;
+
+        if (getrlimit(RLIMIT_SIGPENDING, &rl) == -1)
+            errExit("getrlimit");
+        rl.rlim_cur = cur;
+        if (setrlimit(RLIMIT_SIGPENDING, &rl) == -1)
+            errExit("setrlimit");
+    }
+
+    /* Each sender's counts must be visible to the receiver */
+
+    stats = mmap(NULL, numSenders * sizeof(struct senderStats),
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+        errExit("mmap");
+
+    samples = calloc((size_t)numSenders * numSigs, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    batchList = strdup(batchList);      /* strtok_r() modifies its argument */
+    if (batchList == NULL)
+        errExit("strdup");
+
+    latPrintHeader(fmt, LABELS);
+
+    for (tok = strtok_r(batchList, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save))
+        runOne(getInt(tok, GN_GT_0, "batch"), stats, samples, fmt);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,348 @@
+/* sig_latency.c
+
+   Measure the round-trip latency of signals, for several ways of
+   sending and waiting for them. Compare sig_speed_sigsuspend.c, which
+   measures one of them as a total time under time(1).
+
+   Usage as shown in usageError().
+
+   Two parties (a parent and child process, or, with -t thread, two
+   threads in one process) send a signal back and forth 'rounds' times.
+   The initiator reads the CLOCK_MONOTONIC clock before sending each
+   signal and after receiving the reply; the program reports the
+   distribution of these round-trip times. The mechanisms are:
+
+        sigsuspend     A handler catches the signal, which is unblocked
+                       only during sigsuspend()
+        waitinfo       The signal stays blocked and is accepted with
+                       sigwaitinfo()
+        timedwait      As waitinfo, but with sigtimedwait() and a
+                       timeout
+        signalfd       The signal stays blocked and is read from a
+                       signalfd
+        sigqueue       As waitinfo, but the signal is sent with
+                       sigqueue() (pthread_sigqueue() for threads),
+                       carrying the round number, which the receiver
+                       checks and sends back
+
+   Signals are sent to a process with kill() or sigqueue(), and to a
+   thread with pthread_kill() or pthread_sigqueue(), which use tgkill()
+   and rt_tgsigqueueinfo() to direct the signal at that thread.
+
+   With -c, the initiator and responder are pinned to the given CPUs;
+   giving the same CPU twice measures the same-core case, and two CPUs
+   the cross-core case.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE /* For pthread_sigqueue() */
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <signal.h>
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define TESTSIG SIGRTMIN
+
+enum mech
+{
+    MECH_SIGSUSPEND,
+    MECH_SIGWAITINFO,
+    MECH_SIGTIMEDWAIT,
+    MECH_SIGNALFD,
+    MECH_SIGQUEUE
+};
+
+static const char *mechNames[] = {"sigsuspend", "waitinfo", "timedwait",
+                                  "signalfd", "sigqueue"};
+
+#define NUM_MECHS (sizeof(mechNames) / sizeof(mechNames[0]))
+
+static enum mech mech;
+static int useThreads;
+static int numRounds;
+static int cpu[2];             /* Initiator, responder; -1 == not pinned */
+static sigset_t testMask;      /* Just TESTSIG */
+
+struct party
+{
+    pid_t pid;                 /* Used when the parties are processes */
+    pthread_t tid;             /* Used when they are threads */
+    int sfd;                   /* MECH_SIGNALFD */
+};
+
+static void
+handler(int sig)
+{
+}
+
+static void
+sendSig(const struct party *to, int round)
+{
+    union sigval sv;
+    int s;
+
+    sv.sival_int = round;
+
+    if (useThreads)
+    {
+        s = (mech == MECH_SIGQUEUE) ? pthread_sigqueue(to->tid, TESTSIG, sv) :
+                                      pthread_kill(to->tid, TESTSIG);
+        if (s != 0)
+            errExitEN(s, "pthread_kill/pthread_sigqueue");
+    }
+    else
+    {
+        s = (mech == MECH_SIGQUEUE) ? sigqueue(to->pid, TESTSIG, sv) :
+                                      kill(to->pid, TESTSIG);
+        if (s == -1)
+            errExit("kill/sigqueue");
+    }
+}
+
+static void
+waitSig(struct party *self, int round)
+{
+    struct signalfd_siginfo fdsi;
+    struct timespec ts;
+    siginfo_t si;
+    sigset_t emptyMask;
+
+    switch (mech)
+    {
+    case MECH_SIGSUSPEND:
+        sigemptyset(&emptyMask);
+        if (sigsuspend(&emptyMask) == -1 && errno != EINTR)
+            errExit("sigsuspend");
+        break;
+
+    case MECH_SIGWAITINFO:
+        while (sigwaitinfo(&testMask, &si) == -1)
+            if (errno != EINTR)
+                errExit("sigwaitinfo");
+        break;
+
+    case MECH_SIGTIMEDWAIT:
+        ts.tv_sec = 1;
+        ts.tv_nsec = 0;
+        while (sigtimedwait(&testMask, &si, &ts) == -1)
+            if (errno != EINTR && errno != EAGAIN)
+                errExit("sigtimedwait");
+        break;
+
+    case MECH_SIGNALFD:
+        if (read(self->sfd, &fdsi, sizeof(fdsi)) != sizeof(fdsi))
+            errExit("read-signalfd");
+        break;
+
+    case MECH_SIGQUEUE:
+        while (sigwaitinfo(&testMask, &si) == -1)
+            if (errno != EINTR)
+                errExit("sigwaitinfo");
+        if (si.si_value.sival_int != round)
+            fatal("round %d: received payload %d", round,
+                  si.si_value.sival_int);
+        break;
+    }
+}
+
+/* Prepare the calling process or thread to receive signals */
+
+static void
+initParty(struct party *self, int cpuNum)
+{
+    if (cpuNum != -1 && latPinCpu(cpuNum) == -1)
+        errExit("latPinCpu");
+
+    self->sfd = -1;
+    if (mech == MECH_SIGNALFD)
+    {
+        self->sfd = signalfd(-1, &testMask, SFD_CLOEXEC);
+        if (self->sfd == -1)
+            errExit("signalfd");
+    }
+}
+
+static void
+respond(struct party *self, const struct party *initiator)
+{
+    initParty(self, cpu[1]);
+    for (int r = 0; r < numRounds; r++)
+    {
+        waitSig(self, r);
+        sendSig(initiator, r);
+    }
+    if (self->sfd != -1)
+        close(self->sfd);
+}
+
+static struct party initiator, responder;
+
+static void *
+responderFunc(void *arg)
+{
+    respond(&responder, &initiator);
+    return NULL;
+}
+
+static void
+runOne(long *samples, LatFormat fmt)
+{
+    struct latSummary sum;
+    long long start;
+    char values[128], cpus[32];
+    int s;
+
+    /* The test signal is blocked throughout (except, for sigsuspend,
+       while waiting), in both parties, which inherit this mask */
+
+    if (sigprocmask(SIG_BLOCK, &testMask, NULL) == -1)
+        errExit("sigprocmask");
+
+    initiator.pid = getpid();
+    initiator.tid = pthread_self();
+
+    if (useThreads)
+    {
+        s = pthread_create(&responder.tid, NULL, responderFunc, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+    else
+    {
+        switch (responder.pid = fork())
+        {
+        case -1:
+            errExit("fork");
+        case 0:
+            respond(&responder, &initiator);
+            _exit(EXIT_SUCCESS);
+        default:
+            break;
+        }
+    }
+
+    initParty(&initiator, cpu[0]);
+    for (int r = 0; r < numRounds; r++)
+    {
+        start = latNowNs();
+        sendSig(&responder, r);
+        waitSig(&initiator, r);
+        samples[r] = latNowNs() - start;
+    }
+    if (initiator.sfd != -1)
+        close(initiator.sfd);
+
+    if (useThreads)
+    {
+        s = pthread_join(responder.tid, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+    else
+    {
+        if (waitpid(responder.pid, NULL, 0) == -1)
+            errExit("waitpid");
+    }
+
+    if (cpu[0] == -1)
+        snprintf(cpus, sizeof(cpus), "-");
+    else
+        snprintf(cpus, sizeof(cpus), "%d/%d", cpu[0], cpu[1]);
+
+    latSummarize(samples, numRounds, &sum);
+    snprintf(values, sizeof(values), "%s,%s,%s", mechNames[mech],
+             useThreads ? "thread" : "process", cpus);
+    latPrintRow(fmt, "mechanism,target,cpus", values, &sum);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n num     Round trips (default: 10000)\n");
+    fprintf(stderr, "    -t target  process (default) or thread\n");
+    fprintf(stderr, "    -c a,b     Pin initiator to CPU a, responder to "
+                    "CPU b\n");
+    fprintf(stderr, "    -m list    Comma-separated mechanisms (default: "
+                    "all):\n               ");
+    for (size_t j = 0; j < NUM_MECHS; j++)
+        fprintf(stderr, " %s", mechNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *mechList;
+    struct sigaction sa;
+    long *samples;
+    int opt;
+    LatFormat fmt;
+
+    numRounds = 10000;
+    useThreads = 0;
+    cpu[0] = cpu[1] = -1;
+    mechList = NULL;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "n:t:c:m:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            numRounds = getInt(optarg, GN_GT_0, "rounds");
+            break;
+        case 't':
+            if (strcmp(optarg, "thread") == 0)
+                useThreads = 1;
+            else if (strcmp(optarg, "process") != 0)
+                usageError(argv[0]);
+            break;
+        case 'c':
+            if (sscanf(optarg, "%d,%d", &cpu[0], &cpu[1]) != 2 ||
+                    cpu[0] < 0 || cpu[1] < 0)
+                usageError(argv[0]);
+            break;
+        case 'm':
+            mechList = optarg;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    samples = calloc(numRounds, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    sigemptyset(&testMask);
+    sigaddset(&testMask, TESTSIG);
+
+    /* The handler is used only by sigsuspend; with the other mechanisms,
+       the signal is always blocked, and accepted synchronously */
+
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sa.sa_handler = handler;
+    if (sigaction(TESTSIG, &sa, NULL) == -1)
+        errExit("sigaction");
+
+    latPrintHeader(fmt, "mechanism,target,cpus");
+
+    for (mech = 0; mech < NUM_MECHS; mech++)
+        if (mechList == NULL || latInList(mechList, mechNames[mech]))
+            runOne(samples, fmt);
+
+    exit(EXIT_SUCCESS);
+}
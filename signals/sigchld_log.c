@@ -0,0 +1,182 @@
+/* sigchld_log.c
+
+   Demonstrate logging from a signal handler with the signal log in
+   lib/sig_log.c.
+
+   Usage as shown in usageError().
+
+   The program creates a storm of children that exit at once. Its
+   SIGCHLD handler reaps them, and, rather than calling printf() (which
+   is not async-signal-safe; see nonreentrant.c), records each reaped
+   child, and each call of the handler, in a signal log. The main
+   program drains the log after each wakeup, and prints the records.
+   Because SIGCHLD is not queued, one call of the handler usually reaps
+   several children; the log shows how many.
+
+   At the end, the program reports the number of children reaped, the
+   number of handler calls, and the number of records dropped because
+   the log was full (which a small log, given with -c, provokes).
+*/
+#include <sys/wait.h>
+#include <signal.h>
+#include "sig_log.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+enum
+{
+    EV_REAPED,          /* arg[0] = PID, arg[1] = wait status */
+    EV_HANDLER          /* arg[0] = children reaped by this call */
+};
+
+static SigLog *sigLog;
+static long numReaped;          /* Updated atomically by the handler */
+static long long startNs;
+static long numHandlerRecs, numReapedRecs;
+static int quiet;
+
+static void
+grimReaper(int sig)
+{
+    int savedErrno, status;
+    long n;
+    pid_t pid;
+
+    savedErrno = errno;
+    n = 0;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        slLog(sigLog, EV_REAPED, pid, status, 0);
+        n++;
+    }
+    __atomic_fetch_add(&numReaped, n, __ATOMIC_RELAXED);
+    slLog(sigLog, EV_HANDLER, n, 0, 0);
+    errno = savedErrno;
+}
+
+/* Format one record; called by slDrain() in the main program */
+
+static void
+printRecord(const struct slRecord *rec, void *arg)
+{
+    long long t = rec->timeNs - startNs;
+
+    if (rec->event == EV_REAPED)
+        numReapedRecs++;
+    else
+        numHandlerRecs++;
+
+    if (quiet)
+        return;
+
+    printf("%4lld.%06lld ", t / 1000000000, (t / 1000) % 1000000);
+    if (rec->event == EV_REAPED)
+        printf("  reaped PID %ld, exit status %d\n", rec->arg[0],
+               WEXITSTATUS((int)rec->arg[1]));
+    else
+        printf("SIGCHLD handler: reaped %ld child%s\n", rec->arg[0],
+               (rec->arg[0] == 1) ? "" : "ren");
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n num     Number of children (default: 100)\n");
+    fprintf(stderr, "    -c num     Log capacity, a power of 2 "
+                    "(default: 1024)\n");
+    fprintf(stderr, "    -q         Print only the summary\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction sa;
+    sigset_t blockMask, origMask;
+    int opt, numChildren, capacity;
+    long dropped;
+
+    numChildren = 100;
+    capacity = 1024;
+    quiet = 0;
+
+    while ((opt = getopt(argc, argv, "n:c:q")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            numChildren = getInt(optarg, GN_GT_0, "children");
+            break;
+        case 'c':
+            capacity = getInt(optarg, GN_GT_0, "capacity");
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    sigLog = slCreate(capacity);
+    if (sigLog == NULL)
+        errExit("slCreate");
+
+    setbuf(stdout, NULL); /* Children mustn't inherit buffered output */
+
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = grimReaper;
+    if (sigaction(SIGCHLD, &sa, NULL) == -1)
+        errExit("sigaction");
+
+    /* The handler may run (and log) while we are still creating
+       children, so we drain the log as we go */
+
+    startNs = latNowNs();
+    for (int j = 0; j < numChildren; j++)
+    {
+        switch (fork())
+        {
+        case -1:
+            errExit("fork");
+        case 0:
+            _exit(j % 256);
+        default:
+            break;
+        }
+        slDrain(sigLog, printRecord, NULL);
+    }
+
+    /* Wait until all children have been reaped, draining the log after
+       each wakeup. SIGCHLD is blocked except in sigsuspend(), so that it
+       can't arrive between our check of 'numReaped' and our waiting. */
+
+    sigemptyset(&blockMask);
+    sigaddset(&blockMask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &blockMask, &origMask) == -1)
+        errExit("sigprocmask");
+
+    for (;;)
+    {
+        slDrain(sigLog, printRecord, NULL);
+        if (__atomic_load_n(&numReaped, __ATOMIC_RELAXED) == numChildren)
+            break;
+        if (sigsuspend(&origMask) == -1 && errno != EINTR)
+            errExit("sigsuspend");
+    }
+
+    if (sigprocmask(SIG_SETMASK, &origMask, NULL) == -1)
+        errExit("sigprocmask");
+
+    dropped = slDropped(sigLog);
+    printf("%ld children reaped; %ld reaped and %ld handler records "
+           "logged; %ld dropped\n", numReaped, numReapedRecs,
+           numHandlerRecs, dropped);
+
+    slFree(sigLog);
+    exit(EXIT_SUCCESS);
+}
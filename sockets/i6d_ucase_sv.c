@@ -6,11 +6,12 @@
    See also i6d_ucase_cl.c.
 */
 #include "i6d_ucase.h"
+#include "text_xform.h"
 
 int main(int argc, char *argv[])
 {
     struct sockaddr_in6 svaddr, claddr;
-    int sfd, j;
+    int sfd;
     ssize_t numBytes;
     socklen_t len;
     char buf[BUF_SIZE];
@@ -50,8 +51,7 @@ int main(int argc, char *argv[])
             printf("Server received %ld bytes from (%s, %u)\n",
                    (long)numBytes, claddrStr, ntohs(claddr.sin6_port));
 
-        for (j = 0; j < numBytes; j++)
-            buf[j] = toupper((unsigned char)buf[j]);
+        txTransform(TX_UPPER, buf, numBytes);
 
         if (sendto(sfd, buf, numBytes, 0, (struct sockaddr *)&claddr, len) !=
             numBytes)
@@ -0,0 +1,302 @@
+/* is_echo_rx_sv.c
+
+   An implementation of the TCP "echo" service built on the event loop in
+   lib/reactor.c. Compare is_echo_sv.c, which creates a child process
+   for each client.
+
+   Usage as shown in usageError().
+
+   The server runs 'num-threads' worker threads, each running its own
+   reactor. All of the workers monitor the same (nonblocking) listening
+   socket, with EPOLLEXCLUSIVE, so that a new connection usually wakes
+   just one of them; whichever accepts a connection handles that client
+   from then on. Client sockets are monitored edge-triggered for both
+   input and output, so that output that couldn't be written immediately
+   is sent when the socket becomes writable. A client that sends nothing
+   for 'idle-secs' seconds is disconnected.
+
+   The main thread handles SIGINT and SIGTERM, through its own reactor's
+   signalfd. On receiving either, it asks each worker to stop (with
+   rxStop(), which wakes the worker's loop via an eventfd), and prints
+   the number of clients and bytes each worker handled.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE /* For accept4() */
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include "reactor.h"
+#include "inet_sockets.h" /* Declarations of inet*() socket functions */
+#include "tlpi_hdr.h"
+
+#define BUF_SIZE 4096
+#define MAX_THREADS 64
+#define NS_PER_SEC 1000000000LL
+
+struct worker
+{
+    pthread_t tid;
+    Reactor *rx;
+    long clients;            /* Connections accepted */
+    long bytes;              /* Bytes echoed */
+};
+
+struct client
+{
+    int fd;
+    struct worker *w;
+    int timerId;
+    long long lastActive;    /* rxNowNs() at last input */
+    size_t len, off;         /* Unsent output is buf[off..len-1] */
+    char buf[BUF_SIZE];
+};
+
+static int lfd;
+static long long idleNs;
+
+static void
+closeClient(Reactor *rx, struct client *c)
+{
+    rxRemoveFd(rx, c->fd);
+    if (c->timerId != -1)
+        rxCancelTimer(rx, c->timerId);
+    close(c->fd);
+    free(c);
+}
+
+/* Write as much of the client's pending output as possible. Returns 0
+   if it has all been written, 1 if some remains, or -1 on error. */
+
+static int
+flush(struct client *c)
+{
+    ssize_t numWritten;
+
+    while (c->off < c->len)
+    {
+        numWritten = write(c->fd, c->buf + c->off, c->len - c->off);
+        if (numWritten == -1)
+            return (errno == EAGAIN) ? 1 : -1;
+        c->off += numWritten;
+    }
+    return 0;
+}
+
+static void
+onClient(Reactor *rx, int fd, uint32_t events, void *arg)
+{
+    struct client *c = arg;
+    ssize_t numRead;
+    int s;
+
+    /* Edge-triggered: consume input until read() would block, but don't
+       read more until what we have read has been sent */
+
+    for (;;)
+    {
+        s = flush(c);
+        if (s == -1)
+        {
+            closeClient(rx, c);
+            return;
+        }
+        if (s == 1) /* Wait for EPOLLOUT */
+            return;
+
+        numRead = read(fd, c->buf, BUF_SIZE);
+        if (numRead > 0)
+        {
+            c->len = numRead;
+            c->off = 0;
+            c->w->bytes += numRead;
+            c->lastActive = rxNowNs();
+        }
+        else if (numRead == -1 && errno == EAGAIN)
+        {
+            return;
+        }
+        else /* EOF or error */
+        {
+            closeClient(rx, c);
+            return;
+        }
+    }
+}
+
+/* Called when a client's idle timer expires. Rather than resetting the
+   timer on every read, we let it expire, and then set it again if the
+   client has been active in the meantime. */
+
+static void
+onIdle(Reactor *rx, int timerId, void *arg)
+{
+    struct client *c = arg;
+    long long idle;
+
+    idle = rxNowNs() - c->lastActive;
+    c->timerId = -1; /* One-shot timer has expired */
+
+    if (idle >= idleNs)
+        closeClient(rx, c);
+    else
+        c->timerId = rxAddTimer(rx, idleNs - idle, 0, onIdle, c);
+}
+
+static void
+onListen(Reactor *rx, int fd, uint32_t events, void *arg)
+{
+    struct worker *w = arg;
+    struct client *c;
+    int cfd;
+
+    /* Another worker may have been woken too, and taken the connection */
+
+    while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK)) != -1)
+    {
+        c = malloc(sizeof(struct client));
+        if (c == NULL)
+        {
+            close(cfd);
+            continue;
+        }
+        c->fd = cfd;
+        c->w = w;
+        c->len = c->off = 0;
+        c->lastActive = rxNowNs();
+        c->timerId = -1;
+        if (idleNs > 0)
+            c->timerId = rxAddTimer(rx, idleNs, 0, onIdle, c);
+
+        if (rxAddFd(rx, cfd, EPOLLIN | EPOLLOUT | EPOLLRDHUP, RX_EDGE,
+                    onClient, c) == -1)
+        {
+            errMsg("rxAddFd");
+            if (c->timerId != -1)
+                rxCancelTimer(rx, c->timerId);
+            close(cfd);
+            free(c);
+            continue;
+        }
+        w->clients++;
+    }
+
+    if (errno != EAGAIN && errno != ECONNABORTED && errno != EINTR)
+        errMsg("accept4");
+}
+
+static void *
+workerFunc(void *arg)
+{
+    struct worker *w = arg;
+
+    if (rxRun(w->rx) == -1)
+        errExit("rxRun");
+    return NULL;
+}
+
+static void
+onTermSignal(Reactor *rx, const struct signalfd_siginfo *si, void *arg)
+{
+    printf("Caught %s; stopping\n", strsignal(si->ssi_signo));
+    rxStop(rx);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [-t num-threads] [-i idle-secs] [port]\n",
+            progName);
+    fprintf(stderr, "    -t num     Number of worker threads (default: 2)\n");
+    fprintf(stderr, "    -i secs    Disconnect idle clients after 'secs' "
+                    "seconds\n");
+    fprintf(stderr, "               (default: 60; 0 means never)\n");
+    fprintf(stderr, "    port       Port to listen on (default: 50000)\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    struct worker workers[MAX_THREADS];
+    Reactor *mainRx;
+    int opt, numThreads, s;
+
+    numThreads = 2;
+    idleNs = 60 * NS_PER_SEC;
+    while ((opt = getopt(argc, argv, "t:i:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            numThreads = getInt(optarg, GN_GT_0, "num-threads");
+            if (numThreads > MAX_THREADS)
+                cmdLineErr("At most %d threads\n", MAX_THREADS);
+            break;
+        case 'i':
+            idleNs = getInt(optarg, GN_NONNEG, "idle-secs") * NS_PER_SEC;
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+    if (argc > optind + 1)
+        usageError(argv[0]);
+
+    /* Ignore SIGPIPE, so that writing to a client that has gone away
+       yields EPIPE */
+
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+        errExit("signal");
+
+    lfd = inetListen((optind < argc) ? argv[optind] : "50000", SOMAXCONN,
+                     NULL);
+    if (lfd == -1)
+        errExit("inetListen");
+    if (fcntl(lfd, F_SETFL, fcntl(lfd, F_GETFL) | O_NONBLOCK) == -1)
+        errExit("fcntl");
+
+    /* Add the signals before creating the workers, so that the workers
+       inherit a signal mask that blocks them */
+
+    mainRx = rxCreate();
+    if (mainRx == NULL)
+        errExit("rxCreate");
+    if (rxAddSignal(mainRx, SIGINT, onTermSignal, NULL) == -1 ||
+            rxAddSignal(mainRx, SIGTERM, onTermSignal, NULL) == -1)
+        errExit("rxAddSignal");
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        workers[j].clients = workers[j].bytes = 0;
+        workers[j].rx = rxCreate();
+        if (workers[j].rx == NULL)
+            errExit("rxCreate");
+        if (rxAddFd(workers[j].rx, lfd, EPOLLIN, RX_EXCLUSIVE, onListen,
+                    &workers[j]) == -1)
+            errExit("rxAddFd");
+
+        s = pthread_create(&workers[j].tid, NULL, workerFunc, &workers[j]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+
+    if (rxRun(mainRx) == -1)
+        errExit("rxRun");
+
+    for (int j = 0; j < numThreads; j++)
+        rxStop(workers[j].rx);
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        s = pthread_join(workers[j].tid, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+        printf("worker %d: %ld clients, %ld bytes\n", j, workers[j].clients,
+               workers[j].bytes);
+        rxFree(workers[j].rx);
+    }
+
+    rxFree(mainRx);
+    exit(EXIT_SUCCESS);
+}
@@ -6,11 +6,12 @@
    See also ud_ucase_cl.c.
 */
 #include "ud_ucase.h"
+#include "text_xform.h"
 
 int main(int argc, char *argv[])
 {
     struct sockaddr_un svaddr, claddr;
-    int sfd, j;
+    int sfd;
     ssize_t numBytes;
     socklen_t len;
     char buf[BUF_SIZE];
@@ -47,8 +48,7 @@ int main(int argc, char *argv[])
         printf("Server received %ld bytes from %s\n", (long)numBytes,
                claddr.sun_path);
 
-        for (j = 0; j < numBytes; j++)
-            buf[j] = toupper((unsigned char)buf[j]);
+        txTransform(TX_UPPER, buf, numBytes);
 
         if (sendto(sfd, buf, numBytes, 0, (struct sockaddr *)&claddr, len) !=
             numBytes)
@@ -0,0 +1,273 @@
+/* barrier_bench.c
+
+   Measure the latency of barrier episodes as the number of threads
+   grows, comparing pthread_barrier_wait() with the spinning barriers in
+   lib/spin_barrier.c.
+
+   Usage as shown in usageError().
+
+   The workload is the loop from pthread_barrier_demo.c, made fine
+   grained: each thread loops 'num-barriers' times, doing a random amount
+   of work (up to 'max-work' iterations of an empty loop, rather than
+   sleeping for 1 to 5 seconds) and then waiting on the barrier. With the
+   default of no work, what is measured is the cost of the barrier alone.
+
+   Thread 0 timestamps each of its exits from the barrier; the
+   differences between successive timestamps are the episode latencies,
+   which are reported as percentiles. Before the timed episodes, the
+   threads pass the barrier NUM_CHECKS times more, checking that no
+   thread gets past an episode while another is still short of it; the
+   shared counter used for that check is kept out of the timed episodes,
+   where it would add a contended atomic operation to each one. The
+   barrier kinds are:
+
+        pthread    pthread_barrier_wait()
+        central    SB_CENTRAL: counter plus sense flag, spinning
+        tree       SB_TREE: tournament, spinning
+        hybrid     SB_HYBRID: as central, but spin and then sleep
+
+   The spinning barriers need a CPU per thread: with more threads than
+   CPUs, waiters spin (and yield) while the threads they are waiting for
+   are not running.
+*/
+#include <pthread.h>
+#include "spin_barrier.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+static const char *kindNames[] = {"pthread", "central", "tree", "hybrid"};
+
+#define NUM_KINDS (sizeof(kindNames) / sizeof(kindNames[0]))
+
+#define NUM_CHECKS 1000         /* Untimed episodes that check the barrier */
+
+static int numBarriers;         /* Number of times the threads will
+                                   pass the barrier */
+static int maxWork;             /* Upper limit on work between barriers */
+static int pin;                 /* Pin thread j to CPU j? */
+
+static int kind;                /* Index into kindNames[] */
+static int numThreads;
+static pthread_barrier_t pbarrier;
+static SpinBarrier *sbarrier;
+static long arrivals;           /* Calls to the barrier in the checked
+                                   episodes so far */
+static long *samples;           /* Episode latencies, from thread 0 */
+
+static void
+barrierWait(int idx)
+{
+    int s;
+
+    if (kind == 0)
+    {
+        s = pthread_barrier_wait(&pbarrier);
+        if (s != 0 && s != PTHREAD_BARRIER_SERIAL_THREAD)
+            errExitEN(s, "pthread_barrier_wait");
+    }
+    else
+    {
+        sbWait(sbarrier, idx);
+    }
+}
+
+static void *
+threadFunc(void *arg)
+{
+    int idx = *(int *)arg;
+    unsigned int seed = idx + 1;
+    long long prev, now;
+
+    if (pin && latPinCpu(idx) == -1)
+        errExit("latPinCpu");
+
+    for (int j = 0; j < NUM_CHECKS; j++)
+    {
+        __atomic_fetch_add(&arrivals, 1, __ATOMIC_RELAXED);
+        barrierWait(idx);
+
+        /* A thread that has passed the barrier may already be arriving
+           at the next episode, but no thread may still be short of this
+           one */
+
+        if (__atomic_load_n(&arrivals, __ATOMIC_RELAXED) <
+                (long)(j + 1) * numThreads)
+            fatal("%s: thread %d passed barrier %d early", kindNames[kind],
+                  idx, j);
+    }
+
+    /* Line everyone up before the timed episodes begin */
+
+    barrierWait(idx);
+    prev = latNowNs();
+
+    for (int j = 0; j < numBarriers; j++)
+    {
+        if (maxWork > 0)
+        {
+            int n = rand_r(&seed) % maxWork + 1;
+
+            for (volatile int k = 0; k < n; k++)
+                continue;
+        }
+
+        barrierWait(idx);
+
+        if (idx == 0)
+        {
+            now = latNowNs();
+            samples[j] = now - prev;
+            prev = now;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+runOne(LatFormat fmt)
+{
+    pthread_t *tid;
+    int *idx;
+    int s;
+    struct latSummary sum;
+    char values[128];
+
+    if (kind == 0)
+    {
+        s = pthread_barrier_init(&pbarrier, NULL, numThreads);
+        if (s != 0)
+            errExitEN(s, "pthread_barrier_init");
+    }
+    else
+    {
+        sbarrier = sbCreate(SB_CENTRAL + kind - 1, numThreads);
+        if (sbarrier == NULL)
+            errExit("sbCreate");
+    }
+
+    tid = calloc(numThreads, sizeof(pthread_t));
+    idx = calloc(numThreads, sizeof(int));
+    if (tid == NULL || idx == NULL)
+        errExit("calloc");
+    arrivals = 0;
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        idx[j] = j;
+        s = pthread_create(&tid[j], NULL, threadFunc, &idx[j]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        s = pthread_join(tid[j], NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+
+    if (kind == 0)
+        pthread_barrier_destroy(&pbarrier);
+    else
+        sbFree(sbarrier);
+    free(tid);
+    free(idx);
+
+    latSummarize(samples, numBarriers, &sum);
+    snprintf(values, sizeof(values), "%s,%d,%d", kindNames[kind],
+             numThreads, maxWork);
+    latPrintRow(fmt, "barrier,threads,work", values, &sum);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -b num     Barrier episodes per run (default: "
+                    "100000)\n");
+    fprintf(stderr, "    -n list    Comma-separated thread counts "
+                    "(default: 1,2,4,8)\n");
+    fprintf(stderr, "    -k list    Comma-separated barrier kinds "
+                    "(default: all):\n               ");
+    for (size_t j = 0; j < NUM_KINDS; j++)
+        fprintf(stderr, " %s", kindNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -w num     Maximum loop iterations of work "
+                    "between barriers (default: 0)\n");
+    fprintf(stderr, "    -p         Pin thread j to CPU j\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *threadList, *kindList;
+    char *copy, *tok, *save;
+    int opt;
+    LatFormat fmt;
+
+    numBarriers = 100000;
+    maxWork = 0;
+    pin = 0;
+    threadList = "1,2,4,8";
+    kindList = NULL;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "b:n:k:w:po:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            numBarriers = getInt(optarg, GN_GT_0, "num-barriers");
+            break;
+        case 'n':
+            threadList = optarg;
+            break;
+        case 'k':
+            kindList = optarg;
+            break;
+        case 'w':
+            maxWork = getInt(optarg, GN_NONNEG, "max-work");
+            break;
+        case 'p':
+            pin = 1;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    samples = calloc(numBarriers, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    latPrintHeader(fmt, "barrier,threads,work");
+
+    for (kind = 0; kind < (int)NUM_KINDS; kind++)
+    {
+        if (kindList != NULL && !latInList(kindList, kindNames[kind]))
+            continue;
+
+        copy = strdup(threadList);
+        if (copy == NULL)
+            errExit("strdup");
+        for (tok = strtok_r(copy, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save))
+        {
+            numThreads = getInt(tok, GN_GT_0, "num-threads");
+            runOne(fmt);
+        }
+        free(copy);
+    }
+
+    exit(EXIT_SUCCESS);
+}
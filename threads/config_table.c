@@ -0,0 +1,459 @@
+/* config_table.c
+
+   Compare ways of protecting a read-mostly table: a mutex, a read/write
+   lock (as in thread_incr_rwlock.c), and the epoch-based reclamation in
+   lib/epoch_reclaim.c.
+
+   Usage as shown in usageError().
+
+   The table maps keys to values, rather like a program's configuration.
+   Reader threads look up random keys as fast as they can, while a single
+   writer updates every entry in the table once per 'update-interval'
+   microseconds. The modes are:
+
+        mutex      Readers and the writer lock a mutex; the writer
+                   updates the table in place
+        rwlock     Readers take a read lock and the writer a write lock.
+                   Readers don't exclude each other, but each still
+                   writes to the lock, so its cache line moves between
+                   CPUs on every lookup
+        ebr        The writer updates a copy of the table and swaps the
+                   pointer to it; readers use ebrEnter() and ebrLeave(),
+                   and old versions are freed with ebrRetire()
+        ebr-fence  As ebr, but readers execute a memory fence, rather
+                   than the writer calling membarrier(2)
+
+   Each version of the table holds its version number in every entry;
+   readers check that the value they find matches, which catches both
+   torn updates and reads of a freed version (whose contents are
+   overwritten before it is freed).
+
+   The program prints, for each mode and number of readers, the total
+   lookup rate (in millions per second) and the number of updates made,
+   along with the distribution of the cost of a lookup. Each sample is
+   the average over a batch of BATCH lookups by one reader; each reader
+   keeps its most recent MAX_SAMPLES samples.
+*/
+#include <pthread.h>
+#include <time.h>
+#include "epoch_reclaim.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define NUM_ENTRIES 256
+#define MAX_READERS 64
+#define BATCH 100 /* Lookups between checks of 'stop' */
+#define MAX_SAMPLES 65536 /* Batch times kept per reader */
+
+#define LABELS "mode,readers,update_us,Mreads_s,updates"
+
+struct config
+{
+    long version;
+    struct
+    {
+        int key;
+        long value;
+    } entry[NUM_ENTRIES]; /* Sorted by key */
+};
+
+enum mode
+{
+    MODE_MUTEX,
+    MODE_RWLOCK,
+    MODE_EBR,
+    MODE_EBR_FENCE
+};
+
+static const char *modeNames[] = {"mutex", "rwlock", "ebr", "ebr-fence"};
+
+#define NUM_MODES (sizeof(modeNames) / sizeof(modeNames[0]))
+
+static enum mode mode;
+static int updateUsecs;
+
+static struct config *table;
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static EbrDomain *domain;
+
+static int stop;
+static long numUpdates;
+
+static struct readerResult      /* Each on its own cache line */
+{
+    long reads;
+    long errors;
+    long *samples;              /* MAX_SAMPLES batch times */
+    long numSamples;
+} __attribute__((aligned(64))) results[MAX_READERS];
+
+/* Return the value for 'key', or -1 if there is none */
+
+static long
+lookup(const struct config *t, int key)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = NUM_ENTRIES - 1;
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        if (t->entry[mid].key == key)
+            return t->entry[mid].value;
+        if (t->entry[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+/* Look up 'key', returning 1 if the value found is consistent with the
+   table version, or 0 if not */
+
+static int
+readOne(int key, int slot)
+{
+    const struct config *t;
+    int ok, s;
+
+    switch (mode)
+    {
+    case MODE_MUTEX:
+        s = pthread_mutex_lock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        ok = lookup(table, key) == table->version;
+        s = pthread_mutex_unlock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+        return ok;
+
+    case MODE_RWLOCK:
+        s = pthread_rwlock_rdlock(&rwlock);
+        if (s != 0)
+            errExitEN(s, "pthread_rwlock_rdlock");
+        ok = lookup(table, key) == table->version;
+        s = pthread_rwlock_unlock(&rwlock);
+        if (s != 0)
+            errExitEN(s, "pthread_rwlock_unlock");
+        return ok;
+
+    default: /* MODE_EBR, MODE_EBR_FENCE */
+        ebrEnter(domain, slot);
+        t = __atomic_load_n(&table, __ATOMIC_ACQUIRE);
+        ok = lookup(t, key) == t->version;
+        ebrLeave(domain, slot);
+        return ok;
+    }
+}
+
+static void *
+readerFunc(void *arg)
+{
+    struct readerResult *res = arg;
+    unsigned int seed = res - results + 1;
+    long long start, now;
+    long reads, errors;
+    int slot;
+
+    slot = -1;
+    if (mode == MODE_EBR || mode == MODE_EBR_FENCE)
+    {
+        slot = ebrRegister(domain);
+        if (slot == -1)
+            errExit("ebrRegister");
+    }
+
+    reads = 0;
+    errors = 0;
+    start = latNowNs();
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED))
+    {
+        for (int j = 0; j < BATCH; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            if (!readOne(2 * ((seed >> 16) % NUM_ENTRIES), slot))
+                errors++;
+        }
+        now = latNowNs();
+        res->samples[(reads / BATCH) % MAX_SAMPLES] = (now - start) / BATCH;
+        start = now;
+        reads += BATCH;
+    }
+
+    if (slot != -1)
+        ebrUnregister(domain, slot);
+
+    res->reads = reads;
+    res->errors = errors;
+    res->numSamples = (reads / BATCH < MAX_SAMPLES) ? reads / BATCH :
+                                                       MAX_SAMPLES;
+    return NULL;
+}
+
+/* Set every entry of 't' to version 'v' */
+
+static void
+setVersion(struct config *t, long v)
+{
+    t->version = v;
+    for (int j = 0; j < NUM_ENTRIES; j++)
+        t->entry[j].value = v;
+}
+
+/* Overwrite a retired table, so that a reader that (wrongly) still sees
+   it fails its check, and free it */
+
+static void
+poisonFree(void *ptr)
+{
+    struct config *t = ptr;
+
+    t->version = -1;
+    for (int j = 0; j < NUM_ENTRIES; j++)
+        t->entry[j].value = -2;
+    free(t);
+}
+
+static void
+update(void)
+{
+    struct config *t, *old;
+    int s;
+
+    switch (mode)
+    {
+    case MODE_MUTEX:
+        s = pthread_mutex_lock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        setVersion(table, table->version + 1);
+        s = pthread_mutex_unlock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+        break;
+
+    case MODE_RWLOCK:
+        s = pthread_rwlock_wrlock(&rwlock);
+        if (s != 0)
+            errExitEN(s, "pthread_rwlock_wrlock");
+        setVersion(table, table->version + 1);
+        s = pthread_rwlock_unlock(&rwlock);
+        if (s != 0)
+            errExitEN(s, "pthread_rwlock_unlock");
+        break;
+
+    default: /* MODE_EBR, MODE_EBR_FENCE */
+
+        /* Only this thread changes 'table', so it can read it freely */
+
+        t = malloc(sizeof(struct config));
+        if (t == NULL)
+            errExit("malloc");
+        memcpy(t, table, sizeof(struct config));
+        setVersion(t, table->version + 1);
+
+        old = __atomic_exchange_n(&table, t, __ATOMIC_ACQ_REL);
+        if (ebrRetire(domain, old, poisonFree) == -1)
+            errExit("ebrRetire");
+        break;
+    }
+}
+
+static void *
+writerFunc(void *arg)
+{
+    struct timespec ts;
+
+    ts.tv_sec = updateUsecs / 1000000;
+    ts.tv_nsec = (updateUsecs % 1000000) * 1000;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED))
+    {
+        if (updateUsecs > 0)
+            nanosleep(&ts, NULL);
+        update();
+        numUpdates++;
+    }
+    return NULL;
+}
+
+static void
+runOne(int numReaders, int msecs, LatFormat fmt)
+{
+    pthread_t reader[MAX_READERS], writer;
+    struct latSummary sum;
+    struct timespec ts;
+    long long start, elapsed;
+    long reads, errors, *samples, numSamples;
+    char values[256];
+    int s;
+
+    table = malloc(sizeof(struct config));
+    if (table == NULL)
+        errExit("malloc");
+    for (int j = 0; j < NUM_ENTRIES; j++)
+        table->entry[j].key = 2 * j;
+    setVersion(table, 0);
+
+    domain = NULL;
+    if (mode == MODE_EBR || mode == MODE_EBR_FENCE)
+    {
+        domain = ebrCreate(numReaders,
+                           (mode == MODE_EBR_FENCE) ? EBR_FENCE : 0);
+        if (domain == NULL)
+            errExit("ebrCreate");
+    }
+
+    stop = 0;
+    numUpdates = 0;
+    memset(results, 0, sizeof(results));
+    samples = calloc((size_t)numReaders * MAX_SAMPLES, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+    for (int j = 0; j < numReaders; j++)
+        results[j].samples = &samples[j * MAX_SAMPLES];
+
+    start = latNowNs();
+    for (int j = 0; j < numReaders; j++)
+    {
+        s = pthread_create(&reader[j], NULL, readerFunc, &results[j]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+    s = pthread_create(&writer, NULL, writerFunc, NULL);
+    if (s != 0)
+        errExitEN(s, "pthread_create");
+
+    ts.tv_sec = msecs / 1000;
+    ts.tv_nsec = (msecs % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+    for (int j = 0; j < numReaders; j++)
+    {
+        s = pthread_join(reader[j], NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+    elapsed = latNowNs() - start;
+    s = pthread_join(writer, NULL);
+    if (s != 0)
+        errExitEN(s, "pthread_join");
+
+    reads = 0;
+    errors = 0;
+    numSamples = 0;
+    for (int j = 0; j < numReaders; j++)
+    {
+        reads += results[j].reads;
+        errors += results[j].errors;
+
+        /* Gather the samples at the start of the array */
+
+        memmove(&samples[numSamples], results[j].samples,
+                results[j].numSamples * sizeof(long));
+        numSamples += results[j].numSamples;
+    }
+    if (errors > 0)
+        fatal("%s: %ld of %ld lookups found an inconsistent table",
+              modeNames[mode], errors, reads);
+
+    if (domain != NULL)
+        ebrFree(domain);
+    free(table);
+
+    latSummarize(samples, numSamples, &sum);
+    snprintf(values, sizeof(values), "%s,%d,%d,%.2f,%ld", modeNames[mode],
+             numReaders, updateUsecs, reads / (elapsed / 1e3), numUpdates);
+    latPrintRow(fmt, LABELS, values, &sum);
+    free(samples);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n list    Comma-separated reader counts "
+                    "(default: 1,2,4)\n");
+    fprintf(stderr, "    -m list    Comma-separated modes (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_MODES; j++)
+        fprintf(stderr, " %s", modeNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -u usecs   Interval between updates (default: "
+                    "1000)\n");
+    fprintf(stderr, "    -t msecs   Duration of each run (default: "
+                    "1000)\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *readerList, *modeList;
+    char *copy, *tok, *save;
+    int opt, numReaders, msecs;
+    LatFormat fmt;
+
+    readerList = "1,2,4";
+    modeList = NULL;
+    updateUsecs = 1000;
+    msecs = 1000;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "n:m:u:t:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            readerList = optarg;
+            break;
+        case 'm':
+            modeList = optarg;
+            break;
+        case 'u':
+            updateUsecs = getInt(optarg, GN_NONNEG, "update-interval");
+            break;
+        case 't':
+            msecs = getInt(optarg, GN_GT_0, "msecs");
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    latPrintHeader(fmt, LABELS);
+
+    for (mode = 0; mode < NUM_MODES; mode++)
+    {
+        if (modeList != NULL && !latInList(modeList, modeNames[mode]))
+            continue;
+
+        copy = strdup(readerList);
+        if (copy == NULL)
+            errExit("strdup");
+        for (tok = strtok_r(copy, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save))
+        {
+            numReaders = getInt(tok, GN_GT_0, "num-readers");
+            if (numReaders > MAX_READERS)
+                cmdLineErr("At most %d readers\n", MAX_READERS);
+            runOne(numReaders, msecs, fmt);
+        }
+        free(copy);
+    }
+
+    exit(EXIT_SUCCESS);
+}
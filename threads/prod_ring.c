@@ -0,0 +1,442 @@
+/* prod_ring.c
+
+   A producer-consumer program, in the style of prod_condvar.c, that
+   compares two ways of passing units from producer threads to consumer
+   threads through a bounded buffer:
+
+        condvar   A circular buffer guarded by a mutex, with "not empty"
+                  and "not full" condition variables; every produce and
+                  consume takes the mutex
+        ring      The lock-free ring in lib/mpmc_ring.c; consumers sleep
+                  on a futex only when the ring is empty
+
+   Usage as shown in usageError().
+
+   For each number of producers in the list given with -p, and for each
+   method, the program runs the producers and consumers until every
+   producer has produced its units, and reports the rate at which units
+   were passed through (in thousands per second), the number of times a
+   consumer went to sleep because the buffer was empty, and the number
+   of wakeup calls (signals or futex wakes) that producers made, along
+   with the distribution of the time a producer took to hand over a
+   batch (including any wait for space in a full buffer). Only one
+   produce call in SAMPLE_EVERY is timed, to keep the cost of reading
+   the clock out of the rate. With -b, units are produced and consumed in
+   batches.
+
+   For example:
+
+        $ ./prod_ring -p 1,2,4,8 -c 2 -b 16
+*/
+#include <pthread.h>
+#include <stdint.h>
+#include "mpmc_ring.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define LABELS "method,producers,consumers,batch,Ku_per_s,sleeps,wakes"
+
+#define SAMPLE_EVERY 16 /* Time one produce call in this many */
+
+static long numUnits;    /* Units per producer */
+static size_t batch;     /* Units per produce/consume call */
+static size_t capacity;  /* Buffer capacity */
+
+/* The mutex and condition variable version */
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notFull = PTHREAD_COND_INITIALIZER;
+static void **buf;          /* Circular buffer of 'capacity' units */
+static size_t head, avail;  /* Next unit to consume; units in 'buf' */
+static int producersDone;   /* All producers have finished */
+static int cvWaiters;           /* Consumers waiting on 'notEmpty' */
+static long cvSleeps, cvSignals;
+
+static void
+cvProduce(void *const *units, size_t n)
+{
+    size_t done, k;
+    int s, waiters;
+
+    for (done = 0; done < n; done += k)
+    {
+        s = pthread_mutex_lock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+
+        while (avail == capacity)
+        {
+            s = pthread_cond_wait(&notFull, &mtx);
+            if (s != 0)
+                errExitEN(s, "pthread_cond_wait");
+        }
+
+        for (k = 0; k < n - done && avail < capacity; k++)
+            buf[(head + avail++) % capacity] = units[done + k];
+
+        /* As the ring does, wake consumers only if one is waiting */
+
+        waiters = cvWaiters;
+        if (waiters > 0)
+            cvSignals++;
+
+        s = pthread_mutex_unlock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+
+        if (waiters > 0)
+        {
+            s = (k > 1) ? pthread_cond_broadcast(&notEmpty) :
+                          pthread_cond_signal(&notEmpty);
+            if (s != 0)
+                errExitEN(s, "pthread_cond_signal");
+        }
+    }
+}
+
+/* Returns 0 once the buffer is empty and all producers are done */
+
+static size_t
+cvConsume(void **units, size_t max)
+{
+    size_t k;
+    int s;
+
+    s = pthread_mutex_lock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+
+    while (avail == 0 && !producersDone)
+    {
+        cvSleeps++;
+        cvWaiters++;
+        s = pthread_cond_wait(&notEmpty, &mtx);
+        cvWaiters--;
+        if (s != 0)
+            errExitEN(s, "pthread_cond_wait");
+    }
+
+    for (k = 0; k < max && avail > 0; k++)
+    {
+        units[k] = buf[head];
+        head = (head + 1) % capacity;
+        avail--;
+    }
+
+    s = pthread_mutex_unlock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+
+    if (k > 0)
+    {
+        s = pthread_cond_signal(&notFull);
+        if (s != 0)
+            errExitEN(s, "pthread_cond_signal");
+    }
+    return k;
+}
+
+static void
+cvFinish(void)
+{
+    int s;
+
+    s = pthread_mutex_lock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+    producersDone = 1;
+    s = pthread_mutex_unlock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+
+    s = pthread_cond_broadcast(&notEmpty);
+    if (s != 0)
+        errExitEN(s, "pthread_cond_broadcast");
+}
+
+/* The lock-free ring version */
+
+static MpmcRing *ring;
+
+static void
+ringProduce(void *const *units, size_t n)
+{
+    mrEnqueue(ring, units, n);
+}
+
+static size_t
+ringConsume(void **units, size_t max)
+{
+    return mrDequeue(ring, units, max);
+}
+
+static void
+ringFinish(void)
+{
+    mrClose(ring);
+}
+
+static const struct method
+{
+    const char *name;
+    void (*produce)(void *const *units, size_t n);
+    size_t (*consume)(void **units, size_t max);
+    void (*finish)(void);
+} methods[] = {
+    {"condvar", cvProduce, cvConsume, cvFinish},
+    {"ring", ringProduce, ringConsume, ringFinish},
+};
+
+static const struct method *meth; /* Method in the current run */
+
+/* Number of produce calls a producer times */
+
+static long
+numSamples(void)
+{
+    long calls;
+
+    calls = (numUnits + batch - 1) / batch;
+    return (calls + SAMPLE_EVERY - 1) / SAMPLE_EVERY;
+}
+
+/* 'arg' points to the producer's numSamples() elements of the samples
+   array */
+
+static void *
+producer(void *arg)
+{
+    long *samples = arg;
+    long long start;
+    void **units;
+    long j, call;
+    size_t k;
+
+    units = malloc(batch * sizeof(void *));
+    if (units == NULL)
+        errExit("malloc");
+
+    for (j = 0, call = 0; j < numUnits; j += k, call++)
+    {
+        /* Code to produce the units omitted; we use their numbers */
+
+        for (k = 0; k < batch && j + k < numUnits; k++)
+            units[k] = (void *)(uintptr_t)(j + k + 1);
+
+        if (call % SAMPLE_EVERY == 0)
+        {
+            start = latNowNs();
+            meth->produce(units, k);
+            samples[call / SAMPLE_EVERY] = latNowNs() - start;
+        }
+        else
+        {
+            meth->produce(units, k);
+        }
+    }
+
+    free(units);
+    return NULL;
+}
+
+static void *
+consumer(void *arg)
+{
+    long *numConsumed = arg;
+    void **units;
+    size_t k;
+
+    units = malloc(batch * sizeof(void *));
+    if (units == NULL)
+        errExit("malloc");
+
+    while ((k = meth->consume(units, batch)) > 0)
+        *numConsumed += k; /* Do something with the units */
+
+    free(units);
+    return NULL;
+}
+
+static void
+runOne(int numProducers, int numConsumers, LatFormat fmt)
+{
+    struct latSummary sum;
+    pthread_t *prod, *cons;
+    long *consumed, *samples, total, perProducer;
+    long long start, elapsed;
+    long sleeps, wakes;
+    char values[256];
+    int s;
+
+    head = avail = 0;
+    producersDone = 0;
+    cvWaiters = 0;
+    cvSleeps = cvSignals = 0;
+    buf = malloc(capacity * sizeof(void *));
+    if (buf == NULL)
+        errExit("malloc");
+    ring = mrCreate(capacity);
+    if (ring == NULL)
+        errExit("mrCreate");
+
+    prod = calloc(numProducers, sizeof(pthread_t));
+    cons = calloc(numConsumers, sizeof(pthread_t));
+    consumed = calloc(numConsumers, sizeof(long));
+    perProducer = numSamples();
+    samples = calloc(numProducers * perProducer, sizeof(long));
+    if (prod == NULL || cons == NULL || consumed == NULL || samples == NULL)
+        errExit("calloc");
+
+    start = latNowNs();
+
+    for (int j = 0; j < numConsumers; j++)
+    {
+        s = pthread_create(&cons[j], NULL, consumer, &consumed[j]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+    for (int j = 0; j < numProducers; j++)
+    {
+        s = pthread_create(&prod[j], NULL, producer,
+                           &samples[j * perProducer]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+
+    for (int j = 0; j < numProducers; j++)
+    {
+        s = pthread_join(prod[j], NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+    meth->finish();
+    for (int j = 0; j < numConsumers; j++)
+    {
+        s = pthread_join(cons[j], NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+
+    elapsed = latNowNs() - start;
+
+    total = 0;
+    for (int j = 0; j < numConsumers; j++)
+        total += consumed[j];
+    if (total != numUnits * numProducers)
+        fatal("%s: consumed %ld units; expected %ld", meth->name, total,
+              numUnits * numProducers);
+
+    if (meth->produce == cvProduce)
+    {
+        sleeps = cvSleeps;
+        wakes = cvSignals;
+    }
+    else
+    {
+        sleeps = ring->numSleeps;
+        wakes = ring->numWakes;
+    }
+
+    latSummarize(samples, numProducers * perProducer, &sum);
+    snprintf(values, sizeof(values), "%s,%d,%d,%ld,%.0f,%ld,%ld", meth->name,
+             numProducers, numConsumers, (long)batch,
+             total / (elapsed / 1e9) / 1e3, sleeps, wakes);
+    latPrintRow(fmt, LABELS, values, &sum);
+
+    free(prod);
+    free(cons);
+    free(consumed);
+    free(samples);
+    free(buf);
+    mrFree(ring);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -m method  'condvar' or 'ring' (default: both)\n");
+    fprintf(stderr, "    -p list    Comma-separated producer counts "
+                    "(default: 1,2,4)\n");
+    fprintf(stderr, "    -c num     Consumers (default: 1)\n");
+    fprintf(stderr, "    -n num     Units per producer (default: 1000000)\n");
+    fprintf(stderr, "    -b num     Units per batch (default: 1)\n");
+    fprintf(stderr, "    -q size    Buffer capacity; a power of 2 "
+                    "(default: 1024)\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *prodList, *methName;
+    char *copy, *tok, *save;
+    int opt, numConsumers;
+    LatFormat fmt;
+
+    methName = NULL;
+    prodList = "1,2,4";
+    numConsumers = 1;
+    numUnits = 1000000;
+    batch = 1;
+    capacity = 1024;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "m:p:c:n:b:q:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            methName = optarg;
+            break;
+        case 'p':
+            prodList = optarg;
+            break;
+        case 'c':
+            numConsumers = getInt(optarg, GN_GT_0, "consumers");
+            break;
+        case 'n':
+            numUnits = getLong(optarg, GN_GT_0, "units");
+            break;
+        case 'b':
+            batch = getInt(optarg, GN_GT_0, "batch");
+            break;
+        case 'q':
+            capacity = getInt(optarg, GN_GT_0, "capacity");
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+    if ((capacity & (capacity - 1)) != 0 || capacity < 2)
+        cmdLineErr("Capacity must be a power of 2\n");
+
+    latPrintHeader(fmt, LABELS);
+
+    copy = strdup(prodList);
+    if (copy == NULL)
+        errExit("strdup");
+    for (tok = strtok_r(copy, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save))
+    {
+        for (size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); m++)
+        {
+            meth = &methods[m];
+            if (methName != NULL && strcmp(methName, meth->name) != 0)
+                continue;
+            runOne(getInt(tok, GN_GT_0, "producers"), numConsumers, fmt);
+        }
+    }
+    free(copy);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,88 @@
+/* thread_incr_sharded.c
+
+   This program employs POSIX threads that increment a shared counter,
+   like thread_incr.c, but the counter is a sharded counter (see
+   lib/sharded_counter.c): each thread increments its own slot, on its
+   own cache line, and the slots are only summed at the end. As a
+   consequence, updates are not lost, yet the threads never contend
+   for a lock or for a cache line. Compare with thread_incr.c,
+   thread_incr_mutex.c, and thread_incr_spinlock.c.
+
+   With -c, the threads instead increment the slot of the CPU they are
+   running on (using atomic operations, since threads may share a CPU).
+
+   See ../bench/counter_scale.c for a comparison of the speed of these
+   approaches.
+*/
+#include <pthread.h>
+#include "sharded_counter.h"
+#include "tlpi_hdr.h"
+
+static ShardedCounter *glob;
+static int loops;
+static int perCpu = 0;
+
+static void * /* Loop 'loops' times incrementing 'glob' */
+threadFunc(void *arg)
+{
+    int idx = *((int *)arg);
+
+    for (int j = 0; j < loops; j++)
+    {
+        if (perCpu)
+            scAdd(glob, 1);
+        else
+            scAddSlot(glob, idx, 1);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t *thread;
+    int *idx;
+    int numThreads, opt, s;
+
+    while ((opt = getopt(argc, argv, "c")) != -1)
+    {
+        if (opt != 'c')
+            usageErr("%s [-c] [num-loops [num-threads]]\n", argv[0]);
+        perCpu = 1;
+    }
+
+    loops = (optind < argc) ?
+            getInt(argv[optind], GN_GT_0, "num-loops") : 10000000;
+    numThreads = (optind + 1 < argc) ?
+            getInt(argv[optind + 1], GN_GT_0, "num-threads") : 2;
+
+    /* With per-thread slots, there must be a slot for each thread */
+
+    glob = scCreate(perCpu ? 0 : numThreads);
+    if (glob == NULL)
+        errExit("scCreate");
+
+    thread = calloc(numThreads, sizeof(pthread_t));
+    idx = calloc(numThreads, sizeof(int));
+    if (thread == NULL || idx == NULL)
+        errExit("calloc");
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        idx[j] = j;
+        s = pthread_create(&thread[j], NULL, threadFunc, &idx[j]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        s = pthread_join(thread[j], NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+
+    printf("glob = %ld\n", scRead(glob));
+    scFree(glob);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,923 @@
+/* thread_lock_bench.c
+
+   A more thorough version of thread_lock_speed.c: compare many kinds of
+   lock on the same workload, and measure acquisition latency, throughput,
+   and fairness directly rather than with time(1).
+
+   Usage as shown in usageError().
+
+   Each of 'n' threads repeatedly acquires the lock, performs 'cs' units
+   of work on shared data (incrementing a shared counter), releases the
+   lock, and then performs 'gap' units of work on private data, until
+   the run time expires. The locks are:
+
+        mutex       pthread_mutex_t (default type)
+        mutex-adapt pthread_mutex_t, PTHREAD_MUTEX_ADAPTIVE_NP
+        spin        pthread_spinlock_t
+        tas         Test-and-test-and-set spinlock on an atomic flag
+        ticket      Ticket lock (FIFO)
+        mcs         MCS queue lock (each waiter spins on its own node)
+        clh         CLH queue lock (each waiter spins on its predecessor's
+                    node)
+        futex       Three-state futex mutex (Drepper, "Futexes Are Tricky")
+        adaptive    The futex mutex, but spinning for a while before
+                    sleeping in the kernel
+        rwlock      pthread_rwlock_t (default, reader-preferring); a
+                    fraction of the acquisitions (-r) are reads
+        rwlock-wp   As rwlock, but writer-preferring
+        atomic      No lock at all; the critical section is replaced by
+                    a single atomic fetch-and-add of 'cs' to the counter
+
+   The hand-built locks use the GCC __atomic builtins, which implement
+   the C11 memory model (the rest of this tree is C99). The spinning
+   locks call sched_yield() after spinning for a while, so that they
+   still make progress if there are more threads than CPUs.
+
+   For each run, the program reports:
+
+   * throughput (acquisitions per second, all threads combined);
+   * fairness: Jain's index over the per-thread acquisition counts
+     (1.0 == perfectly even), and the smallest and largest per-thread
+     share relative to an even share;
+   * the distribution of acquisition latency (time from starting to
+     acquire the lock to holding it). Timing every acquisition would
+     perturb the result, so only every 'sample'th acquisition is timed.
+
+   Output is in text, CSV, or JSON (one object per run). The JSON output
+   also includes the per-thread acquisition counts and a histogram of
+   acquisition latency, in power-of-two buckets; -v adds these to the
+   text and CSV output too.
+
+   For example, to compare the queue locks with the mutexes at 1 to 8
+   threads, with a short critical section, producing JSON:
+
+        $ ./thread_lock_bench -l mutex,ticket,mcs,clh -n 1,2,4,8 -c 10 -o json
+*/
+#define _GNU_SOURCE /* For PTHREAD_MUTEX_ADAPTIVE_NP and
+                       PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP */
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define CACHE_LINE 64
+#define SPINS_BEFORE_YIELD 1000 /* For the spinning locks */
+#define ADAPTIVE_SPINS 100      /* For the "adaptive" lock */
+#define HIST_BUCKETS 40         /* Bucket k counts latencies < 2^k ns */
+
+/* Queue node for the MCS and CLH locks */
+
+struct qnode
+{
+    struct qnode *next; /* MCS only */
+    int locked;
+} __attribute__((aligned(CACHE_LINE)));
+
+/* Per-thread state; padded so that threads don't share cache lines */
+
+struct thread
+{
+    pthread_t tid;
+    long acquires;           /* Acquisitions made */
+    long writes;             /* Acquisitions that updated 'counter' */
+    long *samples;           /* Timed acquisition latencies */
+    size_t numSamples;
+    long hist[HIST_BUCKETS]; /* Histogram of 'samples' */
+    struct qnode mcsNode;
+    struct qnode *clhNode;   /* Node we will enqueue next */
+    struct qnode *clhPred;   /* Node we waited on; becomes ours */
+    unsigned int seed;       /* For choosing reads vs writes */
+} __attribute__((aligned(CACHE_LINE)));
+
+/* The locks (only one is in use in any run), each on its own cache line */
+
+static struct
+{
+    pthread_mutex_t mtx;
+} __attribute__((aligned(CACHE_LINE))) mtxLock;
+
+static struct
+{
+    pthread_spinlock_t spin;
+} __attribute__((aligned(CACHE_LINE))) spinLock;
+
+static struct
+{
+    pthread_rwlock_t rw;
+} __attribute__((aligned(CACHE_LINE))) rwLock;
+
+static struct
+{
+    int flag;
+} __attribute__((aligned(CACHE_LINE))) tasLock;
+
+static struct
+{
+    unsigned int next __attribute__((aligned(CACHE_LINE)));
+    unsigned int serving __attribute__((aligned(CACHE_LINE)));
+} ticketLock;
+
+static struct
+{
+    struct qnode *tail;
+} __attribute__((aligned(CACHE_LINE))) queueLock; /* MCS and CLH */
+
+static struct
+{
+    int state; /* 0 == unlocked, 1 == locked, 2 == locked, with waiters */
+} __attribute__((aligned(CACHE_LINE))) futexLock;
+
+static struct
+{
+    volatile long counter; /* Protected by the lock under test */
+    int stop;              /* Set by main() when the run time expires */
+} __attribute__((aligned(CACHE_LINE))) shared;
+
+static pthread_barrier_t startBarrier;
+
+/* Parameters of the current run */
+
+static int csWork, gapWork, readPct, sampleEvery;
+static size_t maxSamples;
+
+/* Spin-wait hint to the CPU; after a while, give up the CPU instead,
+   in case the thread we're waiting for is not running */
+
+static void
+spinPause(int *spins)
+{
+    if (++*spins % SPINS_BEFORE_YIELD == 0)
+    {
+        sched_yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static long
+futex(int *uaddr, int op, int val)
+{
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+/* Each lock is a set of functions. 'isRead' is true if the caller only
+   wants to read the shared data (this matters only for the rwlocks). */
+
+struct lockType
+{
+    const char *name;
+    void (*init)(struct thread *threads, int numThreads);
+    void (*lock)(struct thread *t, int isRead);
+    void (*unlock)(struct thread *t, int isRead);
+    int rw;         /* Does it support readers? */
+    int noCritical; /* No critical section (the "atomic" pseudo-lock) */
+};
+
+/* pthread mutexes, spinlocks, and rwlocks */
+
+static void
+mutexInitType(int type)
+{
+    pthread_mutexattr_t attr;
+    int s;
+
+    s = pthread_mutexattr_init(&attr);
+    if (s != 0)
+        errExitEN(s, "pthread_mutexattr_init");
+    s = pthread_mutexattr_settype(&attr, type);
+    if (s != 0)
+        errExitEN(s, "pthread_mutexattr_settype");
+    s = pthread_mutex_init(&mtxLock.mtx, &attr);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_init");
+    pthread_mutexattr_destroy(&attr);
+}
+
+static void
+mutexInit(struct thread *threads, int numThreads)
+{
+    mutexInitType(PTHREAD_MUTEX_DEFAULT);
+}
+
+static void
+mutexAdaptInit(struct thread *threads, int numThreads)
+{
+    mutexInitType(PTHREAD_MUTEX_ADAPTIVE_NP);
+}
+
+static void
+mutexLock(struct thread *t, int isRead)
+{
+    int s;
+
+    s = pthread_mutex_lock(&mtxLock.mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+}
+
+static void
+mutexUnlock(struct thread *t, int isRead)
+{
+    int s;
+
+    s = pthread_mutex_unlock(&mtxLock.mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+}
+
+static void
+spinInit(struct thread *threads, int numThreads)
+{
+    int s;
+
+    s = pthread_spin_init(&spinLock.spin, PTHREAD_PROCESS_PRIVATE);
+    if (s != 0)
+        errExitEN(s, "pthread_spin_init");
+}
+
+static void
+spinLockFn(struct thread *t, int isRead)
+{
+    int s;
+
+    s = pthread_spin_lock(&spinLock.spin);
+    if (s != 0)
+        errExitEN(s, "pthread_spin_lock");
+}
+
+static void
+spinUnlockFn(struct thread *t, int isRead)
+{
+    int s;
+
+    s = pthread_spin_unlock(&spinLock.spin);
+    if (s != 0)
+        errExitEN(s, "pthread_spin_unlock");
+}
+
+static void
+rwInitKind(int kind)
+{
+    pthread_rwlockattr_t attr;
+    int s;
+
+    s = pthread_rwlockattr_init(&attr);
+    if (s != 0)
+        errExitEN(s, "pthread_rwlockattr_init");
+    s = pthread_rwlockattr_setkind_np(&attr, kind);
+    if (s != 0)
+        errExitEN(s, "pthread_rwlockattr_setkind_np");
+    s = pthread_rwlock_init(&rwLock.rw, &attr);
+    if (s != 0)
+        errExitEN(s, "pthread_rwlock_init");
+    pthread_rwlockattr_destroy(&attr);
+}
+
+static void
+rwInit(struct thread *threads, int numThreads)
+{
+    rwInitKind(PTHREAD_RWLOCK_PREFER_READER_NP);
+}
+
+static void
+rwWpInit(struct thread *threads, int numThreads)
+{
+    rwInitKind(PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+}
+
+static void
+rwLockFn(struct thread *t, int isRead)
+{
+    int s;
+
+    s = isRead ? pthread_rwlock_rdlock(&rwLock.rw) :
+                 pthread_rwlock_wrlock(&rwLock.rw);
+    if (s != 0)
+        errExitEN(s, "pthread_rwlock_%slock", isRead ? "rd" : "wr");
+}
+
+static void
+rwUnlockFn(struct thread *t, int isRead)
+{
+    int s;
+
+    s = pthread_rwlock_unlock(&rwLock.rw);
+    if (s != 0)
+        errExitEN(s, "pthread_rwlock_unlock");
+}
+
+/* Test-and-test-and-set: spin reading the flag (which keeps the cache
+   line shared) until it looks free, and only then try to take it */
+
+static void
+tasInit(struct thread *threads, int numThreads)
+{
+    tasLock.flag = 0;
+}
+
+static void
+tasLockFn(struct thread *t, int isRead)
+{
+    int spins = 0;
+
+    while (__atomic_exchange_n(&tasLock.flag, 1, __ATOMIC_ACQUIRE) != 0)
+        while (__atomic_load_n(&tasLock.flag, __ATOMIC_RELAXED) != 0)
+            spinPause(&spins);
+}
+
+static void
+tasUnlockFn(struct thread *t, int isRead)
+{
+    __atomic_store_n(&tasLock.flag, 0, __ATOMIC_RELEASE);
+}
+
+/* Ticket lock: take a number, and wait until it is served */
+
+static void
+ticketInit(struct thread *threads, int numThreads)
+{
+    ticketLock.next = ticketLock.serving = 0;
+}
+
+static void
+ticketLockFn(struct thread *t, int isRead)
+{
+    unsigned int me;
+    int spins = 0;
+
+    me = __atomic_fetch_add(&ticketLock.next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&ticketLock.serving, __ATOMIC_ACQUIRE) != me)
+        spinPause(&spins);
+}
+
+static void
+ticketUnlockFn(struct thread *t, int isRead)
+{
+    /* Only the holder writes 'serving', so a plain increment suffices */
+
+    __atomic_store_n(&ticketLock.serving,
+                     __atomic_load_n(&ticketLock.serving, __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELEASE);
+}
+
+/* MCS lock: the lock is a pointer to the tail of a queue of waiters;
+   each waiter spins on a flag in its own node, which its predecessor
+   clears when handing over the lock */
+
+static void
+mcsInit(struct thread *threads, int numThreads)
+{
+    queueLock.tail = NULL;
+}
+
+static void
+mcsLock(struct thread *t, int isRead)
+{
+    struct qnode *me = &t->mcsNode, *pred;
+    int spins = 0;
+
+    me->next = NULL;
+    me->locked = 1;
+    pred = __atomic_exchange_n(&queueLock.tail, me, __ATOMIC_ACQ_REL);
+    if (pred == NULL)
+        return; /* Queue was empty */
+
+    __atomic_store_n(&pred->next, me, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&me->locked, __ATOMIC_ACQUIRE))
+        spinPause(&spins);
+}
+
+static void
+mcsUnlock(struct thread *t, int isRead)
+{
+    struct qnode *me = &t->mcsNode, *succ, *expected;
+    int spins = 0;
+
+    succ = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE);
+    if (succ == NULL)
+    {
+        /* No known successor: if we are still the tail, the queue
+           becomes empty; otherwise, a successor is between its
+           exchange and setting our 'next', so wait for it */
+
+        expected = me;
+        if (__atomic_compare_exchange_n(&queueLock.tail, &expected, NULL, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+        while ((succ = __atomic_load_n(&me->next, __ATOMIC_ACQUIRE)) == NULL)
+            spinPause(&spins);
+    }
+
+    __atomic_store_n(&succ->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* CLH lock: as MCS, but each waiter spins on its predecessor's node.
+   On release, a thread adopts its predecessor's node for next time, so
+   there are numThreads + 1 nodes in circulation. */
+
+static void
+clhInit(struct thread *threads, int numThreads)
+{
+    struct qnode *nodes;
+
+    nodes = aligned_alloc(CACHE_LINE, (numThreads + 1) * sizeof(struct qnode));
+    if (nodes == NULL)
+        errExit("aligned_alloc");
+    memset(nodes, 0, (numThreads + 1) * sizeof(struct qnode));
+
+    queueLock.tail = &nodes[numThreads]; /* Dummy; unlocked */
+    for (int j = 0; j < numThreads; j++)
+        threads[j].clhNode = &nodes[j];
+
+    /* The nodes are leaked; they may have migrated between threads, so
+       we can't free them individually, and a run is short-lived */
+}
+
+static void
+clhLock(struct thread *t, int isRead)
+{
+    struct qnode *pred;
+    int spins = 0;
+
+    __atomic_store_n(&t->clhNode->locked, 1, __ATOMIC_RELAXED);
+    pred = __atomic_exchange_n(&queueLock.tail, t->clhNode, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&pred->locked, __ATOMIC_ACQUIRE))
+        spinPause(&spins);
+    t->clhPred = pred;
+}
+
+static void
+clhUnlock(struct thread *t, int isRead)
+{
+    __atomic_store_n(&t->clhNode->locked, 0, __ATOMIC_RELEASE);
+    t->clhNode = t->clhPred;
+}
+
+/* Futex mutex. The unlocker makes a futex() call only if the state
+   says that there may be waiters. */
+
+static void
+futexInit(struct thread *threads, int numThreads)
+{
+    futexLock.state = 0;
+}
+
+static void
+futexLockSpin(int maxSpins)
+{
+    int c, expected;
+
+    for (int j = 0; j <= maxSpins; j++)
+    {
+        expected = 0;
+        if (__atomic_compare_exchange_n(&futexLock.state, &expected, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        if (expected == 2)
+            break; /* Others are already sleeping; join them */
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    /* Mark the lock as contended, and sleep until we get it */
+
+    c = __atomic_exchange_n(&futexLock.state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0)
+    {
+        if (futex(&futexLock.state, FUTEX_WAIT_PRIVATE, 2) == -1 &&
+            errno != EAGAIN && errno != EINTR)
+            errExit("futex-FUTEX_WAIT");
+        c = __atomic_exchange_n(&futexLock.state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+static void
+futexLockFn(struct thread *t, int isRead)
+{
+    futexLockSpin(0);
+}
+
+static void
+adaptiveLockFn(struct thread *t, int isRead)
+{
+    futexLockSpin(ADAPTIVE_SPINS);
+}
+
+static void
+futexUnlockFn(struct thread *t, int isRead)
+{
+    if (__atomic_fetch_sub(&futexLock.state, 1, __ATOMIC_RELEASE) != 1)
+    {
+        __atomic_store_n(&futexLock.state, 0, __ATOMIC_RELEASE);
+        if (futex(&futexLock.state, FUTEX_WAKE_PRIVATE, 1) == -1)
+            errExit("futex-FUTEX_WAKE");
+    }
+}
+
+static void
+noInit(struct thread *threads, int numThreads)
+{
+}
+
+static void
+noLock(struct thread *t, int isRead)
+{
+}
+
+static const struct lockType lockTypes[] = {
+    {"mutex", mutexInit, mutexLock, mutexUnlock, 0, 0},
+    {"mutex-adapt", mutexAdaptInit, mutexLock, mutexUnlock, 0, 0},
+    {"spin", spinInit, spinLockFn, spinUnlockFn, 0, 0},
+    {"tas", tasInit, tasLockFn, tasUnlockFn, 0, 0},
+    {"ticket", ticketInit, ticketLockFn, ticketUnlockFn, 0, 0},
+    {"mcs", mcsInit, mcsLock, mcsUnlock, 0, 0},
+    {"clh", clhInit, clhLock, clhUnlock, 0, 0},
+    {"futex", futexInit, futexLockFn, futexUnlockFn, 0, 0},
+    {"adaptive", futexInit, adaptiveLockFn, futexUnlockFn, 0, 0},
+    {"rwlock", rwInit, rwLockFn, rwUnlockFn, 1, 0},
+    {"rwlock-wp", rwWpInit, rwLockFn, rwUnlockFn, 1, 0},
+    {"atomic", noInit, noLock, noLock, 0, 1},
+};
+
+#define NUM_LOCKS (sizeof(lockTypes) / sizeof(lockTypes[0]))
+
+static const struct lockType *lt; /* Lock in use in the current run */
+
+/* Perform 'n' units of work that the compiler can't optimize away */
+
+static void
+privateWork(int n)
+{
+    volatile int x = 0;
+
+    for (int j = 0; j < n; j++)
+        x++;
+}
+
+static void
+recordSample(struct thread *t, long ns)
+{
+    int b;
+
+    for (b = 0; b < HIST_BUCKETS - 1 && ns >= (1L << b); b++)
+        continue;
+    t->hist[b]++;
+
+    if (t->numSamples < maxSamples)
+        t->samples[t->numSamples++] = ns;
+}
+
+static void *
+threadFunc(void *arg)
+{
+    struct thread *t = arg;
+    long long start;
+    int s, isRead, timed;
+    long v;
+
+    s = pthread_barrier_wait(&startBarrier);
+    if (s != 0 && s != PTHREAD_BARRIER_SERIAL_THREAD)
+        errExitEN(s, "pthread_barrier_wait");
+
+    while (!__atomic_load_n(&shared.stop, __ATOMIC_RELAXED))
+    {
+        isRead = lt->rw && (int)(rand_r(&t->seed) % 100) < readPct;
+        timed = t->acquires % sampleEvery == 0;
+
+        start = timed ? latNowNs() : 0;
+
+        if (lt->noCritical)
+        {
+            __atomic_fetch_add(&shared.counter, csWork, __ATOMIC_SEQ_CST);
+            if (timed)
+                recordSample(t, latNowNs() - start);
+            t->writes++;
+        }
+        else
+        {
+            lt->lock(t, isRead);
+            if (timed)
+                recordSample(t, latNowNs() - start);
+
+            if (isRead)
+            {
+                v = 0;
+                for (int k = 0; k < csWork; k++)
+                    v = shared.counter;
+                (void)v;
+            }
+            else
+            {
+                for (int k = 0; k < csWork; k++)
+                    shared.counter++;
+                t->writes++;
+            }
+
+            lt->unlock(t, isRead);
+        }
+
+        t->acquires++;
+        privateWork(gapWork);
+    }
+
+    return NULL;
+}
+
+static void
+printHistogram(const long *hist)
+{
+    int last;
+
+    for (last = HIST_BUCKETS - 1; last > 0 && hist[last] == 0; last--)
+        continue;
+    for (int b = 0; b <= last; b++)
+        printf("%s%ld", (b == 0) ? "" : ";", hist[b]);
+}
+
+static void
+runOne(int numThreads, int secs, LatFormat fmt, int verbose)
+{
+    struct thread *threads;
+    long hist[HIST_BUCKETS];
+    struct latSummary sum;
+    double sumX, sumX2, jain, share, minShare, maxShare;
+    long total, writes, *all;
+    size_t numAll;
+    long long start, elapsed;
+    int s;
+
+    threads = aligned_alloc(CACHE_LINE, numThreads * sizeof(struct thread));
+    if (threads == NULL)
+        errExit("aligned_alloc");
+    memset(threads, 0, numThreads * sizeof(struct thread));
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        threads[j].seed = j + 1;
+        threads[j].samples = malloc(maxSamples * sizeof(long));
+        if (threads[j].samples == NULL)
+            errExit("malloc");
+    }
+
+    lt->init(threads, numThreads);
+    shared.counter = 0;
+    shared.stop = 0;
+
+    s = pthread_barrier_init(&startBarrier, NULL, numThreads + 1);
+    if (s != 0)
+        errExitEN(s, "pthread_barrier_init");
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        s = pthread_create(&threads[j].tid, NULL, threadFunc, &threads[j]);
+        if (s != 0)
+            errExitEN(s, "pthread_create");
+    }
+
+    s = pthread_barrier_wait(&startBarrier);
+    if (s != 0 && s != PTHREAD_BARRIER_SERIAL_THREAD)
+        errExitEN(s, "pthread_barrier_wait");
+    start = latNowNs();
+
+    sleep(secs);
+    __atomic_store_n(&shared.stop, 1, __ATOMIC_RELAXED);
+
+    for (int j = 0; j < numThreads; j++)
+    {
+        s = pthread_join(threads[j].tid, NULL);
+        if (s != 0)
+            errExitEN(s, "pthread_join");
+    }
+    elapsed = latNowNs() - start;
+    pthread_barrier_destroy(&startBarrier);
+
+    /* Check that the lock really did provide mutual exclusion */
+
+    writes = 0;
+    for (int j = 0; j < numThreads; j++)
+        writes += threads[j].writes;
+    if (shared.counter != writes * csWork)
+        fatal("%s: counter is %ld; expected %ld", lt->name, shared.counter,
+              writes * csWork);
+
+    /* Combine the per-thread results */
+
+    total = numAll = 0;
+    sumX = sumX2 = 0;
+    memset(hist, 0, sizeof(hist));
+    for (int j = 0; j < numThreads; j++)
+    {
+        total += threads[j].acquires;
+        numAll += threads[j].numSamples;
+        sumX += threads[j].acquires;
+        sumX2 += (double)threads[j].acquires * threads[j].acquires;
+        for (int b = 0; b < HIST_BUCKETS; b++)
+            hist[b] += threads[j].hist[b];
+    }
+
+    all = malloc((numAll + 1) * sizeof(long));
+    if (all == NULL)
+        errExit("malloc");
+    numAll = 0;
+    minShare = maxShare = -1;
+    for (int j = 0; j < numThreads; j++)
+    {
+        memcpy(all + numAll, threads[j].samples,
+               threads[j].numSamples * sizeof(long));
+        numAll += threads[j].numSamples;
+
+        share = total ? (double)threads[j].acquires * numThreads / total : 0;
+        if (minShare < 0 || share < minShare)
+            minShare = share;
+        if (share > maxShare)
+            maxShare = share;
+    }
+    latSummarize(all, numAll, &sum);
+    jain = (sumX2 > 0) ? sumX * sumX / (numThreads * sumX2) : 0;
+
+    switch (fmt)
+    {
+    case LAT_FMT_TEXT:
+        printf("%-11s %3d %5d %5d %12.0f %6.3f %6.2f %6.2f %8ld %8.1f %8ld "
+               "%8ld %8ld\n", lt->name, numThreads, csWork, gapWork,
+               total / (elapsed / 1e9), jain, minShare, maxShare, sum.p50,
+               sum.mean, sum.p99, sum.p999, sum.max);
+        if (verbose)
+        {
+            printf("    per-thread: ");
+            for (int j = 0; j < numThreads; j++)
+                printf("%s%ld", (j == 0) ? "" : " ", threads[j].acquires);
+            printf("\n    histogram (count per [2^(k-1), 2^k) ns): ");
+            printHistogram(hist);
+            printf("\n");
+        }
+        break;
+
+    case LAT_FMT_CSV:
+        printf("%s,%d,%d,%d,%d,%.0f,%.4f,%.3f,%.3f,%zu,%ld,%.1f,%ld,%ld,"
+               "%ld,%ld,%ld", lt->name, numThreads, csWork, gapWork,
+               lt->rw ? readPct : 0, total / (elapsed / 1e9), jain,
+               minShare, maxShare, sum.count, sum.min, sum.mean, sum.p50,
+               sum.p90, sum.p99, sum.p999, sum.max);
+        if (verbose)
+        {
+            printf(",");
+            for (int j = 0; j < numThreads; j++)
+                printf("%s%ld", (j == 0) ? "" : ";", threads[j].acquires);
+            printf(",");
+            printHistogram(hist);
+        }
+        printf("\n");
+        break;
+
+    case LAT_FMT_JSON:
+        printf("{\"lock\": \"%s\", \"threads\": %d, \"cs_work\": %d, "
+               "\"gap_work\": %d, \"read_pct\": %d, \"acquires\": %ld, "
+               "\"secs\": %.3f, \"acquires_per_s\": %.0f, \"jain\": %.4f, "
+               "\"min_share\": %.3f, \"max_share\": %.3f, "
+               "\"lat_count\": %zu, \"lat_min_ns\": %ld, "
+               "\"lat_mean_ns\": %.1f, \"lat_p50_ns\": %ld, "
+               "\"lat_p90_ns\": %ld, \"lat_p99_ns\": %ld, "
+               "\"lat_p99.9_ns\": %ld, \"lat_max_ns\": %ld",
+               lt->name, numThreads, csWork, gapWork,
+               lt->rw ? readPct : 0, total, elapsed / 1e9,
+               total / (elapsed / 1e9), jain, minShare, maxShare, sum.count,
+               sum.min, sum.mean, sum.p50, sum.p90, sum.p99, sum.p999,
+               sum.max);
+        printf(", \"per_thread\": [");
+        for (int j = 0; j < numThreads; j++)
+            printf("%s%ld", (j == 0) ? "" : ", ", threads[j].acquires);
+        printf("], \"lat_hist_log2\": [");
+        for (int b = 0; b < HIST_BUCKETS; b++)
+            printf("%s%ld", (b == 0) ? "" : ", ", hist[b]);
+        printf("]}\n");
+        break;
+    }
+    fflush(stdout);
+
+    for (int j = 0; j < numThreads; j++)
+        free(threads[j].samples);
+    free(threads);
+    free(all);
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -l list    Comma-separated locks (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_LOCKS; j++)
+        fprintf(stderr, " %s", lockTypes[j].name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -n list    Comma-separated thread counts "
+                    "(default: 1,2,4)\n");
+    fprintf(stderr, "    -c work    Work units inside the critical section "
+                    "(default: 1)\n");
+    fprintf(stderr, "    -g work    Work units between acquisitions "
+                    "(default: 0)\n");
+    fprintf(stderr, "    -r pct     Percentage of rwlock acquisitions that "
+                    "are reads (default: 80)\n");
+    fprintf(stderr, "    -t secs    Run time per test (default: 1)\n");
+    fprintf(stderr, "    -s n       Time every n'th acquisition "
+                    "(default: 16)\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    fprintf(stderr, "    -v         Also report per-thread counts and "
+                    "latency histogram\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *lockList, *threadList;
+    char *copy, *tok, *save;
+    int opt, secs, verbose;
+    LatFormat fmt;
+
+    lockList = NULL;
+    threadList = "1,2,4";
+    csWork = 1;
+    gapWork = 0;
+    readPct = 80;
+    secs = 1;
+    sampleEvery = 16;
+    fmt = LAT_FMT_TEXT;
+    verbose = 0;
+
+    while ((opt = getopt(argc, argv, "l:n:c:g:r:t:s:o:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            lockList = optarg;
+            break;
+        case 'n':
+            threadList = optarg;
+            break;
+        case 'c':
+            csWork = getInt(optarg, GN_NONNEG, "cs-work");
+            break;
+        case 'g':
+            gapWork = getInt(optarg, GN_NONNEG, "gap-work");
+            break;
+        case 'r':
+            readPct = getInt(optarg, GN_NONNEG, "read-pct");
+            if (readPct > 100)
+                usageError(argv[0]);
+            break;
+        case 't':
+            secs = getInt(optarg, GN_GT_0, "secs");
+            break;
+        case 's':
+            sampleEvery = getInt(optarg, GN_GT_0, "sample");
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    maxSamples = 1000000; /* Per thread */
+
+    if (fmt == LAT_FMT_TEXT)
+        printf("%-11s %3s %5s %5s %12s %6s %6s %6s %8s %8s %8s %8s %8s\n",
+               "lock", "thr", "cs", "gap", "acq/s", "jain", "min", "max",
+               "p50-ns", "mean-ns", "p99-ns", "p99.9-ns", "max-ns");
+    else if (fmt == LAT_FMT_CSV)
+        printf("lock,threads,cs_work,gap_work,read_pct,acquires_per_s,jain,"
+               "min_share,max_share,lat_count,lat_min_ns,lat_mean_ns,"
+               "lat_p50_ns,lat_p90_ns,lat_p99_ns,lat_p99.9_ns,lat_max_ns%s\n",
+               verbose ? ",per_thread,lat_hist_log2" : "");
+
+    for (size_t j = 0; j < NUM_LOCKS; j++)
+    {
+        if (lockList != NULL && !latInList(lockList, lockTypes[j].name))
+            continue;
+        lt = &lockTypes[j];
+
+        copy = strdup(threadList);
+        if (copy == NULL)
+            errExit("strdup");
+        for (tok = strtok_r(copy, ",", &save); tok != NULL;
+             tok = strtok_r(NULL, ",", &save))
+            runOne(getInt(tok, GN_GT_0, "num-threads"), secs, fmt, verbose);
+        free(copy);
+    }
+
+    exit(EXIT_SUCCESS);
+}
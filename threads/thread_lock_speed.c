@@ -19,6 +19,9 @@
    program. In some scenarios (e.g., many threads, large "inner loop"
    values), mutexes will perform better, while in others (few threads,
    small "inner loop" value), spin locks are likely to be better.
+
+   See thread_lock_bench.c for a more thorough comparison of many kinds
+   of lock.
 */
 #include <pthread.h>
 #include "tlpi_hdr.h"
@@ -0,0 +1,176 @@
+/* thread_pool_demo.c
+
+   Usage: thread_pool_demo [-p] [-w num-workers] [fib-n [array-size]]
+
+   Demonstrate the work-stealing thread pool in lib/thread_pool.c with
+   two kinds of parallelism:
+
+   * fork-join: compute the 'fib-n'th Fibonacci number by naive
+     recursion, where each call spawns one of its two recursive calls as
+     a task (below a cutoff, the recursion is done serially);
+
+   * a parallel loop: sum the squares of the elements of an array of
+     'array-size' longs with tpParallelFor().
+
+   After each computation, the program prints the time taken, and for
+   each worker the number of tasks it ran, how many of them it stole,
+   its failed steal attempts, and its busy and idle times. With -p,
+   workers are pinned to CPUs.
+*/
+#include <time.h>
+#include "thread_pool.h"
+#include "tlpi_hdr.h"
+
+#define FIB_CUTOFF 20 /* Below this, don't spawn tasks */
+
+static ThreadPool *tp;
+
+struct fibArgs
+{
+    int n;
+    long result;
+};
+
+static long
+fibSerial(int n)
+{
+    return (n < 2) ? n : fibSerial(n - 1) + fibSerial(n - 2);
+}
+
+static void
+fibTask(void *arg)
+{
+    struct fibArgs *fa = arg;
+    struct fibArgs left, right;
+    TpGroup g;
+
+    if (fa->n < FIB_CUTOFF)
+    {
+        fa->result = fibSerial(fa->n);
+        return;
+    }
+
+    /* Spawn one half, do the other half ourselves, and then join */
+
+    left.n = fa->n - 1;
+    right.n = fa->n - 2;
+    tpGroupInit(&g);
+    if (tpSpawn(tp, &g, fibTask, &left) == -1)
+        errExit("tpSpawn");
+    fibTask(&right);
+    tpWait(tp, &g);
+
+    fa->result = left.result + right.result;
+}
+
+static long *array;
+static long sum;
+
+static void
+sumSquares(long lo, long hi, void *arg)
+{
+    long s = 0;
+
+    for (long j = lo; j < hi; j++)
+        s += array[j] * array[j];
+    __atomic_fetch_add(&sum, s, __ATOMIC_RELAXED);
+}
+
+static double
+elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Print each worker's statistics accumulated since 'prev', and save the
+   current values in 'prev' */
+
+static void
+printStats(struct tpStats *prev)
+{
+    struct tpStats st;
+
+    printf("    %6s %10s %8s %12s %10s %10s\n", "worker", "tasks", "steals",
+           "failed", "busy-ms", "idle-ms");
+    for (int j = 0; j < tpNumWorkers(tp); j++)
+    {
+        tpGetStats(tp, j, &st);
+        printf("    %6d %10ld %8ld %12ld %10.1f %10.1f\n", j,
+               st.tasks - prev[j].tasks, st.steals - prev[j].steals,
+               st.failedSteals - prev[j].failedSteals,
+               (st.busyNs - prev[j].busyNs) / 1e6,
+               (st.idleNs - prev[j].idleNs) / 1e6);
+        prev[j] = st;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct fibArgs fa;
+    struct timespec start;
+    struct tpStats *prev;
+    int opt, numWorkers, flags;
+    long size, expected;
+
+    numWorkers = 0;
+    flags = 0;
+    while ((opt = getopt(argc, argv, "pw:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            flags |= TP_PIN;
+            break;
+        case 'w':
+            numWorkers = getInt(optarg, GN_GT_0, "num-workers");
+            break;
+        default:
+            usageErr("%s [-p] [-w num-workers] [fib-n [array-size]]\n",
+                     argv[0]);
+        }
+    }
+
+    fa.n = (optind < argc) ? getInt(argv[optind], GN_NONNEG, "fib-n") : 32;
+    size = (optind + 1 < argc) ?
+           getLong(argv[optind + 1], GN_GT_0, "array-size") : 10000000;
+
+    tp = tpCreate(numWorkers, flags);
+    if (tp == NULL)
+        errExit("tpCreate");
+    prev = calloc(tpNumWorkers(tp), sizeof(struct tpStats));
+    if (prev == NULL)
+        errExit("calloc");
+
+    /* Fork-join */
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fibTask(&fa);
+    printf("fib(%d) = %ld (%.3f s with %d workers)\n", fa.n, fa.result,
+           elapsed(&start), tpNumWorkers(tp));
+    printStats(prev);
+
+    /* Parallel loop */
+
+    array = malloc(size * sizeof(long));
+    if (array == NULL)
+        errExit("malloc");
+    expected = 0;
+    for (long j = 0; j < size; j++)
+    {
+        array[j] = j % 1000;
+        expected += array[j] * array[j];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (tpParallelFor(tp, 0, size, 10000, sumSquares, NULL) == -1)
+        errExit("tpParallelFor");
+    printf("sum of squares = %ld (%s; %.3f s)\n", sum,
+           (sum == expected) ? "correct" : "WRONG", elapsed(&start));
+    printStats(prev);
+
+    tpDestroy(tp);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,60 @@
+/* deadline_read.c
+
+   Place a timeout on a read(2), as timed_read.c does, but using
+   readDeadline() from lib/io_deadline.c, which waits with ppoll()
+   rather than interrupting the read() with a SIGALRM. No signal
+   handler is needed, and the timeout affects only this read, not the
+   whole process.
+
+   Usage: deadline_read [num-secs [num-reads]]
+
+   The program performs 'num-reads' (default 1) reads from standard
+   input, all of which must complete within 'num-secs' seconds (default
+   10) of the program starting: the deadline is absolute, so the same one
+   applies to every read. As with timed_read.c, 'num-secs' of 0 means no
+   timeout.
+*/
+#include "io_deadline.h"
+#include "tlpi_hdr.h"
+
+#define BUF_SIZE 200
+
+int main(int argc, char *argv[])
+{
+    char buf[BUF_SIZE];
+    ssize_t numRead;
+    long long deadline;
+    int numReads, numSecs;
+
+    if (argc > 1 && strcmp(argv[1], "--help") == 0)
+        usageErr("%s [num-secs [num-reads]]\n", argv[0]);
+
+    numSecs = (argc > 1) ? getInt(argv[1], GN_NONNEG, "num-secs") : 10;
+    deadline = (numSecs == 0) ? IO_NO_DEADLINE :
+                                ioDeadline(numSecs * 1000000000LL);
+    numReads = (argc > 2) ? getInt(argv[2], GN_GT_0, "num-reads") : 1;
+
+    for (int j = 0; j < numReads; j++)
+    {
+        numRead = readDeadline(STDIN_FILENO, buf, BUF_SIZE, deadline);
+        if (numRead == -1)
+        {
+            if (errno == ETIMEDOUT)
+                printf("Read timed out\n");
+            else
+                errMsg("read");
+            break;
+        }
+
+        if (numRead == 0)
+        {
+            printf("End of file\n");
+            break;
+        }
+
+        printf("Successful read (%ld bytes): %.*s",
+               (long)numRead, (int)numRead, buf);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -18,6 +18,9 @@
    Kernel support for Linux timers is provided since Linux 2.6. On older
    systems, an incomplete user-space implementation of POSIX timers
    was provided in glibc.
+
+   See wheel_bench.c for a comparison of this approach, for many timers,
+   with a timing wheel that shares a single timerfd.
 */
 #include <signal.h>
 #include <time.h>
@@ -2,6 +2,9 @@
 
    Demonstrate the use of a timer to place a timeout on a blocking system call
    (read(2) in this case).
+
+   See deadline_read.c for a version that uses ppoll() with a deadline
+   instead of a signal.
 */
 #include <signal.h>
 #include "tlpi_hdr.h"
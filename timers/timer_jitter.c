@@ -0,0 +1,520 @@
+/* timer_jitter.c
+
+   Measure how accurately each of the kernel's timer and sleep
+   mechanisms wakes a program that asks for periodic wakeups.
+
+   Usage as shown in usageError().
+
+   For each mechanism, the program asks to be woken 'num' times, every
+   'period' microseconds, at the absolute CLOCK_MONOTONIC times
+   start + period, start + 2 * period, and so on. It records the
+   lateness of each wakeup (the time from the deadline to the moment the
+   program runs), and counts overruns: the periods that were missed
+   altogether, because a wakeup was so late that the next deadline had
+   also passed. The mechanisms are:
+
+        timerfd     A periodic timerfd, read() in a loop; overruns are
+                    given by the expiration count it returns
+        posix-sig   A periodic POSIX timer with SIGEV_SIGNAL, accepted
+                    with sigwaitinfo(); overruns from si_overrun
+        posix-thr   A periodic POSIX timer with SIGEV_THREAD (see below)
+        abs-sleep   clock_nanosleep() with TIMER_ABSTIME
+        nanosleep   nanosleep() for the time remaining to the deadline
+        epoll       epoll_wait() with no file descriptors, with a timeout
+                    of the time remaining (epoll_pwait2(), where
+                    available, takes nanoseconds; epoll_wait() takes
+                    milliseconds, rounded up)
+
+   For the last three, the program itself skips deadlines that have
+   passed, and counts them as overruns.
+
+   For posix-thr, glibc creates a new thread for each expiry, and these
+   threads may run in any order, so there is no telling directly which
+   expiry a thread is for. Each thread notes the time it started and the
+   overrun count given by timer_getoverrun(); at the end of the run, the
+   wakeups are sorted by time and charged to the deadlines in order, with
+   the overruns skipping deadlines just as they do for posix-sig. (The
+   earliest wakeup can't precede the first expiry, the second earliest
+   can't precede the second, and so on, so sorting doesn't make any
+   wakeup early.)
+
+   The options -f (run under SCHED_FIFO), -s (set the timer slack, which
+   the kernel adds to the sleeps of non-realtime threads, so that it can
+   coalesce wakeups), and -c (pin to a CPU) show how to make periodic
+   tasks more punctual. With -H, each mechanism's results are followed by
+   a histogram of lateness, in power-of-2 buckets of microseconds.
+
+   See also demo_timerfd.c, ptmr_sigev_signal.c, t_nanosleep.c, and
+   t_clock_nanosleep.c, which demonstrate these mechanisms one at a time.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define LABELS "mechanism,period_us,overruns"
+
+#define NUM_BUCKETS 25  /* Up to 2^23 us (about 8 s), and above */
+
+enum mech
+{
+    MECH_TIMERFD,
+    MECH_POSIX_SIG,
+    MECH_POSIX_THR,
+    MECH_ABS_SLEEP,
+    MECH_NANOSLEEP,
+    MECH_EPOLL
+};
+
+static const char *mechNames[] = {"timerfd", "posix-sig", "posix-thr",
+                                  "abs-sleep", "nanosleep", "epoll"};
+
+#define NUM_MECHS (sizeof(mechNames) / sizeof(mechNames[0]))
+
+static long long periodNs, startNs;
+static int numWakeups;
+static long *samples;
+
+/* State of a run: protected by 'mtx' in MECH_POSIX_THR, whose
+   notification threads may overlap */
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int numDone;             /* Wakeups recorded */
+static long long nextIdx;       /* Index of next deadline */
+static long overruns;
+static int thrActive;           /* MECH_POSIX_THR run in progress? */
+static struct thrWakeup
+{                               /* A MECH_POSIX_THR wakeup, recorded
+                                   by threadFunc() */
+    long long now;
+    long missed;
+} *thrWakeups;
+static timer_t posixTid;
+
+static int havePwait2 = 1;      /* Cleared if epoll_pwait2() fails */
+
+static long long
+deadline(long long idx)
+{
+    return startNs + (idx + 1) * periodNs;
+}
+
+static void
+toTimespec(long long ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+/* Record a wakeup for the deadline with index 'nextIdx + missed' */
+
+static void
+recordWakeup(long long now, long missed)
+{
+    nextIdx += missed;
+    overruns += missed;
+    samples[numDone++] = now - deadline(nextIdx);
+    nextIdx++;
+}
+
+/* Sleep until the next deadline with 'mech' (one of the sleeping
+   mechanisms), and record the wakeup. Deadlines that had passed by the
+   time we woke are skipped. */
+
+static void
+sleepOnce(enum mech mech, int epfd)
+{
+    struct epoll_event ev;
+    struct timespec ts;
+    long long d, now;
+    int s;
+
+    d = deadline(nextIdx);
+    for (;;)
+    {
+        now = latNowNs();
+        if (now >= d)
+            break;
+
+        switch (mech)
+        {
+        case MECH_ABS_SLEEP:
+            toTimespec(d, &ts);
+            s = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            if (s != 0 && s != EINTR)
+                errExitEN(s, "clock_nanosleep");
+            break;
+
+        case MECH_NANOSLEEP:
+            toTimespec(d - now, &ts);
+            if (nanosleep(&ts, NULL) == -1 && errno != EINTR)
+                errExit("nanosleep");
+            break;
+
+        default:        /* MECH_EPOLL */
+#ifdef SYS_epoll_pwait2
+            if (havePwait2)
+            {
+                toTimespec(d - now, &ts);
+                s = syscall(SYS_epoll_pwait2, epfd, &ev, 1, &ts, NULL, 0);
+                if (s == -1 && errno == ENOSYS)     /* Before Linux 5.11 */
+                {
+                    havePwait2 = 0;
+                    continue;
+                }
+            }
+            else
+#endif
+            {
+                s = epoll_wait(epfd, &ev, 1,
+                               (int)((d - now + 999999) / 1000000));
+            }
+            if (s == -1 && errno != EINTR)
+                errExit("epoll_wait");
+            break;
+        }
+    }
+
+    now = latNowNs();
+    recordWakeup(now, (now - startNs) / periodNs - 1 - nextIdx);
+}
+
+static void
+threadFunc(union sigval sv)
+{
+    long long now;
+    int missed, s;
+
+    /* Take the time before competing with other notification threads
+       for the mutex */
+
+    now = latNowNs();
+    missed = timer_getoverrun(posixTid);
+    if (missed == -1)
+        missed = 0;     /* The run has finished and the timer is gone */
+
+    /* A notification may still be running after its run has finished
+       and the timer has been deleted; it is then ignored */
+
+    s = pthread_mutex_lock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+    if (thrActive && numDone < numWakeups)
+    {
+        thrWakeups[numDone].now = now;
+        thrWakeups[numDone].missed = missed;
+        if (++numDone == numWakeups)
+        {
+            s = pthread_cond_signal(&cond);
+            if (s != 0)
+                errExitEN(s, "pthread_cond_signal");
+        }
+    }
+    s = pthread_mutex_unlock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+}
+
+static int
+cmpThrWakeup(const void *a, const void *b)
+{
+    long long x = ((const struct thrWakeup *)a)->now;
+    long long y = ((const struct thrWakeup *)b)->now;
+
+    return (x > y) - (x < y);
+}
+
+/* Create and start a periodic POSIX timer that notifies with 'notify' */
+
+static void
+startPosixTimer(int notify)
+{
+    struct sigevent sev;
+    struct itimerspec its;
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = notify;
+    sev.sigev_signo = SIGRTMIN;
+    sev.sigev_notify_function = threadFunc;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &posixTid) == -1)
+        errExit("timer_create");
+
+    toTimespec(deadline(0), &its.it_value);
+    toTimespec(periodNs, &its.it_interval);
+    if (timer_settime(posixTid, TIMER_ABSTIME, &its, NULL) == -1)
+        errExit("timer_settime");
+}
+
+static void
+runMech(enum mech mech)
+{
+    struct itimerspec its;
+    uint64_t numExp;
+    sigset_t mask;
+    siginfo_t si;
+    int tfd, epfd, s;
+
+    numDone = 0;
+    nextIdx = 0;
+    overruns = 0;
+    startNs = latNowNs();
+
+    switch (mech)
+    {
+    case MECH_TIMERFD:
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (tfd == -1)
+            errExit("timerfd_create");
+        toTimespec(deadline(0), &its.it_value);
+        toTimespec(periodNs, &its.it_interval);
+        if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+            errExit("timerfd_settime");
+
+        while (numDone < numWakeups)
+        {
+            if (read(tfd, &numExp, sizeof(numExp)) != sizeof(numExp))
+                errExit("read");
+            recordWakeup(latNowNs(), numExp - 1);
+        }
+        close(tfd);
+        break;
+
+    case MECH_POSIX_SIG:
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGRTMIN);
+        if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+            errExit("sigprocmask");
+        startPosixTimer(SIGEV_SIGNAL);
+
+        while (numDone < numWakeups)
+        {
+            if (sigwaitinfo(&mask, &si) == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                errExit("sigwaitinfo");
+            }
+            recordWakeup(latNowNs(), si.si_overrun);
+        }
+        if (timer_delete(posixTid) == -1)
+            errExit("timer_delete");
+        break;
+
+    case MECH_POSIX_THR:
+        s = pthread_mutex_lock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        thrActive = 1;
+        startPosixTimer(SIGEV_THREAD);
+        while (numDone < numWakeups)
+        {
+            s = pthread_cond_wait(&cond, &mtx);
+            if (s != 0)
+                errExitEN(s, "pthread_cond_wait");
+        }
+        if (timer_delete(posixTid) == -1)
+            errExit("timer_delete");
+        thrActive = 0;
+        s = pthread_mutex_unlock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+
+        qsort(thrWakeups, numWakeups, sizeof(struct thrWakeup),
+              cmpThrWakeup);
+        numDone = 0;
+        while (numDone < numWakeups)
+            recordWakeup(thrWakeups[numDone].now,
+                         thrWakeups[numDone].missed);
+        break;
+
+    default:
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd == -1)
+            errExit("epoll_create1");
+        while (numDone < numWakeups)
+            sleepOnce(mech, epfd);
+        close(epfd);
+        break;
+    }
+}
+
+/* Print a histogram of the lateness of the wakeups */
+
+static void
+printHistogram(void)
+{
+    long count[NUM_BUCKETS], max, early;
+    long us;
+    int b, width;
+
+    memset(count, 0, sizeof(count));
+    early = 0;
+    for (int j = 0; j < numWakeups; j++)
+    {
+        if (samples[j] < 0)     /* Woken before the deadline */
+        {
+            early++;
+            continue;
+        }
+        us = samples[j] / 1000;
+        for (b = 0; b < NUM_BUCKETS - 1 && us >= (1L << b); b++)
+            continue;
+        count[b]++;
+    }
+
+    max = (early > 1) ? early : 1;
+    for (b = 0; b < NUM_BUCKETS; b++)
+        if (count[b] > max)
+            max = count[b];
+
+    if (early > 0)
+    {
+        printf("    <  %8d us %8ld  ", 0, early);
+        width = (int)(early * 50 / max);
+        for (int j = 0; j < (width > 0 ? width : 1); j++)
+            putchar('#');
+        putchar('\n');
+    }
+
+    for (b = 0; b < NUM_BUCKETS; b++)
+    {
+        if (count[b] == 0)
+            continue;
+        if (b == NUM_BUCKETS - 1)
+            printf("    >= %8ld us %8ld  ", 1L << (b - 1), count[b]);
+        else
+            printf("    <  %8ld us %8ld  ", 1L << b, count[b]);
+        width = (int)(count[b] * 50 / max);
+        for (int j = 0; j < (width > 0 ? width : 1); j++)
+            putchar('#');
+        putchar('\n');
+    }
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -p usecs   Period (default: 1000)\n");
+    fprintf(stderr, "    -n num     Wakeups per mechanism (default: 1000)\n");
+    fprintf(stderr, "    -m list    Comma-separated mechanisms (default: "
+                    "all):\n               ");
+    for (size_t j = 0; j < NUM_MECHS; j++)
+        fprintf(stderr, " %s", mechNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -f prio    Run under SCHED_FIFO at priority "
+                    "'prio'\n");
+    fprintf(stderr, "    -s nsecs   Set timer slack (PR_SET_TIMERSLACK)\n");
+    fprintf(stderr, "    -c cpu     Pin to CPU 'cpu'\n");
+    fprintf(stderr, "    -H         Print a histogram of lateness (text "
+                    "format only)\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sched_param sp;
+    struct latSummary sum;
+    const char *mechList;
+    char values[128];
+    int opt, fifoPrio, cpu, histogram;
+    long slack;
+    enum mech mech;
+    LatFormat fmt;
+
+    periodNs = 1000000;
+    numWakeups = 1000;
+    mechList = NULL;
+    fifoPrio = 0;
+    slack = -1;
+    cpu = -1;
+    histogram = 0;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "p:n:m:f:s:c:Ho:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            periodNs = getInt(optarg, GN_GT_0, "period") * 1000LL;
+            break;
+        case 'n':
+            numWakeups = getInt(optarg, GN_GT_0, "num");
+            break;
+        case 'm':
+            mechList = optarg;
+            break;
+        case 'f':
+            fifoPrio = getInt(optarg, GN_GT_0, "prio");
+            break;
+        case 's':
+            slack = getLong(optarg, 0, "slack");
+            break;
+        case 'c':
+            cpu = getInt(optarg, 0, "cpu");
+            break;
+        case 'H':
+            histogram = 1;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    /* These settings are inherited by the notification threads of
+       posix-thr (except the timer slack, which those threads don't use) */
+
+    if (cpu != -1 && latPinCpu(cpu) == -1)
+        errExit("latPinCpu");
+    if (fifoPrio > 0)
+    {
+        sp.sched_priority = fifoPrio;
+        if (sched_setscheduler(0, SCHED_FIFO, &sp) == -1)
+            errExit("sched_setscheduler");
+    }
+    if (slack != -1 && prctl(PR_SET_TIMERSLACK, slack, 0, 0, 0) == -1)
+        errExit("prctl-PR_SET_TIMERSLACK");
+
+    samples = calloc(numWakeups, sizeof(long));
+    thrWakeups = calloc(numWakeups, sizeof(struct thrWakeup));
+    if (samples == NULL || thrWakeups == NULL)
+        errExit("calloc");
+
+    latPrintHeader(fmt, LABELS);
+
+    for (mech = 0; mech < NUM_MECHS; mech++)
+    {
+        if (mechList != NULL && !latInList(mechList, mechNames[mech]))
+            continue;
+
+        runMech(mech);
+
+        latSummarize(samples, numWakeups, &sum);
+        snprintf(values, sizeof(values), "%s,%lld,%ld", mechNames[mech],
+                 periodNs / 1000, overruns);
+        latPrintRow(fmt, LABELS, values, &sum);
+        if (histogram && fmt == LAT_FMT_TEXT)
+            printHistogram();
+    }
+
+    exit(EXIT_SUCCESS);
+}
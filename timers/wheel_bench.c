@@ -0,0 +1,450 @@
+/* wheel_bench.c
+
+   Compare the timing wheel in lib/timer_wheel.c, which multiplexes any
+   number of timers onto one timerfd, with one kernel POSIX timer per
+   timeout.
+
+   Usage as shown in usageError().
+
+   The program starts 'num-timers' one-shot timers with timeouts spread
+   evenly at random between 'min' and 'max' milliseconds, then cancels a
+   given percentage of them (as a server cancels the idle timeout of a
+   connection that has done some work), and waits for the rest to
+   expire. The modes are:
+
+        wheel       A timing wheel, whose timerfd is monitored with epoll
+        posix-sig   timer_create() with SIGEV_SIGNAL; the signals are
+                    read from a signalfd, many at a time
+        posix-thr   timer_create() with SIGEV_THREAD, as in
+                    ptmr_sigev_thread.c
+
+   For each mode, the program reports the average cost of starting and of
+   cancelling a timer, the number of wakeups (epoll_wait() returns,
+   read()s of the signalfd, or notification threads) needed for the
+   expiries, and the distribution of lateness: the time from each
+   timer's deadline to its callback.
+
+   Each POSIX timer preallocates a queued signal (glibc implements
+   SIGEV_THREAD with a signal, too), so the number of timers is limited
+   by RLIMIT_SIGPENDING. The program raises its soft limit to the hard
+   limit, and skips the POSIX modes if 'num-timers' is still too many.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include "timer_wheel.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define LABELS "mode,timers,cancel_pct,arm_ns,cancel_ns,wakeups"
+
+enum mode
+{
+    MODE_WHEEL,
+    MODE_POSIX_SIG,
+    MODE_POSIX_THR
+};
+
+static const char *modeNames[] = {"wheel", "posix-sig", "posix-thr"};
+
+#define NUM_MODES (sizeof(modeNames) / sizeof(modeNames[0]))
+
+struct rec
+{
+    TwTimer tw;                 /* MODE_WHEEL */
+    timer_t tid;                /* The POSIX modes */
+    long long deadline;         /* CLOCK_MONOTONIC, in nanoseconds */
+    long long delay;
+    int cancel;                 /* Cancel this timer? */
+};
+
+static struct rec *recs;
+static long *samples;
+static int numTimers, cancelPct;
+static long long tickNs;
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static long numFired;           /* Slots of 'samples' claimed */
+static long numRecorded;        /* MODE_POSIX_THR: slots filled in */
+static long numToCancel;
+
+/* Record the lateness of an expiry that happened at 'now'. A timer that
+   is to be cancelled can expire first only if its timeout is shorter
+   than the time taken to start all of the timers; such an expiry is
+   ignored. Returns 1 if the expiry was recorded, or 0 if not. The
+   notification threads of MODE_POSIX_THR call this concurrently, so
+   each claims its slot in 'samples' atomically. */
+
+static int
+recordExpiry(struct rec *r, long long now)
+{
+    long idx;
+
+    if (r->cancel)
+        return 0;
+    idx = __atomic_fetch_add(&numFired, 1, __ATOMIC_RELAXED);
+    samples[idx] = now - r->deadline;
+    return 1;
+}
+
+/* Choose the timeouts, and which timers are cancelled. The sequence of
+   pseudorandom numbers is the same for every mode. */
+
+static void
+initRecs(long long minNs, long long maxNs)
+{
+    unsigned long long x = 88172645463325252ULL;  /* xorshift64 */
+
+    numToCancel = 0;
+    for (int j = 0; j < numTimers; j++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        recs[j].delay = minNs + (long long)(x % (maxNs - minNs + 1));
+        recs[j].cancel = (int)((x >> 32) % 100) < cancelPct;
+        numToCancel += recs[j].cancel;
+    }
+}
+
+static void
+wheelExpired(TimerWheel *tw, TwTimer *t, void *arg)
+{
+    recordExpiry(arg, latNowNs());
+}
+
+static long
+runWheel(long long *armNs, long long *cancelNs)
+{
+    struct epoll_event ev;
+    TimerWheel *tw;
+    long long start;
+    long wakeups;
+    int epfd;
+
+    tw = twCreate(tickNs);
+    if (tw == NULL)
+        errExit("twCreate");
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1)
+        errExit("epoll_create1");
+    ev.events = EPOLLIN;
+    ev.data.fd = twFd(tw);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, twFd(tw), &ev) == -1)
+        errExit("epoll_ctl");
+
+    start = latNowNs();
+    for (int j = 0; j < numTimers; j++)
+    {
+        recs[j].deadline = latNowNs() + recs[j].delay;
+        twInitTimer(&recs[j].tw, wheelExpired, &recs[j]);
+        if (twAdd(tw, &recs[j].tw, recs[j].delay) == -1)
+            errExit("twAdd");
+    }
+    *armNs = latNowNs() - start;
+
+    start = latNowNs();
+    for (int j = 0; j < numTimers; j++)
+        if (recs[j].cancel)
+            twCancel(tw, &recs[j].tw);
+    *cancelNs = latNowNs() - start;
+
+    for (wakeups = 0; numFired < numTimers - numToCancel; wakeups++)
+    {
+        if (epoll_wait(epfd, &ev, 1, -1) == -1)
+            errExit("epoll_wait");
+        if (twProcess(tw) == -1)
+            errExit("twProcess");
+    }
+
+    close(epfd);
+    twFree(tw);
+    return wakeups;
+}
+
+static long
+runPosixSig(long long *armNs, long long *cancelNs)
+{
+    struct signalfd_siginfo fdsi[64];
+    struct sigevent sev;
+    struct itimerspec its;
+    struct rec *r;
+    long long start;
+    long wakeups;
+    sigset_t mask;
+    ssize_t numRead;
+    int sfd;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGRTMIN);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+        errExit("sigprocmask");
+    sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+    if (sfd == -1)
+        errExit("signalfd");
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = SIGRTMIN;
+    memset(&its, 0, sizeof(its));
+
+    start = latNowNs();
+    for (int j = 0; j < numTimers; j++)
+    {
+        recs[j].deadline = latNowNs() + recs[j].delay;
+        sev.sigev_value.sival_ptr = &recs[j];
+        if (timer_create(CLOCK_MONOTONIC, &sev, &recs[j].tid) == -1)
+            errExit("timer_create (timer %d)", j);
+        its.it_value.tv_sec = recs[j].delay / 1000000000;
+        its.it_value.tv_nsec = recs[j].delay % 1000000000;
+        if (timer_settime(recs[j].tid, 0, &its, NULL) == -1)
+            errExit("timer_settime");
+    }
+    *armNs = latNowNs() - start;
+
+    start = latNowNs();
+    for (int j = 0; j < numTimers; j++)
+        if (recs[j].cancel && timer_delete(recs[j].tid) == -1)
+            errExit("timer_delete");
+    *cancelNs = latNowNs() - start;
+
+    for (wakeups = 0; numFired < numTimers - numToCancel; wakeups++)
+    {
+        numRead = read(sfd, fdsi, sizeof(fdsi));
+        if (numRead == -1)
+            errExit("read");
+        for (size_t j = 0; j < numRead / sizeof(fdsi[0]); j++)
+        {
+            r = (struct rec *)(uintptr_t)fdsi[j].ssi_ptr;
+            recordExpiry(r, latNowNs());
+            if (!r->cancel && timer_delete(r->tid) == -1)
+                errExit("timer_delete");
+        }
+    }
+
+    close(sfd);
+    return wakeups;
+}
+
+/* Take the time first, so that waiting for the mutex (which happens
+   only for the last expiry) is not counted as lateness */
+
+static void
+threadFunc(union sigval sv)
+{
+    long long now;
+    int s;
+
+    now = latNowNs();
+    if (!recordExpiry(sv.sival_ptr, now))
+        return;
+
+    if (__atomic_add_fetch(&numRecorded, 1, __ATOMIC_RELEASE) ==
+            numTimers - numToCancel)
+    {
+        s = pthread_mutex_lock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_lock");
+        s = pthread_cond_signal(&cond);
+        if (s != 0)
+            errExitEN(s, "pthread_cond_signal");
+        s = pthread_mutex_unlock(&mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_mutex_unlock");
+    }
+}
+
+static long
+runPosixThr(long long *armNs, long long *cancelNs)
+{
+    struct sigevent sev;
+    struct itimerspec its;
+    long long start;
+    int s;
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD;
+    sev.sigev_notify_function = threadFunc;
+    memset(&its, 0, sizeof(its));
+    numRecorded = 0;
+
+    start = latNowNs();
+    for (int j = 0; j < numTimers; j++)
+    {
+        recs[j].deadline = latNowNs() + recs[j].delay;
+        sev.sigev_value.sival_ptr = &recs[j];
+        if (timer_create(CLOCK_MONOTONIC, &sev, &recs[j].tid) == -1)
+            errExit("timer_create (timer %d)", j);
+        its.it_value.tv_sec = recs[j].delay / 1000000000;
+        its.it_value.tv_nsec = recs[j].delay % 1000000000;
+        if (timer_settime(recs[j].tid, 0, &its, NULL) == -1)
+            errExit("timer_settime");
+    }
+    *armNs = latNowNs() - start;
+
+    start = latNowNs();
+    for (int j = 0; j < numTimers; j++)
+        if (recs[j].cancel && timer_delete(recs[j].tid) == -1)
+            errExit("timer_delete");
+    *cancelNs = latNowNs() - start;
+
+    s = pthread_mutex_lock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_lock");
+    while (__atomic_load_n(&numRecorded, __ATOMIC_ACQUIRE) <
+            numTimers - numToCancel)
+    {
+        s = pthread_cond_wait(&cond, &mtx);
+        if (s != 0)
+            errExitEN(s, "pthread_cond_wait");
+    }
+    s = pthread_mutex_unlock(&mtx);
+    if (s != 0)
+        errExitEN(s, "pthread_mutex_unlock");
+
+    for (int j = 0; j < numTimers; j++)
+        if (!recs[j].cancel && timer_delete(recs[j].tid) == -1)
+            errExit("timer_delete");
+
+    return numFired;
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n num     Number of timers (default: 100000)\n");
+    fprintf(stderr, "    -t min,max Timeouts, in milliseconds "
+                    "(default: 100,1000)\n");
+    fprintf(stderr, "    -c pct     Percentage of timers cancelled "
+                    "(default: 50)\n");
+    fprintf(stderr, "    -k usecs   Tick of timing wheel (default: 1000)\n");
+    fprintf(stderr, "    -m list    Comma-separated modes (default: all):"
+                    "\n               ");
+    for (size_t j = 0; j < NUM_MODES; j++)
+        fprintf(stderr, " %s", modeNames[j]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    struct latSummary sum;
+    struct rlimit rl;
+    long long armNs, cancelNs;
+    const char *modeList;
+    char values[256];
+    int opt, minMs, maxMs;
+    long wakeups;
+    enum mode mode;
+    LatFormat fmt;
+
+    numTimers = 100000;
+    minMs = 100;
+    maxMs = 1000;
+    cancelPct = 50;
+    tickNs = 1000000;
+    modeList = NULL;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "n:t:c:k:m:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            numTimers = getInt(optarg, GN_GT_0, "num-timers");
+            break;
+        case 't':
+            if (sscanf(optarg, "%d,%d", &minMs, &maxMs) != 2 ||
+                    minMs < 0 || maxMs < minMs)
+                usageError(argv[0]);
+            break;
+        case 'c':
+            cancelPct = getInt(optarg, 0, "pct");
+            if (cancelPct > 100)
+                usageError(argv[0]);
+            break;
+        case 'k':
+            tickNs = getInt(optarg, GN_GT_0, "usecs") * 1000LL;
+            break;
+        case 'm':
+            modeList = optarg;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+
+    if (getrlimit(RLIMIT_SIGPENDING, &rl) == -1)
+        errExit("getrlimit");
+    rl.rlim_cur = rl.rlim_max;
+    if (setrlimit(RLIMIT_SIGPENDING, &rl) == -1)
+        errExit("setrlimit");
+
+    recs = calloc(numTimers, sizeof(struct rec));
+    samples = calloc(numTimers, sizeof(long));
+    if (recs == NULL || samples == NULL)
+        errExit("calloc");
+
+    latPrintHeader(fmt, LABELS);
+
+    for (mode = 0; mode < NUM_MODES; mode++)
+    {
+        if (modeList != NULL && !latInList(modeList, modeNames[mode]))
+            continue;
+
+        /* Each POSIX timer needs a queued signal, and some may be in
+           use elsewhere; if even the limit is too small, don't try */
+
+        if (mode != MODE_WHEEL && rl.rlim_cur != RLIM_INFINITY &&
+                (rlim_t)numTimers >= rl.rlim_cur)
+        {
+            fprintf(stderr, "%s: skipped; %d timers need more queued "
+                    "signals than RLIMIT_SIGPENDING (%ld)\n",
+                    modeNames[mode], numTimers, (long)rl.rlim_cur);
+            continue;
+        }
+
+        initRecs(minMs * 1000000LL, maxMs * 1000000LL);
+        numFired = 0;
+
+        switch (mode)
+        {
+        case MODE_WHEEL:
+            wakeups = runWheel(&armNs, &cancelNs);
+            break;
+        case MODE_POSIX_SIG:
+            wakeups = runPosixSig(&armNs, &cancelNs);
+            break;
+        case MODE_POSIX_THR:
+            wakeups = runPosixThr(&armNs, &cancelNs);
+            break;
+        }
+
+        latSummarize(samples, numFired, &sum);
+        snprintf(values, sizeof(values), "%s,%d,%d,%.0f,%.0f,%ld",
+                 modeNames[mode], numTimers, cancelPct,
+                 (double)armNs / numTimers,
+                 numToCancel > 0 ? (double)cancelNs / numToCancel : 0.0,
+                 wakeups);
+        latPrintRow(fmt, LABELS, values, &sum);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,300 @@
+/* clock_bench.c
+
+   Measure the cost and granularity of reading each of the kernel's
+   clocks, through the vDSO and through a real system call. Compare
+   gettimeofday.c, which does this for gettimeofday() only, and must be
+   timed with time(1).
+
+   Usage as shown in usageError().
+
+   For each clock, the program reads the clock 'num' times in a loop,
+   first with clock_gettime() (which the C library implements with the
+   vDSO where it can) and then with syscall(SYS_clock_gettime). It times
+   batches of 64 calls, and reports the distribution of the cost per
+   call, the resolution given by clock_getres(), and the smallest nonzero
+   step between successive readings that it saw ("-" if the clock never
+   changed). The clocks, and the names shown for them, are:
+
+        realtime     CLOCK_REALTIME
+        real-crs     CLOCK_REALTIME_COARSE
+        mono         CLOCK_MONOTONIC
+        mono-crs     CLOCK_MONOTONIC_COARSE
+        mono-raw     CLOCK_MONOTONIC_RAW
+        boottime     CLOCK_BOOTTIME
+        tai          CLOCK_TAI
+        proc-cpu     CLOCK_PROCESS_CPUTIME_ID
+        thread-cpu   CLOCK_THREAD_CPUTIME_ID
+        gtod         gettimeofday()
+
+   The kernel implements only some of them in the vDSO (the CPU-time
+   clocks, for example, always need a system call), and falls back to a
+   system call for the rest, as it also does if the current clocksource
+   (see /sys/devices/system/clocksource) can't be read from user space.
+
+   With -t, the program also calibrates the user-space TSC clock in
+   tsc_clock.c (on x86, if the TSC is invariant), reports how far it
+   has drifted from CLOCK_MONOTONIC after a second, and measures the
+   cost of rdtsc, rdtscp, and a conversion of a reading to nanoseconds.
+
+   This program is Linux-specific.
+*/
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include "tsc_clock.h"
+#include "lat_stats.h"
+#include "tlpi_hdr.h"
+
+#define LABELS "clock,path,res_ns,step_ns"
+
+#define BATCH 64                /* Calls timed together */
+
+enum path
+{
+    PATH_VDSO,
+    PATH_SYSCALL,
+    PATH_RDTSC,
+    PATH_RDTSCP,
+    PATH_TSC_NS
+};
+
+static const char *pathNames[] = {"vdso", "syscall", "rdtsc", "rdtscp",
+                                  "tscToNs"};
+
+#define CLOCK_GTOD -1           /* Pseudo clock ID for gettimeofday() */
+
+static const struct
+{
+    const char *name;
+    clockid_t id;
+} clocks[] = {
+    {"realtime", CLOCK_REALTIME},
+    {"real-crs", CLOCK_REALTIME_COARSE},
+    {"mono", CLOCK_MONOTONIC},
+    {"mono-crs", CLOCK_MONOTONIC_COARSE},
+    {"mono-raw", CLOCK_MONOTONIC_RAW},
+    {"boottime", CLOCK_BOOTTIME},
+    {"tai", CLOCK_TAI},
+    {"proc-cpu", CLOCK_PROCESS_CPUTIME_ID},
+    {"thread-cpu", CLOCK_THREAD_CPUTIME_ID},
+    {"gtod", CLOCK_GTOD}
+};
+
+#define NUM_CLOCKS (sizeof(clocks) / sizeof(clocks[0]))
+
+static TscClock tsc;
+
+/* Read clock 'id' by way of 'path', returning nanoseconds (or, for
+   rdtsc and rdtscp, ticks) */
+
+static long long
+readClock(clockid_t id, enum path path)
+{
+    struct timespec ts;
+    struct timeval tv;
+    uint32_t aux;
+    int s;
+
+    switch (path)
+    {
+    case PATH_RDTSC:
+        return (long long)tscRead();
+    case PATH_RDTSCP:
+        return (long long)tscReadP(&aux);
+    case PATH_TSC_NS:
+        return tscNowNs(&tsc);
+    default:
+        break;
+    }
+
+    if (id == CLOCK_GTOD)
+    {
+        s = (path == PATH_VDSO) ? gettimeofday(&tv, NULL) :
+                                  syscall(SYS_gettimeofday, &tv, NULL);
+        if (s == -1)
+            errExit("gettimeofday");
+        return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+    }
+
+    s = (path == PATH_VDSO) ? clock_gettime(id, &ts) :
+                              syscall(SYS_clock_gettime, id, &ts);
+    if (s == -1)
+        errExit("clock_gettime");
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+runOne(const char *name, clockid_t id, enum path path, int numCalls,
+       long *samples, LatFormat fmt)
+{
+    struct latSummary sum;
+    struct timespec res;
+    long long start, prev, t, step;
+    char values[128], resStr[32], stepStr[32];
+    int numBatches;
+
+    numBatches = numCalls / BATCH;
+    step = 0;
+    prev = readClock(id, path);
+
+    for (int b = 0; b < numBatches; b++)
+    {
+        start = latNowNs();
+        for (int j = 0; j < BATCH; j++)
+        {
+            t = readClock(id, path);
+            if (t > prev && (step == 0 || t - prev < step))
+                step = t - prev;
+            prev = t;
+        }
+        samples[b] = (latNowNs() - start) / BATCH;
+    }
+
+    if (path == PATH_VDSO || path == PATH_SYSCALL)
+    {
+        if (id == CLOCK_GTOD)
+            snprintf(resStr, sizeof(resStr), "1000");
+        else if (clock_getres(id, &res) == -1)
+            snprintf(resStr, sizeof(resStr), "-");
+        else
+            snprintf(resStr, sizeof(resStr), "%lld",
+                     res.tv_sec * 1000000000LL + res.tv_nsec);
+    }
+    else
+    {
+        snprintf(resStr, sizeof(resStr), "%.2f", 1e9 / tsc.hz);
+    }
+
+    if (step == 0)
+        snprintf(stepStr, sizeof(stepStr), "-");
+    else if (path == PATH_RDTSC || path == PATH_RDTSCP)
+        snprintf(stepStr, sizeof(stepStr), "%.1f", step * 1e9 / tsc.hz);
+    else
+        snprintf(stepStr, sizeof(stepStr), "%lld", step);
+
+    latSummarize(samples, numBatches, &sum);
+    snprintf(values, sizeof(values), "%s,%s,%s,%s", name, pathNames[path],
+             resStr, stepStr);
+    latPrintRow(fmt, LABELS, values, &sum);
+}
+
+/* Calibrate the TSC clock, and report on it. Returns 0 on success, or
+   -1 if the TSC can't be used. */
+
+static int
+setupTsc(LatFormat fmt)
+{
+    struct timespec ts;
+    FILE *out, *fp;
+    char source[64];
+    long long drift;
+
+    out = (fmt == LAT_FMT_TEXT) ? stdout : stderr;
+
+    source[0] = '\0';
+    fp = fopen("/sys/devices/system/clocksource/clocksource0/"
+               "current_clocksource", "r");
+    if (fp != NULL)
+    {
+        if (fgets(source, sizeof(source), fp) != NULL)
+            source[strcspn(source, "\n")] = '\0';
+        fclose(fp);
+    }
+
+    fprintf(out, "TSC invariant: %s; kernel clocksource: %s\n",
+            tscInvariant() ? "yes" : "no",
+            (source[0] != '\0') ? source : "unknown");
+
+    if (tscCalibrate(&tsc, 100000000) == -1)
+    {
+        fprintf(out, "Not using the TSC: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* After a second, see how far the TSC clock has drifted from
+       CLOCK_MONOTONIC */
+
+    ts.tv_sec = 1;
+    ts.tv_nsec = 0;
+    nanosleep(&ts, NULL);
+    drift = tscNowNs(&tsc) - latNowNs();
+
+    fprintf(out, "TSC frequency: %.6f GHz; drift after 1 s: %lld ns\n\n",
+            tsc.hz / 1e9, drift);
+    return 0;
+}
+
+static void
+usageError(const char *progName)
+{
+    fprintf(stderr, "Usage: %s [options]\n", progName);
+    fprintf(stderr, "    -n num     Calls per clock and path "
+                    "(default: 1000000)\n");
+    fprintf(stderr, "    -t         Also calibrate and measure the TSC "
+                    "clock\n");
+    fprintf(stderr, "    -o fmt     Output format: text (default), csv, "
+                    "json\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    long *samples;
+    int opt, numCalls, useTsc;
+    LatFormat fmt;
+
+    numCalls = 1000000;
+    useTsc = 0;
+    fmt = LAT_FMT_TEXT;
+
+    while ((opt = getopt(argc, argv, "n:to:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            numCalls = getInt(optarg, GN_GT_0, "num");
+            break;
+        case 't':
+            useTsc = 1;
+            break;
+        case 'o':
+            if (latParseFormat(optarg, &fmt) == -1)
+                usageError(argv[0]);
+            break;
+        default:
+            usageError(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+        usageError(argv[0]);
+    if (numCalls < BATCH)
+        numCalls = BATCH;
+
+    samples = calloc(numCalls / BATCH, sizeof(long));
+    if (samples == NULL)
+        errExit("calloc");
+
+    if (useTsc && setupTsc(fmt) == -1)
+        useTsc = 0;
+
+    latPrintHeader(fmt, LABELS);
+
+    for (size_t c = 0; c < NUM_CLOCKS; c++)
+    {
+        runOne(clocks[c].name, clocks[c].id, PATH_VDSO, numCalls,
+               samples, fmt);
+        runOne(clocks[c].name, clocks[c].id, PATH_SYSCALL, numCalls,
+               samples, fmt);
+    }
+
+    if (useTsc)
+    {
+        runOne("tsc", 0, PATH_RDTSC, numCalls, samples, fmt);
+        runOne("tsc", 0, PATH_RDTSCP, numCalls, samples, fmt);
+        runOne("tsc", 0, PATH_TSC_NS, numCalls, samples, fmt);
+    }
+
+    exit(EXIT_SUCCESS);
+}
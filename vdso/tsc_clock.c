@@ -0,0 +1,110 @@
+/* tsc_clock.c
+
+   Implement the calibrated TSC clock declared in tsc_clock.h.
+
+   Calibration reads the TSC and CLOCK_MONOTONIC together twice,
+   'periodNs' apart, and divides the difference in ticks by the
+   difference in nanoseconds. Each paired reading brackets the call to
+   clock_gettime() between two reads of the TSC, and takes the middle of
+   the closest bracket of several tries, so that an interrupt or
+   preemption during one try does not skew the result.
+*/
+#define _GNU_SOURCE
+#include <time.h>
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "tsc_clock.h" /* Declares functions defined here */
+
+#define PAIR_TRIES 16
+
+/* Return 1 if the CPU says that its TSC is invariant, otherwise 0 */
+
+int
+tscInvariant(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    /* CPUID leaf 0x80000007 ("advanced power management"), EDX bit 8 */
+
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+        return 0;
+    return (edx >> 8) & 1;
+#else
+    return 0;
+#endif
+}
+
+static long long
+monoNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Read the TSC and CLOCK_MONOTONIC at (as nearly as possible) the same
+   moment */
+
+static void
+readPair(uint64_t *tsc, long long *ns)
+{
+    uint64_t before, after, best;
+    long long t;
+
+    best = UINT64_MAX;
+    for (int j = 0; j < PAIR_TRIES; j++)
+    {
+        before = tscRead();
+        t = monoNs();
+        after = tscRead();
+        if (after - before < best)
+        {
+            best = after - before;
+            *tsc = before + (after - before) / 2;
+            *ns = t;
+        }
+    }
+}
+
+/* Measure the TSC's rate over 'periodNs' nanoseconds (longer is more
+   accurate; 100 ms gives errors of a few parts per million), and
+   initialize 'tc'. Returns 0 on success, or -1 on error: ENOTSUP if the
+   TSC is not invariant (or not available), or ERANGE if it runs slower
+   than 1 GHz, which the conversion in tscToNs() does not allow for. */
+
+int
+tscCalibrate(TscClock *tc, long long periodNs)
+{
+    struct timespec ts;
+    uint64_t tsc0, tsc1;
+    long long ns0, ns1;
+
+    if (!tscInvariant())
+    {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    readPair(&tsc0, &ns0);
+    ts.tv_sec = periodNs / 1000000000;
+    ts.tv_nsec = periodNs % 1000000000;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        continue;
+    readPair(&tsc1, &ns1);
+
+    tc->hz = (double)(tsc1 - tsc0) * 1e9 / (ns1 - ns0);
+    if (tc->hz < 1e9)
+    {
+        errno = ERANGE;
+        return -1;
+    }
+
+    tc->mult = (uint64_t)(4294967296.0 * 1e9 / tc->hz);
+    tc->tscBase = tsc1;
+    tc->nsBase = ns1;
+    return 0;
+}
@@ -0,0 +1,107 @@
+/* tsc_clock.h
+
+   Header file for tsc_clock.c.
+
+   A user-space clock that reads the x86 timestamp counter (TSC) with
+   the rdtsc or rdtscp instruction, and converts the count to
+   nanoseconds on the CLOCK_MONOTONIC timeline, using a rate measured
+   against CLOCK_MONOTONIC by tscCalibrate(). Reading it costs a few
+   nanoseconds and no function call, which can matter for timestamping
+   in a hot path; clock_gettime() through the vDSO (see clock_bench.c)
+   is usually almost as fast, and should be preferred elsewhere.
+
+   The clock is only usable where the TSC is "invariant": it ticks at a
+   constant rate regardless of CPU frequency changes and sleep states,
+   and (on modern systems) is synchronized across CPUs. tscInvariant()
+   checks the CPUID flag that says so; tscCalibrate() refuses to
+   calibrate without it. The converted times drift slowly away from
+   CLOCK_MONOTONIC (which NTP may slew); a long-running program should
+   calibrate again from time to time.
+
+   On other architectures, tscInvariant() returns 0, and tscCalibrate()
+   fails with ENOTSUP.
+*/
+#ifndef TSC_CLOCK_H
+#define TSC_CLOCK_H /* Prevent accidental double inclusion */
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint64_t tscBase;           /* TSC reading at calibration... */
+    long long nsBase;           /* ...and the CLOCK_MONOTONIC time then */
+    uint64_t mult;              /* Nanoseconds per tick, times 2^32 */
+    double hz;                  /* Measured TSC frequency */
+} TscClock;
+
+int tscInvariant(void);
+
+int tscCalibrate(TscClock *tc, long long periodNs);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* Read the TSC. rdtsc may be executed before earlier instructions have
+   completed; rdtscp waits for them, and also returns the processor's
+   TSC_AUX value (on Linux, the CPU and NUMA node numbers), in '*aux'. */
+
+static inline uint64_t
+tscRead(void)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t
+tscReadP(uint32_t *aux)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi), "=c"(*aux));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#else
+
+static inline uint64_t
+tscRead(void)
+{
+    return 0;
+}
+
+static inline uint64_t
+tscReadP(uint32_t *aux)
+{
+    *aux = 0;
+    return 0;
+}
+
+#endif
+
+/* Convert TSC reading 'tsc' to CLOCK_MONOTONIC nanoseconds. Splitting
+   the tick count into 32-bit halves keeps the products within 64 bits.
+   The count is taken as signed, because a reading taken on another CPU
+   soon after calibration can be slightly behind 'tscBase' (the TSCs of
+   different CPUs are not perfectly synchronized); the magnitude is
+   converted, and the sign then restored. */
+
+static inline long long
+tscToNs(const TscClock *tc, uint64_t tsc)
+{
+    int64_t delta = (int64_t)(tsc - tc->tscBase);
+    uint64_t mag = (delta < 0) ? -(uint64_t)delta : (uint64_t)delta;
+    long long ns;
+
+    ns = (long long)((mag >> 32) * tc->mult +
+                     (((mag & 0xffffffff) * tc->mult) >> 32));
+    return tc->nsBase + ((delta < 0) ? -ns : ns);
+}
+
+static inline long long
+tscNowNs(const TscClock *tc)
+{
+    return tscToNs(tc, tscRead());
+}
+
+#endif